@@ -11,7 +11,7 @@ INSTALLDIR ?= $(DESTDIR)/usr/lib
 # Converts cr/lf to just lf
 DOS2UNIX = dos2unix
 
-LIBRARIES = -lstdc++
+LIBRARIES = -lstdc++ -lpthread
 
 MODULES = $(SRCS:.c=.o)
 MODULES := $(MODULES:.cpp=.o)
@@ -487,6 +487,14 @@ FI_ENUM(FREE_IMAGE_JPEG_OPERATION) {
 	FIJPEG_OP_ROTATE_270	= 7		//! 270-degree clockwise (or 90 ccw)
 };
 
+/** Lossless JPEG transformation options
+Flags used in FreeImage_JPEGTransformEx
+*/
+#define FIJPEG_PERFECT		0x0001	//! fail if there are non-transformable edge blocks
+#define FIJPEG_GRAYSCALE	0x0002	//! discard the color components of a YCbCr image
+#define FIJPEG_PROGRESSIVE	0x0004	//! write a progressive JPEG
+#define FIJPEG_OPTIMIZE		0x0008	//! compute optimal Huffman tables (smaller file)
+
 /** Tone mapping operators.
 Constants used in FreeImage_ToneMapping.
 */
@@ -524,6 +532,46 @@ FI_ENUM(FREE_IMAGE_COLOR_CHANNEL) {
 	FICC_PHASE	= 9		//! Complex images: use phase
 };
 
+/** Row operations.
+Operations of a row pipeline, used in FreeImage_ApplyRowPipeline. 
+Rows are processed as 8-bit greyscale, 24-bit or 32-bit pixels.
+*/
+FI_ENUM(FREE_IMAGE_ROW_OPERATION) {
+	FIRO_CONVERT		= 0,	//! convert the pixels to 'param' bits per pixel : 8 (greyscale), 24 or 32
+	FIRO_GREYSCALE		= 1,	//! convert the pixels to 8-bit greyscale
+	FIRO_LUT			= 2,	//! apply the 256-entry table 'lut' to the channel 'param' (a FREE_IMAGE_COLOR_CHANNEL, see FreeImage_AdjustCurve)
+	FIRO_SWAP_RED_BLUE	= 3,	//! swap the red and blue channels
+	FIRO_PREMULTIPLY	= 4		//! multiply the color channels by the alpha channel (32-bit pixels)
+};
+
+/** Row operation and its parameters
+*/
+FI_STRUCT (FIROWOPERATION) {
+	FREE_IMAGE_ROW_OPERATION operation;	//! operation
+	int param;							//! bits per pixel (FIRO_CONVERT) or color channel (FIRO_LUT)
+	BYTE *lut;							//! lookup table (FIRO_LUT)
+};
+
+#define FIRO_MULTITHREAD	0x0001	//! FreeImage_ApplyRowPipeline: process bands of rows on several threads (one thread per processor)
+
+/** Porter-Duff compositing operators.
+Operators used in FreeImage_PasteComposite, the source being the pasted image.
+*/
+FI_ENUM(FREE_IMAGE_PORTER_DUFF) {
+	FIPD_CLEAR		= 0,	//! clear the destination
+	FIPD_SRC		= 1,	//! copy the source
+	FIPD_DST		= 2,	//! keep the destination
+	FIPD_SRC_OVER	= 3,	//! source over destination (alpha blending)
+	FIPD_DST_OVER	= 4,	//! destination over source
+	FIPD_SRC_IN		= 5,	//! source inside the destination alpha
+	FIPD_DST_IN		= 6,	//! destination inside the source alpha
+	FIPD_SRC_OUT	= 7,	//! source outside the destination alpha
+	FIPD_DST_OUT	= 8,	//! destination outside the source alpha
+	FIPD_SRC_ATOP	= 9,	//! source inside the destination alpha, over the destination
+	FIPD_DST_ATOP	= 10,	//! destination inside the source alpha, over the source
+	FIPD_XOR		= 11	//! source outside the destination alpha plus destination outside the source alpha
+};
+
 // Metadata support ---------------------------------------------------------
 
 /**
@@ -581,6 +629,33 @@ FI_STRUCT (FIMETADATA) { void *data; };
 */
 FI_STRUCT (FITAG) { void *data; };
 
+// ZLib streams -------------------------------------------------------------
+
+/**
+  Data format of a ZLib stream
+*/
+FI_ENUM(FREE_IMAGE_ZFORMAT) {
+	FIZ_ZLIB	= 0,	//! ZLib format (RFC 1950)
+	FIZ_GZIP	= 1,	//! GZip format (RFC 1952)
+	FIZ_RAW		= 2,	//! raw deflate data (RFC 1951), without header nor checksum
+	FIZ_AUTO	= 3		//! decompression only : ZLib or GZip format, detected from the header
+};
+
+/**
+  Handle to a ZLib compression or decompression stream
+*/
+FI_STRUCT (FIZSTREAM) { void *data; };
+
+#define FIZ_STREAM_ERROR	-1	//! FreeImage_ZLibProcessStream: invalid or corrupted data, or invalid parameters
+#define FIZ_STREAM_OK		0	//! FreeImage_ZLibProcessStream: progress was made, more input or more output space is needed
+#define FIZ_STREAM_END		1	//! FreeImage_ZLibProcessStream: the end of the stream has been reached and written
+#define FIZ_STREAM_NEED_INPUT	2	//! FreeImage_ZLibProcessStream: no progress is possible without more input (truncated data at the end of the input)
+
+/**
+  Handle to a reusable lossless JPEG transformation context
+*/
+FI_STRUCT (FIJPEGTRANSFORMER) { void *data; };
+
 // File IO routines ---------------------------------------------------------
 
 #ifndef FREEIMAGE_IO
@@ -680,6 +755,7 @@ typedef void (DLL_CALLCONV *FI_InitProc)(Plugin *plugin, int format_id);
 #define EXR_PXR24			0x0010	//! save with lossy 24-bit float compression
 #define EXR_B44				0x0020	//! save with lossy 44% float compression - goes to 22% when combined with EXR_LC
 #define EXR_LC				0x0040	//! save images with one luminance and two chroma channels, rather than as RGB (lossy compression)
+#define EXR_MULTITHREAD		0x0080	//! load / save: (de)compress blocks of scan lines or tiles using the OpenEXR thread pool (one thread per processor)
 #define FAXG3_DEFAULT		0
 #define GIF_DEFAULT			0
 #define GIF_LOAD256			1		//! load the image as a 256 color image with ununsed palette entries, if it's 16 or 2 color
@@ -696,6 +772,8 @@ typedef void (DLL_CALLCONV *FI_InitProc)(Plugin *plugin, int format_id);
 #define JPEG_CMYK			0x0004	//! load separated CMYK "as is" (use | to combine with other load flags)
 #define JPEG_EXIFROTATE		0x0008	//! load and rotate according to Exif 'Orientation' tag if available
 #define JPEG_GREYSCALE		0x0010	//! load and convert to a 8-bit greyscale image
+#define JPEG_RGBA			0x0020	//! load colour images as 32-bit images with an opaque alpha channel
+#define JPEG_SCANS(count)	(((count) & 0x7F) << 8)	//! load a progressive-JPEG from its first 'count' scans only (1-127), a faster lower quality preview (use | to combine with other load flags)
 #define JPEG_QUALITYSUPERB  0x80	//! save with superb quality (100:1)
 #define JPEG_QUALITYGOOD    0x0100	//! save with good quality (75:1)
 #define JPEG_QUALITYNORMAL  0x0200	//! save with normal quality (50:1)
@@ -725,6 +803,10 @@ typedef void (DLL_CALLCONV *FI_InitProc)(Plugin *plugin, int format_id);
 #define PNG_Z_BEST_COMPRESSION		0x0009	//! save using ZLib level 9 compression flag (default value is 6)
 #define PNG_Z_NO_COMPRESSION		0x0100	//! save without ZLib compression
 #define PNG_INTERLACED				0x0200	//! save using Adam7 interlacing (use | to combine with other save flags)
+#define PNG_MULTITHREAD				0x0400	//! save: filter and compress bands of rows on several threads (one thread per processor), ignored with PNG_INTERLACED
+#define PNG_FILTERS_FAST			0x0800	//! save: use for every row the filter with the best estimated cost over a sample of rows, ignored with PNG_INTERLACED
+#define PNG_FILTERS_ADAPTIVE		0x1000	//! save: choose for each row the filter with the best estimated cost among the 5 PNG filters, ignored with PNG_INTERLACED
+#define PNG_FILTERS_BRUTE			0x2000	//! save: choose for each row the filter giving the smallest compressed row (slow), ignored with PNG_INTERLACED
 #define PNM_DEFAULT         0
 #define PNM_SAVE_RAW        0       //! if set the writer saves in RAW format (i.e. P4, P5 or P6)
 #define PNM_SAVE_ASCII      1       //! if set the writer saves in ASCII format (i.e. P1, P2 or P3)
@@ -743,6 +825,7 @@ typedef void (DLL_CALLCONV *FI_InitProc)(Plugin *plugin, int format_id);
 #define TARGA_SAVE_RLE		2		//! if set, the writer saves with RLE compression
 #define TIFF_DEFAULT        0
 #define TIFF_CMYK			0x0001	//! reads/stores tags for separated CMYK (use | to combine with compression flags)
+#define TIFF_MULTITHREAD	0x0080	//! load / save: (de)compress strips or tiles on several threads (one thread per processor)
 #define TIFF_PACKBITS       0x0100  //! save using PACKBITS compression
 #define TIFF_DEFLATE        0x0200  //! save using DEFLATE compression (a.k.a. ZLIB compression)
 #define TIFF_ADOBE_DEFLATE  0x0400  //! save using ADOBE DEFLATE compression
@@ -752,6 +835,8 @@ typedef void (DLL_CALLCONV *FI_InitProc)(Plugin *plugin, int format_id);
 #define TIFF_LZW			0x4000	//! save using LZW compression
 #define TIFF_JPEG			0x8000	//! save using JPEG compression
 #define TIFF_LOGLUV			0x10000	//! save using LogLuv compression
+#define TIFF_TILED			0x20000	//! save using tiles instead of strips (256x256 tiles unless TIFF_BLOCKSIZE is used)
+#define TIFF_BLOCKSIZE(size)	(((((size) + 15) >> 4) & 0xFF) << 20)	//! save with strips of 'size' rows or with 'size' x 'size' tiles, rounded up to a multiple of 16 (max 4080; use | to combine with other flags)
 #define WBMP_DEFAULT        0
 #define XBM_DEFAULT			0
 #define XPM_DEFAULT			0
@@ -776,6 +861,8 @@ typedef void (DLL_CALLCONV *FI_InitProc)(Plugin *plugin, int format_id);
 #define FI_RESCALE_DEFAULT			0x00    //! default options; none of the following other options apply
 #define FI_RESCALE_TRUE_COLOR		0x01	//! for non-transparent greyscale images, convert to 24-bit if src bitdepth <= 8 (default is a 8-bit greyscale image). 
 #define FI_RESCALE_OMIT_METADATA	0x02	//! do not copy metadata to the rescaled image
+#define FI_RESCALE_ALPHA_WEIGHTED	0x04	//! weight the colors of 32-bit, RGBA16 and RGBAF pixels by their alpha while filtering (no dark fringes around transparent areas)
+#define FI_RESCALE_LINEAR_LIGHT		0x08	//! filter 24- and 32-bit images in linear light, decoding their sRGB colors before filtering and encoding them after (no darkening of high contrast details)
 
 
 #ifdef __cplusplus
@@ -787,6 +874,15 @@ extern "C" {
 DLL_API void DLL_CALLCONV FreeImage_Initialise(BOOL load_local_plugins_only FI_DEFAULT(FALSE));
 DLL_API void DLL_CALLCONV FreeImage_DeInitialise(void);
 
+// CPU features routines ----------------------------------------------------
+
+#define FI_CPU_SSE2			0x0001	//! SSE2 instruction set
+#define FI_CPU_SSSE3		0x0002	//! SSSE3 instruction set
+#define FI_CPU_AVX2			0x0004	//! AVX2 instruction set (and OS support of the 256-bit registers)
+
+DLL_API unsigned DLL_CALLCONV FreeImage_GetCPUFeatures(void);
+DLL_API unsigned DLL_CALLCONV FreeImage_SetCPUFeatures(unsigned features);
+
 // Version routines ---------------------------------------------------------
 
 DLL_API const char *DLL_CALLCONV FreeImage_GetVersion(void);
@@ -1011,8 +1107,11 @@ DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ConvertToRGB16(FIBITMAP *dib);
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ConvertToRGBA16(FIBITMAP *dib);
 
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ConvertToStandardType(FIBITMAP *src, BOOL scale_linear FI_DEFAULT(TRUE));
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ConvertToStandardTypeWindow(FIBITMAP *src, double low_percentile FI_DEFAULT(0.5), double high_percentile FI_DEFAULT(99.5));
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ConvertToType(FIBITMAP *src, FREE_IMAGE_TYPE dst_type, BOOL scale_linear FI_DEFAULT(TRUE));
 
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ApplyRowPipeline(FIBITMAP *dib, const FIROWOPERATION *operations, int count, FIBITMAP *dst FI_DEFAULT(NULL), int flags FI_DEFAULT(0));
+
 // Tone mapping operators ---------------------------------------------------
 
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_ToneMapping(FIBITMAP *dib, FREE_IMAGE_TMO tmo, double first_param FI_DEFAULT(0), double second_param FI_DEFAULT(0));
@@ -1030,6 +1129,13 @@ DLL_API DWORD DLL_CALLCONV FreeImage_ZLibGZip(BYTE *target, DWORD target_size, B
 DLL_API DWORD DLL_CALLCONV FreeImage_ZLibGUnzip(BYTE *target, DWORD target_size, BYTE *source, DWORD source_size);
 DLL_API DWORD DLL_CALLCONV FreeImage_ZLibCRC32(DWORD crc, BYTE *source, DWORD source_size);
 
+DLL_API FIZSTREAM *DLL_CALLCONV FreeImage_ZLibOpenCompressor(FREE_IMAGE_ZFORMAT format FI_DEFAULT(FIZ_ZLIB), int level FI_DEFAULT(-1), int strategy FI_DEFAULT(0));
+DLL_API FIZSTREAM *DLL_CALLCONV FreeImage_ZLibOpenDecompressor(FREE_IMAGE_ZFORMAT format FI_DEFAULT(FIZ_AUTO));
+DLL_API void DLL_CALLCONV FreeImage_ZLibCloseStream(FIZSTREAM *stream);
+DLL_API BOOL DLL_CALLCONV FreeImage_ZLibResetStream(FIZSTREAM *stream);
+DLL_API BOOL DLL_CALLCONV FreeImage_ZLibSetStreamParams(FIZSTREAM *stream, int level, int strategy FI_DEFAULT(0));
+DLL_API int DLL_CALLCONV FreeImage_ZLibProcessStream(FIZSTREAM *stream, BYTE *source, DWORD *source_size, BYTE *target, DWORD *target_size, BOOL finish FI_DEFAULT(FALSE));
+
 // --------------------------------------------------------------------------
 // Metadata routines
 // --------------------------------------------------------------------------
@@ -1085,6 +1191,15 @@ DLL_API BOOL DLL_CALLCONV FreeImage_JPEGTransformFromHandle(FreeImageIO* src_io,
 DLL_API BOOL DLL_CALLCONV FreeImage_JPEGTransformCombined(const char *src_file, const char *dst_file, FREE_IMAGE_JPEG_OPERATION operation, int* left, int* top, int* right, int* bottom, BOOL perfect FI_DEFAULT(TRUE));
 DLL_API BOOL DLL_CALLCONV FreeImage_JPEGTransformCombinedU(const wchar_t *src_file, const wchar_t *dst_file, FREE_IMAGE_JPEG_OPERATION operation, int* left, int* top, int* right, int* bottom, BOOL perfect FI_DEFAULT(TRUE));
 DLL_API BOOL DLL_CALLCONV FreeImage_JPEGTransformCombinedFromMemory(FIMEMORY* src_stream, FIMEMORY* dst_stream, FREE_IMAGE_JPEG_OPERATION operation, int* left, int* top, int* right, int* bottom, BOOL perfect FI_DEFAULT(TRUE));
+DLL_API FIJPEGTRANSFORMER *DLL_CALLCONV FreeImage_JPEGOpenTransformer(void);
+DLL_API void DLL_CALLCONV FreeImage_JPEGCloseTransformer(FIJPEGTRANSFORMER *transformer);
+DLL_API BOOL DLL_CALLCONV FreeImage_JPEGTransformEx(FIJPEGTRANSFORMER *transformer, FIMEMORY* src_stream, FIMEMORY* dst_stream, const FREE_IMAGE_JPEG_OPERATION *operations, int count, int* left, int* top, int* right, int* bottom, int flags FI_DEFAULT(0));
+
+// --------------------------------------------------------------------------
+// OpenEXR region loading routines
+// --------------------------------------------------------------------------
+
+DLL_API FIBITMAP *DLL_CALLCONV FreeImage_LoadEXRRegionFromHandle(FreeImageIO *io, fi_handle handle, int left, int top, int right, int bottom, int flags FI_DEFAULT(0));
 
 
 // --------------------------------------------------------------------------
@@ -1127,10 +1242,12 @@ DLL_API BOOL DLL_CALLCONV FreeImage_SetComplexChannel(FIBITMAP *dst, FIBITMAP *s
 // copy / paste / composite routines
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_Copy(FIBITMAP *dib, int left, int top, int right, int bottom);
 DLL_API BOOL DLL_CALLCONV FreeImage_Paste(FIBITMAP *dst, FIBITMAP *src, int left, int top, int alpha);
+DLL_API BOOL DLL_CALLCONV FreeImage_PasteComposite(FIBITMAP *dst, FIBITMAP *src, int left, int top, FREE_IMAGE_PORTER_DUFF op FI_DEFAULT(FIPD_SRC_OVER), BOOL premultiplied FI_DEFAULT(FALSE));
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_CreateView(FIBITMAP *dib, unsigned left, unsigned top, unsigned right, unsigned bottom);
 
 DLL_API FIBITMAP *DLL_CALLCONV FreeImage_Composite(FIBITMAP *fg, BOOL useFileBkg FI_DEFAULT(FALSE), RGBQUAD *appBkColor FI_DEFAULT(NULL), FIBITMAP *bg FI_DEFAULT(NULL));
 DLL_API BOOL DLL_CALLCONV FreeImage_PreMultiplyWithAlpha(FIBITMAP *dib);
+DLL_API BOOL DLL_CALLCONV FreeImage_UnPreMultiplyWithAlpha(FIBITMAP *dib);
 
 // background filling routines
 DLL_API BOOL DLL_CALLCONV FreeImage_FillBackground(FIBITMAP *dib, const void *color, int options FI_DEFAULT(0));
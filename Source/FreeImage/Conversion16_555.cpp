@@ -79,8 +79,9 @@ void DLL_CALLCONV
 FreeImage_ConvertLine16_565_To16_555(BYTE *target, BYTE *source, int width_in_pixels) {
 	WORD *src_bits = (WORD *)source;
 	WORD *new_bits = (WORD *)target;
+	const int simd_cols = FreeImage_ConvertLineSIMD(FI_LINE_16_565_TO16_555, target, source, width_in_pixels);
 
-	for (int cols = 0; cols < width_in_pixels; cols++) {
+	for (int cols = simd_cols; cols < width_in_pixels; cols++) {
 		new_bits[cols] = RGB555((((src_bits[cols] & FI16_565_BLUE_MASK) >> FI16_565_BLUE_SHIFT) * 0xFF) / 0x1F,
 			                    (((src_bits[cols] & FI16_565_GREEN_MASK) >> FI16_565_GREEN_SHIFT) * 0xFF) / 0x3F,
 								(((src_bits[cols] & FI16_565_RED_MASK) >> FI16_565_RED_SHIFT) * 0xFF) / 0x1F);
@@ -90,8 +91,10 @@ FreeImage_ConvertLine16_565_To16_555(BYTE *target, BYTE *source, int width_in_pi
 void DLL_CALLCONV
 FreeImage_ConvertLine24To16_555(BYTE *target, BYTE *source, int width_in_pixels) {
 	WORD *new_bits = (WORD *)target;
+	const int simd_cols = FreeImage_ConvertLineSIMD(FI_LINE_24TO16_555, target, source, width_in_pixels);
 
-	for (int cols = 0; cols < width_in_pixels; cols++) {
+	source += 3 * simd_cols;
+	for (int cols = simd_cols; cols < width_in_pixels; cols++) {
 		new_bits[cols] = RGB555(source[FI_RGBA_BLUE], source[FI_RGBA_GREEN], source[FI_RGBA_RED]);
 
 		source += 3;
@@ -101,8 +104,10 @@ FreeImage_ConvertLine24To16_555(BYTE *target, BYTE *source, int width_in_pixels)
 void DLL_CALLCONV
 FreeImage_ConvertLine32To16_555(BYTE *target, BYTE *source, int width_in_pixels) {
 	WORD *new_bits = (WORD *)target;
+	const int simd_cols = FreeImage_ConvertLineSIMD(FI_LINE_32TO16_555, target, source, width_in_pixels);
 
-	for (int cols = 0; cols < width_in_pixels; cols++) {
+	source += 4 * simd_cols;
+	for (int cols = simd_cols; cols < width_in_pixels; cols++) {
 		new_bits[cols] = RGB555(source[FI_RGBA_BLUE], source[FI_RGBA_GREEN], source[FI_RGBA_RED]);
 
 		source += 4;
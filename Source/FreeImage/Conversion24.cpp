@@ -80,8 +80,10 @@ FreeImage_ConvertLine8To24(BYTE *target, BYTE *source, int width_in_pixels, RGBQ
 void DLL_CALLCONV
 FreeImage_ConvertLine16To24_555(BYTE *target, BYTE *source, int width_in_pixels) {
 	WORD *bits = (WORD *)source;
+	const int simd_cols = FreeImage_ConvertLineSIMD(FI_LINE_16TO24_555, target, source, width_in_pixels);
 
-	for (int cols = 0; cols < width_in_pixels; cols++) {
+	target += 3 * simd_cols;
+	for (int cols = simd_cols; cols < width_in_pixels; cols++) {
 		target[FI_RGBA_RED]   = (BYTE)((((bits[cols] & FI16_555_RED_MASK) >> FI16_555_RED_SHIFT) * 0xFF) / 0x1F);
 		target[FI_RGBA_GREEN] = (BYTE)((((bits[cols] & FI16_555_GREEN_MASK) >> FI16_555_GREEN_SHIFT) * 0xFF) / 0x1F);
 		target[FI_RGBA_BLUE]  = (BYTE)((((bits[cols] & FI16_555_BLUE_MASK) >> FI16_555_BLUE_SHIFT) * 0xFF) / 0x1F);
@@ -93,8 +95,10 @@ FreeImage_ConvertLine16To24_555(BYTE *target, BYTE *source, int width_in_pixels)
 void DLL_CALLCONV
 FreeImage_ConvertLine16To24_565(BYTE *target, BYTE *source, int width_in_pixels) {
 	WORD *bits = (WORD *)source;
+	const int simd_cols = FreeImage_ConvertLineSIMD(FI_LINE_16TO24_565, target, source, width_in_pixels);
 
-	for (int cols = 0; cols < width_in_pixels; cols++) {
+	target += 3 * simd_cols;
+	for (int cols = simd_cols; cols < width_in_pixels; cols++) {
 		target[FI_RGBA_RED]   = (BYTE)((((bits[cols] & FI16_565_RED_MASK) >> FI16_565_RED_SHIFT) * 0xFF) / 0x1F);
 		target[FI_RGBA_GREEN] = (BYTE)((((bits[cols] & FI16_565_GREEN_MASK) >> FI16_565_GREEN_SHIFT) * 0xFF) / 0x3F);
 		target[FI_RGBA_BLUE]  = (BYTE)((((bits[cols] & FI16_565_BLUE_MASK) >> FI16_565_BLUE_SHIFT) * 0xFF) / 0x1F);
@@ -105,7 +109,11 @@ FreeImage_ConvertLine16To24_565(BYTE *target, BYTE *source, int width_in_pixels)
 
 void DLL_CALLCONV
 FreeImage_ConvertLine32To24(BYTE *target, BYTE *source, int width_in_pixels) {
-	for (int cols = 0; cols < width_in_pixels; cols++) {
+	const int simd_cols = FreeImage_ConvertLineSIMD(FI_LINE_32TO24, target, source, width_in_pixels);
+
+	target += 3 * simd_cols;
+	source += 4 * simd_cols;
+	for (int cols = simd_cols; cols < width_in_pixels; cols++) {
 		target[FI_RGBA_BLUE] = source[FI_RGBA_BLUE];
 		target[FI_RGBA_GREEN] = source[FI_RGBA_GREEN];
 		target[FI_RGBA_RED] = source[FI_RGBA_RED];
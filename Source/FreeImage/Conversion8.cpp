@@ -76,7 +76,10 @@ FreeImage_ConvertLine16To8_565(BYTE *target, BYTE *source, int width_in_pixels)
 
 void DLL_CALLCONV
 FreeImage_ConvertLine24To8(BYTE *target, BYTE *source, int width_in_pixels) {
-	for (unsigned cols = 0; cols < (unsigned)width_in_pixels; cols++) {
+	const int simd_cols = FreeImage_ConvertLineSIMD(FI_LINE_24TO8, target, source, width_in_pixels);
+
+	source += 3 * simd_cols;
+	for (unsigned cols = (unsigned)simd_cols; cols < (unsigned)width_in_pixels; cols++) {
 		target[cols] = GREY(source[FI_RGBA_RED], source[FI_RGBA_GREEN], source[FI_RGBA_BLUE]);
 		source += 3;
 	}
@@ -84,7 +87,10 @@ FreeImage_ConvertLine24To8(BYTE *target, BYTE *source, int width_in_pixels) {
 
 void DLL_CALLCONV
 FreeImage_ConvertLine32To8(BYTE *target, BYTE *source, int width_in_pixels) {
-	for (unsigned cols = 0; cols < (unsigned)width_in_pixels; cols++) {
+	const int simd_cols = FreeImage_ConvertLineSIMD(FI_LINE_32TO8, target, source, width_in_pixels);
+
+	source += 4 * simd_cols;
+	for (unsigned cols = (unsigned)simd_cols; cols < (unsigned)width_in_pixels; cols++) {
 		target[cols] = GREY(source[FI_RGBA_RED], source[FI_RGBA_GREEN], source[FI_RGBA_BLUE]);
 		source += 4;
 	}
@@ -0,0 +1,444 @@
+// ==========================================================
+// Row pipeline : fused per-row conversions
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#include "FreeImage.h"
+#include "Utilities.h"
+#include "Parallel.h"
+
+// ----------------------------------------------------------
+//   In-place row operations
+// ----------------------------------------------------------
+
+/**
+Apply a lookup table to a row of 'bytespp' bytes per pixel, with the channel rules of FreeImage_AdjustCurve
+*/
+static void
+ApplyRowLUT(BYTE *bits, int width, int bytespp, const BYTE *lut, FREE_IMAGE_COLOR_CHANNEL channel) {
+	if(bytespp == 1) {
+		for(int x = 0; x < width; x++) {
+			bits[x] = lut[bits[x]];
+		}
+		return;
+	}
+
+	if(channel == FICC_RGB) {
+		for(int x = 0; x < width; x++, bits += bytespp) {
+			bits[FI_RGBA_BLUE]	= lut[bits[FI_RGBA_BLUE]];
+			bits[FI_RGBA_GREEN]	= lut[bits[FI_RGBA_GREEN]];
+			bits[FI_RGBA_RED]	= lut[bits[FI_RGBA_RED]];
+		}
+		return;
+	}
+
+	int offset = -1;
+	switch(channel) {
+		case FICC_RED:
+			offset = FI_RGBA_RED;
+			break;
+		case FICC_GREEN:
+			offset = FI_RGBA_GREEN;
+			break;
+		case FICC_BLUE:
+			offset = FI_RGBA_BLUE;
+			break;
+		case FICC_ALPHA:
+			offset = (bytespp == 4) ? FI_RGBA_ALPHA : -1;
+			break;
+		default:
+			break;
+	}
+	if(offset >= 0) {
+		for(int x = 0; x < width; x++, bits += bytespp) {
+			bits[offset] = lut[bits[offset]];
+		}
+	}
+}
+
+static void
+SwapRowRedBlue(BYTE *bits, int width, int bytespp) {
+	for(int x = 0; x < width; x++, bits += bytespp) {
+		INPLACESWAP(bits[0], bits[2]);
+	}
+}
+
+/**
+Premultiply a row of 32-bit pixels, as FreeImage_PreMultiplyWithAlpha
+*/
+static void
+PreMultiplyRow(BYTE *bits, int width) {
+	const int done = FreeImage_PreMultiplyLineSIMD(FIT_BITMAP, bits, width);
+	bits += 4 * done;
+	for(int x = done; x < width; x++, bits += 4) {
+		const BYTE alpha = bits[FI_RGBA_ALPHA];
+		if(alpha == 0x00) {
+			bits[FI_RGBA_BLUE] = 0x00;
+			bits[FI_RGBA_GREEN] = 0x00;
+			bits[FI_RGBA_RED] = 0x00;
+		} else if(alpha != 0xFF) {
+			bits[FI_RGBA_BLUE] = (BYTE)( (alpha * (WORD)bits[FI_RGBA_BLUE] + 127) / 255 );
+			bits[FI_RGBA_GREEN] = (BYTE)( (alpha * (WORD)bits[FI_RGBA_GREEN] + 127) / 255 );
+			bits[FI_RGBA_RED] = (BYTE)( (alpha * (WORD)bits[FI_RGBA_RED] + 127) / 255 );
+		}
+	}
+}
+
+// ----------------------------------------------------------
+//   Pipeline
+// ----------------------------------------------------------
+
+/**
+Row operation with its input and output pixel formats (8, 24 or 32 bits per pixel)
+*/
+struct RowPipelineStep {
+	const FIROWOPERATION *operation;
+	int input_bpp;
+	int output_bpp;
+};
+
+class RowPipelineTask : public ParallelTask {
+public:
+	FIBITMAP *src;
+	FIBITMAP *dst;
+	int width;
+	int height;
+	unsigned band_rows;
+
+	//! source bit depth, palette (1-, 4- and 8-bit images) and transparency table (32-bit working format only)
+	unsigned src_bpp;
+	RGBQUAD *src_palette;
+	BYTE *src_table;
+	int src_transparent_pixels;
+	BOOL src_is565;
+
+	//! working format of the source rows
+	int start_bpp;
+	//! index of the last step changing the pixel format, -1 for the conversion of the source rows
+	//! to the working format, -2 when the pixel format never changes
+	int last_format_change;
+
+	const RowPipelineStep *steps;
+	int step_count;
+
+	//! two row buffers for each thread
+	BYTE *buffers;
+	size_t row_size;
+
+	RGBQUAD grey_palette[256];
+
+	void run(unsigned band, unsigned thread) {
+		BYTE *rows[2];
+		rows[0] = buffers + 2 * row_size * thread;
+		rows[1] = rows[0] + row_size;
+
+		const unsigned first = band * band_rows;
+		const unsigned last = MIN(first + band_rows, (unsigned)height);
+		for(unsigned y = first; y < last; y++) {
+			processRow(FreeImage_GetScanLine(dst, y), FreeImage_GetScanLine(src, y), rows);
+		}
+	}
+
+private:
+	void readRow(BYTE *target, BYTE *source) {
+		if(start_bpp == 32) {
+			// palettized image with transparency
+			for(int x = 0; x < width; x++, target += 4) {
+				int index = 0;
+				switch(src_bpp) {
+					case 1:
+						index = (source[x >> 3] & (0x80 >> (x & 0x07))) != 0 ? 1 : 0;
+						break;
+					case 4:
+						index = (x & 0x01) ? LOWNIBBLE(source[x >> 1]) : (HINIBBLE(source[x >> 1]) >> 4);
+						break;
+					default:
+						index = source[x];
+						break;
+				}
+				target[FI_RGBA_BLUE]	= src_palette[index].rgbBlue;
+				target[FI_RGBA_GREEN]	= src_palette[index].rgbGreen;
+				target[FI_RGBA_RED]		= src_palette[index].rgbRed;
+				target[FI_RGBA_ALPHA]	= (index < src_transparent_pixels) ? src_table[index] : 0xFF;
+			}
+			return;
+		}
+
+		switch(src_bpp) {
+			case 1:
+				FreeImage_ConvertLine1To24(target, source, width, src_palette);
+				break;
+			case 4:
+				FreeImage_ConvertLine4To24(target, source, width, src_palette);
+				break;
+			case 8:
+				FreeImage_ConvertLine8To24(target, source, width, src_palette);
+				break;
+			case 16:
+				if(src_is565) {
+					FreeImage_ConvertLine16To24_565(target, source, width);
+				} else {
+					FreeImage_ConvertLine16To24_555(target, source, width);
+				}
+				break;
+		}
+	}
+
+	void convertRow(BYTE *target, int target_bpp, BYTE *source, int source_bpp) {
+		switch(source_bpp) {
+			case 8:
+				if(target_bpp == 24) {
+					FreeImage_ConvertLine8To24(target, source, width, grey_palette);
+				} else {
+					FreeImage_ConvertLine8To32(target, source, width, grey_palette);
+				}
+				break;
+			case 24:
+				if(target_bpp == 8) {
+					FreeImage_ConvertLine24To8(target, source, width);
+				} else {
+					FreeImage_ConvertLine24To32(target, source, width);
+				}
+				break;
+			case 32:
+				if(target_bpp == 8) {
+					FreeImage_ConvertLine32To8(target, source, width);
+				} else {
+					FreeImage_ConvertLine32To24(target, source, width);
+				}
+				break;
+		}
+	}
+
+	void applyOperation(BYTE *bits, const RowPipelineStep& step) {
+		const FIROWOPERATION *operation = step.operation;
+		const int bytespp = step.input_bpp / 8;
+
+		switch(operation->operation) {
+			case FIRO_LUT:
+				ApplyRowLUT(bits, width, bytespp, operation->lut, (FREE_IMAGE_COLOR_CHANNEL)operation->param);
+				break;
+			case FIRO_SWAP_RED_BLUE:
+				if(bytespp >= 3) {
+					SwapRowRedBlue(bits, width, bytespp);
+				}
+				break;
+			case FIRO_PREMULTIPLY:
+				if(bytespp == 4) {
+					PreMultiplyRow(bits, width);
+				}
+				break;
+			default:
+				// conversion to the same format
+				break;
+		}
+	}
+
+	/**
+	Run the pipeline on a row. Each step writes either to a row buffer of the thread or,
+	once the pixel format reaches the output format, directly to the destination row.
+	The source row is never written unless the destination is the source image.
+	*/
+	void processRow(BYTE *dst_row, BYTE *src_row, BYTE *rows[2]) {
+		BYTE *current = src_row;
+		BOOL writable = (src == dst);
+		int current_bpp = start_bpp;
+
+		if(last_format_change >= -1) {
+			if(start_bpp != (int)src_bpp) {
+				BYTE *target = (last_format_change == -1) ? dst_row : rows[0];
+				readRow(target, src_row);
+				current = target;
+				writable = TRUE;
+			}
+		}
+
+		for(int i = 0; i < step_count; i++) {
+			const RowPipelineStep& step = steps[i];
+
+			if(step.output_bpp != step.input_bpp) {
+				BYTE *target = (i == last_format_change) ? dst_row : ((current == rows[0]) ? rows[1] : rows[0]);
+				convertRow(target, step.output_bpp, current, step.input_bpp);
+				current = target;
+				writable = TRUE;
+			} else {
+				if(!writable) {
+					// work on a copy of the source row
+					BYTE *target = (i > last_format_change) ? dst_row : rows[0];
+					memcpy(target, current, width * (step.input_bpp / 8));
+					current = target;
+					writable = TRUE;
+				}
+				applyOperation(current, step);
+			}
+			current_bpp = step.output_bpp;
+		}
+
+		if(current != dst_row) {
+			memcpy(dst_row, current, width * (current_bpp / 8));
+		}
+	}
+};
+
+/**
+Apply a chain of row operations to an image, without intermediate images.
+Rows are read in the working format (8-bit greyscale for 8-bit greyscale images, 32-bit for 32-bit
+images and palettized images with transparency, 24-bit otherwise), every operation is applied to
+a row before the next row is read, and the result is written once in the destination image.
+Running a pipeline gives the same pixels as the equivalent chain of FreeImage_ConvertTo24Bits,
+FreeImage_ConvertTo32Bits, FreeImage_ConvertToGreyscale, FreeImage_AdjustCurve,
+SwapRedBlue and FreeImage_PreMultiplyWithAlpha calls.
+@param dib Source image (FIT_BITMAP, 1-, 4-, 8-, 16-, 24- or 32-bit)
+@param operations Row operations, applied in order
+@param count Number of operations, may be 0 (the source is converted to the working format)
+@param dst Destination image with the size of the source and the bit depth of the last operation,
+may be the source image itself (in-place processing) or NULL to allocate a new image.
+The palette of an 8-bit destination is set to a greyscale ramp.
+@param flags FIRO_MULTITHREAD to process bands of rows on several threads
+@return Returns the destination image, or NULL if an operation is invalid, if the source cannot be handled
+or if 'dst' does not match the output format
+*/
+FIBITMAP * DLL_CALLCONV
+FreeImage_ApplyRowPipeline(FIBITMAP *dib, const FIROWOPERATION *operations, int count, FIBITMAP *dst, int flags) {
+	if(!FreeImage_HasPixels(dib) || (FreeImage_GetImageType(dib) != FIT_BITMAP)) {
+		return NULL;
+	}
+	if((count < 0) || ((count > 0) && !operations)) {
+		return NULL;
+	}
+
+	RowPipelineTask task;
+	task.src = dib;
+	task.width = (int)FreeImage_GetWidth(dib);
+	task.height = (int)FreeImage_GetHeight(dib);
+	task.src_bpp = FreeImage_GetBPP(dib);
+	task.src_palette = FreeImage_GetPalette(dib);
+	task.src_table = FreeImage_GetTransparencyTable(dib);
+	task.src_transparent_pixels = FreeImage_GetTransparencyCount(dib);
+	task.src_is565 = (task.src_bpp == 16) && IS_FORMAT_RGB565(dib);
+	CREATE_GREYSCALE_PALETTE(task.grey_palette, 256);
+
+	switch(task.src_bpp) {
+		case 1:
+		case 4:
+		case 8:
+			if((task.src_bpp == 8) && (FreeImage_GetColorType(dib) == FIC_MINISBLACK)) {
+				task.start_bpp = 8;
+			} else {
+				task.start_bpp = FreeImage_IsTransparent(dib) ? 32 : 24;
+			}
+			break;
+		case 16:
+		case 24:
+			task.start_bpp = 24;
+			break;
+		case 32:
+			task.start_bpp = 32;
+			break;
+		default:
+			return NULL;
+	}
+
+	// pixel format after each operation
+
+	std::vector<RowPipelineStep> steps(count);
+	int bpp = task.start_bpp;
+	task.last_format_change = (task.start_bpp != (int)task.src_bpp) ? -1 : -2;
+
+	for(int i = 0; i < count; i++) {
+		const FIROWOPERATION *operation = &operations[i];
+		steps[i].operation = operation;
+		steps[i].input_bpp = bpp;
+
+		switch(operation->operation) {
+			case FIRO_CONVERT:
+				if((operation->param != 8) && (operation->param != 24) && (operation->param != 32)) {
+					return NULL;
+				}
+				bpp = operation->param;
+				break;
+			case FIRO_GREYSCALE:
+				bpp = 8;
+				break;
+			case FIRO_LUT:
+				if(!operation->lut) {
+					return NULL;
+				}
+				break;
+			case FIRO_SWAP_RED_BLUE:
+			case FIRO_PREMULTIPLY:
+				break;
+			default:
+				return NULL;
+		}
+
+		steps[i].output_bpp = bpp;
+		if(bpp != steps[i].input_bpp) {
+			task.last_format_change = i;
+		}
+	}
+	task.steps = count ? &steps[0] : NULL;
+	task.step_count = count;
+
+	// destination image
+
+	FIBITMAP *new_dib = NULL;
+	if(dst) {
+		if(!FreeImage_HasPixels(dst) || (FreeImage_GetImageType(dst) != FIT_BITMAP) || ((int)FreeImage_GetBPP(dst) != bpp)) {
+			return NULL;
+		}
+		if(((int)FreeImage_GetWidth(dst) != task.width) || ((int)FreeImage_GetHeight(dst) != task.height)) {
+			return NULL;
+		}
+	} else {
+		new_dib = FreeImage_Allocate(task.width, task.height, bpp, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+		if(!new_dib) {
+			return NULL;
+		}
+		FreeImage_CloneMetadata(new_dib, dib);
+		dst = new_dib;
+	}
+	task.dst = dst;
+
+	// run the pipeline by bands of rows, with two row buffers per thread
+
+	task.row_size = (size_t)task.width * 4;
+	task.band_rows = MAX(1U, (unsigned)(65536 / task.row_size));
+	const unsigned band_count = (task.height + task.band_rows - 1) / task.band_rows;
+	const unsigned threads = (flags & FIRO_MULTITHREAD) ? MIN(GetProcessorCount(), band_count) : 1;
+
+	task.buffers = (BYTE*)malloc(2 * task.row_size * threads);
+	if(!task.buffers) {
+		if(new_dib) {
+			FreeImage_Unload(new_dib);
+		}
+		return NULL;
+	}
+
+	ParallelRun(task, band_count, threads);
+
+	free(task.buffers);
+
+	if(bpp == 8) {
+		// the destination holds greyscale values : replace a palette processed in place
+		CREATE_GREYSCALE_PALETTE(FreeImage_GetPalette(dst), 256);
+		if((dst == dib) && (task.start_bpp != 8)) {
+			FreeImage_SetTransparencyTable(dst, NULL, 0);
+		}
+	}
+
+	return dst;
+}
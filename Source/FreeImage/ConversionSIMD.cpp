@@ -0,0 +1,2296 @@
+// ==========================================================
+// SIMD scanline conversion kernels and CPU feature dispatch
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#include "FreeImage.h"
+#include "Utilities.h"
+
+#if defined(FREEIMAGE_SSSE3)
+#include <tmmintrin.h>
+#endif
+#if defined(FREEIMAGE_AVX2)
+#include <immintrin.h>
+#endif
+
+#if defined(FREEIMAGE_SSE2)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__GNUC__)
+#include <cpuid.h>
+#endif
+#endif
+
+/**
+SIMD kernel of a line conversion.
+Converts the leading pixels of the line by blocks and returns the number of pixels converted,
+the remaining ones are converted by the scalar code of the FreeImage_ConvertLine function.
+*/
+typedef int (*FI_LineKernel)(BYTE *target, const BYTE *source, int width_in_pixels);
+
+/**
+SIMD kernels of the greyscale sample lines (see FreeImage_FindMinMaxLineSIMD and FreeImage_ScaleLineToByteSIMD)
+*/
+typedef int (*FI_MinMaxKernel)(const BYTE *source, int width, double& min, double& max);
+typedef int (*FI_ScaleKernel)(BYTE *target, const BYTE *source, int width, double low, double scale);
+
+/**
+SIMD kernel of a compositing line (see FreeImage_CompositeLineSIMD)
+*/
+typedef int (*FI_CompositeKernel)(BYTE *target, const BYTE *source, int width, int src_factor, int dst_factor);
+
+/**
+SIMD kernels of the alpha channel routines (see FreeImage_PreMultiplyLineSIMD, FreeImage_UnPreMultiplyLineSIMD 
+and FreeImage_BlendBackgroundLineSIMD)
+*/
+typedef int (*FI_AlphaKernel)(BYTE *bits, int width);
+typedef int (*FI_BlendKernel)(BYTE *target, const BYTE *foreground, const BYTE *background, int width);
+
+/**
+SIMD kernels of the area averaging and resampling rows (see FreeImage_AccumulateLineSIMD, 
+FreeImage_AccumulateLineFSIMD and FreeImage_AccumulateLine16SIMD)
+*/
+typedef int (*FI_AccumulateKernel)(DWORD *sums, const BYTE *source, int count, unsigned weight);
+typedef int (*FI_AccumulateFKernel)(float *sums, const float *source, int count, float weight);
+typedef int (*FI_Accumulate16Kernel)(int *sums, const WORD *source0, const WORD *source1, int count, int weight0, int weight1);
+
+/**
+SIMD kernels of the pixel transposition and mirroring (see FreeImage_TransposeTileSIMD and FreeImage_ReverseLineSIMD)
+*/
+typedef int (*FI_TransposeKernel)(BYTE *dst, int dst_pitch, const BYTE *src, int src_pitch, int width, int height);
+typedef int (*FI_ReverseKernel)(BYTE *dst, const BYTE *src, int width);
+
+// ==========================================================
+//   CPU feature detection
+// ==========================================================
+
+static unsigned
+DetectCPUFeatures() {
+	unsigned features = 0;
+
+#if defined(FREEIMAGE_SSE2)
+	unsigned regs[4] = { 0, 0, 0, 0 };	// eax, ebx, ecx, edx
+	unsigned max_leaf = 0;
+
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	max_leaf = (unsigned)info[0];
+	if(max_leaf >= 1) {
+		__cpuid(info, 1);
+		for(int i = 0; i < 4; i++) regs[i] = (unsigned)info[i];
+	}
+#elif defined(__GNUC__)
+	max_leaf = __get_cpuid_max(0, NULL);
+	if(max_leaf >= 1) {
+		__cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+	}
+#endif
+
+	if(regs[3] & (1 << 26)) {
+		features |= FI_CPU_SSE2;
+	}
+	if((features & FI_CPU_SSE2) && (regs[2] & (1 << 9))) {
+		features |= FI_CPU_SSSE3;
+	}
+
+	// AVX2 needs the OS to save the YMM registers (OSXSAVE and XCR0 bits 1 and 2)
+	const unsigned avx_osxsave = (1 << 27) | (1 << 28);
+	if(((regs[2] & avx_osxsave) == avx_osxsave) && (max_leaf >= 7)) {
+		unsigned xcr0 = 0;
+#if defined(_MSC_VER) && (_MSC_VER >= 1600)
+		xcr0 = (unsigned)_xgetbv(0);
+#elif defined(__GNUC__)
+		unsigned edx_xcr0 = 0;
+		__asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a" (xcr0), "=d" (edx_xcr0) : "c" (0));
+#endif
+		if((xcr0 & 6) == 6) {
+#if defined(_MSC_VER)
+			__cpuidex(info, 7, 0);
+			regs[1] = (unsigned)info[1];
+#elif defined(__GNUC__)
+			__cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+			if((features & FI_CPU_SSSE3) && (regs[1] & (1 << 5))) {
+				features |= FI_CPU_AVX2;
+			}
+		}
+	}
+#endif // FREEIMAGE_SSE2
+
+	return features;
+}
+
+#if defined(FREEIMAGE_SSE2)
+
+// ==========================================================
+//   SSE2 kernels
+// ==========================================================
+
+// bit position of each channel inside a 32-bit pixel
+#define FI_SHIFT_RED	(8 * FI_RGBA_RED)
+#define FI_SHIFT_GREEN	(8 * FI_RGBA_GREEN)
+#define FI_SHIFT_BLUE	(8 * FI_RGBA_BLUE)
+
+/**
+Expand 5-bit and 6-bit channels held in 16-bit lanes to 8-bit values,
+computing exactly (v * 0xFF) / 0x1F and (v * 0xFF) / 0x3F as the scalar code
+*/
+static inline __m128i
+Expand5_SSE2(__m128i v) {
+	return _mm_srli_epi16(_mm_mullo_epi16(v, _mm_set1_epi16(1053)), 7);
+}
+
+static inline __m128i
+Expand6_SSE2(__m128i v) {
+	return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(v, _mm_set1_epi16(259)), _mm_set1_epi16(3)), 6);
+}
+
+/**
+Expand 8 RGB 555 or RGB 565 pixels to 8 32-bit pixels with an opaque alpha channel
+*/
+template <BOOL is565> static inline void
+Expand16To32_SSE2(__m128i v, __m128i& lo, __m128i& hi) {
+	__m128i r, g, b;
+	if(is565) {
+		r = Expand5_SSE2(_mm_srli_epi16(v, FI16_565_RED_SHIFT));
+		g = Expand6_SSE2(_mm_and_si128(_mm_srli_epi16(v, FI16_565_GREEN_SHIFT), _mm_set1_epi16(0x3F)));
+		b = Expand5_SSE2(_mm_and_si128(v, _mm_set1_epi16(0x1F)));
+	} else {
+		r = Expand5_SSE2(_mm_and_si128(_mm_srli_epi16(v, FI16_555_RED_SHIFT), _mm_set1_epi16(0x1F)));
+		g = Expand5_SSE2(_mm_and_si128(_mm_srli_epi16(v, FI16_555_GREEN_SHIFT), _mm_set1_epi16(0x1F)));
+		b = Expand5_SSE2(_mm_and_si128(v, _mm_set1_epi16(0x1F)));
+	}
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+	const __m128i c0 = b, c2 = r;
+#else
+	const __m128i c0 = r, c2 = b;
+#endif
+	const __m128i c01 = _mm_or_si128(c0, _mm_slli_epi16(g, 8));
+	const __m128i c23 = _mm_or_si128(c2, _mm_set1_epi16((short)0xFF00));
+	lo = _mm_unpacklo_epi16(c01, c23);
+	hi = _mm_unpackhi_epi16(c01, c23);
+}
+
+/**
+Pack 4 32-bit pixels to 4 RGB 555 or RGB 565 values held in 32-bit lanes
+*/
+template <BOOL is565> static inline __m128i
+Pack32To16_SSE2(__m128i p) {
+	const __m128i r = _mm_srli_epi32(p, FI_SHIFT_RED + 3);
+	const __m128i b = _mm_srli_epi32(p, FI_SHIFT_BLUE + 3);
+	if(is565) {
+		const __m128i g = _mm_srli_epi32(p, FI_SHIFT_GREEN + 2);
+		return _mm_or_si128(_mm_or_si128(
+			_mm_and_si128(_mm_slli_epi32(r, FI16_565_RED_SHIFT), _mm_set1_epi32(FI16_565_RED_MASK)),
+			_mm_and_si128(_mm_slli_epi32(g, FI16_565_GREEN_SHIFT), _mm_set1_epi32(FI16_565_GREEN_MASK))),
+			_mm_and_si128(b, _mm_set1_epi32(FI16_565_BLUE_MASK)));
+	} else {
+		const __m128i g = _mm_srli_epi32(p, FI_SHIFT_GREEN + 3);
+		return _mm_or_si128(_mm_or_si128(
+			_mm_and_si128(_mm_slli_epi32(r, FI16_555_RED_SHIFT), _mm_set1_epi32(FI16_555_RED_MASK)),
+			_mm_and_si128(_mm_slli_epi32(g, FI16_555_GREEN_SHIFT), _mm_set1_epi32(FI16_555_GREEN_MASK))),
+			_mm_and_si128(b, _mm_set1_epi32(FI16_555_BLUE_MASK)));
+	}
+}
+
+/**
+Narrow two vectors of 16-bit values held in 32-bit lanes to a vector of 8 words
+*/
+static inline __m128i
+Narrow32To16_SSE2(__m128i a, __m128i b) {
+	// sign extend the low words so that the signed saturation keeps them unchanged
+	a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+	b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+	return _mm_packs_epi32(a, b);
+}
+
+/**
+Greyscale value of 4 32-bit pixels, computed with the same float operations as the GREY macro
+*/
+static inline __m128i
+Grey32_SSE2(__m128i p) {
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	const __m128 r = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, FI_SHIFT_RED), mask));
+	const __m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, FI_SHIFT_GREEN), mask));
+	const __m128 b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, FI_SHIFT_BLUE), mask));
+	__m128 y = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.2126F), r), _mm_mul_ps(_mm_set1_ps(0.7152F), g));
+	y = _mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(0.0722F), b));
+	return _mm_cvttps_epi32(_mm_add_ps(y, _mm_set1_ps(0.5F)));
+}
+
+static inline void
+StoreGrey16_SSE2(BYTE *target, __m128i p0, __m128i p1, __m128i p2, __m128i p3) {
+	const __m128i y01 = _mm_packs_epi32(Grey32_SSE2(p0), Grey32_SSE2(p1));
+	const __m128i y23 = _mm_packs_epi32(Grey32_SSE2(p2), Grey32_SSE2(p3));
+	_mm_storeu_si128((__m128i*)target, _mm_packus_epi16(y01, y23));
+}
+
+template <BOOL is565> static int
+ConvertLine16To32_SSE2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 8 <= width_in_pixels; cols += 8) {
+		__m128i lo, hi;
+		Expand16To32_SSE2<is565>(_mm_loadu_si128((const __m128i*)(source + 2 * cols)), lo, hi);
+		_mm_storeu_si128((__m128i*)(target + 4 * cols), lo);
+		_mm_storeu_si128((__m128i*)(target + 4 * cols + 16), hi);
+	}
+	return cols;
+}
+
+template <BOOL is565> static int
+ConvertLine32To16_SSE2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 8 <= width_in_pixels; cols += 8) {
+		const __m128i a = Pack32To16_SSE2<is565>(_mm_loadu_si128((const __m128i*)(source + 4 * cols)));
+		const __m128i b = Pack32To16_SSE2<is565>(_mm_loadu_si128((const __m128i*)(source + 4 * cols + 16)));
+		_mm_storeu_si128((__m128i*)(target + 2 * cols), Narrow32To16_SSE2(a, b));
+	}
+	return cols;
+}
+
+static int
+ConvertLine16_565_To16_555_SSE2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	const __m128i mask5 = _mm_set1_epi16(0x1F);
+	int cols = 0;
+	for(; cols + 8 <= width_in_pixels; cols += 8) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(source + 2 * cols));
+		const __m128i r = _mm_srli_epi16(Expand5_SSE2(_mm_srli_epi16(v, FI16_565_RED_SHIFT)), 3);
+		const __m128i g = _mm_srli_epi16(Expand6_SSE2(_mm_and_si128(_mm_srli_epi16(v, FI16_565_GREEN_SHIFT), _mm_set1_epi16(0x3F))), 3);
+		const __m128i b = _mm_srli_epi16(Expand5_SSE2(_mm_and_si128(v, mask5)), 3);
+		const __m128i w = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(r, FI16_555_RED_SHIFT), _mm_slli_epi16(g, FI16_555_GREEN_SHIFT)), b);
+		_mm_storeu_si128((__m128i*)(target + 2 * cols), w);
+	}
+	return cols;
+}
+
+static int
+ConvertLine16_555_To16_565_SSE2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	const __m128i mask5 = _mm_set1_epi16(0x1F);
+	int cols = 0;
+	for(; cols + 8 <= width_in_pixels; cols += 8) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(source + 2 * cols));
+		const __m128i r = _mm_srli_epi16(Expand5_SSE2(_mm_and_si128(_mm_srli_epi16(v, FI16_555_RED_SHIFT), mask5)), 3);
+		const __m128i g = _mm_srli_epi16(Expand5_SSE2(_mm_and_si128(_mm_srli_epi16(v, FI16_555_GREEN_SHIFT), mask5)), 2);
+		const __m128i b = _mm_srli_epi16(Expand5_SSE2(_mm_and_si128(v, mask5)), 3);
+		const __m128i w = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(r, FI16_565_RED_SHIFT), _mm_slli_epi16(g, FI16_565_GREEN_SHIFT)), b);
+		_mm_storeu_si128((__m128i*)(target + 2 * cols), w);
+	}
+	return cols;
+}
+
+static int
+ConvertLine32To8_SSE2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		const __m128i *src = (const __m128i*)(source + 4 * cols);
+		StoreGrey16_SSE2(target + cols, _mm_loadu_si128(src), _mm_loadu_si128(src + 1), _mm_loadu_si128(src + 2), _mm_loadu_si128(src + 3));
+	}
+	return cols;
+}
+
+// ==========================================================
+//   SSE2 greyscale sample kernels
+// ==========================================================
+
+/**
+Vector operations on the samples of each greyscale image type.
+Unsigned samples are compared as signed values after flipping their sign bit.
+*/
+template <class T> struct Samples_SSE2;
+
+/**
+Signed 32-bit min / max, SSE4.1 instructions being emulated with a comparison
+*/
+static inline __m128i
+Min32_SSE2(__m128i a, __m128i b) {
+	const __m128i gt = _mm_cmpgt_epi32(a, b);
+	return _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, a));
+}
+
+static inline __m128i
+Max32_SSE2(__m128i a, __m128i b) {
+	const __m128i gt = _mm_cmpgt_epi32(a, b);
+	return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+
+template <> struct Samples_SSE2<WORD> {
+	typedef __m128i V;
+	static inline V bias() { return _mm_set1_epi16((short)0x8000); }
+	static inline V set1(WORD v) { return _mm_set1_epi16((short)(v ^ 0x8000)); }
+	static inline V load(const WORD *p) { return _mm_xor_si128(_mm_loadu_si128((const __m128i*)p), bias()); }
+	static inline void store(WORD *p, V v) { _mm_storeu_si128((__m128i*)p, _mm_xor_si128(v, bias())); }
+	static inline V min(V a, V b) { return _mm_min_epi16(a, b); }
+	static inline V max(V a, V b) { return _mm_max_epi16(a, b); }
+	static inline void diff4(const WORD *p, double low, __m128d& d0, __m128d& d1) {
+		const __m128i v = _mm_sub_epi32(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)p), _mm_setzero_si128()), _mm_set1_epi32((int)low));
+		d0 = _mm_cvtepi32_pd(v);
+		d1 = _mm_cvtepi32_pd(_mm_srli_si128(v, 8));
+	}
+};
+
+template <> struct Samples_SSE2<short> {
+	typedef __m128i V;
+	static inline V set1(short v) { return _mm_set1_epi16(v); }
+	static inline V load(const short *p) { return _mm_loadu_si128((const __m128i*)p); }
+	static inline void store(short *p, V v) { _mm_storeu_si128((__m128i*)p, v); }
+	static inline V min(V a, V b) { return _mm_min_epi16(a, b); }
+	static inline V max(V a, V b) { return _mm_max_epi16(a, b); }
+	static inline void diff4(const short *p, double low, __m128d& d0, __m128d& d1) {
+		const __m128i w = _mm_loadl_epi64((const __m128i*)p);
+		const __m128i v = _mm_sub_epi32(_mm_srai_epi32(_mm_unpacklo_epi16(w, w), 16), _mm_set1_epi32((int)low));
+		d0 = _mm_cvtepi32_pd(v);
+		d1 = _mm_cvtepi32_pd(_mm_srli_si128(v, 8));
+	}
+};
+
+template <> struct Samples_SSE2<DWORD> {
+	typedef __m128i V;
+	static inline V bias() { return _mm_set1_epi32((int)0x80000000); }
+	static inline V set1(DWORD v) { return _mm_set1_epi32((int)(v ^ 0x80000000)); }
+	static inline V load(const DWORD *p) { return _mm_xor_si128(_mm_loadu_si128((const __m128i*)p), bias()); }
+	static inline void store(DWORD *p, V v) { _mm_storeu_si128((__m128i*)p, _mm_xor_si128(v, bias())); }
+	static inline V min(V a, V b) { return Min32_SSE2(a, b); }
+	static inline V max(V a, V b) { return Max32_SSE2(a, b); }
+	static inline void diff4(const DWORD *p, double low, __m128d& d0, __m128d& d1) {
+		// (v ^ 0x80000000) as a signed value, plus 2^31
+		const __m128i v = load(p);
+		const __m128d sign = _mm_set1_pd(2147483648.0);
+		const __m128d vlow = _mm_set1_pd(low);
+		d0 = _mm_sub_pd(_mm_add_pd(_mm_cvtepi32_pd(v), sign), vlow);
+		d1 = _mm_sub_pd(_mm_add_pd(_mm_cvtepi32_pd(_mm_srli_si128(v, 8)), sign), vlow);
+	}
+};
+
+template <> struct Samples_SSE2<LONG> {
+	typedef __m128i V;
+	static inline V set1(LONG v) { return _mm_set1_epi32((int)v); }
+	static inline V load(const LONG *p) { return _mm_loadu_si128((const __m128i*)p); }
+	static inline void store(LONG *p, V v) { _mm_storeu_si128((__m128i*)p, v); }
+	static inline V min(V a, V b) { return Min32_SSE2(a, b); }
+	static inline V max(V a, V b) { return Max32_SSE2(a, b); }
+	static inline void diff4(const LONG *p, double low, __m128d& d0, __m128d& d1) {
+		const __m128i v = load(p);
+		const __m128d vlow = _mm_set1_pd(low);
+		d0 = _mm_sub_pd(_mm_cvtepi32_pd(v), vlow);
+		d1 = _mm_sub_pd(_mm_cvtepi32_pd(_mm_srli_si128(v, 8)), vlow);
+	}
+};
+
+template <> struct Samples_SSE2<float> {
+	typedef __m128 V;
+	static inline V set1(float v) { return _mm_set1_ps(v); }
+	static inline V load(const float *p) { return _mm_loadu_ps(p); }
+	static inline void store(float *p, V v) { _mm_storeu_ps(p, v); }
+	// the second operand is returned when the first one is NaN
+	static inline V min(V a, V b) { return _mm_min_ps(a, b); }
+	static inline V max(V a, V b) { return _mm_max_ps(a, b); }
+	static inline void diff4(const float *p, double low, __m128d& d0, __m128d& d1) {
+		const __m128 v = _mm_sub_ps(load(p), _mm_set1_ps((float)low));
+		d0 = _mm_cvtps_pd(v);
+		d1 = _mm_cvtps_pd(_mm_movehl_ps(v, v));
+	}
+};
+
+template <> struct Samples_SSE2<double> {
+	typedef __m128d V;
+	static inline V set1(double v) { return _mm_set1_pd(v); }
+	static inline V load(const double *p) { return _mm_loadu_pd(p); }
+	static inline void store(double *p, V v) { _mm_storeu_pd(p, v); }
+	static inline V min(V a, V b) { return _mm_min_pd(a, b); }
+	static inline V max(V a, V b) { return _mm_max_pd(a, b); }
+	static inline void diff4(const double *p, double low, __m128d& d0, __m128d& d1) {
+		const __m128d vlow = _mm_set1_pd(low);
+		d0 = _mm_sub_pd(load(p), vlow);
+		d1 = _mm_sub_pd(load(p + 2), vlow);
+	}
+};
+
+/**
+Merge the lanes of the min / max vectors into the running min / max values
+*/
+template <class T> static inline void
+MergeMinMax(const T *lanes_min, const T *lanes_max, int count, double& min, double& max) {
+	T l_min = lanes_min[0];
+	T l_max = lanes_max[0];
+	for(int i = 1; i < count; i++) {
+		if(lanes_min[i] < l_min) l_min = lanes_min[i];
+		if(lanes_max[i] > l_max) l_max = lanes_max[i];
+	}
+	min = (double)l_min;
+	max = (double)l_max;
+}
+
+template <class T> static int
+FindMinMaxLine_SSE2(const BYTE *source, int width, double& min, double& max) {
+	typedef Samples_SSE2<T> S;
+	const int count = sizeof(typename S::V) / sizeof(T);
+	const T *src = (const T*)source;
+
+	typename S::V vmin = S::set1((T)min);
+	typename S::V vmax = S::set1((T)max);
+	int x = 0;
+	for(; x + count <= width; x += count) {
+		const typename S::V v = S::load(src + x);
+		vmin = S::min(v, vmin);
+		vmax = S::max(v, vmax);
+	}
+
+	T lanes_min[sizeof(typename S::V) / sizeof(T)];
+	T lanes_max[sizeof(typename S::V) / sizeof(T)];
+	S::store(lanes_min, vmin);
+	S::store(lanes_max, vmax);
+	MergeMinMax(lanes_min, lanes_max, count, min, max);
+	return x;
+}
+
+/**
+Scale 4 sample offsets, clamp the result to [0, 255] and truncate it to 4 32-bit integers.
+NaN values give 0, the second operand of maxpd being returned.
+*/
+static inline __m128i
+Round4_SSE2(__m128d d0, __m128d d1, __m128d scale) {
+	const __m128d half = _mm_set1_pd(0.5);
+	const __m128d zero = _mm_setzero_pd();
+	const __m128d c255 = _mm_set1_pd(255);
+	d0 = _mm_min_pd(_mm_max_pd(_mm_add_pd(_mm_mul_pd(d0, scale), half), zero), c255);
+	d1 = _mm_min_pd(_mm_max_pd(_mm_add_pd(_mm_mul_pd(d1, scale), half), zero), c255);
+	return _mm_unpacklo_epi64(_mm_cvttpd_epi32(d0), _mm_cvttpd_epi32(d1));
+}
+
+template <class T> static int
+ScaleLineToByte_SSE2(BYTE *target, const BYTE *source, int width, double low, double scale) {
+	const T *src = (const T*)source;
+	const __m128d vscale = _mm_set1_pd(scale);
+	int x = 0;
+	for(; x + 16 <= width; x += 16) {
+		__m128i q[4];
+		for(int i = 0; i < 4; i++) {
+			__m128d d0, d1;
+			Samples_SSE2<T>::diff4(src + x + 4 * i, low, d0, d1);
+			q[i] = Round4_SSE2(d0, d1, vscale);
+		}
+		_mm_storeu_si128((__m128i*)(target + x), _mm_packus_epi16(_mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3])));
+	}
+	return x;
+}
+
+// ==========================================================
+//   SSE2 compositing kernels
+// ==========================================================
+
+// Pixels are processed as 16-bit lanes, 2 RGBA pixels per vector.
+// MAX_VALUE is the maximum value of a channel : 0xFF for 32-bit pixels, 0xFFFF for RGBA16 pixels.
+
+/**
+Porter-Duff factors, computed as (alpha & factor_and) ^ factor_xor (see FI_PD_ZERO to FI_PD_INV_ALPHA)
+*/
+struct CompositeFactors_SSE2 {
+	__m128i src_and, src_xor;
+	__m128i dst_and, dst_xor;
+	__m128i alpha_mask;		// alpha lanes
+	__m128i max_value;
+
+	CompositeFactors_SSE2(int src_factor, int dst_factor, int max) {
+		src_and = _mm_set1_epi16((src_factor & 2) ? -1 : 0);
+		src_xor = _mm_set1_epi16((short)((src_factor & 1) ? max : 0));
+		dst_and = _mm_set1_epi16((dst_factor & 2) ? -1 : 0);
+		dst_xor = _mm_set1_epi16((short)((dst_factor & 1) ? max : 0));
+		alpha_mask = _mm_slli_epi64(_mm_srli_epi64(_mm_set1_epi32(-1), 48), 16 * FI_RGBA_ALPHA);
+		max_value = _mm_set1_epi16((short)max);
+	}
+};
+
+static inline __m128i
+BroadcastAlpha_SSE2(__m128i v) {
+	const int alpha = _MM_SHUFFLE(FI_RGBA_ALPHA, FI_RGBA_ALPHA, FI_RGBA_ALPHA, FI_RGBA_ALPHA);
+	return _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, alpha), alpha);
+}
+
+/**
+Channel arithmetic of each pixel format
+*/
+template <int MAX_VALUE> struct Channels_SSE2;
+
+template <> struct Channels_SSE2<0xFF> {
+	static inline void load(const BYTE *p, __m128i& lo, __m128i& hi) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)p);
+		lo = _mm_unpacklo_epi8(v, _mm_setzero_si128());
+		hi = _mm_unpackhi_epi8(v, _mm_setzero_si128());
+	}
+	static inline void store(BYTE *p, __m128i lo, __m128i hi) {
+		_mm_storeu_si128((__m128i*)p, _mm_packus_epi16(lo, hi));
+	}
+	// rounded a * b / 255
+	static inline __m128i mulDiv(__m128i a, __m128i b) {
+		const __m128i x = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+		return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+	}
+	static inline __m128i addClamp(__m128i a, __m128i b) {
+		return _mm_min_epi16(_mm_add_epi16(a, b), _mm_set1_epi16(0xFF));
+	}
+	// 32-bit lanes in [0, 2^31) to 16-bit lanes clamped to MAX_VALUE
+	static inline __m128i packClamp(__m128i lo, __m128i hi) {
+		return _mm_min_epi16(_mm_packs_epi32(lo, hi), _mm_set1_epi16(0xFF));
+	}
+};
+
+template <> struct Channels_SSE2<0xFFFF> {
+	static inline void load(const BYTE *p, __m128i& lo, __m128i& hi) {
+		lo = _mm_loadu_si128((const __m128i*)p);
+		hi = _mm_loadu_si128((const __m128i*)(p + 16));
+	}
+	static inline void store(BYTE *p, __m128i lo, __m128i hi) {
+		_mm_storeu_si128((__m128i*)p, lo);
+		_mm_storeu_si128((__m128i*)(p + 16), hi);
+	}
+	static inline __m128i div(__m128i x) {
+		x = _mm_add_epi32(x, _mm_set1_epi32(0x8000));
+		return _mm_srli_epi32(_mm_add_epi32(x, _mm_srli_epi32(x, 16)), 16);
+	}
+	static inline __m128i packClamp(__m128i lo, __m128i hi) {
+		const __m128i bias = _mm_set1_epi32(0x8000);
+		return _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(lo, bias), _mm_sub_epi32(hi, bias)), _mm_set1_epi16((short)0x8000));
+	}
+	// rounded a * b / 65535
+	static inline __m128i mulDiv(__m128i a, __m128i b) {
+		const __m128i lo = _mm_mullo_epi16(a, b);
+		const __m128i hi = _mm_mulhi_epu16(a, b);
+		return packClamp(div(_mm_unpacklo_epi16(lo, hi)), div(_mm_unpackhi_epi16(lo, hi)));
+	}
+	static inline __m128i addClamp(__m128i a, __m128i b) {
+		return _mm_adds_epu16(a, b);
+	}
+};
+
+/**
+Divide 4 color channels by their alpha, as MIN(MAX_VALUE, (float)c * MAX_VALUE / alpha + 0.5f), 0 when alpha is 0
+*/
+static inline __m128i
+Unpremultiply4_SSE2(__m128i c, __m128i a, __m128 max_value) {
+	const __m128 v = _mm_add_ps(_mm_div_ps(_mm_mul_ps(_mm_cvtepi32_ps(c), max_value), _mm_cvtepi32_ps(a)), _mm_set1_ps(0.5f));
+	return _mm_andnot_si128(_mm_cmpeq_epi32(a, _mm_setzero_si128()), _mm_cvttps_epi32(_mm_min_ps(v, max_value)));
+}
+
+/**
+Divide the color channels of 2 premultiplied pixels by their alpha
+*/
+template <int MAX_VALUE> static inline __m128i
+UnpremultiplyPixels2_SSE2(__m128i v, __m128i alpha_mask) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i a = BroadcastAlpha_SSE2(v);
+	const __m128 max_value = _mm_set1_ps((float)MAX_VALUE);
+	const __m128i lo = Unpremultiply4_SSE2(_mm_unpacklo_epi16(v, zero), _mm_unpacklo_epi16(a, zero), max_value);
+	const __m128i hi = Unpremultiply4_SSE2(_mm_unpackhi_epi16(v, zero), _mm_unpackhi_epi16(a, zero), max_value);
+	const __m128i c = Channels_SSE2<MAX_VALUE>::packClamp(lo, hi);
+	return _mm_or_si128(_mm_andnot_si128(alpha_mask, c), _mm_and_si128(alpha_mask, v));
+}
+
+template <int MAX_VALUE, BOOL premultiplied> static inline __m128i
+CompositePixels2_SSE2(__m128i s, __m128i d, const CompositeFactors_SSE2& f) {
+	typedef Channels_SSE2<MAX_VALUE> C;
+
+	const __m128i as = BroadcastAlpha_SSE2(s);
+	const __m128i ad = BroadcastAlpha_SSE2(d);
+	if(!premultiplied) {
+		// multiply the color channels by alpha and the alpha channel by MAX_VALUE
+		s = C::mulDiv(s, _mm_or_si128(_mm_andnot_si128(f.alpha_mask, as), _mm_and_si128(f.alpha_mask, f.max_value)));
+		d = C::mulDiv(d, _mm_or_si128(_mm_andnot_si128(f.alpha_mask, ad), _mm_and_si128(f.alpha_mask, f.max_value)));
+	}
+
+	const __m128i fa = _mm_xor_si128(_mm_and_si128(ad, f.src_and), f.src_xor);
+	const __m128i fb = _mm_xor_si128(_mm_and_si128(as, f.dst_and), f.dst_xor);
+	const __m128i o = C::addClamp(C::mulDiv(s, fa), C::mulDiv(d, fb));
+	if(premultiplied) {
+		return o;
+	}
+
+	return UnpremultiplyPixels2_SSE2<MAX_VALUE>(o, f.alpha_mask);
+}
+
+template <int MAX_VALUE, BOOL premultiplied> static int
+CompositeLine_SSE2(BYTE *target, const BYTE *source, int width, int src_factor, int dst_factor) {
+	typedef Channels_SSE2<MAX_VALUE> C;
+	const int bytespp = (MAX_VALUE == 0xFF) ? 4 : 8;
+	const CompositeFactors_SSE2 f(src_factor, dst_factor, MAX_VALUE);
+
+	int x = 0;
+	for(; x + 4 <= width; x += 4) {
+		__m128i s0, s1, d0, d1;
+		C::load(source + bytespp * x, s0, s1);
+		C::load(target + bytespp * x, d0, d1);
+		C::store(target + bytespp * x, CompositePixels2_SSE2<MAX_VALUE, premultiplied>(s0, d0, f), CompositePixels2_SSE2<MAX_VALUE, premultiplied>(s1, d1, f));
+	}
+	return x;
+}
+
+// ==========================================================
+//   SSE2 alpha channel kernels
+// ==========================================================
+
+/**
+Alpha lanes of 2 RGBA pixels held as 16-bit lanes
+*/
+static inline __m128i
+AlphaMask_SSE2() {
+	return _mm_slli_epi64(_mm_srli_epi64(_mm_set1_epi32(-1), 48), 16 * FI_RGBA_ALPHA);
+}
+
+/**
+Multiply the color channels by alpha, as (c * alpha + MAX_VALUE / 2) / MAX_VALUE. 
+The rounded division of Channels_SSE2::mulDiv gives the same result, c * alpha / MAX_VALUE never being 
+halfway between two integers.
+*/
+template <int MAX_VALUE> static int
+PreMultiplyLine_SSE2(BYTE *bits, int width) {
+	typedef Channels_SSE2<MAX_VALUE> C;
+	const int bytespp = (MAX_VALUE == 0xFF) ? 4 : 8;
+	const __m128i alpha_mask = AlphaMask_SSE2();
+	const __m128i max_alpha = _mm_and_si128(alpha_mask, _mm_set1_epi16((short)MAX_VALUE));
+
+	int x = 0;
+	for(; x + 4 <= width; x += 4) {
+		__m128i v0, v1;
+		C::load(bits + bytespp * x, v0, v1);
+		// the alpha channel is multiplied by MAX_VALUE
+		v0 = C::mulDiv(v0, _mm_or_si128(_mm_andnot_si128(alpha_mask, BroadcastAlpha_SSE2(v0)), max_alpha));
+		v1 = C::mulDiv(v1, _mm_or_si128(_mm_andnot_si128(alpha_mask, BroadcastAlpha_SSE2(v1)), max_alpha));
+		C::store(bits + bytespp * x, v0, v1);
+	}
+	return x;
+}
+
+template <int MAX_VALUE> static int
+UnPreMultiplyLine_SSE2(BYTE *bits, int width) {
+	typedef Channels_SSE2<MAX_VALUE> C;
+	const int bytespp = (MAX_VALUE == 0xFF) ? 4 : 8;
+	const __m128i alpha_mask = AlphaMask_SSE2();
+
+	int x = 0;
+	for(; x + 4 <= width; x += 4) {
+		__m128i v0, v1;
+		C::load(bits + bytespp * x, v0, v1);
+		C::store(bits + bytespp * x, UnpremultiplyPixels2_SSE2<MAX_VALUE>(v0, alpha_mask), UnpremultiplyPixels2_SSE2<MAX_VALUE>(v1, alpha_mask));
+	}
+	return x;
+}
+
+// FIRGBAF pixels, one pixel per vector
+
+static inline __m128
+AlphaMaskF_SSE2() {
+	return _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+}
+
+static int
+PreMultiplyLineF_SSE2(BYTE *bits, int width) {
+	float *pixels = (float*)bits;
+	const __m128 alpha_mask = AlphaMaskF_SSE2();
+
+	int x = 0;
+	for(; x + 2 <= width; x += 2) {
+		for(int k = 0; k < 2; k++) {
+			const __m128 v = _mm_loadu_ps(pixels + 4 * (x + k));
+			const __m128 c = _mm_mul_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)));
+			_mm_storeu_ps(pixels + 4 * (x + k), _mm_or_ps(_mm_andnot_ps(alpha_mask, c), _mm_and_ps(alpha_mask, v)));
+		}
+	}
+	return x;
+}
+
+static int
+UnPreMultiplyLineF_SSE2(BYTE *bits, int width) {
+	float *pixels = (float*)bits;
+	const __m128 alpha_mask = AlphaMaskF_SSE2();
+
+	int x = 0;
+	for(; x + 2 <= width; x += 2) {
+		for(int k = 0; k < 2; k++) {
+			const __m128 v = _mm_loadu_ps(pixels + 4 * (x + k));
+			const __m128 a = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+			const __m128 c = _mm_andnot_ps(_mm_cmpeq_ps(a, _mm_setzero_ps()), _mm_div_ps(v, a));
+			_mm_storeu_ps(pixels + 4 * (x + k), _mm_or_ps(_mm_andnot_ps(alpha_mask, c), _mm_and_ps(alpha_mask, v)));
+		}
+	}
+	return x;
+}
+
+/**
+Blend 32-bit foreground pixels with 32-bit background pixels, as FreeImage_Composite : 
+(alpha * fg + (255 - alpha) * bg) >> 8, the background for alpha == 0 and the foreground for alpha == 255. 
+Both special cases are handled by using 256 instead of 255 as the weight of the selected pixel. 
+The alpha channel of the target pixels is undefined.
+*/
+static inline __m128i
+BlendBackground2_SSE2(__m128i f, __m128i b) {
+	const __m128i a = BroadcastAlpha_SSE2(f);
+	const __m128i wf = _mm_sub_epi16(a, _mm_cmpeq_epi16(a, _mm_set1_epi16(0xFF)));
+	const __m128i wb = _mm_sub_epi16(_mm_sub_epi16(_mm_set1_epi16(0xFF), a), _mm_cmpeq_epi16(a, _mm_setzero_si128()));
+	return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(f, wf), _mm_mullo_epi16(b, wb)), 8);
+}
+
+static int
+BlendBackgroundLine_SSE2(BYTE *target, const BYTE *foreground, const BYTE *background, int width) {
+	typedef Channels_SSE2<0xFF> C;
+
+	int x = 0;
+	for(; x + 4 <= width; x += 4) {
+		__m128i f0, f1, b0, b1;
+		C::load(foreground + 4 * x, f0, f1);
+		C::load(background + 4 * x, b0, b1);
+		C::store(target + 4 * x, BlendBackground2_SSE2(f0, b0), BlendBackground2_SSE2(f1, b1));
+	}
+	return x;
+}
+
+/**
+Add weighted bytes to 32-bit sums. The weight being at most 256, the products fit in 16 bits.
+*/
+static int
+AccumulateLine_SSE2(DWORD *sums, const BYTE *source, int count, unsigned weight) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i w = _mm_set1_epi16((short)weight);
+
+	int i = 0;
+	for(; i + 16 <= count; i += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(source + i));
+		const __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), w);
+		const __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), w);
+		__m128i *s = (__m128i*)(sums + i);
+		_mm_storeu_si128(s + 0, _mm_add_epi32(_mm_loadu_si128(s + 0), _mm_unpacklo_epi16(lo, zero)));
+		_mm_storeu_si128(s + 1, _mm_add_epi32(_mm_loadu_si128(s + 1), _mm_unpackhi_epi16(lo, zero)));
+		_mm_storeu_si128(s + 2, _mm_add_epi32(_mm_loadu_si128(s + 2), _mm_unpacklo_epi16(hi, zero)));
+		_mm_storeu_si128(s + 3, _mm_add_epi32(_mm_loadu_si128(s + 3), _mm_unpackhi_epi16(hi, zero)));
+	}
+	return i;
+}
+
+/**
+Add weighted floats to float sums (a multiplication and an addition, as the scalar code)
+*/
+static int
+AccumulateLineF_SSE2(float *sums, const float *source, int count, float weight) {
+	const __m128 w = _mm_set1_ps(weight);
+
+	int i = 0;
+	for(; i + 8 <= count; i += 8) {
+		_mm_storeu_ps(sums + i, _mm_add_ps(_mm_loadu_ps(sums + i), _mm_mul_ps(_mm_loadu_ps(source + i), w)));
+		_mm_storeu_ps(sums + i + 4, _mm_add_ps(_mm_loadu_ps(sums + i + 4), _mm_mul_ps(_mm_loadu_ps(source + i + 4), w)));
+	}
+	return i;
+}
+
+/**
+Add the 16-bit samples of two lines, biased to signed values and multiplied by fixed point weights, 
+to 32-bit sums : the samples of both lines are interleaved and multiplied-added in pairs
+*/
+static int
+AccumulateLine16_SSE2(int *sums, const WORD *source0, const WORD *source1, int count, int weight0, int weight1) {
+	const __m128i bias = _mm_set1_epi16((short)0x8000);
+	const __m128i w = _mm_set1_epi32((int)(((unsigned)weight1 << 16) | ((unsigned)weight0 & 0xFFFF)));
+
+	int i = 0;
+	for(; i + 8 <= count; i += 8) {
+		const __m128i v0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(source0 + i)), bias);
+		const __m128i v1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(source1 + i)), bias);
+		__m128i *s = (__m128i*)(sums + i);
+		_mm_storeu_si128(s + 0, _mm_add_epi32(_mm_loadu_si128(s + 0), _mm_madd_epi16(_mm_unpacklo_epi16(v0, v1), w)));
+		_mm_storeu_si128(s + 1, _mm_add_epi32(_mm_loadu_si128(s + 1), _mm_madd_epi16(_mm_unpackhi_epi16(v0, v1), w)));
+	}
+	return i;
+}
+
+// ==========================================================
+//   SSE2 transposition and mirroring kernels
+// ==========================================================
+
+/**
+Transpose a 8x8 block of 8-bit pixels
+*/
+struct Transpose8x8_8_SSE2 {
+	enum { WIDTH = 8, HEIGHT = 8, BYTESPP = 1 };
+
+	static inline void
+	transpose(BYTE *dst, int dst_pitch, const BYTE *src, int src_pitch) {
+		const __m128i r0 = _mm_loadl_epi64((const __m128i*)(src));
+		const __m128i r1 = _mm_loadl_epi64((const __m128i*)(src + src_pitch));
+		const __m128i r2 = _mm_loadl_epi64((const __m128i*)(src + 2 * src_pitch));
+		const __m128i r3 = _mm_loadl_epi64((const __m128i*)(src + 3 * src_pitch));
+		const __m128i r4 = _mm_loadl_epi64((const __m128i*)(src + 4 * src_pitch));
+		const __m128i r5 = _mm_loadl_epi64((const __m128i*)(src + 5 * src_pitch));
+		const __m128i r6 = _mm_loadl_epi64((const __m128i*)(src + 6 * src_pitch));
+		const __m128i r7 = _mm_loadl_epi64((const __m128i*)(src + 7 * src_pitch));
+
+		// interleave lines by pairs, then by 4, then by 8
+		const __m128i t0 = _mm_unpacklo_epi8(r0, r1);
+		const __m128i t1 = _mm_unpacklo_epi8(r2, r3);
+		const __m128i t2 = _mm_unpacklo_epi8(r4, r5);
+		const __m128i t3 = _mm_unpacklo_epi8(r6, r7);
+		const __m128i u0 = _mm_unpacklo_epi16(t0, t1);
+		const __m128i u1 = _mm_unpackhi_epi16(t0, t1);
+		const __m128i u2 = _mm_unpacklo_epi16(t2, t3);
+		const __m128i u3 = _mm_unpackhi_epi16(t2, t3);
+		const __m128i c01 = _mm_unpacklo_epi32(u0, u2);
+		const __m128i c23 = _mm_unpackhi_epi32(u0, u2);
+		const __m128i c45 = _mm_unpacklo_epi32(u1, u3);
+		const __m128i c67 = _mm_unpackhi_epi32(u1, u3);
+
+		_mm_storel_epi64((__m128i*)(dst), c01);
+		_mm_storel_epi64((__m128i*)(dst + dst_pitch), _mm_unpackhi_epi64(c01, c01));
+		_mm_storel_epi64((__m128i*)(dst + 2 * dst_pitch), c23);
+		_mm_storel_epi64((__m128i*)(dst + 3 * dst_pitch), _mm_unpackhi_epi64(c23, c23));
+		_mm_storel_epi64((__m128i*)(dst + 4 * dst_pitch), c45);
+		_mm_storel_epi64((__m128i*)(dst + 5 * dst_pitch), _mm_unpackhi_epi64(c45, c45));
+		_mm_storel_epi64((__m128i*)(dst + 6 * dst_pitch), c67);
+		_mm_storel_epi64((__m128i*)(dst + 7 * dst_pitch), _mm_unpackhi_epi64(c67, c67));
+	}
+};
+
+/**
+Transpose a 8x8 block of 16-bit pixels
+*/
+struct Transpose8x8_16_SSE2 {
+	enum { WIDTH = 8, HEIGHT = 8, BYTESPP = 2 };
+
+	static inline void
+	transpose(BYTE *dst, int dst_pitch, const BYTE *src, int src_pitch) {
+		const __m128i r0 = _mm_loadu_si128((const __m128i*)(src));
+		const __m128i r1 = _mm_loadu_si128((const __m128i*)(src + src_pitch));
+		const __m128i r2 = _mm_loadu_si128((const __m128i*)(src + 2 * src_pitch));
+		const __m128i r3 = _mm_loadu_si128((const __m128i*)(src + 3 * src_pitch));
+		const __m128i r4 = _mm_loadu_si128((const __m128i*)(src + 4 * src_pitch));
+		const __m128i r5 = _mm_loadu_si128((const __m128i*)(src + 5 * src_pitch));
+		const __m128i r6 = _mm_loadu_si128((const __m128i*)(src + 6 * src_pitch));
+		const __m128i r7 = _mm_loadu_si128((const __m128i*)(src + 7 * src_pitch));
+
+		const __m128i t0 = _mm_unpacklo_epi16(r0, r1);
+		const __m128i t1 = _mm_unpackhi_epi16(r0, r1);
+		const __m128i t2 = _mm_unpacklo_epi16(r2, r3);
+		const __m128i t3 = _mm_unpackhi_epi16(r2, r3);
+		const __m128i t4 = _mm_unpacklo_epi16(r4, r5);
+		const __m128i t5 = _mm_unpackhi_epi16(r4, r5);
+		const __m128i t6 = _mm_unpacklo_epi16(r6, r7);
+		const __m128i t7 = _mm_unpackhi_epi16(r6, r7);
+		const __m128i u0 = _mm_unpacklo_epi32(t0, t2);
+		const __m128i u1 = _mm_unpackhi_epi32(t0, t2);
+		const __m128i u2 = _mm_unpacklo_epi32(t1, t3);
+		const __m128i u3 = _mm_unpackhi_epi32(t1, t3);
+		const __m128i u4 = _mm_unpacklo_epi32(t4, t6);
+		const __m128i u5 = _mm_unpackhi_epi32(t4, t6);
+		const __m128i u6 = _mm_unpacklo_epi32(t5, t7);
+		const __m128i u7 = _mm_unpackhi_epi32(t5, t7);
+
+		_mm_storeu_si128((__m128i*)(dst), _mm_unpacklo_epi64(u0, u4));
+		_mm_storeu_si128((__m128i*)(dst + dst_pitch), _mm_unpackhi_epi64(u0, u4));
+		_mm_storeu_si128((__m128i*)(dst + 2 * dst_pitch), _mm_unpacklo_epi64(u1, u5));
+		_mm_storeu_si128((__m128i*)(dst + 3 * dst_pitch), _mm_unpackhi_epi64(u1, u5));
+		_mm_storeu_si128((__m128i*)(dst + 4 * dst_pitch), _mm_unpacklo_epi64(u2, u6));
+		_mm_storeu_si128((__m128i*)(dst + 5 * dst_pitch), _mm_unpackhi_epi64(u2, u6));
+		_mm_storeu_si128((__m128i*)(dst + 6 * dst_pitch), _mm_unpacklo_epi64(u3, u7));
+		_mm_storeu_si128((__m128i*)(dst + 7 * dst_pitch), _mm_unpackhi_epi64(u3, u7));
+	}
+};
+
+/**
+Transpose a 4x4 block of 32-bit pixels
+*/
+struct Transpose4x4_32_SSE2 {
+	enum { WIDTH = 4, HEIGHT = 4, BYTESPP = 4 };
+
+	static inline void
+	transpose(BYTE *dst, int dst_pitch, const BYTE *src, int src_pitch) {
+		const __m128i r0 = _mm_loadu_si128((const __m128i*)(src));
+		const __m128i r1 = _mm_loadu_si128((const __m128i*)(src + src_pitch));
+		const __m128i r2 = _mm_loadu_si128((const __m128i*)(src + 2 * src_pitch));
+		const __m128i r3 = _mm_loadu_si128((const __m128i*)(src + 3 * src_pitch));
+
+		const __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+		const __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+		const __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+		const __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+		_mm_storeu_si128((__m128i*)(dst), _mm_unpacklo_epi64(t0, t1));
+		_mm_storeu_si128((__m128i*)(dst + dst_pitch), _mm_unpackhi_epi64(t0, t1));
+		_mm_storeu_si128((__m128i*)(dst + 2 * dst_pitch), _mm_unpacklo_epi64(t2, t3));
+		_mm_storeu_si128((__m128i*)(dst + 3 * dst_pitch), _mm_unpackhi_epi64(t2, t3));
+	}
+};
+
+/**
+Transpose a 2x2 block of 64-bit pixels
+*/
+struct Transpose2x2_64_SSE2 {
+	enum { WIDTH = 2, HEIGHT = 2, BYTESPP = 8 };
+
+	static inline void
+	transpose(BYTE *dst, int dst_pitch, const BYTE *src, int src_pitch) {
+		const __m128i r0 = _mm_loadu_si128((const __m128i*)(src));
+		const __m128i r1 = _mm_loadu_si128((const __m128i*)(src + src_pitch));
+
+		_mm_storeu_si128((__m128i*)(dst), _mm_unpacklo_epi64(r0, r1));
+		_mm_storeu_si128((__m128i*)(dst + dst_pitch), _mm_unpackhi_epi64(r0, r1));
+	}
+};
+
+/**
+Transpose the leading square blocks of a tile.
+Parameter Block is a structure with the block micro-kernel, the number of source columns (WIDTH) 
+and lines (HEIGHT) it transposes, and the size of the pixels. HEIGHT divides WIDTH.
+The blocks are walked down the columns, so that each destination line is written 
+from left to right instead of 16 bytes at a time across the whole tile.
+@return Returns the size of the square blocks (WIDTH)
+*/
+template <class Block> static int
+TransposeTile_SSE2(BYTE *dst, int dst_pitch, const BYTE *src, int src_pitch, int width, int height) {
+	const int lines = height - (height % Block::WIDTH);
+	for(int x = 0; x + Block::WIDTH <= width; x += Block::WIDTH) {
+		for(int y = 0; y < lines; y += Block::HEIGHT) {
+			Block::transpose(dst + (ptrdiff_t)x * dst_pitch + y * Block::BYTESPP, dst_pitch, src + (ptrdiff_t)y * src_pitch + x * Block::BYTESPP, src_pitch);
+		}
+	}
+	return Block::WIDTH;
+}
+
+/**
+Reverse the pixels of a line by 16 bytes, for the pixel sizes that divide 16
+*/
+template <int BYTESPP> static int
+ReverseLine_SSE2(BYTE *dst, const BYTE *src, int width) {
+	const int count = 16 / BYTESPP;
+
+	int x = 0;
+	for(; x + count <= width; x += count) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + x * BYTESPP));
+		switch(BYTESPP) {
+			case 1:
+				// swap the bytes of each word, then reverse the words
+				v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+			case 2:
+				// reverse the words of each half, then swap the halves
+				v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+				v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+			case 8:
+				v = _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+				break;
+			case 4:
+				v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+				break;
+		}
+		_mm_storeu_si128((__m128i*)(dst + (width - x - count) * BYTESPP), v);
+	}
+	return x;
+}
+
+#endif // FREEIMAGE_SSE2
+
+#if defined(FREEIMAGE_SSSE3)
+
+// ==========================================================
+//   SSSE3 kernels
+// ==========================================================
+
+/**
+Load 16 24-bit pixels (48 bytes) as 4 vectors of 32-bit pixels, the alpha byte is set to 0xFF
+*/
+FI_TARGET_SSSE3 static inline void
+Load24To32x16_SSSE3(const BYTE *source, __m128i& p0, __m128i& p1, __m128i& p2, __m128i& p3) {
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+	const __m128i v0 = _mm_loadu_si128((const __m128i*)source);
+	const __m128i v1 = _mm_loadu_si128((const __m128i*)(source + 16));
+	const __m128i v2 = _mm_loadu_si128((const __m128i*)(source + 32));
+	p0 = _mm_or_si128(_mm_shuffle_epi8(v0, shuffle), alpha);
+	p1 = _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(v1, v0, 12), shuffle), alpha);
+	p2 = _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(v2, v1, 8), shuffle), alpha);
+	p3 = _mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(v2, 4), shuffle), alpha);
+}
+
+/**
+Store 4 vectors of 32-bit pixels as 16 24-bit pixels (48 bytes)
+*/
+FI_TARGET_SSSE3 static inline void
+Store32To24x16_SSSE3(BYTE *target, __m128i p0, __m128i p1, __m128i p2, __m128i p3) {
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	p0 = _mm_shuffle_epi8(p0, shuffle);
+	p1 = _mm_shuffle_epi8(p1, shuffle);
+	p2 = _mm_shuffle_epi8(p2, shuffle);
+	p3 = _mm_shuffle_epi8(p3, shuffle);
+	_mm_storeu_si128((__m128i*)target, _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+	_mm_storeu_si128((__m128i*)(target + 16), _mm_or_si128(_mm_srli_si128(p1, 4), _mm_slli_si128(p2, 8)));
+	_mm_storeu_si128((__m128i*)(target + 32), _mm_or_si128(_mm_srli_si128(p2, 8), _mm_slli_si128(p3, 4)));
+}
+
+FI_TARGET_SSSE3 static int
+ConvertLine32To24_SSSE3(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		const __m128i *src = (const __m128i*)(source + 4 * cols);
+		Store32To24x16_SSSE3(target + 3 * cols, _mm_loadu_si128(src), _mm_loadu_si128(src + 1), _mm_loadu_si128(src + 2), _mm_loadu_si128(src + 3));
+	}
+	return cols;
+}
+
+FI_TARGET_SSSE3 static int
+ConvertLine24To32_SSSE3(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		__m128i p0, p1, p2, p3;
+		Load24To32x16_SSSE3(source + 3 * cols, p0, p1, p2, p3);
+		__m128i *dst = (__m128i*)(target + 4 * cols);
+		_mm_storeu_si128(dst, p0);
+		_mm_storeu_si128(dst + 1, p1);
+		_mm_storeu_si128(dst + 2, p2);
+		_mm_storeu_si128(dst + 3, p3);
+	}
+	return cols;
+}
+
+template <BOOL is565> FI_TARGET_SSSE3 static int
+ConvertLine16To24_SSSE3(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		__m128i p0, p1, p2, p3;
+		Expand16To32_SSE2<is565>(_mm_loadu_si128((const __m128i*)(source + 2 * cols)), p0, p1);
+		Expand16To32_SSE2<is565>(_mm_loadu_si128((const __m128i*)(source + 2 * cols + 16)), p2, p3);
+		Store32To24x16_SSSE3(target + 3 * cols, p0, p1, p2, p3);
+	}
+	return cols;
+}
+
+template <BOOL is565> FI_TARGET_SSSE3 static int
+ConvertLine24To16_SSSE3(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		__m128i p0, p1, p2, p3;
+		Load24To32x16_SSSE3(source + 3 * cols, p0, p1, p2, p3);
+		__m128i *dst = (__m128i*)(target + 2 * cols);
+		_mm_storeu_si128(dst, Narrow32To16_SSE2(Pack32To16_SSE2<is565>(p0), Pack32To16_SSE2<is565>(p1)));
+		_mm_storeu_si128(dst + 1, Narrow32To16_SSE2(Pack32To16_SSE2<is565>(p2), Pack32To16_SSE2<is565>(p3)));
+	}
+	return cols;
+}
+
+FI_TARGET_SSSE3 static int
+ConvertLine24To8_SSSE3(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		__m128i p0, p1, p2, p3;
+		Load24To32x16_SSSE3(source + 3 * cols, p0, p1, p2, p3);
+		StoreGrey16_SSE2(target + cols, p0, p1, p2, p3);
+	}
+	return cols;
+}
+
+/**
+Reverse the pixels of a line by 16 bytes with a byte shuffle, for the 1- and 2-byte pixels
+*/
+template <int BYTESPP> FI_TARGET_SSSE3 static int
+ReverseLine_SSSE3(BYTE *dst, const BYTE *src, int width) {
+	const int count = 16 / BYTESPP;
+	const __m128i shuffle = (BYTESPP == 1) ?
+		_mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0) :
+		_mm_setr_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+
+	int x = 0;
+	for(; x + count <= width; x += count) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(src + x * BYTESPP));
+		_mm_storeu_si128((__m128i*)(dst + (width - x - count) * BYTESPP), _mm_shuffle_epi8(v, shuffle));
+	}
+	return x;
+}
+
+/**
+Reverse the pixels of a line by 48 bytes, for the 3-, 6- and 12-byte pixels : each 16 bytes
+of a reversed block gather bytes of up to two of the three 16 bytes of the source block
+*/
+template <int BYTESPP> FI_TARGET_SSSE3 static int
+ReverseLine48_SSSE3(BYTE *dst, const BYTE *src, int width) {
+	const int count = 48 / BYTESPP;
+	if(width < count) {
+		return 0;
+	}
+
+	// shuffle[k][j] moves the bytes of the source vector j that belong to the reversed vector k
+	__m128i shuffle[3][3];
+	for(int k = 0; k < 3; k++) {
+		for(int j = 0; j < 3; j++) {
+			BYTE mask[16];
+			for(int b = 0; b < 16; b++) {
+				const int i = 16 * k + b;
+				const int s = 48 - BYTESPP * (i / BYTESPP + 1) + i % BYTESPP;
+				mask[b] = ((s >> 4) == j) ? (BYTE)(s & 15) : 0x80;
+			}
+			shuffle[k][j] = _mm_loadu_si128((const __m128i*)mask);
+		}
+	}
+
+	int x = 0;
+	for(; x + count <= width; x += count) {
+		const __m128i *s = (const __m128i*)(src + x * BYTESPP);
+		const __m128i v0 = _mm_loadu_si128(s);
+		const __m128i v1 = _mm_loadu_si128(s + 1);
+		const __m128i v2 = _mm_loadu_si128(s + 2);
+		__m128i *d = (__m128i*)(dst + (width - x - count) * BYTESPP);
+		for(int k = 0; k < 3; k++) {
+			const __m128i v = _mm_or_si128(_mm_shuffle_epi8(v0, shuffle[k][0]), _mm_shuffle_epi8(v1, shuffle[k][1]));
+			_mm_storeu_si128(d + k, _mm_or_si128(v, _mm_shuffle_epi8(v2, shuffle[k][2])));
+		}
+	}
+	return x;
+}
+
+#endif // FREEIMAGE_SSSE3
+
+#if defined(FREEIMAGE_AVX2)
+
+// ==========================================================
+//   AVX2 kernels
+// ==========================================================
+
+// The byte shuffles work inside each 128-bit lane, 24-bit pixels are therefore loaded and stored
+// 12 bytes per lane, with 16-byte (load) and 32-byte (store) accesses that stay inside the line.
+
+FI_TARGET_AVX2 static inline __m256i
+Expand5_AVX2(__m256i v) {
+	return _mm256_srli_epi16(_mm256_mullo_epi16(v, _mm256_set1_epi16(1053)), 7);
+}
+
+FI_TARGET_AVX2 static inline __m256i
+Expand6_AVX2(__m256i v) {
+	return _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(v, _mm256_set1_epi16(259)), _mm256_set1_epi16(3)), 6);
+}
+
+/**
+Expand 16 RGB 555 or RGB 565 pixels to 16 32-bit pixels with an opaque alpha channel
+*/
+template <BOOL is565> FI_TARGET_AVX2 static inline void
+Expand16To32_AVX2(__m256i v, __m256i& lo, __m256i& hi) {
+	__m256i r, g, b;
+	if(is565) {
+		r = Expand5_AVX2(_mm256_srli_epi16(v, FI16_565_RED_SHIFT));
+		g = Expand6_AVX2(_mm256_and_si256(_mm256_srli_epi16(v, FI16_565_GREEN_SHIFT), _mm256_set1_epi16(0x3F)));
+		b = Expand5_AVX2(_mm256_and_si256(v, _mm256_set1_epi16(0x1F)));
+	} else {
+		r = Expand5_AVX2(_mm256_and_si256(_mm256_srli_epi16(v, FI16_555_RED_SHIFT), _mm256_set1_epi16(0x1F)));
+		g = Expand5_AVX2(_mm256_and_si256(_mm256_srli_epi16(v, FI16_555_GREEN_SHIFT), _mm256_set1_epi16(0x1F)));
+		b = Expand5_AVX2(_mm256_and_si256(v, _mm256_set1_epi16(0x1F)));
+	}
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+	const __m256i c0 = b, c2 = r;
+#else
+	const __m256i c0 = r, c2 = b;
+#endif
+	const __m256i c01 = _mm256_or_si256(c0, _mm256_slli_epi16(g, 8));
+	const __m256i c23 = _mm256_or_si256(c2, _mm256_set1_epi16((short)0xFF00));
+	// the unpacks interleave each lane : put pixels 0-7 in 'lo' and 8-15 in 'hi'
+	const __m256i u0 = _mm256_unpacklo_epi16(c01, c23);
+	const __m256i u1 = _mm256_unpackhi_epi16(c01, c23);
+	lo = _mm256_permute2x128_si256(u0, u1, 0x20);
+	hi = _mm256_permute2x128_si256(u0, u1, 0x31);
+}
+
+template <BOOL is565> FI_TARGET_AVX2 static inline __m256i
+Pack32To16_AVX2(__m256i p) {
+	const __m256i r = _mm256_srli_epi32(p, FI_SHIFT_RED + 3);
+	const __m256i b = _mm256_srli_epi32(p, FI_SHIFT_BLUE + 3);
+	if(is565) {
+		const __m256i g = _mm256_srli_epi32(p, FI_SHIFT_GREEN + 2);
+		return _mm256_or_si256(_mm256_or_si256(
+			_mm256_and_si256(_mm256_slli_epi32(r, FI16_565_RED_SHIFT), _mm256_set1_epi32(FI16_565_RED_MASK)),
+			_mm256_and_si256(_mm256_slli_epi32(g, FI16_565_GREEN_SHIFT), _mm256_set1_epi32(FI16_565_GREEN_MASK))),
+			_mm256_and_si256(b, _mm256_set1_epi32(FI16_565_BLUE_MASK)));
+	} else {
+		const __m256i g = _mm256_srli_epi32(p, FI_SHIFT_GREEN + 3);
+		return _mm256_or_si256(_mm256_or_si256(
+			_mm256_and_si256(_mm256_slli_epi32(r, FI16_555_RED_SHIFT), _mm256_set1_epi32(FI16_555_RED_MASK)),
+			_mm256_and_si256(_mm256_slli_epi32(g, FI16_555_GREEN_SHIFT), _mm256_set1_epi32(FI16_555_GREEN_MASK))),
+			_mm256_and_si256(b, _mm256_set1_epi32(FI16_555_BLUE_MASK)));
+	}
+}
+
+/**
+Narrow two vectors of 8 16-bit values held in 32-bit lanes to a vector of 16 words, in pixel order
+*/
+FI_TARGET_AVX2 static inline __m256i
+Narrow32To16_AVX2(__m256i a, __m256i b) {
+	a = _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16);
+	b = _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16);
+	return _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+}
+
+FI_TARGET_AVX2 static inline __m256i
+Grey32_AVX2(__m256i p) {
+	const __m256i mask = _mm256_set1_epi32(0xFF);
+	const __m256 r = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(p, FI_SHIFT_RED), mask));
+	const __m256 g = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(p, FI_SHIFT_GREEN), mask));
+	const __m256 b = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(p, FI_SHIFT_BLUE), mask));
+	__m256 y = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(0.2126F), r), _mm256_mul_ps(_mm256_set1_ps(0.7152F), g));
+	y = _mm256_add_ps(y, _mm256_mul_ps(_mm256_set1_ps(0.0722F), b));
+	return _mm256_cvttps_epi32(_mm256_add_ps(y, _mm256_set1_ps(0.5F)));
+}
+
+FI_TARGET_AVX2 static inline void
+StoreGrey32_AVX2(BYTE *target, __m256i p0, __m256i p1, __m256i p2, __m256i p3) {
+	const __m256i y01 = _mm256_packs_epi32(Grey32_AVX2(p0), Grey32_AVX2(p1));
+	const __m256i y23 = _mm256_packs_epi32(Grey32_AVX2(p2), Grey32_AVX2(p3));
+	const __m256i y = _mm256_packus_epi16(y01, y23);
+	// the packs interleave the lanes : restore the pixel order of the 4-pixel groups
+	_mm256_storeu_si256((__m256i*)target, _mm256_permutevar8x32_epi32(y, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7)));
+}
+
+/**
+Load 8 24-bit pixels as 32-bit pixels with an opaque alpha, reads 28 bytes
+*/
+FI_TARGET_AVX2 static inline __m256i
+Load24To32x8_AVX2(const BYTE *source) {
+	const __m256i shuffle = _mm256_setr_epi8(
+		0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+		0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m256i v = _mm256_inserti128_si256(
+		_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)source)),
+		_mm_loadu_si128((const __m128i*)(source + 12)), 1);
+	return _mm256_or_si256(_mm256_shuffle_epi8(v, shuffle), _mm256_set1_epi32((int)0xFF000000));
+}
+
+/**
+Store 8 32-bit pixels as 24-bit pixels, writes 32 bytes (the last 8 bytes are garbage)
+*/
+FI_TARGET_AVX2 static inline void
+Store32To24x8_AVX2(BYTE *target, __m256i p) {
+	const __m256i shuffle = _mm256_setr_epi8(
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+		0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	const __m256i v = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(p, shuffle), _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+	_mm256_storeu_si256((__m256i*)target, v);
+}
+
+// number of pixels that must remain in the line when loading (resp. storing) 8 24-bit pixels
+#define FI_AVX2_LOAD24_PIXELS	10
+#define FI_AVX2_STORE24_PIXELS	11
+
+FI_TARGET_AVX2 static int
+ConvertLine32To24_AVX2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 + (FI_AVX2_STORE24_PIXELS - 8) <= width_in_pixels; cols += 16) {
+		const __m256i *src = (const __m256i*)(source + 4 * cols);
+		Store32To24x8_AVX2(target + 3 * cols, _mm256_loadu_si256(src));
+		Store32To24x8_AVX2(target + 3 * cols + 24, _mm256_loadu_si256(src + 1));
+	}
+	_mm256_zeroupper();
+	return cols;
+}
+
+FI_TARGET_AVX2 static int
+ConvertLine24To32_AVX2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 + (FI_AVX2_LOAD24_PIXELS - 8) <= width_in_pixels; cols += 16) {
+		__m256i *dst = (__m256i*)(target + 4 * cols);
+		_mm256_storeu_si256(dst, Load24To32x8_AVX2(source + 3 * cols));
+		_mm256_storeu_si256(dst + 1, Load24To32x8_AVX2(source + 3 * cols + 24));
+	}
+	_mm256_zeroupper();
+	return cols;
+}
+
+template <BOOL is565> FI_TARGET_AVX2 static int
+ConvertLine16To24_AVX2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 + (FI_AVX2_STORE24_PIXELS - 8) <= width_in_pixels; cols += 16) {
+		__m256i lo, hi;
+		Expand16To32_AVX2<is565>(_mm256_loadu_si256((const __m256i*)(source + 2 * cols)), lo, hi);
+		Store32To24x8_AVX2(target + 3 * cols, lo);
+		Store32To24x8_AVX2(target + 3 * cols + 24, hi);
+	}
+	_mm256_zeroupper();
+	return cols;
+}
+
+template <BOOL is565> FI_TARGET_AVX2 static int
+ConvertLine16To32_AVX2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		__m256i lo, hi;
+		Expand16To32_AVX2<is565>(_mm256_loadu_si256((const __m256i*)(source + 2 * cols)), lo, hi);
+		_mm256_storeu_si256((__m256i*)(target + 4 * cols), lo);
+		_mm256_storeu_si256((__m256i*)(target + 4 * cols + 32), hi);
+	}
+	_mm256_zeroupper();
+	return cols;
+}
+
+template <BOOL is565> FI_TARGET_AVX2 static int
+ConvertLine24To16_AVX2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 + (FI_AVX2_LOAD24_PIXELS - 8) <= width_in_pixels; cols += 16) {
+		const __m256i a = Pack32To16_AVX2<is565>(Load24To32x8_AVX2(source + 3 * cols));
+		const __m256i b = Pack32To16_AVX2<is565>(Load24To32x8_AVX2(source + 3 * cols + 24));
+		_mm256_storeu_si256((__m256i*)(target + 2 * cols), Narrow32To16_AVX2(a, b));
+	}
+	_mm256_zeroupper();
+	return cols;
+}
+
+template <BOOL is565> FI_TARGET_AVX2 static int
+ConvertLine32To16_AVX2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		const __m256i *src = (const __m256i*)(source + 4 * cols);
+		const __m256i a = Pack32To16_AVX2<is565>(_mm256_loadu_si256(src));
+		const __m256i b = Pack32To16_AVX2<is565>(_mm256_loadu_si256(src + 1));
+		_mm256_storeu_si256((__m256i*)(target + 2 * cols), Narrow32To16_AVX2(a, b));
+	}
+	_mm256_zeroupper();
+	return cols;
+}
+
+FI_TARGET_AVX2 static int
+ConvertLine16_565_To16_555_AVX2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	const __m256i mask5 = _mm256_set1_epi16(0x1F);
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		const __m256i v = _mm256_loadu_si256((const __m256i*)(source + 2 * cols));
+		const __m256i r = _mm256_srli_epi16(Expand5_AVX2(_mm256_srli_epi16(v, FI16_565_RED_SHIFT)), 3);
+		const __m256i g = _mm256_srli_epi16(Expand6_AVX2(_mm256_and_si256(_mm256_srli_epi16(v, FI16_565_GREEN_SHIFT), _mm256_set1_epi16(0x3F))), 3);
+		const __m256i b = _mm256_srli_epi16(Expand5_AVX2(_mm256_and_si256(v, mask5)), 3);
+		const __m256i w = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi16(r, FI16_555_RED_SHIFT), _mm256_slli_epi16(g, FI16_555_GREEN_SHIFT)), b);
+		_mm256_storeu_si256((__m256i*)(target + 2 * cols), w);
+	}
+	_mm256_zeroupper();
+	return cols;
+}
+
+FI_TARGET_AVX2 static int
+ConvertLine16_555_To16_565_AVX2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	const __m256i mask5 = _mm256_set1_epi16(0x1F);
+	int cols = 0;
+	for(; cols + 16 <= width_in_pixels; cols += 16) {
+		const __m256i v = _mm256_loadu_si256((const __m256i*)(source + 2 * cols));
+		const __m256i r = _mm256_srli_epi16(Expand5_AVX2(_mm256_and_si256(_mm256_srli_epi16(v, FI16_555_RED_SHIFT), mask5)), 3);
+		const __m256i g = _mm256_srli_epi16(Expand5_AVX2(_mm256_and_si256(_mm256_srli_epi16(v, FI16_555_GREEN_SHIFT), mask5)), 2);
+		const __m256i b = _mm256_srli_epi16(Expand5_AVX2(_mm256_and_si256(v, mask5)), 3);
+		const __m256i w = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi16(r, FI16_565_RED_SHIFT), _mm256_slli_epi16(g, FI16_565_GREEN_SHIFT)), b);
+		_mm256_storeu_si256((__m256i*)(target + 2 * cols), w);
+	}
+	_mm256_zeroupper();
+	return cols;
+}
+
+FI_TARGET_AVX2 static int
+ConvertLine24To8_AVX2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 32 + (FI_AVX2_LOAD24_PIXELS - 8) <= width_in_pixels; cols += 32) {
+		const BYTE *src = source + 3 * cols;
+		StoreGrey32_AVX2(target + cols, Load24To32x8_AVX2(src), Load24To32x8_AVX2(src + 24), Load24To32x8_AVX2(src + 48), Load24To32x8_AVX2(src + 72));
+	}
+	_mm256_zeroupper();
+	return cols;
+}
+
+FI_TARGET_AVX2 static int
+ConvertLine32To8_AVX2(BYTE *target, const BYTE *source, int width_in_pixels) {
+	int cols = 0;
+	for(; cols + 32 <= width_in_pixels; cols += 32) {
+		const __m256i *src = (const __m256i*)(source + 4 * cols);
+		StoreGrey32_AVX2(target + cols, _mm256_loadu_si256(src), _mm256_loadu_si256(src + 1), _mm256_loadu_si256(src + 2), _mm256_loadu_si256(src + 3));
+	}
+	_mm256_zeroupper();
+	return cols;
+}
+
+// ==========================================================
+//   AVX2 greyscale sample kernels
+// ==========================================================
+
+template <class T> struct Samples_AVX2;
+
+template <> struct Samples_AVX2<WORD> {
+	typedef __m256i V;
+	FI_TARGET_AVX2 static inline V set1(WORD v) { return _mm256_set1_epi16((short)v); }
+	FI_TARGET_AVX2 static inline V load(const WORD *p) { return _mm256_loadu_si256((const __m256i*)p); }
+	FI_TARGET_AVX2 static inline void store(WORD *p, V v) { _mm256_storeu_si256((__m256i*)p, v); }
+	FI_TARGET_AVX2 static inline V min(V a, V b) { return _mm256_min_epu16(a, b); }
+	FI_TARGET_AVX2 static inline V max(V a, V b) { return _mm256_max_epu16(a, b); }
+	FI_TARGET_AVX2 static inline __m256d diff4(const WORD *p, double low) {
+		const __m128i v = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)p));
+		return _mm256_cvtepi32_pd(_mm_sub_epi32(v, _mm_set1_epi32((int)low)));
+	}
+};
+
+template <> struct Samples_AVX2<short> {
+	typedef __m256i V;
+	FI_TARGET_AVX2 static inline V set1(short v) { return _mm256_set1_epi16(v); }
+	FI_TARGET_AVX2 static inline V load(const short *p) { return _mm256_loadu_si256((const __m256i*)p); }
+	FI_TARGET_AVX2 static inline void store(short *p, V v) { _mm256_storeu_si256((__m256i*)p, v); }
+	FI_TARGET_AVX2 static inline V min(V a, V b) { return _mm256_min_epi16(a, b); }
+	FI_TARGET_AVX2 static inline V max(V a, V b) { return _mm256_max_epi16(a, b); }
+	FI_TARGET_AVX2 static inline __m256d diff4(const short *p, double low) {
+		const __m128i v = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*)p));
+		return _mm256_cvtepi32_pd(_mm_sub_epi32(v, _mm_set1_epi32((int)low)));
+	}
+};
+
+template <> struct Samples_AVX2<DWORD> {
+	typedef __m256i V;
+	FI_TARGET_AVX2 static inline V set1(DWORD v) { return _mm256_set1_epi32((int)v); }
+	FI_TARGET_AVX2 static inline V load(const DWORD *p) { return _mm256_loadu_si256((const __m256i*)p); }
+	FI_TARGET_AVX2 static inline void store(DWORD *p, V v) { _mm256_storeu_si256((__m256i*)p, v); }
+	FI_TARGET_AVX2 static inline V min(V a, V b) { return _mm256_min_epu32(a, b); }
+	FI_TARGET_AVX2 static inline V max(V a, V b) { return _mm256_max_epu32(a, b); }
+	FI_TARGET_AVX2 static inline __m256d diff4(const DWORD *p, double low) {
+		// (v ^ 0x80000000) as a signed value, plus 2^31
+		const __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)p), _mm_set1_epi32((int)0x80000000));
+		return _mm256_sub_pd(_mm256_add_pd(_mm256_cvtepi32_pd(v), _mm256_set1_pd(2147483648.0)), _mm256_set1_pd(low));
+	}
+};
+
+template <> struct Samples_AVX2<LONG> {
+	typedef __m256i V;
+	FI_TARGET_AVX2 static inline V set1(LONG v) { return _mm256_set1_epi32((int)v); }
+	FI_TARGET_AVX2 static inline V load(const LONG *p) { return _mm256_loadu_si256((const __m256i*)p); }
+	FI_TARGET_AVX2 static inline void store(LONG *p, V v) { _mm256_storeu_si256((__m256i*)p, v); }
+	FI_TARGET_AVX2 static inline V min(V a, V b) { return _mm256_min_epi32(a, b); }
+	FI_TARGET_AVX2 static inline V max(V a, V b) { return _mm256_max_epi32(a, b); }
+	FI_TARGET_AVX2 static inline __m256d diff4(const LONG *p, double low) {
+		return _mm256_sub_pd(_mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)p)), _mm256_set1_pd(low));
+	}
+};
+
+template <> struct Samples_AVX2<float> {
+	typedef __m256 V;
+	FI_TARGET_AVX2 static inline V set1(float v) { return _mm256_set1_ps(v); }
+	FI_TARGET_AVX2 static inline V load(const float *p) { return _mm256_loadu_ps(p); }
+	FI_TARGET_AVX2 static inline void store(float *p, V v) { _mm256_storeu_ps(p, v); }
+	// the second operand is returned when the first one is NaN
+	FI_TARGET_AVX2 static inline V min(V a, V b) { return _mm256_min_ps(a, b); }
+	FI_TARGET_AVX2 static inline V max(V a, V b) { return _mm256_max_ps(a, b); }
+	FI_TARGET_AVX2 static inline __m256d diff4(const float *p, double low) {
+		return _mm256_cvtps_pd(_mm_sub_ps(_mm_loadu_ps(p), _mm_set1_ps((float)low)));
+	}
+};
+
+template <> struct Samples_AVX2<double> {
+	typedef __m256d V;
+	FI_TARGET_AVX2 static inline V set1(double v) { return _mm256_set1_pd(v); }
+	FI_TARGET_AVX2 static inline V load(const double *p) { return _mm256_loadu_pd(p); }
+	FI_TARGET_AVX2 static inline void store(double *p, V v) { _mm256_storeu_pd(p, v); }
+	FI_TARGET_AVX2 static inline V min(V a, V b) { return _mm256_min_pd(a, b); }
+	FI_TARGET_AVX2 static inline V max(V a, V b) { return _mm256_max_pd(a, b); }
+	FI_TARGET_AVX2 static inline __m256d diff4(const double *p, double low) {
+		return _mm256_sub_pd(load(p), _mm256_set1_pd(low));
+	}
+};
+
+template <class T> FI_TARGET_AVX2 static int
+FindMinMaxLine_AVX2(const BYTE *source, int width, double& min, double& max) {
+	typedef Samples_AVX2<T> S;
+	const int count = sizeof(typename S::V) / sizeof(T);
+	const T *src = (const T*)source;
+
+	typename S::V vmin = S::set1((T)min);
+	typename S::V vmax = S::set1((T)max);
+	int x = 0;
+	for(; x + count <= width; x += count) {
+		const typename S::V v = S::load(src + x);
+		vmin = S::min(v, vmin);
+		vmax = S::max(v, vmax);
+	}
+
+	T lanes_min[sizeof(typename S::V) / sizeof(T)];
+	T lanes_max[sizeof(typename S::V) / sizeof(T)];
+	S::store(lanes_min, vmin);
+	S::store(lanes_max, vmax);
+	_mm256_zeroupper();
+	MergeMinMax(lanes_min, lanes_max, count, min, max);
+	return x;
+}
+
+/**
+AVX2 version of Round4_SSE2
+*/
+FI_TARGET_AVX2 static inline __m128i
+Round4_AVX2(__m256d d, __m256d scale) {
+	d = _mm256_add_pd(_mm256_mul_pd(d, scale), _mm256_set1_pd(0.5));
+	d = _mm256_min_pd(_mm256_max_pd(d, _mm256_setzero_pd()), _mm256_set1_pd(255));
+	return _mm256_cvttpd_epi32(d);
+}
+
+template <class T> FI_TARGET_AVX2 static int
+ScaleLineToByte_AVX2(BYTE *target, const BYTE *source, int width, double low, double scale) {
+	const T *src = (const T*)source;
+	const __m256d vscale = _mm256_set1_pd(scale);
+	int x = 0;
+	for(; x + 16 <= width; x += 16) {
+		const __m128i q0 = Round4_AVX2(Samples_AVX2<T>::diff4(src + x, low), vscale);
+		const __m128i q1 = Round4_AVX2(Samples_AVX2<T>::diff4(src + x + 4, low), vscale);
+		const __m128i q2 = Round4_AVX2(Samples_AVX2<T>::diff4(src + x + 8, low), vscale);
+		const __m128i q3 = Round4_AVX2(Samples_AVX2<T>::diff4(src + x + 12, low), vscale);
+		_mm_storeu_si128((__m128i*)(target + x), _mm_packus_epi16(_mm_packs_epi32(q0, q1), _mm_packs_epi32(q2, q3)));
+	}
+	_mm256_zeroupper();
+	return x;
+}
+
+// ==========================================================
+//   AVX2 compositing kernels
+// ==========================================================
+
+// AVX2 versions of the SSE2 compositing kernels, 4 pixels per vector.
+// Unpacking and packing work inside each 128-bit lane and keep the order of the pixels.
+
+struct CompositeFactors_AVX2 {
+	__m256i src_and, src_xor;
+	__m256i dst_and, dst_xor;
+	__m256i alpha_mask;
+	__m256i max_value;
+
+	FI_TARGET_AVX2 CompositeFactors_AVX2(int src_factor, int dst_factor, int max) {
+		src_and = _mm256_set1_epi16((src_factor & 2) ? -1 : 0);
+		src_xor = _mm256_set1_epi16((short)((src_factor & 1) ? max : 0));
+		dst_and = _mm256_set1_epi16((dst_factor & 2) ? -1 : 0);
+		dst_xor = _mm256_set1_epi16((short)((dst_factor & 1) ? max : 0));
+		alpha_mask = _mm256_slli_epi64(_mm256_srli_epi64(_mm256_set1_epi32(-1), 48), 16 * FI_RGBA_ALPHA);
+		max_value = _mm256_set1_epi16((short)max);
+	}
+};
+
+FI_TARGET_AVX2 static inline __m256i
+BroadcastAlpha_AVX2(__m256i v) {
+	const int alpha = _MM_SHUFFLE(FI_RGBA_ALPHA, FI_RGBA_ALPHA, FI_RGBA_ALPHA, FI_RGBA_ALPHA);
+	return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, alpha), alpha);
+}
+
+template <int MAX_VALUE> struct Channels_AVX2;
+
+template <> struct Channels_AVX2<0xFF> {
+	FI_TARGET_AVX2 static inline void load(const BYTE *p, __m256i& lo, __m256i& hi) {
+		const __m256i v = _mm256_loadu_si256((const __m256i*)p);
+		lo = _mm256_unpacklo_epi8(v, _mm256_setzero_si256());
+		hi = _mm256_unpackhi_epi8(v, _mm256_setzero_si256());
+	}
+	FI_TARGET_AVX2 static inline void store(BYTE *p, __m256i lo, __m256i hi) {
+		_mm256_storeu_si256((__m256i*)p, _mm256_packus_epi16(lo, hi));
+	}
+	FI_TARGET_AVX2 static inline __m256i mulDiv(__m256i a, __m256i b) {
+		const __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(a, b), _mm256_set1_epi16(128));
+		return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+	}
+	FI_TARGET_AVX2 static inline __m256i addClamp(__m256i a, __m256i b) {
+		return _mm256_min_epi16(_mm256_add_epi16(a, b), _mm256_set1_epi16(0xFF));
+	}
+	FI_TARGET_AVX2 static inline __m256i packClamp(__m256i lo, __m256i hi) {
+		return _mm256_min_epi16(_mm256_packs_epi32(lo, hi), _mm256_set1_epi16(0xFF));
+	}
+};
+
+template <> struct Channels_AVX2<0xFFFF> {
+	FI_TARGET_AVX2 static inline void load(const BYTE *p, __m256i& lo, __m256i& hi) {
+		lo = _mm256_loadu_si256((const __m256i*)p);
+		hi = _mm256_loadu_si256((const __m256i*)(p + 32));
+	}
+	FI_TARGET_AVX2 static inline void store(BYTE *p, __m256i lo, __m256i hi) {
+		_mm256_storeu_si256((__m256i*)p, lo);
+		_mm256_storeu_si256((__m256i*)(p + 32), hi);
+	}
+	FI_TARGET_AVX2 static inline __m256i div(__m256i x) {
+		x = _mm256_add_epi32(x, _mm256_set1_epi32(0x8000));
+		return _mm256_srli_epi32(_mm256_add_epi32(x, _mm256_srli_epi32(x, 16)), 16);
+	}
+	FI_TARGET_AVX2 static inline __m256i packClamp(__m256i lo, __m256i hi) {
+		return _mm256_packus_epi32(lo, hi);
+	}
+	FI_TARGET_AVX2 static inline __m256i mulDiv(__m256i a, __m256i b) {
+		const __m256i lo = _mm256_mullo_epi16(a, b);
+		const __m256i hi = _mm256_mulhi_epu16(a, b);
+		return packClamp(div(_mm256_unpacklo_epi16(lo, hi)), div(_mm256_unpackhi_epi16(lo, hi)));
+	}
+	FI_TARGET_AVX2 static inline __m256i addClamp(__m256i a, __m256i b) {
+		return _mm256_adds_epu16(a, b);
+	}
+};
+
+FI_TARGET_AVX2 static inline __m256i
+Unpremultiply8_AVX2(__m256i c, __m256i a, __m256 max_value) {
+	const __m256 v = _mm256_add_ps(_mm256_div_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(c), max_value), _mm256_cvtepi32_ps(a)), _mm256_set1_ps(0.5f));
+	return _mm256_andnot_si256(_mm256_cmpeq_epi32(a, _mm256_setzero_si256()), _mm256_cvttps_epi32(_mm256_min_ps(v, max_value)));
+}
+
+template <int MAX_VALUE> FI_TARGET_AVX2 static inline __m256i
+UnpremultiplyPixels4_AVX2(__m256i v, __m256i alpha_mask) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i a = BroadcastAlpha_AVX2(v);
+	const __m256 max_value = _mm256_set1_ps((float)MAX_VALUE);
+	const __m256i lo = Unpremultiply8_AVX2(_mm256_unpacklo_epi16(v, zero), _mm256_unpacklo_epi16(a, zero), max_value);
+	const __m256i hi = Unpremultiply8_AVX2(_mm256_unpackhi_epi16(v, zero), _mm256_unpackhi_epi16(a, zero), max_value);
+	const __m256i c = Channels_AVX2<MAX_VALUE>::packClamp(lo, hi);
+	return _mm256_or_si256(_mm256_andnot_si256(alpha_mask, c), _mm256_and_si256(alpha_mask, v));
+}
+
+template <int MAX_VALUE, BOOL premultiplied> FI_TARGET_AVX2 static inline __m256i
+CompositePixels4_AVX2(__m256i s, __m256i d, const CompositeFactors_AVX2& f) {
+	typedef Channels_AVX2<MAX_VALUE> C;
+
+	const __m256i as = BroadcastAlpha_AVX2(s);
+	const __m256i ad = BroadcastAlpha_AVX2(d);
+	if(!premultiplied) {
+		s = C::mulDiv(s, _mm256_or_si256(_mm256_andnot_si256(f.alpha_mask, as), _mm256_and_si256(f.alpha_mask, f.max_value)));
+		d = C::mulDiv(d, _mm256_or_si256(_mm256_andnot_si256(f.alpha_mask, ad), _mm256_and_si256(f.alpha_mask, f.max_value)));
+	}
+
+	const __m256i fa = _mm256_xor_si256(_mm256_and_si256(ad, f.src_and), f.src_xor);
+	const __m256i fb = _mm256_xor_si256(_mm256_and_si256(as, f.dst_and), f.dst_xor);
+	const __m256i o = C::addClamp(C::mulDiv(s, fa), C::mulDiv(d, fb));
+	if(premultiplied) {
+		return o;
+	}
+
+	return UnpremultiplyPixels4_AVX2<MAX_VALUE>(o, f.alpha_mask);
+}
+
+template <int MAX_VALUE, BOOL premultiplied> FI_TARGET_AVX2 static int
+CompositeLine_AVX2(BYTE *target, const BYTE *source, int width, int src_factor, int dst_factor) {
+	typedef Channels_AVX2<MAX_VALUE> C;
+	const int bytespp = (MAX_VALUE == 0xFF) ? 4 : 8;
+	const CompositeFactors_AVX2 f(src_factor, dst_factor, MAX_VALUE);
+
+	int x = 0;
+	for(; x + 8 <= width; x += 8) {
+		__m256i s0, s1, d0, d1;
+		C::load(source + bytespp * x, s0, s1);
+		C::load(target + bytespp * x, d0, d1);
+		C::store(target + bytespp * x, CompositePixels4_AVX2<MAX_VALUE, premultiplied>(s0, d0, f), CompositePixels4_AVX2<MAX_VALUE, premultiplied>(s1, d1, f));
+	}
+	_mm256_zeroupper();
+	return x;
+}
+
+// ==========================================================
+//   AVX2 alpha channel kernels
+// ==========================================================
+
+FI_TARGET_AVX2 static inline __m256i
+AlphaMask_AVX2() {
+	return _mm256_slli_epi64(_mm256_srli_epi64(_mm256_set1_epi32(-1), 48), 16 * FI_RGBA_ALPHA);
+}
+
+template <int MAX_VALUE> FI_TARGET_AVX2 static int
+PreMultiplyLine_AVX2(BYTE *bits, int width) {
+	typedef Channels_AVX2<MAX_VALUE> C;
+	const int bytespp = (MAX_VALUE == 0xFF) ? 4 : 8;
+	const __m256i alpha_mask = AlphaMask_AVX2();
+	const __m256i max_alpha = _mm256_and_si256(alpha_mask, _mm256_set1_epi16((short)MAX_VALUE));
+
+	int x = 0;
+	for(; x + 8 <= width; x += 8) {
+		__m256i v0, v1;
+		C::load(bits + bytespp * x, v0, v1);
+		v0 = C::mulDiv(v0, _mm256_or_si256(_mm256_andnot_si256(alpha_mask, BroadcastAlpha_AVX2(v0)), max_alpha));
+		v1 = C::mulDiv(v1, _mm256_or_si256(_mm256_andnot_si256(alpha_mask, BroadcastAlpha_AVX2(v1)), max_alpha));
+		C::store(bits + bytespp * x, v0, v1);
+	}
+	_mm256_zeroupper();
+	return x;
+}
+
+template <int MAX_VALUE> FI_TARGET_AVX2 static int
+UnPreMultiplyLine_AVX2(BYTE *bits, int width) {
+	typedef Channels_AVX2<MAX_VALUE> C;
+	const int bytespp = (MAX_VALUE == 0xFF) ? 4 : 8;
+	const __m256i alpha_mask = AlphaMask_AVX2();
+
+	int x = 0;
+	for(; x + 8 <= width; x += 8) {
+		__m256i v0, v1;
+		C::load(bits + bytespp * x, v0, v1);
+		C::store(bits + bytespp * x, UnpremultiplyPixels4_AVX2<MAX_VALUE>(v0, alpha_mask), UnpremultiplyPixels4_AVX2<MAX_VALUE>(v1, alpha_mask));
+	}
+	_mm256_zeroupper();
+	return x;
+}
+
+// FIRGBAF pixels, two pixels per vector
+
+FI_TARGET_AVX2 static inline __m256
+AlphaMaskF_AVX2() {
+	return _mm256_castsi256_ps(_mm256_set_epi32(-1, 0, 0, 0, -1, 0, 0, 0));
+}
+
+FI_TARGET_AVX2 static int
+PreMultiplyLineF_AVX2(BYTE *bits, int width) {
+	float *pixels = (float*)bits;
+	const __m256 alpha_mask = AlphaMaskF_AVX2();
+
+	int x = 0;
+	for(; x + 4 <= width; x += 4) {
+		for(int k = 0; k < 4; k += 2) {
+			const __m256 v = _mm256_loadu_ps(pixels + 4 * (x + k));
+			const __m256 c = _mm256_mul_ps(v, _mm256_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)));
+			_mm256_storeu_ps(pixels + 4 * (x + k), _mm256_blendv_ps(c, v, alpha_mask));
+		}
+	}
+	_mm256_zeroupper();
+	return x;
+}
+
+FI_TARGET_AVX2 static int
+UnPreMultiplyLineF_AVX2(BYTE *bits, int width) {
+	float *pixels = (float*)bits;
+	const __m256 alpha_mask = AlphaMaskF_AVX2();
+
+	int x = 0;
+	for(; x + 4 <= width; x += 4) {
+		for(int k = 0; k < 4; k += 2) {
+			const __m256 v = _mm256_loadu_ps(pixels + 4 * (x + k));
+			const __m256 a = _mm256_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+			const __m256 c = _mm256_andnot_ps(_mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_EQ_OQ), _mm256_div_ps(v, a));
+			_mm256_storeu_ps(pixels + 4 * (x + k), _mm256_blendv_ps(c, v, alpha_mask));
+		}
+	}
+	_mm256_zeroupper();
+	return x;
+}
+
+FI_TARGET_AVX2 static inline __m256i
+BlendBackground4_AVX2(__m256i f, __m256i b) {
+	const __m256i a = BroadcastAlpha_AVX2(f);
+	const __m256i wf = _mm256_sub_epi16(a, _mm256_cmpeq_epi16(a, _mm256_set1_epi16(0xFF)));
+	const __m256i wb = _mm256_sub_epi16(_mm256_sub_epi16(_mm256_set1_epi16(0xFF), a), _mm256_cmpeq_epi16(a, _mm256_setzero_si256()));
+	return _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(f, wf), _mm256_mullo_epi16(b, wb)), 8);
+}
+
+FI_TARGET_AVX2 static int
+BlendBackgroundLine_AVX2(BYTE *target, const BYTE *foreground, const BYTE *background, int width) {
+	typedef Channels_AVX2<0xFF> C;
+
+	int x = 0;
+	for(; x + 8 <= width; x += 8) {
+		__m256i f0, f1, b0, b1;
+		C::load(foreground + 4 * x, f0, f1);
+		C::load(background + 4 * x, b0, b1);
+		C::store(target + 4 * x, BlendBackground4_AVX2(f0, b0), BlendBackground4_AVX2(f1, b1));
+	}
+	_mm256_zeroupper();
+	return x;
+}
+
+FI_TARGET_AVX2 static int
+AccumulateLine_AVX2(DWORD *sums, const BYTE *source, int count, unsigned weight) {
+	const __m256i w = _mm256_set1_epi16((short)weight);
+
+	int i = 0;
+	for(; i + 32 <= count; i += 32) {
+		for(int k = 0; k < 32; k += 16) {
+			const __m256i v = _mm256_mullo_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(source + i + k))), w);
+			__m256i *s = (__m256i*)(sums + i + k);
+			_mm256_storeu_si256(s + 0, _mm256_add_epi32(_mm256_loadu_si256(s + 0), _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v))));
+			_mm256_storeu_si256(s + 1, _mm256_add_epi32(_mm256_loadu_si256(s + 1), _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1))));
+		}
+	}
+	_mm256_zeroupper();
+	return i;
+}
+
+FI_TARGET_AVX2 static int
+AccumulateLineF_AVX2(float *sums, const float *source, int count, float weight) {
+	const __m256 w = _mm256_set1_ps(weight);
+
+	int i = 0;
+	for(; i + 16 <= count; i += 16) {
+		_mm256_storeu_ps(sums + i, _mm256_add_ps(_mm256_loadu_ps(sums + i), _mm256_mul_ps(_mm256_loadu_ps(source + i), w)));
+		_mm256_storeu_ps(sums + i + 8, _mm256_add_ps(_mm256_loadu_ps(sums + i + 8), _mm256_mul_ps(_mm256_loadu_ps(source + i + 8), w)));
+	}
+	_mm256_zeroupper();
+	return i;
+}
+
+FI_TARGET_AVX2 static int
+AccumulateLine16_AVX2(int *sums, const WORD *source0, const WORD *source1, int count, int weight0, int weight1) {
+	const __m256i bias = _mm256_set1_epi16((short)0x8000);
+	const __m256i w = _mm256_set1_epi32((int)(((unsigned)weight1 << 16) | ((unsigned)weight0 & 0xFFFF)));
+
+	int i = 0;
+	for(; i + 16 <= count; i += 16) {
+		// 64-bit blocks reordered as 0, 2, 1, 3 so that the in-lane unpacks keep the sample order
+		const __m256i v0 = _mm256_permute4x64_epi64(_mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(source0 + i)), bias), 0xD8);
+		const __m256i v1 = _mm256_permute4x64_epi64(_mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(source1 + i)), bias), 0xD8);
+		__m256i *s = (__m256i*)(sums + i);
+		_mm256_storeu_si256(s + 0, _mm256_add_epi32(_mm256_loadu_si256(s + 0), _mm256_madd_epi16(_mm256_unpacklo_epi16(v0, v1), w)));
+		_mm256_storeu_si256(s + 1, _mm256_add_epi32(_mm256_loadu_si256(s + 1), _mm256_madd_epi16(_mm256_unpackhi_epi16(v0, v1), w)));
+	}
+	_mm256_zeroupper();
+	return i;
+}
+
+// ==========================================================
+//   AVX2 transposition kernels
+// ==========================================================
+
+/**
+Store the low and high lanes of a vector as two lines of 16 bytes
+*/
+FI_TARGET_AVX2 static inline void
+StoreLanes_AVX2(BYTE *lo, BYTE *hi, __m256i v) {
+	_mm_storeu_si128((__m128i*)lo, _mm256_castsi256_si128(v));
+	_mm_storeu_si128((__m128i*)hi, _mm256_extracti128_si256(v, 1));
+}
+
+/**
+Transpose a block of 8 columns and 4 lines of 32-bit pixels : the lanes hold the two 4x4 blocks 
+transposed by Transpose4x4_32_SSE2. The destination lines get 16 bytes each, as with SSE2 : 
+image lines are only 16-byte aligned, and 32 bytes written to each destination line would 
+often cross cache lines and make the transposition of large images 2 times slower.
+*/
+struct Transpose8x4_32_AVX2 {
+	enum { WIDTH = 8, HEIGHT = 4, BYTESPP = 4 };
+
+	FI_TARGET_AVX2 static inline void
+	transpose(BYTE *dst, int dst_pitch, const BYTE *src, int src_pitch) {
+		const __m256i r0 = _mm256_loadu_si256((const __m256i*)(src));
+		const __m256i r1 = _mm256_loadu_si256((const __m256i*)(src + src_pitch));
+		const __m256i r2 = _mm256_loadu_si256((const __m256i*)(src + 2 * src_pitch));
+		const __m256i r3 = _mm256_loadu_si256((const __m256i*)(src + 3 * src_pitch));
+
+		const __m256i t0 = _mm256_unpacklo_epi32(r0, r1);
+		const __m256i t1 = _mm256_unpacklo_epi32(r2, r3);
+		const __m256i t2 = _mm256_unpackhi_epi32(r0, r1);
+		const __m256i t3 = _mm256_unpackhi_epi32(r2, r3);
+
+		BYTE *dst4 = dst + 4 * dst_pitch;
+		StoreLanes_AVX2(dst, dst4, _mm256_unpacklo_epi64(t0, t1));
+		StoreLanes_AVX2(dst + dst_pitch, dst4 + dst_pitch, _mm256_unpackhi_epi64(t0, t1));
+		StoreLanes_AVX2(dst + 2 * dst_pitch, dst4 + 2 * dst_pitch, _mm256_unpacklo_epi64(t2, t3));
+		StoreLanes_AVX2(dst + 3 * dst_pitch, dst4 + 3 * dst_pitch, _mm256_unpackhi_epi64(t2, t3));
+	}
+};
+
+/**
+Transpose a block of 4 columns and 2 lines of 64-bit pixels, in the same way
+*/
+struct Transpose4x2_64_AVX2 {
+	enum { WIDTH = 4, HEIGHT = 2, BYTESPP = 8 };
+
+	FI_TARGET_AVX2 static inline void
+	transpose(BYTE *dst, int dst_pitch, const BYTE *src, int src_pitch) {
+		const __m256i r0 = _mm256_loadu_si256((const __m256i*)(src));
+		const __m256i r1 = _mm256_loadu_si256((const __m256i*)(src + src_pitch));
+
+		BYTE *dst2 = dst + 2 * dst_pitch;
+		StoreLanes_AVX2(dst, dst2, _mm256_unpacklo_epi64(r0, r1));
+		StoreLanes_AVX2(dst + dst_pitch, dst2 + dst_pitch, _mm256_unpackhi_epi64(r0, r1));
+	}
+};
+
+template <class Block> FI_TARGET_AVX2 static int
+TransposeTile_AVX2(BYTE *dst, int dst_pitch, const BYTE *src, int src_pitch, int width, int height) {
+	const int lines = height - (height % Block::WIDTH);
+	for(int x = 0; x + Block::WIDTH <= width; x += Block::WIDTH) {
+		for(int y = 0; y < lines; y += Block::HEIGHT) {
+			Block::transpose(dst + (ptrdiff_t)x * dst_pitch + y * Block::BYTESPP, dst_pitch, src + (ptrdiff_t)y * src_pitch + x * Block::BYTESPP, src_pitch);
+		}
+	}
+	_mm256_zeroupper();
+	return Block::WIDTH;
+}
+
+#endif // FREEIMAGE_AVX2
+
+// ==========================================================
+//   Dispatch table
+// ==========================================================
+
+/**
+Kernels of each line conversion, from the most to the least demanding instruction set
+*/
+struct LineKernelEntry {
+	FI_LINE_CONVERSION conversion;
+	unsigned features;
+	FI_LineKernel kernel;
+};
+
+static const LineKernelEntry s_line_kernel_list[] = {
+#if defined(FREEIMAGE_AVX2)
+	{ FI_LINE_32TO24,			FI_CPU_AVX2,	ConvertLine32To24_AVX2 },
+	{ FI_LINE_24TO32,			FI_CPU_AVX2,	ConvertLine24To32_AVX2 },
+	{ FI_LINE_16TO24_555,		FI_CPU_AVX2,	ConvertLine16To24_AVX2<FALSE> },
+	{ FI_LINE_16TO24_565,		FI_CPU_AVX2,	ConvertLine16To24_AVX2<TRUE> },
+	{ FI_LINE_16TO32_555,		FI_CPU_AVX2,	ConvertLine16To32_AVX2<FALSE> },
+	{ FI_LINE_16TO32_565,		FI_CPU_AVX2,	ConvertLine16To32_AVX2<TRUE> },
+	{ FI_LINE_24TO16_555,		FI_CPU_AVX2,	ConvertLine24To16_AVX2<FALSE> },
+	{ FI_LINE_24TO16_565,		FI_CPU_AVX2,	ConvertLine24To16_AVX2<TRUE> },
+	{ FI_LINE_32TO16_555,		FI_CPU_AVX2,	ConvertLine32To16_AVX2<FALSE> },
+	{ FI_LINE_32TO16_565,		FI_CPU_AVX2,	ConvertLine32To16_AVX2<TRUE> },
+	{ FI_LINE_16_565_TO16_555,	FI_CPU_AVX2,	ConvertLine16_565_To16_555_AVX2 },
+	{ FI_LINE_16_555_TO16_565,	FI_CPU_AVX2,	ConvertLine16_555_To16_565_AVX2 },
+	{ FI_LINE_24TO8,			FI_CPU_AVX2,	ConvertLine24To8_AVX2 },
+	{ FI_LINE_32TO8,			FI_CPU_AVX2,	ConvertLine32To8_AVX2 },
+#endif
+#if defined(FREEIMAGE_SSSE3)
+	{ FI_LINE_32TO24,			FI_CPU_SSSE3,	ConvertLine32To24_SSSE3 },
+	{ FI_LINE_24TO32,			FI_CPU_SSSE3,	ConvertLine24To32_SSSE3 },
+	{ FI_LINE_16TO24_555,		FI_CPU_SSSE3,	ConvertLine16To24_SSSE3<FALSE> },
+	{ FI_LINE_16TO24_565,		FI_CPU_SSSE3,	ConvertLine16To24_SSSE3<TRUE> },
+	{ FI_LINE_24TO16_555,		FI_CPU_SSSE3,	ConvertLine24To16_SSSE3<FALSE> },
+	{ FI_LINE_24TO16_565,		FI_CPU_SSSE3,	ConvertLine24To16_SSSE3<TRUE> },
+	{ FI_LINE_24TO8,			FI_CPU_SSSE3,	ConvertLine24To8_SSSE3 },
+#endif
+#if defined(FREEIMAGE_SSE2)
+	{ FI_LINE_16TO32_555,		FI_CPU_SSE2,	ConvertLine16To32_SSE2<FALSE> },
+	{ FI_LINE_16TO32_565,		FI_CPU_SSE2,	ConvertLine16To32_SSE2<TRUE> },
+	{ FI_LINE_32TO16_555,		FI_CPU_SSE2,	ConvertLine32To16_SSE2<FALSE> },
+	{ FI_LINE_32TO16_565,		FI_CPU_SSE2,	ConvertLine32To16_SSE2<TRUE> },
+	{ FI_LINE_16_565_TO16_555,	FI_CPU_SSE2,	ConvertLine16_565_To16_555_SSE2 },
+	{ FI_LINE_16_555_TO16_565,	FI_CPU_SSE2,	ConvertLine16_555_To16_565_SSE2 },
+	{ FI_LINE_32TO8,			FI_CPU_SSE2,	ConvertLine32To8_SSE2 },
+#endif
+	{ FI_LINE_CONVERSION_COUNT,	0,				NULL }
+};
+
+static FI_LineKernel s_line_kernels[FI_LINE_CONVERSION_COUNT];
+
+/**
+Kernels of each greyscale image type, from the most to the least demanding instruction set
+*/
+struct SampleKernelEntry {
+	FREE_IMAGE_TYPE type;
+	unsigned features;
+	FI_MinMaxKernel find_min_max;
+	FI_ScaleKernel scale_to_byte;
+};
+
+static const SampleKernelEntry s_sample_kernel_list[] = {
+#if defined(FREEIMAGE_AVX2)
+	{ FIT_UINT16,	FI_CPU_AVX2,	FindMinMaxLine_AVX2<WORD>,		ScaleLineToByte_AVX2<WORD> },
+	{ FIT_INT16,	FI_CPU_AVX2,	FindMinMaxLine_AVX2<short>,		ScaleLineToByte_AVX2<short> },
+	{ FIT_UINT32,	FI_CPU_AVX2,	FindMinMaxLine_AVX2<DWORD>,		ScaleLineToByte_AVX2<DWORD> },
+	{ FIT_INT32,	FI_CPU_AVX2,	FindMinMaxLine_AVX2<LONG>,		ScaleLineToByte_AVX2<LONG> },
+	{ FIT_FLOAT,	FI_CPU_AVX2,	FindMinMaxLine_AVX2<float>,		ScaleLineToByte_AVX2<float> },
+	{ FIT_DOUBLE,	FI_CPU_AVX2,	FindMinMaxLine_AVX2<double>,	ScaleLineToByte_AVX2<double> },
+#endif
+#if defined(FREEIMAGE_SSE2)
+	{ FIT_UINT16,	FI_CPU_SSE2,	FindMinMaxLine_SSE2<WORD>,		ScaleLineToByte_SSE2<WORD> },
+	{ FIT_INT16,	FI_CPU_SSE2,	FindMinMaxLine_SSE2<short>,		ScaleLineToByte_SSE2<short> },
+	{ FIT_UINT32,	FI_CPU_SSE2,	FindMinMaxLine_SSE2<DWORD>,		ScaleLineToByte_SSE2<DWORD> },
+	{ FIT_INT32,	FI_CPU_SSE2,	FindMinMaxLine_SSE2<LONG>,		ScaleLineToByte_SSE2<LONG> },
+	{ FIT_FLOAT,	FI_CPU_SSE2,	FindMinMaxLine_SSE2<float>,		ScaleLineToByte_SSE2<float> },
+	{ FIT_DOUBLE,	FI_CPU_SSE2,	FindMinMaxLine_SSE2<double>,	ScaleLineToByte_SSE2<double> },
+#endif
+	{ FIT_UNKNOWN,	0,				NULL,							NULL }
+};
+
+static const SampleKernelEntry *s_sample_kernels[FIT_RGBAF + 1];
+
+/**
+Compositing kernels of 32-bit (FIT_BITMAP) and FIT_RGBA16 images, from the most to the least demanding instruction set
+*/
+struct CompositeKernelEntry {
+	FREE_IMAGE_TYPE type;
+	unsigned features;
+	FI_CompositeKernel straight;
+	FI_CompositeKernel premultiplied;
+};
+
+static const CompositeKernelEntry s_composite_kernel_list[] = {
+#if defined(FREEIMAGE_AVX2)
+	{ FIT_BITMAP,	FI_CPU_AVX2,	CompositeLine_AVX2<0xFF, FALSE>,	CompositeLine_AVX2<0xFF, TRUE> },
+	{ FIT_RGBA16,	FI_CPU_AVX2,	CompositeLine_AVX2<0xFFFF, FALSE>,	CompositeLine_AVX2<0xFFFF, TRUE> },
+#endif
+#if defined(FREEIMAGE_SSE2)
+	{ FIT_BITMAP,	FI_CPU_SSE2,	CompositeLine_SSE2<0xFF, FALSE>,	CompositeLine_SSE2<0xFF, TRUE> },
+	{ FIT_RGBA16,	FI_CPU_SSE2,	CompositeLine_SSE2<0xFFFF, FALSE>,	CompositeLine_SSE2<0xFFFF, TRUE> },
+#endif
+	{ FIT_UNKNOWN,	0,				NULL,								NULL }
+};
+
+static const CompositeKernelEntry *s_composite_kernels[FIT_RGBAF + 1];
+
+/**
+Alpha channel kernels of 32-bit (FIT_BITMAP), FIT_RGBA16 and FIT_RGBAF images, 
+from the most to the least demanding instruction set
+*/
+struct AlphaKernelEntry {
+	FREE_IMAGE_TYPE type;
+	unsigned features;
+	FI_AlphaKernel premultiply;
+	FI_AlphaKernel unpremultiply;
+	FI_BlendKernel blend_background;	// 32-bit images only
+};
+
+static const AlphaKernelEntry s_alpha_kernel_list[] = {
+#if defined(FREEIMAGE_AVX2)
+	{ FIT_BITMAP,	FI_CPU_AVX2,	PreMultiplyLine_AVX2<0xFF>,		UnPreMultiplyLine_AVX2<0xFF>,	BlendBackgroundLine_AVX2 },
+	{ FIT_RGBA16,	FI_CPU_AVX2,	PreMultiplyLine_AVX2<0xFFFF>,	UnPreMultiplyLine_AVX2<0xFFFF>,	NULL },
+	{ FIT_RGBAF,	FI_CPU_AVX2,	PreMultiplyLineF_AVX2,			UnPreMultiplyLineF_AVX2,		NULL },
+#endif
+#if defined(FREEIMAGE_SSE2)
+	{ FIT_BITMAP,	FI_CPU_SSE2,	PreMultiplyLine_SSE2<0xFF>,		UnPreMultiplyLine_SSE2<0xFF>,	BlendBackgroundLine_SSE2 },
+	{ FIT_RGBA16,	FI_CPU_SSE2,	PreMultiplyLine_SSE2<0xFFFF>,	UnPreMultiplyLine_SSE2<0xFFFF>,	NULL },
+	{ FIT_RGBAF,	FI_CPU_SSE2,	PreMultiplyLineF_SSE2,			UnPreMultiplyLineF_SSE2,		NULL },
+#endif
+	{ FIT_UNKNOWN,	0,				NULL,							NULL,							NULL }
+};
+
+static const AlphaKernelEntry *s_alpha_kernels[FIT_RGBAF + 1];
+
+/**
+Area averaging and resampling kernels, from the most to the least demanding instruction set
+*/
+struct AccumulateKernelEntry {
+	unsigned features;
+	FI_AccumulateKernel accumulate;
+	FI_AccumulateFKernel accumulate_float;
+	FI_Accumulate16Kernel accumulate_16;
+};
+
+static const AccumulateKernelEntry s_accumulate_kernel_list[] = {
+#if defined(FREEIMAGE_AVX2)
+	{ FI_CPU_AVX2,	AccumulateLine_AVX2,	AccumulateLineF_AVX2,	AccumulateLine16_AVX2 },
+#endif
+#if defined(FREEIMAGE_SSE2)
+	{ FI_CPU_SSE2,	AccumulateLine_SSE2,	AccumulateLineF_SSE2,	AccumulateLine16_SSE2 },
+#endif
+	{ 0,			NULL,					NULL,					NULL }
+};
+
+static const AccumulateKernelEntry *s_accumulate_kernels;
+
+/**
+Pixel transposition and mirroring kernels of each pixel size, from the most to the least demanding instruction set
+*/
+struct TransposeKernelEntry {
+	unsigned bytespp;
+	unsigned features;
+	FI_TransposeKernel kernel;
+};
+
+static const TransposeKernelEntry s_transpose_kernel_list[] = {
+#if defined(FREEIMAGE_AVX2)
+	{ 4,	FI_CPU_AVX2,	TransposeTile_AVX2<Transpose8x4_32_AVX2> },
+	{ 8,	FI_CPU_AVX2,	TransposeTile_AVX2<Transpose4x2_64_AVX2> },
+#endif
+#if defined(FREEIMAGE_SSE2)
+	{ 1,	FI_CPU_SSE2,	TransposeTile_SSE2<Transpose8x8_8_SSE2> },
+	{ 2,	FI_CPU_SSE2,	TransposeTile_SSE2<Transpose8x8_16_SSE2> },
+	{ 4,	FI_CPU_SSE2,	TransposeTile_SSE2<Transpose4x4_32_SSE2> },
+	{ 8,	FI_CPU_SSE2,	TransposeTile_SSE2<Transpose2x2_64_SSE2> },
+#endif
+	{ 0,	0,				NULL }
+};
+
+struct ReverseKernelEntry {
+	unsigned bytespp;
+	unsigned features;
+	FI_ReverseKernel kernel;
+};
+
+static const ReverseKernelEntry s_reverse_kernel_list[] = {
+#if defined(FREEIMAGE_SSSE3)
+	{ 1,	FI_CPU_SSSE3,	ReverseLine_SSSE3<1> },
+	{ 2,	FI_CPU_SSSE3,	ReverseLine_SSSE3<2> },
+	{ 3,	FI_CPU_SSSE3,	ReverseLine48_SSSE3<3> },
+	{ 6,	FI_CPU_SSSE3,	ReverseLine48_SSSE3<6> },
+	{ 12,	FI_CPU_SSSE3,	ReverseLine48_SSSE3<12> },
+#endif
+#if defined(FREEIMAGE_SSE2)
+	{ 1,	FI_CPU_SSE2,	ReverseLine_SSE2<1> },
+	{ 2,	FI_CPU_SSE2,	ReverseLine_SSE2<2> },
+	{ 4,	FI_CPU_SSE2,	ReverseLine_SSE2<4> },
+	{ 8,	FI_CPU_SSE2,	ReverseLine_SSE2<8> },
+	{ 16,	FI_CPU_SSE2,	ReverseLine_SSE2<16> },
+#endif
+	{ 0,	0,				NULL }
+};
+
+// kernels indexed by the pixel size, from 1 to 16 bytes
+static FI_TransposeKernel s_transpose_kernels[17];
+static FI_ReverseKernel s_reverse_kernels[17];
+
+/**
+Select for each conversion and each image type the first kernel of the lists supported by 'features'
+*/
+static unsigned
+SelectKernels(unsigned features) {
+	for(int i = 0; i <= FIT_RGBAF; i++) {
+		const SampleKernelEntry *kernels = NULL;
+		for(const SampleKernelEntry *entry = s_sample_kernel_list; entry->find_min_max; entry++) {
+			if((entry->type == i) && ((entry->features & features) == entry->features)) {
+				kernels = entry;
+				break;
+			}
+		}
+		s_sample_kernels[i] = kernels;
+	}
+	for(int i = 0; i <= FIT_RGBAF; i++) {
+		const CompositeKernelEntry *kernels = NULL;
+		for(const CompositeKernelEntry *entry = s_composite_kernel_list; entry->straight; entry++) {
+			if((entry->type == i) && ((entry->features & features) == entry->features)) {
+				kernels = entry;
+				break;
+			}
+		}
+		s_composite_kernels[i] = kernels;
+	}
+	for(int i = 0; i <= FIT_RGBAF; i++) {
+		const AlphaKernelEntry *kernels = NULL;
+		for(const AlphaKernelEntry *entry = s_alpha_kernel_list; entry->premultiply; entry++) {
+			if((entry->type == i) && ((entry->features & features) == entry->features)) {
+				kernels = entry;
+				break;
+			}
+		}
+		s_alpha_kernels[i] = kernels;
+	}
+	s_accumulate_kernels = NULL;
+	for(const AccumulateKernelEntry *entry = s_accumulate_kernel_list; entry->accumulate; entry++) {
+		if((entry->features & features) == entry->features) {
+			s_accumulate_kernels = entry;
+			break;
+		}
+	}
+
+	for(unsigned i = 0; i <= 16; i++) {
+		FI_TransposeKernel kernel = NULL;
+		for(const TransposeKernelEntry *entry = s_transpose_kernel_list; entry->kernel; entry++) {
+			if((entry->bytespp == i) && ((entry->features & features) == entry->features)) {
+				kernel = entry->kernel;
+				break;
+			}
+		}
+		s_transpose_kernels[i] = kernel;
+	}
+	for(unsigned i = 0; i <= 16; i++) {
+		FI_ReverseKernel kernel = NULL;
+		for(const ReverseKernelEntry *entry = s_reverse_kernel_list; entry->kernel; entry++) {
+			if((entry->bytespp == i) && ((entry->features & features) == entry->features)) {
+				kernel = entry->kernel;
+				break;
+			}
+		}
+		s_reverse_kernels[i] = kernel;
+	}
+
+	for(int i = 0; i < FI_LINE_CONVERSION_COUNT; i++) {
+		FI_LineKernel kernel = NULL;
+		for(const LineKernelEntry *entry = s_line_kernel_list; entry->kernel; entry++) {
+			if((entry->conversion == i) && ((entry->features & features) == entry->features)) {
+				kernel = entry->kernel;
+				break;
+			}
+		}
+		s_line_kernels[i] = kernel;
+	}
+	return features;
+}
+
+// the CPU is queried and the kernels are selected when the library is loaded
+static const unsigned s_cpu_detected = DetectCPUFeatures();
+static unsigned s_cpu_enabled = SelectKernels(s_cpu_detected);
+
+// ==========================================================
+//   Internal and public API
+// ==========================================================
+
+int
+FreeImage_ConvertLineSIMD(FI_LINE_CONVERSION conversion, BYTE *target, const BYTE *source, int width_in_pixels) {
+	FI_LineKernel kernel = s_line_kernels[conversion];
+	return kernel ? kernel(target, source, width_in_pixels) : 0;
+}
+
+int
+FreeImage_FindMinMaxLineSIMD(FREE_IMAGE_TYPE type, const BYTE *source, int width, double& min, double& max) {
+	const SampleKernelEntry *kernels = s_sample_kernels[type];
+	return kernels ? kernels->find_min_max(source, width, min, max) : 0;
+}
+
+int
+FreeImage_CompositeLineSIMD(FREE_IMAGE_TYPE type, BYTE *target, const BYTE *source, int width, int src_factor, int dst_factor, BOOL premultiplied) {
+	const CompositeKernelEntry *kernels = s_composite_kernels[type];
+	if(!kernels) {
+		return 0;
+	}
+	return premultiplied ? kernels->premultiplied(target, source, width, src_factor, dst_factor) : kernels->straight(target, source, width, src_factor, dst_factor);
+}
+
+int
+FreeImage_PreMultiplyLineSIMD(FREE_IMAGE_TYPE type, BYTE *bits, int width) {
+	const AlphaKernelEntry *kernels = s_alpha_kernels[type];
+	return kernels ? kernels->premultiply(bits, width) : 0;
+}
+
+int
+FreeImage_UnPreMultiplyLineSIMD(FREE_IMAGE_TYPE type, BYTE *bits, int width) {
+	const AlphaKernelEntry *kernels = s_alpha_kernels[type];
+	return kernels ? kernels->unpremultiply(bits, width) : 0;
+}
+
+int
+FreeImage_BlendBackgroundLineSIMD(BYTE *target, const BYTE *foreground, const BYTE *background, int width) {
+	const AlphaKernelEntry *kernels = s_alpha_kernels[FIT_BITMAP];
+	return kernels ? kernels->blend_background(target, foreground, background, width) : 0;
+}
+
+int
+FreeImage_AccumulateLineSIMD(DWORD *sums, const BYTE *source, int count, unsigned weight) {
+	return s_accumulate_kernels ? s_accumulate_kernels->accumulate(sums, source, count, weight) : 0;
+}
+
+int
+FreeImage_AccumulateLineFSIMD(float *sums, const float *source, int count, float weight) {
+	return s_accumulate_kernels ? s_accumulate_kernels->accumulate_float(sums, source, count, weight) : 0;
+}
+
+int
+FreeImage_AccumulateLine16SIMD(int *sums, const WORD *source0, const WORD *source1, int count, int weight0, int weight1) {
+	return s_accumulate_kernels ? s_accumulate_kernels->accumulate_16(sums, source0, source1, count, weight0, weight1) : 0;
+}
+
+int
+FreeImage_TransposeTileSIMD(BYTE *dst, int dst_pitch, const BYTE *src, int src_pitch, int width, int height, unsigned bytespp) {
+	FI_TransposeKernel kernel = (bytespp <= 16) ? s_transpose_kernels[bytespp] : NULL;
+	return kernel ? kernel(dst, dst_pitch, src, src_pitch, width, height) : 0;
+}
+
+int
+FreeImage_ReverseLineSIMD(BYTE *dst, const BYTE *src, int width, unsigned bytespp) {
+	FI_ReverseKernel kernel = (bytespp <= 16) ? s_reverse_kernels[bytespp] : NULL;
+	return kernel ? kernel(dst, src, width) : 0;
+}
+
+int
+FreeImage_ScaleLineToByteSIMD(FREE_IMAGE_TYPE type, BYTE *target, const BYTE *source, int width, double low, double scale) {
+	const SampleKernelEntry *kernels = s_sample_kernels[type];
+	return kernels ? kernels->scale_to_byte(target, source, width, low, scale) : 0;
+}
+
+/**
+Get the instruction sets used by the code paths selected at run time
+@return Returns a combination of FI_CPU_SSE2, FI_CPU_SSSE3 and FI_CPU_AVX2 flags
+*/
+unsigned DLL_CALLCONV
+FreeImage_GetCPUFeatures() {
+	return s_cpu_enabled;
+}
+
+/**
+Restrict the instruction sets used by the code paths selected at run time,
+e.g. 0 selects the scalar code and 0xFFFFFFFF restores every feature supported by the CPU.
+This function is not thread safe and must not be called while other threads convert images.
+@param features Combination of FI_CPU_SSE2, FI_CPU_SSSE3 and FI_CPU_AVX2 flags
+@return Returns the features supported by the CPU among the requested ones
+*/
+unsigned DLL_CALLCONV
+FreeImage_SetCPUFeatures(unsigned features) {
+	s_cpu_enabled = SelectKernels(s_cpu_detected & features);
+	return s_cpu_enabled;
+}
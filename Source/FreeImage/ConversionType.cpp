@@ -22,6 +22,7 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "Parallel.h"
 
 // ----------------------------------------------------------
 
@@ -65,28 +66,175 @@ CONVERT_TYPE<Tdst, Tsrc>::convert(FIBITMAP *src, FREE_IMAGE_TYPE dst_type) {
 }
 
 
+// ----------------------------------------------------------
+//   Scaling of greyscale samples to 8-bit
+// ----------------------------------------------------------
+
+/** Difference between a sample and the low bound of a scaling, 
+	computed in double precision (exact for integer samples).
+	This is also the arithmetic of FreeImage_ScaleLineToByteSIMD.
+*/
+template<class Tsrc> static inline double
+SampleOffset(Tsrc value, double low) {
+	return (double)value - low;
+}
+
+/** Float samples are subtracted in single precision, as in previous versions
+*/
+static inline double
+SampleOffset(float value, double low) {
+	return (double)(value - (float)low);
+}
+
+/** Scale a sample offset to [0..255], rounding to the nearest integer. 
+	NaN values give 0.
+*/
+static inline BYTE
+ScaleSampleToByte(double offset, double scale) {
+	const double value = scale * offset + 0.5;
+	return (value > 0) ? ((value < 255) ? (BYTE)value : (BYTE)255) : (BYTE)0;
+}
+
+/** Number of rows processed at once by the band tasks below (about 256K samples), 
+	the bands being shared between the processors
+*/
+static unsigned
+GetBandRows(unsigned width) {
+	return MAX(1U, (unsigned)((1 << 18) / width));
+}
+
+static void
+RunBands(ParallelTask &task, unsigned height, unsigned band_rows) {
+	const unsigned band_count = (height + band_rows - 1) / band_rows;
+	ParallelRun(task, band_count, MIN(GetProcessorCount(), band_count));
+}
+
+/** Find the min and max value of each band of rows, NaN values being ignored
+*/
+template<class Tsrc>
+class MinMaxTask : public ParallelTask {
+public:
+	FIBITMAP *src;
+	FREE_IMAGE_TYPE type;
+	unsigned width;
+	unsigned height;
+	unsigned band_rows;
+	Tsrc start_min;		// initial min and max values of each band
+	Tsrc start_max;
+	std::vector<Tsrc> band_min;
+	std::vector<Tsrc> band_max;
+
+	void run(unsigned band, unsigned /*thread*/) {
+		double l_min = start_min;
+		double l_max = start_max;
+		const unsigned last = MIN(height, (band + 1) * band_rows);
+
+		for(unsigned y = band * band_rows; y < last; y++) {
+			const BYTE *line = FreeImage_GetScanLine(src, y);
+			const unsigned done = (unsigned)FreeImage_FindMinMaxLineSIMD(type, line, (int)width, l_min, l_max);
+
+			const Tsrc *bits = reinterpret_cast<const Tsrc*>(line);
+			Tsrc t_min = (Tsrc)l_min;
+			Tsrc t_max = (Tsrc)l_max;
+			for(unsigned x = done; x < width; x++) {
+				if(bits[x] < t_min) t_min = bits[x];
+				if(bits[x] > t_max) t_max = bits[x];
+			}
+			l_min = t_min;
+			l_max = t_max;
+		}
+		band_min[band] = (Tsrc)l_min;
+		band_max[band] = (Tsrc)l_max;
+	}
+};
+
+/** Count the samples of each histogram bin, each thread filling its own histogram
+*/
+template<class Tsrc>
+class HistogramTask : public ParallelTask {
+public:
+	FIBITMAP *src;
+	unsigned width;
+	unsigned height;
+	unsigned band_rows;
+	double min;			// low bound of the first bin
+	double bin_scale;	// number of bins per unit
+	unsigned bin_count;
+	DWORD *histograms;	// bin_count values per thread
+
+	void run(unsigned band, unsigned thread) {
+		DWORD *histogram = histograms + thread * bin_count;
+		const unsigned last = MIN(height, (band + 1) * band_rows);
+
+		for(unsigned y = band * band_rows; y < last; y++) {
+			const Tsrc *bits = reinterpret_cast<const Tsrc*>(FreeImage_GetScanLine(src, y));
+			for(unsigned x = 0; x < width; x++) {
+				const double value = (double)bits[x];
+				if(value == value) {
+					// not a NaN
+					const unsigned bin = (unsigned)((value - min) * bin_scale);
+					histogram[MIN(bin, bin_count - 1)]++;
+				}
+			}
+		}
+	}
+};
+
+/** Scale the samples of each band of rows to 8-bit
+*/
+template<class Tsrc>
+class ScaleToByteTask : public ParallelTask {
+public:
+	FIBITMAP *src;
+	FIBITMAP *dst;
+	FREE_IMAGE_TYPE type;
+	unsigned width;
+	unsigned height;
+	unsigned band_rows;
+	double low;
+	double scale;
+
+	void run(unsigned band, unsigned /*thread*/) {
+		const unsigned last = MIN(height, (band + 1) * band_rows);
+
+		for(unsigned y = band * band_rows; y < last; y++) {
+			const BYTE *line = FreeImage_GetScanLine(src, y);
+			BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
+			const unsigned done = (unsigned)FreeImage_ScaleLineToByteSIMD(type, dst_bits, line, (int)width, low, scale);
+
+			const Tsrc *src_bits = reinterpret_cast<const Tsrc*>(line);
+			for(unsigned x = done; x < width; x++) {
+				dst_bits[x] = ScaleSampleToByte(SampleOffset(src_bits[x], low), scale);
+			}
+		}
+	}
+};
+
 /** Convert a greyscale image of type Tsrc to a 8-bit grayscale dib.
 	Conversion is done using either a linear scaling from [min, max] to [0, 255]
 	or a rounding from src_pixel to (BYTE) MIN(255, MAX(0, q)) where int q = int(src_pixel + 0.5); 
+	convertWindow scales linearly a window of values given by two percentiles of the samples.
+	Each pass runs on bands of rows shared between the processors, with SIMD kernels when available.
 */
 template<class Tsrc>
 class CONVERT_TO_BYTE
 {
 public:
 	FIBITMAP* convert(FIBITMAP *src, BOOL scale_linear);
+	FIBITMAP* convertWindow(FIBITMAP *src, double low_percentile, double high_percentile);
+
+private:
+	FIBITMAP* allocate(FIBITMAP *src);
+	void findMinMax(FIBITMAP *src, Tsrc& min, Tsrc& max);
+	BOOL findPercentiles(FIBITMAP *src, double low_percentile, double high_percentile, double& low, double& high);
+	void scaleToByte(FIBITMAP *src, FIBITMAP *dst, double low, double scale);
 };
 
 template<class Tsrc> FIBITMAP* 
-CONVERT_TO_BYTE<Tsrc>::convert(FIBITMAP *src, BOOL scale_linear) {
-	FIBITMAP *dst = NULL;
-	unsigned x, y;
-
-	unsigned width	= FreeImage_GetWidth(src);
-	unsigned height = FreeImage_GetHeight(src);
-
+CONVERT_TO_BYTE<Tsrc>::allocate(FIBITMAP *src) {
 	// allocate a 8-bit dib
 
-	dst = FreeImage_AllocateT(FIT_BITMAP, width, height, 8, 0, 0, 0);
+	FIBITMAP *dst = FreeImage_AllocateT(FIT_BITMAP, FreeImage_GetWidth(src), FreeImage_GetHeight(src), 8, 0, 0, 0);
 	if(!dst) return NULL;
 
 	// build a greyscale palette
@@ -97,51 +245,164 @@ CONVERT_TO_BYTE<Tsrc>::convert(FIBITMAP *src, BOOL scale_linear) {
 		pal[i].rgbBlue = (BYTE)i;
 	}
 
+	return dst;
+}
+
+/** Find the min and max value of the image, starting from the input values of min and max
+*/
+template<class Tsrc> void 
+CONVERT_TO_BYTE<Tsrc>::findMinMax(FIBITMAP *src, Tsrc& min, Tsrc& max) {
+	MinMaxTask<Tsrc> task;
+	task.src = src;
+	task.type = FreeImage_GetImageType(src);
+	task.width = FreeImage_GetWidth(src);
+	task.height = FreeImage_GetHeight(src);
+	task.band_rows = GetBandRows(task.width);
+	task.start_min = min;
+	task.start_max = max;
+
+	const unsigned band_count = (task.height + task.band_rows - 1) / task.band_rows;
+	task.band_min.resize(band_count);
+	task.band_max.resize(band_count);
+
+	RunBands(task, task.height, task.band_rows);
+
+	for(unsigned i = 0; i < band_count; i++) {
+		if(task.band_min[i] < min) min = task.band_min[i];
+		if(task.band_max[i] > max) max = task.band_max[i];
+	}
+}
+
+/** Find the values of two percentiles of the samples (NaN values excepted) from a histogram of 
+	65536 bins. Integer samples get one bin per value when they span less than 65536 values, 
+	other samples get percentiles rounded to the bounds of their bins.
+	@return Returns FALSE if the histogram cannot be allocated
+*/
+template<class Tsrc> BOOL 
+CONVERT_TO_BYTE<Tsrc>::findPercentiles(FIBITMAP *src, double low_percentile, double high_percentile, double& low, double& high) {
+	// find the range of the samples
+
+	Tsrc min = std::numeric_limits<Tsrc>::max();
+	Tsrc max = std::numeric_limits<Tsrc>::is_integer ? std::numeric_limits<Tsrc>::min() : -std::numeric_limits<Tsrc>::max();
+	findMinMax(src, min, max);
+	if(max < min) {
+		// only NaN values
+		min = max = 0;
+	}
+
+	// build the histogram
+
+	HistogramTask<Tsrc> task;
+	task.src = src;
+	task.width = FreeImage_GetWidth(src);
+	task.height = FreeImage_GetHeight(src);
+	task.band_rows = GetBandRows(task.width);
+	task.min = (double)min;
+	task.bin_count = 65536;
+
+	const double range = (double)max - (double)min;
+	task.bin_scale = (range > 0) ? (task.bin_count - 1) / range : 1;
+	const BOOL exact = std::numeric_limits<Tsrc>::is_integer && (task.bin_scale >= 1);
+	if(exact) {
+		task.bin_scale = 1;
+	}
+
+	const unsigned band_count = (task.height + task.band_rows - 1) / task.band_rows;
+	const unsigned threads = MIN(GetProcessorCount(), band_count);
+	task.histograms = (DWORD*)calloc((size_t)threads * task.bin_count, sizeof(DWORD));
+	if(!task.histograms) return FALSE;
+
+	ParallelRun(task, band_count, threads);
+
+	DWORD *histogram = task.histograms;
+	double total = 0;
+	for(unsigned i = 0; i < task.bin_count; i++) {
+		for(unsigned t = 1; t < threads; t++) {
+			histogram[i] += task.histograms[t * task.bin_count + i];
+		}
+		total += histogram[i];
+	}
+
+	// find the bins holding the samples of rank p * (total - 1)
+
+	const double low_rank = floor(low_percentile / 100 * MAX(0.0, total - 1) + 0.5);
+	const double high_rank = floor(high_percentile / 100 * MAX(0.0, total - 1) + 0.5);
+	unsigned low_bin = 0, high_bin = 0;
+	double count = 0;
+	for(unsigned i = 0; i < task.bin_count; i++) {
+		if(count <= low_rank) low_bin = i;
+		if(count <= high_rank) high_bin = i;
+		count += histogram[i];
+		if(count > high_rank) break;
+	}
+
+	free(task.histograms);
+
+	low = task.min + low_bin / task.bin_scale;
+	high = exact ? (task.min + high_bin) : MIN((double)max, task.min + (high_bin + 1) / task.bin_scale);
+
+	return TRUE;
+}
+
+template<class Tsrc> void 
+CONVERT_TO_BYTE<Tsrc>::scaleToByte(FIBITMAP *src, FIBITMAP *dst, double low, double scale) {
+	ScaleToByteTask<Tsrc> task;
+	task.src = src;
+	task.dst = dst;
+	task.type = FreeImage_GetImageType(src);
+	task.width = FreeImage_GetWidth(src);
+	task.height = FreeImage_GetHeight(src);
+	task.band_rows = GetBandRows(task.width);
+	task.low = low;
+	task.scale = scale;
+
+	RunBands(task, task.height, task.band_rows);
+}
+
+template<class Tsrc> FIBITMAP* 
+CONVERT_TO_BYTE<Tsrc>::convert(FIBITMAP *src, BOOL scale_linear) {
+	FIBITMAP *dst = allocate(src);
+	if(!dst) return NULL;
+
 	// convert the src image to dst
 	// (FIBITMAP are stored upside down)
 	if(scale_linear) {
-		Tsrc max, min;
-		double scale;
-
 		// find the min and max value of the image
-		Tsrc l_min, l_max;
-		min = 255, max = 0;
-		for(y = 0; y < height; y++) {
-			Tsrc *bits = reinterpret_cast<Tsrc*>(FreeImage_GetScanLine(src, y));
-			MAXMIN(bits, width, l_max, l_min);
-			if(l_max > max) max = l_max;
-			if(l_min < min) min = l_min;
-		}
+		Tsrc min = 255, max = 0;
+		findMinMax(src, min, max);
 		if(max == min) {
 			max = 255; min = 0;
 		}
 
-		// compute the scaling factor
-		scale = 255 / (double)(max - min);
-
 		// scale to 8-bit
-		for(y = 0; y < height; y++) {
-			Tsrc *src_bits = reinterpret_cast<Tsrc*>(FreeImage_GetScanLine(src, y));
-			BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
-			for(x = 0; x < width; x++) {
-				dst_bits[x] = (BYTE)( scale * (src_bits[x] - min) + 0.5);
-			}
-		}
+		scaleToByte(src, dst, (double)min, 255 / SampleOffset(max, (double)min));
 	} else {
-		for(y = 0; y < height; y++) {
-			Tsrc *src_bits = reinterpret_cast<Tsrc*>(FreeImage_GetScanLine(src, y));
-			BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
-			for(x = 0; x < width; x++) {
-				// rounding
-				int q = int(src_bits[x] + 0.5);
-				dst_bits[x] = (BYTE) MIN(255, MAX(0, q));
-			}
-		}
+		// rounding
+		scaleToByte(src, dst, 0, 1);
 	}
 
 	return dst;
 }
 
+template<class Tsrc> FIBITMAP* 
+CONVERT_TO_BYTE<Tsrc>::convertWindow(FIBITMAP *src, double low_percentile, double high_percentile) {
+	double low, high;
+	if(!findPercentiles(src, low_percentile, high_percentile, low, high)) {
+		return NULL;
+	}
+	if(high <= low) {
+		// constant window : samples above the low bound are white
+		high = low + 1;
+	}
+
+	FIBITMAP *dst = allocate(src);
+	if(!dst) return NULL;
+
+	scaleToByte(src, dst, low, 255 / (high - low));
+
+	return dst;
+}
+
 /** Convert a greyscale image of type Tsrc to a FICOMPLEX dib.
 */
 template<class Tsrc>
@@ -299,6 +560,84 @@ FreeImage_ConvertToStandardType(FIBITMAP *src, BOOL scale_linear) {
 
 
 
+/** Convert a greyscale image of any type to a standard 8-bit greyscale image, 
+scaling linearly the values between two percentiles of the image samples to [0..255]. 
+Values below the low percentile are black and values above the high percentile are white, 
+NaN values are black. The percentiles are found with a histogram of the samples: they are 
+exact for 16-bit images and for 32-bit integer images spanning less than 65536 values, 
+otherwise they are rounded to 1/65535 of the range of the samples.
+For standard images, a clone of the input image is returned.
+For complex images, the window is computed from the magnitude.
+@param src Image to convert
+@param low_percentile Percentile mapped to black, in [0..100]
+@param high_percentile Percentile mapped to white, in [low_percentile..100]
+*/
+FIBITMAP* DLL_CALLCONV
+FreeImage_ConvertToStandardTypeWindow(FIBITMAP *src, double low_percentile, double high_percentile) {
+	FIBITMAP *dst = NULL;
+
+	if(!FreeImage_HasPixels(src)) return NULL;
+
+	if(!((0 <= low_percentile) && (low_percentile <= high_percentile) && (high_percentile <= 100))) {
+		// FreeImage_OutputMessageProc does not format floating point values
+		char low[32], high[32];
+		sprintf(low, "%g", low_percentile);
+		sprintf(high, "%g", high_percentile);
+		FreeImage_OutputMessageProc(FIF_UNKNOWN, "FreeImage_ConvertToStandardTypeWindow: invalid percentiles [%s, %s]", low, high);
+		return NULL;
+	}
+
+	// convert from src_type to FIT_BITMAP
+
+	const FREE_IMAGE_TYPE src_type = FreeImage_GetImageType(src);
+
+	switch(src_type) {
+		case FIT_BITMAP:	// standard image: 1-, 4-, 8-, 16-, 24-, 32-bit
+			dst = FreeImage_Clone(src);
+			break;
+		case FIT_UINT16:	// array of unsigned short: unsigned 16-bit
+			dst = convertUShortToByte.convertWindow(src, low_percentile, high_percentile);
+			break;
+		case FIT_INT16:		// array of short: signed 16-bit
+			dst = convertShortToByte.convertWindow(src, low_percentile, high_percentile);
+			break;
+		case FIT_UINT32:	// array of unsigned long: unsigned 32-bit
+			dst = convertULongToByte.convertWindow(src, low_percentile, high_percentile);
+			break;
+		case FIT_INT32:		// array of long: signed 32-bit
+			dst = convertLongToByte.convertWindow(src, low_percentile, high_percentile);
+			break;
+		case FIT_FLOAT:		// array of float: 32-bit
+			dst = convertFloatToByte.convertWindow(src, low_percentile, high_percentile);
+			break;
+		case FIT_DOUBLE:	// array of double: 64-bit
+			dst = convertDoubleToByte.convertWindow(src, low_percentile, high_percentile);
+			break;
+		case FIT_COMPLEX:	// array of FICOMPLEX: 2 x 64-bit
+			{
+				// Convert to type FIT_DOUBLE
+				FIBITMAP *dib_double = FreeImage_GetComplexChannel(src, FICC_MAG);
+				if(dib_double) {
+					dst = convertDoubleToByte.convertWindow(dib_double, low_percentile, high_percentile);
+					// Free image of type FIT_DOUBLE
+					FreeImage_Unload(dib_double);
+				}
+			}
+			break;
+		default:
+			break;
+	}
+
+	if(NULL == dst) {
+		FreeImage_OutputMessageProc(FIF_UNKNOWN, "FREE_IMAGE_TYPE: Unable to convert from type %d to type %d.\n No such conversion exists.", src_type, FIT_BITMAP);
+	} else {
+		// copy metadata from src to dst
+		FreeImage_CloneMetadata(dst, src);
+	}
+	
+	return dst;
+}
+
 // ----------------------------------------------------------
 //   smart convert X to Y
 // ----------------------------------------------------------
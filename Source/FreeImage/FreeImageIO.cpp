@@ -173,3 +173,137 @@ SetMemoryIO(FreeImageIO *io) {
 	io->tell_proc  = _MemoryTellProc;
 	io->write_proc = _MemoryWriteProc;
 }
+
+// =====================================================================
+// Buffered input
+// =====================================================================
+
+BufferedReader::BufferedReader(FreeImageIO *io, fi_handle handle, unsigned size) :
+_io(io), _handle(handle), _memory(FALSE), _buffer(NULL), _size(size), _begin(NULL), _ptr(NULL), _end(NULL), _position(0) {
+	if(io->read_proc == _MemoryReadProc) {
+		// read the memory stream in place : the window is attached on the first refill
+		_memory = TRUE;
+	} else {
+		_buffer = (BYTE*)malloc(_size);
+		_begin = _ptr = _end = _buffer;
+		_position = io->tell_proc(handle);
+	}
+}
+
+BufferedReader::~BufferedReader() {
+	sync();
+	if(_buffer) {
+		free(_buffer);
+	}
+}
+
+BOOL 
+BufferedReader::refill(unsigned count) {
+	if(_memory) {
+		if(_begin == NULL) {
+			// attach the window to the whole memory stream
+			FIMEMORYHEADER *mem_header = (FIMEMORYHEADER*)(((FIMEMORY*)_handle)->data);
+			_begin = (BYTE*)mem_header->data;
+			_end = _begin + mem_header->file_length;
+			_ptr = _begin + MIN(mem_header->current_position, mem_header->file_length);
+			_position = 0;
+		}
+		// nothing more to read
+		return ((unsigned)(_end - _ptr) >= count);
+	}
+
+	if(_buffer == NULL) {
+		return FALSE;
+	}
+
+	// keep the unread bytes and read the next block after them
+	const unsigned remaining = (unsigned)(_end - _ptr);
+	if(remaining > 0) {
+		memmove(_buffer, _ptr, remaining);
+	}
+	_position += (long)(_ptr - _begin);
+	_begin = _ptr = _buffer;
+	_end = _buffer + remaining + _io->read_proc(_buffer + remaining, 1, _size - remaining, _handle);
+
+	return ((unsigned)(_end - _ptr) >= count);
+}
+
+unsigned 
+BufferedReader::read(void *buffer, unsigned size) {
+	BYTE *dst = (BYTE*)buffer;
+	unsigned total = 0;
+
+	while(total < size) {
+		if(_ptr == _end) {
+			if(!_memory && (size - total >= _size)) {
+				// large read : bypass the buffer
+				const unsigned count = _io->read_proc(dst + total, 1, size - total, _handle);
+				_position += (long)(_ptr - _begin) + (long)count;
+				_begin = _ptr = _end = _buffer;
+				return total + count;
+			}
+			if(!refill(1)) {
+				break;
+			}
+		}
+		const unsigned count = MIN(size - total, (unsigned)(_end - _ptr));
+		memcpy(dst + total, _ptr, count);
+		_ptr += count;
+		total += count;
+	}
+
+	return total;
+}
+
+BOOL 
+BufferedReader::seek(long position) {
+	if(position < 0) {
+		return FALSE;
+	}
+	if(_memory) {
+		if(_begin == NULL) {
+			refill(0);
+		}
+		// the position can be beyond the end of the stream
+		_ptr = _begin + MIN(position, (long)(_end - _begin));
+		return TRUE;
+	}
+	if((position >= _position) && (position <= _position + (long)(_end - _begin))) {
+		// inside the current window
+		_ptr = _begin + (position - _position);
+		return TRUE;
+	}
+	if(_io->seek_proc(_handle, position, SEEK_SET) != 0) {
+		return FALSE;
+	}
+	_position = position;
+	_begin = _ptr = _end = _buffer;
+	return TRUE;
+}
+
+long 
+BufferedReader::tell() const {
+	if(_memory && (_begin == NULL)) {
+		FIMEMORYHEADER *mem_header = (FIMEMORYHEADER*)(((FIMEMORY*)_handle)->data);
+		return mem_header->current_position;
+	}
+	return _position + (long)(_ptr - _begin);
+}
+
+void 
+BufferedReader::sync() {
+	if(_memory) {
+		if(_begin != NULL) {
+			// detach the window
+			FIMEMORYHEADER *mem_header = (FIMEMORYHEADER*)(((FIMEMORY*)_handle)->data);
+			mem_header->current_position = tell();
+			_begin = _ptr = _end = NULL;
+		}
+		return;
+	}
+	if(_ptr < _end) {
+		_io->seek_proc(_handle, -(long)(_end - _ptr), SEEK_CUR);
+	}
+	_position = tell();
+	_begin = _ptr = _end = _buffer;
+}
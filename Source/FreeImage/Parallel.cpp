@@ -0,0 +1,304 @@
+// ==========================================================
+// Parallel execution helpers
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#include "Parallel.h"
+#include "Utilities.h"
+
+#if defined(_WIN32) || defined(__WIN32__)
+#define PARALLEL_WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// ----------------------------------------------------------
+
+unsigned
+GetProcessorCount() {
+	long count = 1;
+#if defined(PARALLEL_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	count = (long)info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return (count > 1) ? (unsigned)count : 1;
+}
+
+// ----------------------------------------------------------
+//   ParallelMutex
+// ----------------------------------------------------------
+
+ParallelMutex::ParallelMutex() {
+#if defined(PARALLEL_WIN32)
+	CRITICAL_SECTION *cs = new CRITICAL_SECTION;
+	InitializeCriticalSection(cs);
+	_mutex = cs;
+#else
+	pthread_mutex_t *mutex = new pthread_mutex_t;
+	pthread_mutex_init(mutex, NULL);
+	_mutex = mutex;
+#endif
+}
+
+ParallelMutex::~ParallelMutex() {
+#if defined(PARALLEL_WIN32)
+	CRITICAL_SECTION *cs = (CRITICAL_SECTION*)_mutex;
+	DeleteCriticalSection(cs);
+	delete cs;
+#else
+	pthread_mutex_t *mutex = (pthread_mutex_t*)_mutex;
+	pthread_mutex_destroy(mutex);
+	delete mutex;
+#endif
+}
+
+void
+ParallelMutex::lock() {
+#if defined(PARALLEL_WIN32)
+	EnterCriticalSection((CRITICAL_SECTION*)_mutex);
+#else
+	pthread_mutex_lock((pthread_mutex_t*)_mutex);
+#endif
+}
+
+void
+ParallelMutex::unlock() {
+#if defined(PARALLEL_WIN32)
+	LeaveCriticalSection((CRITICAL_SECTION*)_mutex);
+#else
+	pthread_mutex_unlock((pthread_mutex_t*)_mutex);
+#endif
+}
+
+// ----------------------------------------------------------
+//   ParallelRun
+// ----------------------------------------------------------
+
+/**
+Work queue shared by the threads of a ParallelRun call
+*/
+typedef struct tagParallelQueue {
+	ParallelTask *task;
+	ParallelMutex *mutex;
+	unsigned next;
+	unsigned count;
+} ParallelQueue;
+
+/**
+Worker thread parameters
+*/
+typedef struct tagParallelWorker {
+	ParallelQueue *queue;
+	unsigned thread;
+#if defined(PARALLEL_WIN32)
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+} ParallelWorker;
+
+/**
+Process the queued items until the queue is empty
+*/
+static void
+ProcessQueue(ParallelQueue *queue, unsigned thread) {
+	for(;;) {
+		unsigned item = 0;
+		{
+			ParallelLock lock(*queue->mutex);
+			if(queue->next >= queue->count) {
+				break;
+			}
+			item = queue->next++;
+		}
+		queue->task->run(item, thread);
+	}
+}
+
+#if defined(PARALLEL_WIN32)
+static unsigned __stdcall
+WorkerProc(void *arg) {
+	ParallelWorker *worker = (ParallelWorker*)arg;
+	ProcessQueue(worker->queue, worker->thread);
+	return 0;
+}
+#else
+static void*
+WorkerProc(void *arg) {
+	ParallelWorker *worker = (ParallelWorker*)arg;
+	ProcessQueue(worker->queue, worker->thread);
+	return NULL;
+}
+#endif
+
+void
+ParallelRun(ParallelTask &task, unsigned count, unsigned threads) {
+	threads = MIN(threads, count);
+
+	ParallelWorker *workers = NULL;
+	if(threads > 1) {
+		workers = (ParallelWorker*)malloc((threads - 1) * sizeof(ParallelWorker));
+	}
+	if(!workers) {
+		// serial execution
+		for(unsigned item = 0; item < count; item++) {
+			task.run(item, 0);
+		}
+		return;
+	}
+
+	ParallelMutex mutex;
+
+	ParallelQueue queue;
+	queue.task = &task;
+	queue.mutex = &mutex;
+	queue.next = 0;
+	queue.count = count;
+
+	// start the workers (the calling thread is thread 0)
+
+	unsigned started = 0;
+	for(unsigned t = 1; t < threads; t++) {
+		ParallelWorker *worker = &workers[started];
+		worker->queue = &queue;
+		worker->thread = t;
+#if defined(PARALLEL_WIN32)
+		worker->handle = (HANDLE)_beginthreadex(NULL, 0, WorkerProc, worker, 0, NULL);
+		if(worker->handle == 0) {
+			break;
+		}
+#else
+		if(pthread_create(&worker->handle, NULL, WorkerProc, worker) != 0) {
+			break;
+		}
+#endif
+		started++;
+	}
+
+	// take part in the work, then wait for the workers
+
+	ProcessQueue(&queue, 0);
+
+	for(unsigned i = 0; i < started; i++) {
+#if defined(PARALLEL_WIN32)
+		WaitForSingleObject(workers[i].handle, INFINITE);
+		CloseHandle(workers[i].handle);
+#else
+		pthread_join(workers[i].handle, NULL);
+#endif
+	}
+
+	free(workers);
+}
+
+// ----------------------------------------------------------
+//   ParallelThreadSlot
+// ----------------------------------------------------------
+
+#if defined(PARALLEL_WIN32)
+static VOID WINAPI
+DestroyThreadData(PVOID value) {
+	delete (ParallelThreadData*)value;
+}
+#else
+static void
+DestroyThreadData(void *value) {
+	delete (ParallelThreadData*)value;
+}
+#endif
+
+ParallelThreadSlot::ParallelThreadSlot() : _key(NULL) {
+#if defined(PARALLEL_WIN32)
+	// fiber local storage is used for its destructor callback, called when a thread exits
+	const DWORD index = FlsAlloc(DestroyThreadData);
+	if(index != FLS_OUT_OF_INDEXES) {
+		_key = new DWORD(index);
+	}
+#else
+	pthread_key_t *key = new pthread_key_t;
+	if(pthread_key_create(key, DestroyThreadData) == 0) {
+		_key = key;
+	} else {
+		delete key;
+	}
+#endif
+}
+
+ParallelThreadSlot::~ParallelThreadSlot() {
+	if(_key) {
+		delete take();
+#if defined(PARALLEL_WIN32)
+		DWORD *index = (DWORD*)_key;
+		FlsFree(*index);
+		delete index;
+#else
+		pthread_key_t *key = (pthread_key_t*)_key;
+		pthread_key_delete(*key);
+		delete key;
+#endif
+	}
+}
+
+ParallelThreadData* 
+ParallelThreadSlot::take() {
+	if(!_key) {
+		return NULL;
+	}
+#if defined(PARALLEL_WIN32)
+	const DWORD index = *(DWORD*)_key;
+	ParallelThreadData *data = (ParallelThreadData*)FlsGetValue(index);
+	if(data) {
+		FlsSetValue(index, NULL);
+	}
+#else
+	const pthread_key_t key = *(pthread_key_t*)_key;
+	ParallelThreadData *data = (ParallelThreadData*)pthread_getspecific(key);
+	if(data) {
+		pthread_setspecific(key, NULL);
+	}
+#endif
+	return data;
+}
+
+void 
+ParallelThreadSlot::put(ParallelThreadData *data) {
+	if(!data) {
+		return;
+	}
+	BOOL stored = FALSE;
+	if(_key) {
+#if defined(PARALLEL_WIN32)
+		const DWORD index = *(DWORD*)_key;
+		if(FlsGetValue(index) == NULL) {
+			stored = FlsSetValue(index, data) ? TRUE : FALSE;
+		}
+#else
+		const pthread_key_t key = *(pthread_key_t*)_key;
+		if(pthread_getspecific(key) == NULL) {
+			stored = (pthread_setspecific(key, data) == 0) ? TRUE : FALSE;
+		}
+#endif
+	}
+	if(!stored) {
+		delete data;
+	}
+}
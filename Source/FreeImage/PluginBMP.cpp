@@ -25,6 +25,7 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "FreeImageIO.h"
 
 // ----------------------------------------------------------
 //   Constants + headers
@@ -206,13 +207,17 @@ Load image pixels for 4-bit RLE compressed dib
 */
 static BOOL 
 LoadPixelDataRLE4(FreeImageIO *io, fi_handle handle, int width, int height, FIBITMAP *dib) {
-	int status_byte = 0;
+	BYTE status_byte = 0;
 	BYTE second_byte = 0;
 	int bits = 0;
 
 	BYTE *pixels = NULL;	// temporary 8-bit buffer
 
+	BufferedReader reader(io, handle);
+
 	try {
+		if(reader.isNull()) throw(1);
+
 		height = abs(height);
 
 		pixels = (BYTE*)malloc(width * height * sizeof(BYTE));
@@ -226,13 +231,13 @@ LoadPixelDataRLE4(FreeImageIO *io, fi_handle handle, int width, int height, FIBI
 			if (q < pixels || q  >= end) {
 				break;
 			}
-			if(io->read_proc(&status_byte, sizeof(BYTE), 1, handle) != 1) {
+			if(!reader.getByte(&status_byte)) {
 				throw(1);
 			}
 			if (status_byte != 0)	{
-				status_byte = (int)MIN((size_t)status_byte, (size_t)(end - q));
+				status_byte = (BYTE)MIN((size_t)status_byte, (size_t)(end - q));
 				// Encoded mode
-				if(io->read_proc(&second_byte, sizeof(BYTE), 1, handle) != 1) {
+				if(!reader.getByte(&second_byte)) {
 					throw(1);
 				}
 				for (int i = 0; i < status_byte; i++)	{
@@ -242,7 +247,7 @@ LoadPixelDataRLE4(FreeImageIO *io, fi_handle handle, int width, int height, FIBI
 			}
 			else {
 				// Escape mode
-				if(io->read_proc(&status_byte, sizeof(BYTE), 1, handle) != 1) {
+				if(!reader.getByte(&status_byte)) {
 					throw(1);
 				}
 				switch (status_byte) {
@@ -267,10 +272,10 @@ LoadPixelDataRLE4(FreeImageIO *io, fi_handle handle, int width, int height, FIBI
 						BYTE delta_x = 0;
 						BYTE delta_y = 0;
 
-						if(io->read_proc(&delta_x, sizeof(BYTE), 1, handle) != 1) {
+						if(!reader.getByte(&delta_x)) {
 							throw(1);
 						}
-						if(io->read_proc(&delta_y, sizeof(BYTE), 1, handle) != 1) {
+						if(!reader.getByte(&delta_y)) {
 							throw(1);
 						}
 
@@ -285,10 +290,10 @@ LoadPixelDataRLE4(FreeImageIO *io, fi_handle handle, int width, int height, FIBI
 					default:
 					{
 						// Absolute mode
-						status_byte = (int)MIN((size_t)status_byte, (size_t)(end - q));
+						status_byte = (BYTE)MIN((size_t)status_byte, (size_t)(end - q));
 						for (int i = 0; i < status_byte; i++) {
 							if ((i & 0x01) == 0) {
-								if(io->read_proc(&second_byte, sizeof(BYTE), 1, handle) != 1) {
+								if(!reader.getByte(&second_byte)) {
 									throw(1);
 								}
 							}
@@ -298,7 +303,7 @@ LoadPixelDataRLE4(FreeImageIO *io, fi_handle handle, int width, int height, FIBI
 						// Read pad byte
 						if (((status_byte & 0x03) == 1) || ((status_byte & 0x03) == 2)) {
 							BYTE padding = 0;
-							if(io->read_proc(&padding, sizeof(BYTE), 1, handle) != 1) {
+							if(!reader.getByte(&padding)) {
 								throw(1);
 							}
 						}
@@ -354,14 +359,19 @@ LoadPixelDataRLE8(FreeImageIO *io, fi_handle handle, int width, int height, FIBI
 	int scanline = 0;
 	int bits = 0;
 
+	BufferedReader reader(io, handle);
+	if(reader.isNull()) {
+		return FALSE;
+	}
+
 	for (;;) {
-		if( io->read_proc(&status_byte, sizeof(BYTE), 1, handle) != 1) {
+		if(!reader.getByte(&status_byte)) {
 			return FALSE;
 		}
 
 		switch (status_byte) {
 			case RLE_COMMAND :
-				if(io->read_proc(&status_byte, sizeof(BYTE), 1, handle) != 1) {
+				if(!reader.getByte(&status_byte)) {
 					return FALSE;
 				}
 
@@ -381,10 +391,10 @@ LoadPixelDataRLE8(FreeImageIO *io, fi_handle handle, int width, int height, FIBI
 						BYTE delta_x = 0;
 						BYTE delta_y = 0;
 
-						if(io->read_proc(&delta_x, sizeof(BYTE), 1, handle) != 1) {
+						if(!reader.getByte(&delta_x)) {
 							return FALSE;
 						}
-						if(io->read_proc(&delta_y, sizeof(BYTE), 1, handle) != 1) {
+						if(!reader.getByte(&delta_y)) {
 							return FALSE;
 						}
 
@@ -406,17 +416,17 @@ LoadPixelDataRLE8(FreeImageIO *io, fi_handle handle, int width, int height, FIBI
 
 						BYTE *sline = FreeImage_GetScanLine(dib, scanline);
 
-						if(io->read_proc((void *)(sline + bits), sizeof(BYTE) * count, 1, handle) != 1) {
-							return FALSE;
-						}
-						
 						// align run length to even number of bytes 
 
-						if ((status_byte & 1) == 1) {
-							if(io->read_proc(&second_byte, sizeof(BYTE), 1, handle) != 1) {
-								return FALSE;
-							}
+						const unsigned run_size = status_byte + (status_byte & 1);
+						const BYTE *run = reader.peek(run_size);
+						if(!run) {
+							return FALSE;
+						}
+						if(count > 0) {
+							memcpy(sline + bits, run, count);
 						}
+						reader.skip(run_size);
 
 						bits += status_byte;													
 
@@ -436,7 +446,7 @@ LoadPixelDataRLE8(FreeImageIO *io, fi_handle handle, int width, int height, FIBI
 
 				BYTE *sline = FreeImage_GetScanLine(dib, scanline);
 
-				if(io->read_proc(&second_byte, sizeof(BYTE), 1, handle) != 1) {
+				if(!reader.getByte(&second_byte)) {
 					return FALSE;
 				}
 
@@ -37,8 +37,14 @@
 #include "../OpenEXR/IlmImf/ImfRgba.h"
 #include "../OpenEXR/IlmImf/ImfArray.h"
 #include "../OpenEXR/IlmImf/ImfPreviewImage.h"
+#include "../OpenEXR/IlmImf/ImfTiledInputFile.h"
+#include "../OpenEXR/IlmImf/ImfThreading.h"
+#include "../OpenEXR/IlmImf/ImfVersion.h"
+#include "../OpenEXR/IlmThread/IlmThread.h"
 #include "../OpenEXR/Half/half.h"
 
+#include "Parallel.h"
+
 
 // ==========================================================
 // Plugin Interface
@@ -171,8 +177,73 @@ SupportsNoPixels() {
 
 // --------------------------------------------------------------------------
 
-static FIBITMAP * DLL_CALLCONV
-Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
+/**
+Get the number of worker threads used for block (de)compression. 
+When EXR_MULTITHREAD is set, the OpenEXR global thread pool is grown to the number of 
+online processors and this number is returned, otherwise the file is processed by the calling thread.
+@param flags Load / save flags
+@return Returns the thread count to pass to the OpenEXR file objects
+*/
+static int 
+GetThreadCount(int flags) {
+	if(((flags & EXR_MULTITHREAD) != EXR_MULTITHREAD) || !IlmThread::supportsThreads()) {
+		return 0;
+	}
+
+	const int count = (int)GetProcessorCount();
+
+	if(Imf::globalThreadCount() < count) {
+		Imf::setGlobalThreadCount(count);
+	}
+
+	return count;
+}
+
+/**
+Insert the Y or R, G, B[, A] float slices of a pixel buffer into a frame buffer
+@param frameBuffer Frame buffer to fill
+@param base Address of the pixel (0, 0) in the file coordinate system
+@param components Number of float components per pixel (1, 3 or 4)
+@param yStride Offset from a line to the next one, in bytes
+*/
+static void 
+InsertFloatSlices(Imf::FrameBuffer& frameBuffer, char *base, int components, size_t yStride) {
+	const char *channel_name[4] = { "R", "G", "B", "A" };
+	const size_t bytespp = sizeof(float) * components;
+
+	if(components == 1) {
+		frameBuffer.insert ("Y",	// name
+			Imf::Slice (Imf::FLOAT,	// type
+			base,					// base
+			bytespp,				// xStride
+			yStride,				// yStride
+			1, 1,					// x/y sampling
+			0.0));					// fillValue
+	} else if((components == 3) || (components == 4)) {
+		for(int c = 0; c < components; c++) {
+			frameBuffer.insert (
+				channel_name[c],					// name
+				Imf::Slice (Imf::FLOAT,				// type
+				base + c * sizeof(float),			// base
+				bytespp,							// xStride
+				yStride,							// yStride
+				1, 1,								// x/y sampling
+				0.0));								// fillValue
+		}
+	}
+}
+
+/**
+Load an EXR image or a rectangular part of it. 
+Only the scanline blocks (or the tiles) covering the requested region are decompressed. 
+@param io FreeImage IO
+@param handle FreeImage IO handle
+@param flags Load flags
+@param rect Region to load, relative to the upper-left corner of the data window, or NULL to load the whole data window
+@return Returns the loaded dib if successful, returns NULL otherwise
+*/
+static FIBITMAP * 
+LoadEXR(FreeImageIO *io, fi_handle handle, int flags, const Imath::Box2i *rect) {
 	bool bUseRgbaInterface = false;
 	FIBITMAP *dib = NULL;	
 
@@ -183,6 +254,8 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 	try {
 		BOOL header_only = (flags & FIF_LOAD_NOPIXELS) == FIF_LOAD_NOPIXELS;
 
+		const int threads = header_only ? 0 : GetThreadCount(flags);
+
 		// save the stream starting point
 		const long stream_start = io->tell_proc(handle);
 
@@ -190,12 +263,24 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 		C_IStream istream(io, handle);
 
 		// open the file
-		Imf::InputFile file(istream);
+		Imf::InputFile file(istream, threads);
 
 		// get file info			
 		const Imath::Box2i &dataWindow = file.header().dataWindow();
-		int width  = dataWindow.max.x - dataWindow.min.x + 1;
-		int height = dataWindow.max.y - dataWindow.min.y + 1;
+
+		// get the region to load, clipped to the data window
+		Imath::Box2i region = dataWindow;
+		if(rect) {
+			region.min.x = MAX(dataWindow.min.x, dataWindow.min.x + rect->min.x);
+			region.min.y = MAX(dataWindow.min.y, dataWindow.min.y + rect->min.y);
+			region.max.x = MIN(dataWindow.max.x, dataWindow.min.x + rect->max.x);
+			region.max.y = MIN(dataWindow.max.y, dataWindow.min.y + rect->max.y);
+			if(region.isEmpty()) {
+				THROW (Iex::ArgExc, "Invalid region: the region does not intersect the data window");
+			}
+		}
+		const int width  = region.max.x - region.min.x + 1;
+		const int height = region.max.y - region.min.y + 1;
 
 		//const Imf::Compression &compression = file.header().compression();
 
@@ -348,88 +433,120 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 
 		// load pixels
 		// --------------------------------------------------------------
+		// lines are stored top-down in the file and bottom-up in the dib: 
+		// the line y of the region goes to the dib scanline (height - 1 - y)
 
-		const BYTE *bits = FreeImage_GetBits(dib);			// pointer to our pixel buffer
+		BYTE *bits = FreeImage_GetBits(dib);				// pointer to our pixel buffer
 		const size_t bytespp = sizeof(float) * components;	// size of our pixel in bytes
 		const unsigned pitch = FreeImage_GetPitch(dib);		// size of our yStride in bytes
+		const size_t line_size = width * bytespp;			// size of a region line in bytes
+
+		const int dataWidth = dataWindow.max.x - dataWindow.min.x + 1;
 
-		Imf::PixelType pixelType = Imf::FLOAT;	// load as float data type;
-		
 		if(bUseRgbaInterface) {
 			// use the RGBA interface (used when loading RY BY Y images )
 
-			const int chunk_size = 16;
-
-			BYTE *scanline = (BYTE*)bits;
+			const int chunk_size = 16 * MAX(1, threads);
 
 			// re-open using the RGBA interface
 			io->seek_proc(handle, stream_start, SEEK_SET);
-			Imf::RgbaInputFile rgbaFile(istream);
+			Imf::RgbaInputFile rgbaFile(istream, threads);
 
-			// read the file in chunks
-			Imath::Box2i dw = dataWindow;
-			Imf::Array2D<Imf::Rgba> chunk(chunk_size, width);
-			while (dw.min.y <= dw.max.y) {
+			// read the region lines in chunks
+			Imf::Array2D<Imf::Rgba> chunk(chunk_size, dataWidth);
+			for(int y1 = region.min.y; y1 <= region.max.y; y1 += chunk_size) {
+				const int y2 = MIN(y1 + chunk_size - 1, region.max.y);
 				// read a chunk
-				rgbaFile.setFrameBuffer (&chunk[0][0] - dw.min.x - dw.min.y * width, 1, width);
-				rgbaFile.readPixels (dw.min.y, MIN(dw.min.y + chunk_size - 1, dw.max.y));
+				rgbaFile.setFrameBuffer (&chunk[0][0] - dataWindow.min.x - y1 * dataWidth, 1, dataWidth);
+				rgbaFile.readPixels (y1, y2);
 				// fill the dib
-				const int y_max = ((dw.max.y - dw.min.y) <= chunk_size) ? (dw.max.y - dw.min.y) : chunk_size;
-				for(int y = 0; y < y_max; y++) {
-					FIRGBF *pixel = (FIRGBF*)scanline;
-					const Imf::Rgba *half_rgba = chunk[y];
+				for(int y = y1; y <= y2; y++) {
+					FIRGBF *pixel = (FIRGBF*)FreeImage_GetScanLine(dib, height - 1 - (y - region.min.y));
+					const Imf::Rgba *half_rgba = chunk[y - y1] + (region.min.x - dataWindow.min.x);
 					for(int x = 0; x < width; x++) {
 						// convert from half to float
 						pixel[x].red = half_rgba[x].r;
 						pixel[x].green = half_rgba[x].g;
 						pixel[x].blue = half_rgba[x].b;
 					}
-					// next line
-					scanline += pitch;
 				}
-				// next chunk
-				dw.min.y += chunk_size;
 			}
 
-		} else {
-			// use the low level interface
+		} else if(Imf::isTiled(file.version())) {
+			// use the tiled interface: read the tiles covering the region, one row of tiles at a time
 
-			// build a frame buffer (i.e. what we want on output)
-			Imf::FrameBuffer frameBuffer;
+			// re-open using the tiled interface
+			io->seek_proc(handle, stream_start, SEEK_SET);
+			Imf::TiledInputFile tiledFile(istream, threads);
+
+			const Imf::TileDescription &tileDesc = tiledFile.header().tileDescription();
+			const int tile_w = (int)tileDesc.xSize;
+			const int tile_h = (int)tileDesc.ySize;
+
+			// range of the tiles covering the region (level 0)
+			const int dx1 = (region.min.x - dataWindow.min.x) / tile_w;
+			const int dx2 = (region.max.x - dataWindow.min.x) / tile_w;
+			const int dy1 = (region.min.y - dataWindow.min.y) / tile_h;
+			const int dy2 = (region.max.y - dataWindow.min.y) / tile_h;
+
+			// band buffer holding a row of tiles
+			const int band_x = dataWindow.min.x + dx1 * tile_w;
+			const size_t band_pitch = (size_t)(dx2 - dx1 + 1) * tile_w * bytespp;
+			Imf::Array<char> band(band_pitch * tile_h);
+
+			for(int dy = dy1; dy <= dy2; dy++) {
+				const int band_y = dataWindow.min.y + dy * tile_h;
+
+				Imf::FrameBuffer frameBuffer;
+				InsertFloatSlices(frameBuffer, (char*)band - band_x * bytespp - band_y * band_pitch, components, band_pitch);
+				tiledFile.setFrameBuffer(frameBuffer);
+				tiledFile.readTiles(dx1, dx2, dy, dy);
+
+				// copy the region part of the band
+				const int y1 = MAX(band_y, region.min.y);
+				const int y2 = MIN(band_y + tile_h - 1, region.max.y);
+				for(int y = y1; y <= y2; y++) {
+					const char *src_line = (char*)band + (y - band_y) * band_pitch + (region.min.x - band_x) * bytespp;
+					memcpy(FreeImage_GetScanLine(dib, height - 1 - (y - region.min.y)), src_line, line_size);
+				}
+			}
 
-			// allow dataWindow with minimal bounds different form zero
-			size_t offset = - dataWindow.min.x * bytespp - dataWindow.min.y * pitch;
+		} else if(width == dataWidth) {
+			// use the low level interface, reading the lines directly into the dib
 
-			if(components == 1) {
-				frameBuffer.insert ("Y",	// name
-					Imf::Slice (pixelType,	// type
-					(char*)(bits + offset), // base
-					bytespp,				// xStride
-					pitch,					// yStride
-					1, 1,					// x/y sampling
-					0.0));					// fillValue
-			} else if((components == 3) || (components == 4)) {
-				const char *channel_name[4] = { "R", "G", "B", "A" };
+			// address of the pixel (0, 0) with a negative yStride: 
+			// allow dataWindow with minimal bounds different form zero
+			char *base = (char*)bits + (ptrdiff_t)(height - 1 + region.min.y) * pitch - (ptrdiff_t)region.min.x * bytespp;
 
-				for(int c = 0; c < components; c++) {
-					frameBuffer.insert (
-						channel_name[c],					// name
-						Imf::Slice (pixelType,				// type
-						(char*)(bits + c * sizeof(float) + offset), // base
-						bytespp,							// xStride
-						pitch,								// yStride
-						1, 1,								// x/y sampling
-						0.0));								// fillValue
-				}
-			}
+			Imf::FrameBuffer frameBuffer;
+			InsertFloatSlices(frameBuffer, base, components, (size_t)(-(ptrdiff_t)pitch));
 
 			// read the file
 			file.setFrameBuffer(frameBuffer);
-			file.readPixels(dataWindow.min.y, dataWindow.max.y);
-		}
+			file.readPixels(region.min.y, region.max.y);
+
+		} else {
+			// use the low level interface, reading bands of full data window lines
+
+			const int band_height = 64 * MAX(1, threads);
+			const size_t band_pitch = dataWidth * bytespp;
+			Imf::Array<char> band(band_pitch * band_height);
+
+			for(int y1 = region.min.y; y1 <= region.max.y; y1 += band_height) {
+				const int y2 = MIN(y1 + band_height - 1, region.max.y);
 
-		// lastly, flip dib lines
-		FreeImage_FlipVertical(dib);
+				Imf::FrameBuffer frameBuffer;
+				InsertFloatSlices(frameBuffer, (char*)band - dataWindow.min.x * bytespp - y1 * band_pitch, components, band_pitch);
+				file.setFrameBuffer(frameBuffer);
+				file.readPixels(y1, y2);
+
+				// copy the region part of the band
+				for(int y = y1; y <= y2; y++) {
+					const char *src_line = (char*)band + (y - y1) * band_pitch + (region.min.x - dataWindow.min.x) * bytespp;
+					memcpy(FreeImage_GetScanLine(dib, height - 1 - (y - region.min.y)), src_line, line_size);
+				}
+			}
+		}
 
 	}
 	catch(Iex::BaseExc & e) {
@@ -439,10 +556,22 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 		FreeImage_OutputMessageProc(s_format_id, e.what());
 		return NULL;
 	}
+	catch(std::bad_alloc &) {
+		if(dib != NULL) {
+			FreeImage_Unload(dib);
+		}
+		FreeImage_OutputMessageProc(s_format_id, FI_MSG_ERROR_MEMORY);
+		return NULL;
+	}
 
 	return dib;
 }
 
+static FIBITMAP * DLL_CALLCONV
+Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
+	return LoadEXR(io, handle, flags, NULL);
+}
+
 /**
 Set the preview image using the dib embedded thumbnail
 */
@@ -496,7 +625,7 @@ SetPreviewImage(FIBITMAP *dib, Imf::Header& header) {
 Save using EXR_LC compression (works only with RGB[A]F images)
 */
 static BOOL 
-SaveAsEXR_LC(C_OStream& ostream, FIBITMAP *dib, Imf::Header& header, int width, int height) {
+SaveAsEXR_LC(C_OStream& ostream, FIBITMAP *dib, Imf::Header& header, int width, int height, int threads) {
 	int x, y;
 	Imf::RgbaChannels rgbaChannels;
 
@@ -538,7 +667,7 @@ SaveAsEXR_LC(C_OStream& ostream, FIBITMAP *dib, Imf::Header& header, int width,
 		}
 
 		// write the data
-		Imf::RgbaOutputFile file(ostream, header, rgbaChannels);
+		Imf::RgbaOutputFile file(ostream, header, rgbaChannels, threads);
 		file.setFrameBuffer (&pixels[0][0], 1, width);
 		file.writePixels (height);
 
@@ -555,7 +684,6 @@ SaveAsEXR_LC(C_OStream& ostream, FIBITMAP *dib, Imf::Header& header, int width,
 static BOOL DLL_CALLCONV
 Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void *data) {
 	const char *channel_name[4] = { "R", "G", "B", "A" };
-	BOOL bIsFlipped = FALSE;
 	half *halfData = NULL;
 
 	if(!dib || !handle) return FALSE;
@@ -614,7 +742,7 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 		
 		// check for EXR_LC compression
 		if((flags & EXR_LC) == EXR_LC) {
-			return SaveAsEXR_LC(ostream, dib, header, width, height);
+			return SaveAsEXR_LC(ostream, dib, header, width, height, GetThreadCount(flags));
 		}
 
 		// output pixel type
@@ -656,10 +784,10 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 		// build a frame buffer (i.e. what we have on input)
 		Imf::FrameBuffer frameBuffer;
 
-		BYTE *bits = NULL;	// pointer to our pixel buffer
+		BYTE *bits = NULL;	// pointer to our first line (top-down)
 		size_t bytespp = 0;	// size of our pixel in bytes
 		size_t bytespc = 0;	// size of our pixel component in bytes
-		unsigned pitch = 0;	// size of our yStride in bytes
+		size_t pitch = 0;	// size of our yStride in bytes
 
 
 		if(pixelType == Imf::HALF) {
@@ -685,13 +813,11 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 			bytespp = sizeof(half) * components;
 			pitch = sizeof(half) * width * components;
 		} else if(pixelType == Imf::FLOAT) {
-			// invert dib scanlines
-			bIsFlipped = FreeImage_FlipVertical(dib);
-		
-			bits = FreeImage_GetBits(dib);
+			// read the dib scanlines bottom-up, using a negative yStride
+			bits = FreeImage_GetScanLine(dib, height - 1);
 			bytespc = sizeof(float);
 			bytespp = sizeof(float) * components;
-			pitch = FreeImage_GetPitch(dib);
+			pitch = (size_t)(-(ptrdiff_t)FreeImage_GetPitch(dib));
 		}
 
 		if(image_type == FIT_FLOAT) {
@@ -712,17 +838,13 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 		}
 
 		// write the data
-		Imf::OutputFile file (ostream, header);
+		Imf::OutputFile file (ostream, header, GetThreadCount(flags));
 		file.setFrameBuffer (frameBuffer);
 		file.writePixels (height);
 
 		if(halfData != NULL) {
 			delete[] halfData;
 		}
-		if(bIsFlipped) {
-			// invert dib scanlines
-			FreeImage_FlipVertical(dib);
-		}
 
 		return TRUE;
 
@@ -730,10 +852,6 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 		if(halfData != NULL) {
 			delete[] halfData;
 		}
-		if(bIsFlipped) {
-			// invert dib scanlines
-			FreeImage_FlipVertical(dib);
-		}
 
 		FreeImage_OutputMessageProc(s_format_id, e.what());
 
@@ -771,3 +889,26 @@ InitEXR(Plugin *plugin, int format_id) {
 	plugin->supports_icc_profiles_proc = NULL;
 	plugin->supports_no_pixels_proc = SupportsNoPixels;
 }
+
+// ==========================================================
+//   Region loading
+// ==========================================================
+
+FIBITMAP * DLL_CALLCONV
+FreeImage_LoadEXRRegionFromHandle(FreeImageIO *io, fi_handle handle, int left, int top, int right, int bottom, int flags) {
+	// normalize the rectangle
+	if(right < left) {
+		INPLACESWAP(left, right);
+	}
+	if(bottom < top) {
+		INPLACESWAP(top, bottom);
+	}
+	if((left < 0) || (top < 0) || (left == right) || (top == bottom)) {
+		return NULL;
+	}
+
+	// the rectangle excludes its right and bottom edges
+	const Imath::Box2i rect(Imath::V2i(left, top), Imath::V2i(right - 1, bottom - 1));
+
+	return LoadEXR(io, handle, flags, &rect);
+}
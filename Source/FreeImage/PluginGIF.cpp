@@ -27,6 +27,7 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "Parallel.h"
 #include "../Metadata/FreeImageTag.h"
 
 // ==========================================================
@@ -70,11 +71,11 @@ struct PageInfo {
 //GIF defines a max of 12 bits per code
 #define MAX_LZW_CODE			4096
 
-class StringTable
+class StringTable : public ParallelThreadData
 {
 public:
 	StringTable();
-	~StringTable();
+	virtual ~StringTable();
 	void Initialize(int minCodeSize);
 	BYTE *FillInputBuffer(int len);
 	void CompressStart(int bpp, int width);
@@ -98,7 +99,12 @@ protected:
 	int firstPixelPassed; // A specific flag that indicates if the first pixel
 	                      // of the whole image had already been read
 
-	std::string m_strings[MAX_LZW_CODE]; //This is what is really the "string table" data for the Decompressor
+	//This is what is really the "string table" data for the Decompressor : 
+	//each code is the string of its prefix code followed by its suffix character
+	WORD m_strPrefix[MAX_LZW_CODE];
+	BYTE m_strSuffix[MAX_LZW_CODE];
+	BYTE m_strFirst[MAX_LZW_CODE]; //first character of the string
+	WORD m_strLength[MAX_LZW_CODE];
 	int* m_strmap;
 
 	//input buffer
@@ -180,10 +186,13 @@ StringTable::StringTable()
 {
 	m_buffer = NULL;
 	firstPixelPassed = 0; // Still no pixel read
-	// Maximum number of entries in the map is MAX_LZW_CODE * 256 
-	// (aka 2**12 * 2**8 => a 20 bits key)
-	// This Map could be optmized to only handle MAX_LZW_CODE * 2**(m_bpp)
-	m_strmap = new(std::nothrow) int[1<<20];
+	// the compressor map is allocated by CompressStart, a decompressor doesn't need it
+	m_strmap = NULL;
+	// codes not yet defined are empty strings
+	memset(m_strPrefix, 0, sizeof(m_strPrefix));
+	memset(m_strSuffix, 0, sizeof(m_strSuffix));
+	memset(m_strFirst, 0, sizeof(m_strFirst));
+	memset(m_strLength, 0, sizeof(m_strLength));
 }
 
 StringTable::~StringTable()
@@ -200,6 +209,7 @@ StringTable::~StringTable()
 void StringTable::Initialize(int minCodeSize)
 {
 	m_done = false;
+	firstPixelPassed = 0;
 
 	m_bpp = 8;
 	m_minCodeSize = minCodeSize;
@@ -240,6 +250,12 @@ void StringTable::CompressStart(int bpp, int width)
 
 	m_partial |= m_clearCode << m_partialSize;
 	m_partialSize += m_codeSize;
+	if(m_strmap == NULL) {
+		// Maximum number of entries in the map is MAX_LZW_CODE * 256 
+		// (aka 2**12 * 2**8 => a 20 bits key)
+		// This Map could be optmized to only handle MAX_LZW_CODE * 2**(m_bpp)
+		m_strmap = new(std::nothrow) int[1<<20];
+	}
 	ClearCompressorTable();
 }
 
@@ -389,10 +405,20 @@ bool StringTable::Decompress(BYTE *buf, int *len)
 
 			//add new string to string table, if not the first pass since a clear code
 			if( m_oldCode != MAX_LZW_CODE && m_nextCode < MAX_LZW_CODE) {
-				m_strings[m_nextCode] = m_strings[m_oldCode] + m_strings[code == m_nextCode ? m_oldCode : code][0];
+				if( m_strLength[m_oldCode] >= MAX_LZW_CODE - 1 ) {
+					//no valid string is that long
+					m_done = true;
+					*len = (int)(bufpos - buf);
+					return true;
+				}
+				m_strPrefix[m_nextCode] = (WORD)m_oldCode;
+				m_strSuffix[m_nextCode] = m_strFirst[code == m_nextCode ? m_oldCode : code];
+				m_strFirst[m_nextCode] = m_strFirst[m_oldCode];
+				m_strLength[m_nextCode] = (WORD)(m_strLength[m_oldCode] + 1);
 			}
 
-			if( (int)m_strings[code].size() > *len - (bufpos - buf) ) {
+			const int length = m_strLength[code];
+			if( length > *len - (bufpos - buf) ) {
 				//out of space, stuff the code back in for next time
 				m_partial <<= m_codeSize;
 				m_partialSize += m_codeSize;
@@ -402,9 +428,13 @@ bool StringTable::Decompress(BYTE *buf, int *len)
 				return true;
 			}
 
-			//output the string into the buffer
-			memcpy(bufpos, m_strings[code].data(), m_strings[code].size());
-			bufpos += m_strings[code].size();
+			//output the string into the buffer, from its last character to its first one
+			int prefix = code;
+			for( BYTE *p = bufpos + length; p > bufpos; ) {
+				*--p = m_strSuffix[prefix];
+				prefix = m_strPrefix[prefix];
+			}
+			bufpos += length;
 
 			//increment the next highest valid code, add a bit to the mask if we need to increase the code size
 			if( m_oldCode != MAX_LZW_CODE && m_nextCode < MAX_LZW_CODE ) {
@@ -445,8 +475,10 @@ void StringTable::ClearCompressorTable(void)
 void StringTable::ClearDecompressorTable(void)
 {
 	for( int i = 0; i < m_clearCode; i++ ) {
-		m_strings[i].resize(1);
-		m_strings[i][0] = (char)i;
+		m_strPrefix[i] = 0;
+		m_strSuffix[i] = (BYTE)i;
+		m_strFirst[i] = (BYTE)i;
+		m_strLength[i] = 1;
 	}
 	m_nextCode = m_endCode + 1;
 
@@ -461,6 +493,9 @@ void StringTable::ClearDecompressorTable(void)
 
 static int s_format_id;
 
+//! per-thread decoder string table, kept from one call to Load to the next
+static ParallelThreadSlot s_decoder_tables;
+
 // ==========================================================
 // Plugin Implementation
 // ==========================================================
@@ -910,7 +945,14 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 
 		//LZW Minimum Code Size
 		io->read_proc(&b, 1, 1, handle);
-		StringTable *stringtable = new(std::nothrow) StringTable;
+		// reuse the string table of the last image decoded by this thread
+		StringTable *stringtable = static_cast<StringTable*>(s_decoder_tables.take());
+		if( stringtable == NULL ) {
+			stringtable = new(std::nothrow) StringTable;
+			if( stringtable == NULL ) {
+				throw FI_MSG_ERROR_MEMORY;
+			}
+		}
 		stringtable->Initialize(b);
 
 		//Image Data Sub-blocks
@@ -1057,7 +1099,7 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 		b = (BYTE)disposal_method;
 		FreeImage_SetMetadataEx(FIMD_ANIMATION, dib, "DisposalMethod", ANIMTAG_DISPOSALMETHOD, FIDT_BYTE, 1, 1, &b);
 
-		delete stringtable;
+		s_decoder_tables.put(stringtable);
 
 	} catch (const char *msg) {
 		if( dib != NULL ) {
@@ -21,6 +21,8 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "FreeImageIO.h"
+#include "Parallel.h"
 
 // ==========================================================
 // Plugin Interface
@@ -81,16 +83,19 @@ typedef enum {
 // ----------------------------------------------------------
 
 static BOOL rgbe_Error(rgbe_error_code error_code, const char *msg);
-static BOOL rgbe_GetLine(FreeImageIO *io, fi_handle handle, char *buffer, int length);
-static inline void rgbe_FloatToRGBE(BYTE rgbe[4], FIRGBF *rgbf);
-static inline void rgbe_RGBEToFloat(FIRGBF *rgbf, BYTE rgbe[4]);
-static BOOL rgbe_ReadHeader(FreeImageIO *io, fi_handle handle, unsigned *width, unsigned *height, rgbeHeaderInfo *header_info);
+static BOOL rgbe_GetLine(BufferedReader& reader, char *buffer, int length);
+static inline float rgbe_Scale(int e);
+static inline void rgbe_FloatToRGBE(BYTE rgbe[4], const FIRGBF *rgbf);
+static inline void rgbe_RGBEToFloat(FIRGBF *rgbf, const BYTE rgbe[4]);
+static void rgbe_PlanarToFloat(FIRGBF *data, const BYTE *scanline_buffer, int scanline_width);
+static BOOL rgbe_ReadHeader(BufferedReader& reader, unsigned *width, unsigned *height, rgbeHeaderInfo *header_info);
 static BOOL rgbe_WriteHeader(FreeImageIO *io, fi_handle handle, unsigned width, unsigned height, rgbeHeaderInfo *info);
-static BOOL rgbe_ReadPixels(FreeImageIO *io, fi_handle handle, FIRGBF *data, unsigned numpixels);
+static BOOL rgbe_ReadPixels(BufferedReader& reader, BYTE *scanline_buffer, int scanline_width, int start);
 static BOOL rgbe_WritePixels(FreeImageIO *io, fi_handle handle, FIRGBF *data, unsigned numpixels);
-static BOOL rgbe_ReadPixels_RLE(FreeImageIO *io, fi_handle handle, FIRGBF *data, int scanline_width, unsigned num_scanlines);
-static BOOL rgbe_WriteBytes_RLE(FreeImageIO *io, fi_handle handle, BYTE *data, int numbytes);
-static BOOL rgbe_WritePixels_RLE(FreeImageIO *io, fi_handle handle, FIRGBF *data, unsigned scanline_width, unsigned num_scanlines);
+static BOOL rgbe_ReadPixels_RLE(BufferedReader& reader, BYTE *scanline_buffer, int scanline_width);
+static unsigned rgbe_WriteBytes_RLE(BYTE *dst, const BYTE *data, int numbytes);
+static inline unsigned rgbe_RLEBufferSize(unsigned scanline_width);
+static BOOL rgbe_WritePixels_RLE(FreeImageIO *io, fi_handle handle, FIRGBF *data, unsigned scanline_width, BYTE *buffer);
 static BOOL rgbe_ReadMetadata(FIBITMAP *dib, rgbeHeaderInfo *header_info);
 static BOOL rgbe_WriteMetadata(FIBITMAP *dib, rgbeHeaderInfo *header_info);
 
@@ -123,11 +128,11 @@ rgbe_Error(rgbe_error_code error_code, const char *msg) {
 Get a line from a ASCII io stream
 */
 static BOOL 
-rgbe_GetLine(FreeImageIO *io, fi_handle handle, char *buffer, int length) {
+rgbe_GetLine(BufferedReader& reader, char *buffer, int length) {
 	int i;
 	memset(buffer, 0, length);
 	for(i = 0; i < length; i++) {
-		if(!io->read_proc(&buffer[i], 1, 1, handle))
+		if(!reader.getByte((BYTE*)&buffer[i]))
 			return FALSE;
 		if(buffer[i] == 0x0A)
 			break;
@@ -136,14 +141,30 @@ rgbe_GetLine(FreeImageIO *io, fi_handle handle, char *buffer, int length) {
 	return (i < length) ? TRUE : FALSE;
 }
 
+/**
+Compute 2^(e - (128+8)) for a rgbe exponent byte, by building the IEEE-754 float directly. 
+Exponents below 10 give a denormal result and are left to ldexp.
+*/
+static inline float 
+rgbe_Scale(int e) {
+	const int biased = e - (128+8) + 127;
+	if(biased > 0) {
+		union { DWORD i; float f; } scale;
+		scale.i = (DWORD)biased << 23;
+		return scale.f;
+	}
+	return (float)ldexp(1.0, e - (int)(128+8));
+}
+
 /**
 Standard conversion from float pixels to rgbe pixels. 
+The frexp call is replaced by a read of the float exponent field : 
+v = m * 2^e with m in [0.5, 1), so that 256 / 2^e is built the same way. 
 Note: you can remove the "inline"s if your compiler complains about it 
 */
 static inline void 
-rgbe_FloatToRGBE(BYTE rgbe[4], FIRGBF *rgbf) {
+rgbe_FloatToRGBE(BYTE rgbe[4], const FIRGBF *rgbf) {
 	float v;
-	int e;
 
 	v = rgbf->red;
 	if (rgbf->green > v) v = rgbf->green;
@@ -152,7 +173,12 @@ rgbe_FloatToRGBE(BYTE rgbe[4], FIRGBF *rgbf) {
 		rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
 	}
 	else {
-		v = (float)(frexp(v, &e) * 256.0 / v);
+		// v is a normalized float (v >= 1e-32 > FLT_MIN)
+		union { float f; DWORD i; } bits;
+		bits.f = v;
+		const int e = (int)((bits.i >> 23) & 0xFF) - 126;
+		bits.i = (DWORD)(127 + 8 - e) << 23;
+		v = bits.f;
 		rgbe[0] = (BYTE) (rgbf->red * v);
 		rgbe[1] = (BYTE) (rgbf->green * v);
 		rgbe[2] = (BYTE) (rgbf->blue * v);
@@ -166,9 +192,9 @@ Note: Ward uses ldexp(col+0.5,exp-(128+8)).
 However we wanted pixels in the range [0,1] to map back into the range [0,1].
 */
 static inline void 
-rgbe_RGBEToFloat(FIRGBF *rgbf, BYTE rgbe[4]) {
+rgbe_RGBEToFloat(FIRGBF *rgbf, const BYTE rgbe[4]) {
 	if (rgbe[3]) {   // nonzero pixel
-		float f = (float)(ldexp(1.0, rgbe[3] - (int)(128+8)));
+		const float f = rgbe_Scale(rgbe[3]);
 		rgbf->red   = rgbe[0] * f;
 		rgbf->green = rgbe[1] * f;
 		rgbf->blue  = rgbe[2] * f;
@@ -179,11 +205,76 @@ rgbe_RGBEToFloat(FIRGBF *rgbf, BYTE rgbe[4]) {
 	}
 }
 
+/**
+Convert a decoded RLE scanline to float pixels. 
+The scanline buffer holds the four channels one after the other (r, g, b then e planes). 
+The SSE2 path converts 4 pixels at a time : the scale factor is built from the exponent 
+bits in integer registers and the RGB planes are interleaved with shuffles.
+*/
+static void 
+rgbe_PlanarToFloat(FIRGBF *data, const BYTE *scanline_buffer, int scanline_width) {
+	const BYTE *r = scanline_buffer;
+	const BYTE *g = r + scanline_width;
+	const BYTE *b = g + scanline_width;
+	const BYTE *e = b + scanline_width;
+
+	int x = 0;
+
+#ifdef FREEIMAGE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i bias = _mm_set1_epi32(128+8-127);
+
+	for(; x + 4 <= scanline_width; x += 4) {
+		DWORD e4;
+		memcpy(&e4, e + x, 4);
+		const __m128i ei = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)e4), zero), zero);
+		const __m128i biased = _mm_sub_epi32(ei, bias);
+		const __m128i nonzero = _mm_cmpgt_epi32(ei, zero);
+		const __m128i denormal = _mm_andnot_si128(_mm_cmpgt_epi32(biased, zero), nonzero);
+		if(_mm_movemask_epi8(denormal)) {
+			// exponents 1 to 9 : very rare, use the scalar path
+			for(int k = 0; k < 4; k++) {
+				const BYTE rgbe[4] = { r[x+k], g[x+k], b[x+k], e[x+k] };
+				rgbe_RGBEToFloat(&data[x+k], rgbe);
+			}
+			continue;
+		}
+		// scale = 2^(e-136), or 0 when e == 0
+		const __m128 scale = _mm_and_ps(_mm_castsi128_ps(_mm_slli_epi32(biased, 23)), _mm_castsi128_ps(nonzero));
+
+		DWORD r4, g4, b4;
+		memcpy(&r4, r + x, 4);
+		memcpy(&g4, g + x, 4);
+		memcpy(&b4, b + x, 4);
+		const __m128 R = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)r4), zero), zero)), scale);
+		const __m128 G = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)g4), zero), zero)), scale);
+		const __m128 B = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)b4), zero), zero)), scale);
+
+		// interleave as r0 g0 b0 r1 | g1 b1 r2 g2 | b2 r3 g3 b3
+		const __m128 rg_lo = _mm_unpacklo_ps(R, G);
+		const __m128 rg_hi = _mm_unpackhi_ps(R, G);
+		const __m128 v0 = _mm_shuffle_ps(rg_lo, _mm_shuffle_ps(B, R, _MM_SHUFFLE(1,1,0,0)), _MM_SHUFFLE(2,0,1,0));
+		const __m128 v1 = _mm_shuffle_ps(_mm_shuffle_ps(G, B, _MM_SHUFFLE(1,1,1,1)), rg_hi, _MM_SHUFFLE(1,0,2,0));
+		const __m128 v2 = _mm_shuffle_ps(_mm_shuffle_ps(B, R, _MM_SHUFFLE(3,3,2,2)), _mm_shuffle_ps(G, B, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(2,0,2,0));
+
+		float *dst = (float*)&data[x];
+		_mm_storeu_ps(dst, v0);
+		_mm_storeu_ps(dst + 4, v1);
+		_mm_storeu_ps(dst + 8, v2);
+	}
+#endif // FREEIMAGE_SSE2
+
+	for(; x < scanline_width; x++) {
+		const BYTE rgbe[4] = { r[x], g[x], b[x], e[x] };
+		rgbe_RGBEToFloat(&data[x], rgbe);
+	}
+}
+
 /**
 Minimal header reading. Modify if you want to parse more information 
 */
 static BOOL 
-rgbe_ReadHeader(FreeImageIO *io, fi_handle handle, unsigned *width, unsigned *height, rgbeHeaderInfo *header_info) {
+rgbe_ReadHeader(BufferedReader& reader, unsigned *width, unsigned *height, rgbeHeaderInfo *header_info) {
 	char buf[HDR_MAXLINE];
 	float tempf;
 	int i;
@@ -196,7 +287,7 @@ rgbe_ReadHeader(FreeImageIO *io, fi_handle handle, unsigned *width, unsigned *he
 	header_info->exposure = 1.0;
 
 	// get the first line
-	if(!rgbe_GetLine(io, handle, buf, HDR_MAXLINE))
+	if(!rgbe_GetLine(reader, buf, HDR_MAXLINE))
 		return rgbe_Error(rgbe_read_error, NULL);
 
 	// check the signature
@@ -217,7 +308,7 @@ rgbe_ReadHeader(FreeImageIO *io, fi_handle handle, unsigned *width, unsigned *he
 
 	for(;;) {
 		// get next line
-		if(!rgbe_GetLine(io, handle, buf, HDR_MAXLINE))
+		if(!rgbe_GetLine(reader, buf, HDR_MAXLINE))
 			return rgbe_Error(rgbe_read_error, NULL);
 
 		if((buf[0] == 0) || (buf[0] == '\n')) {
@@ -246,7 +337,7 @@ rgbe_ReadHeader(FreeImageIO *io, fi_handle handle, unsigned *width, unsigned *he
 	}
 
 	// get next line
-	if(!rgbe_GetLine(io, handle, buf, HDR_MAXLINE))
+	if(!rgbe_GetLine(reader, buf, HDR_MAXLINE))
 		return rgbe_Error(rgbe_read_error, NULL);
 
 	// get the image width & height
@@ -313,17 +404,20 @@ rgbe_WriteMetadata(FIBITMAP *dib, rgbeHeaderInfo *header_info) {
 }
 
 /** 
-Simple read routine. Will not correctly handle run length encoding 
+Simple read routine. Will not correctly handle run length encoding. 
+The pixels [start, scanline_width) are stored in the r, g, b and e planes of the scanline buffer.
 */
 static BOOL 
-rgbe_ReadPixels(FreeImageIO *io, fi_handle handle, FIRGBF *data, unsigned numpixels) {
+rgbe_ReadPixels(BufferedReader& reader, BYTE *scanline_buffer, int scanline_width, int start) {
   BYTE rgbe[4];
 
-  for(unsigned x = 0; x < numpixels; x++) {
-	if(io->read_proc(rgbe, 1, sizeof(rgbe), handle) < 1) {
+  for(int x = start; x < scanline_width; x++) {
+	if(reader.read(rgbe, sizeof(rgbe)) != sizeof(rgbe)) {
 		return rgbe_Error(rgbe_read_error, NULL);
 	}
-	rgbe_RGBEToFloat(&data[x], rgbe);
+	for(int i = 0; i < 4; i++) {
+		scanline_buffer[i * scanline_width + x] = rgbe[i];
+	}
   }
 
   return TRUE;
@@ -331,108 +425,88 @@ rgbe_ReadPixels(FreeImageIO *io, fi_handle handle, FIRGBF *data, unsigned numpix
 
 /**
  Simple write routine that does not use run length encoding. 
- These routines can be made faster by allocating a larger buffer and
- fread-ing and fwrite-ing the data in larger chunks.
+ Pixels are converted into a single buffer which is then written at once. 
 */
 static BOOL 
 rgbe_WritePixels(FreeImageIO *io, fi_handle handle, FIRGBF *data, unsigned numpixels) {
-  BYTE rgbe[4];
-
+  BYTE *buffer = (BYTE*)malloc(4 * numpixels * sizeof(BYTE));
+  if(!buffer) {
+	  return rgbe_Error(rgbe_memory_error, "unable to allocate buffer space");
+  }
   for(unsigned x = 0; x < numpixels; x++) {
-	  rgbe_FloatToRGBE(rgbe, &data[x]);
-	  if(io->write_proc(rgbe, sizeof(rgbe), 1, handle) < 1)
-		  return rgbe_Error(rgbe_write_error, NULL);
+	  rgbe_FloatToRGBE(&buffer[4 * x], &data[x]);
   }
+  const BOOL bOK = (io->write_proc(buffer, 4 * numpixels, 1, handle) == 1);
+  free(buffer);
 
-  return TRUE;
+  return bOK ? TRUE : rgbe_Error(rgbe_write_error, NULL);
 }
 
+/**
+Read a scanline, run length encoded or not. 
+The scanline is decoded as four planes (r, g, b then e), converted later by rgbe_PlanarToFloat.
+@param reader Input stream
+@param scanline_buffer Output buffer of 4 x scanline_width bytes
+@param scanline_width Scanline width, in pixels
+@return Returns TRUE if successful, returns FALSE otherwise
+*/
 static BOOL 
-rgbe_ReadPixels_RLE(FreeImageIO *io, fi_handle handle, FIRGBF *data, int scanline_width, unsigned num_scanlines) {
-	BYTE rgbe[4], *scanline_buffer, *ptr, *ptr_end;
+rgbe_ReadPixels_RLE(BufferedReader& reader, BYTE *scanline_buffer, int scanline_width) {
+	BYTE rgbe[4], *ptr, *ptr_end;
 	int i, count;
 	BYTE buf[2];
 	
 	if ((scanline_width < 8)||(scanline_width > 0x7fff)) {
 		// run length encoding is not allowed so read flat
-		return rgbe_ReadPixels(io, handle, data, scanline_width * num_scanlines);
-	}
-	scanline_buffer = NULL;
-	// read in each successive scanline 
-	while(num_scanlines > 0) {
-		if(io->read_proc(rgbe, 1, sizeof(rgbe), handle) < 1) {
-			free(scanline_buffer);
-			return rgbe_Error(rgbe_read_error,NULL);
-		}
-		if((rgbe[0] != 2) || (rgbe[1] != 2) || (rgbe[2] & 0x80)) {
-			// this file is not run length encoded
-			rgbe_RGBEToFloat(data, rgbe);
-			data ++;
-			free(scanline_buffer);
-			return rgbe_ReadPixels(io, handle, data, scanline_width * num_scanlines - 1);
-		}
-		if((((int)rgbe[2]) << 8 | rgbe[3]) != scanline_width) {
-			free(scanline_buffer);
-			return rgbe_Error(rgbe_format_error,"wrong scanline width");
+		return rgbe_ReadPixels(reader, scanline_buffer, scanline_width, 0);
+	}
+	if(reader.read(rgbe, sizeof(rgbe)) != sizeof(rgbe)) {
+		return rgbe_Error(rgbe_read_error,NULL);
+	}
+	if((rgbe[0] != 2) || (rgbe[1] != 2) || (rgbe[2] & 0x80)) {
+		// this scanline is not run length encoded
+		for(i = 0; i < 4; i++) {
+			scanline_buffer[i * scanline_width] = rgbe[i];
 		}
-		if(scanline_buffer == NULL) {
-			scanline_buffer = (BYTE*)malloc(sizeof(BYTE) * 4 * scanline_width);
-			if(scanline_buffer == NULL) {
-				return rgbe_Error(rgbe_memory_error, "unable to allocate buffer space");
+		return rgbe_ReadPixels(reader, scanline_buffer, scanline_width, 1);
+	}
+	if((((int)rgbe[2]) << 8 | rgbe[3]) != scanline_width) {
+		return rgbe_Error(rgbe_format_error,"wrong scanline width");
+	}
+	
+	ptr = &scanline_buffer[0];
+	// read each of the four channels for the scanline into the buffer
+	for(i = 0; i < 4; i++) {
+		ptr_end = &scanline_buffer[(i+1)*scanline_width];
+		while(ptr < ptr_end) {
+			if(reader.read(buf, 2 * sizeof(BYTE)) != 2 * sizeof(BYTE)) {
+				return rgbe_Error(rgbe_read_error, NULL);
 			}
-		}
-		
-		ptr = &scanline_buffer[0];
-		// read each of the four channels for the scanline into the buffer
-		for(i = 0; i < 4; i++) {
-			ptr_end = &scanline_buffer[(i+1)*scanline_width];
-			while(ptr < ptr_end) {
-				if(io->read_proc(buf, 1, 2 * sizeof(BYTE), handle) < 1) {
-					free(scanline_buffer);
-					return rgbe_Error(rgbe_read_error, NULL);
+			if(buf[0] > 128) {
+				// a run of the same value
+				count = buf[0] - 128;
+				if((count == 0) || (count > ptr_end - ptr)) {
+					return rgbe_Error(rgbe_format_error, "bad scanline data");
 				}
-				if(buf[0] > 128) {
-					// a run of the same value
-					count = buf[0] - 128;
-					if((count == 0) || (count > ptr_end - ptr)) {
-						free(scanline_buffer);
-						return rgbe_Error(rgbe_format_error, "bad scanline data");
-					}
-					while(count-- > 0)
-						*ptr++ = buf[1];
+				memset(ptr, buf[1], count);
+				ptr += count;
+			}
+			else {
+				// a non-run
+				count = buf[0];
+				if((count == 0) || (count > ptr_end - ptr)) {
+					return rgbe_Error(rgbe_format_error, "bad scanline data");
 				}
-				else {
-					// a non-run
-					count = buf[0];
-					if((count == 0) || (count > ptr_end - ptr)) {
-						free(scanline_buffer);
-						return rgbe_Error(rgbe_format_error, "bad scanline data");
-					}
-					*ptr++ = buf[1];
-					if(--count > 0) {
-						if(io->read_proc(ptr, 1, sizeof(BYTE) * count, handle) < 1) {
-							free(scanline_buffer);
-							return rgbe_Error(rgbe_read_error, NULL);
-						}
-						ptr += count;
+				*ptr++ = buf[1];
+				if(--count > 0) {
+					if(reader.read(ptr, sizeof(BYTE) * count) != sizeof(BYTE) * count) {
+						return rgbe_Error(rgbe_read_error, NULL);
 					}
+					ptr += count;
 				}
 			}
 		}
-		// now convert data from buffer into floats
-		for(i = 0; i < scanline_width; i++) {
-			rgbe[0] = scanline_buffer[i];
-			rgbe[1] = scanline_buffer[i+scanline_width];
-			rgbe[2] = scanline_buffer[i+2*scanline_width];
-			rgbe[3] = scanline_buffer[i+3*scanline_width];
-			rgbe_RGBEToFloat(data, rgbe);
-			data ++;
-		}
-
-		num_scanlines--;
 	}
-
-	free(scanline_buffer);
 	
 	return TRUE;
 }
@@ -442,13 +516,14 @@ rgbe_ReadPixels_RLE(FreeImageIO *io, fi_handle handle, FIRGBF *data, int scanlin
  Run length encoding adds considerable complexity but does 
  save some space.  For each scanline, each channel (r,g,b,e) is 
  encoded separately for better compression. 
- @return Returns TRUE if successful, returns FALSE otherwise
+ @param dst Output buffer, large enough to hold numbytes + (numbytes + 127) / 128 bytes
+ @return Returns the number of bytes written to dst
 */
-static BOOL 
-rgbe_WriteBytes_RLE(FreeImageIO *io, fi_handle handle, BYTE *data, int numbytes) {
+static unsigned 
+rgbe_WriteBytes_RLE(BYTE *dst, const BYTE *data, int numbytes) {
 	static const int MINRUNLENGTH = 4;
 	int cur, beg_run, run_count, old_run_count, nonrun_count;
-	BYTE buf[2];
+	BYTE *out = dst;
 	
 	cur = 0;
 	while(cur < numbytes) {
@@ -465,10 +540,8 @@ rgbe_WriteBytes_RLE(FreeImageIO *io, fi_handle handle, BYTE *data, int numbytes)
 		}
 		// if data before next big run is a short run then write it as such 
 		if ((old_run_count > 1)&&(old_run_count == beg_run - cur)) {
-			buf[0] = (BYTE)(128 + old_run_count);   // write short run
-			buf[1] = data[cur];
-			if(io->write_proc(buf, 2 * sizeof(BYTE), 1, handle) < 1)
-				return rgbe_Error(rgbe_write_error, NULL);
+			*out++ = (BYTE)(128 + old_run_count);   // write short run
+			*out++ = data[cur];
 			cur = beg_run;
 		}
 		// write out bytes until we reach the start of the next run 
@@ -476,68 +549,72 @@ rgbe_WriteBytes_RLE(FreeImageIO *io, fi_handle handle, BYTE *data, int numbytes)
 			nonrun_count = beg_run - cur;
 			if (nonrun_count > 128) 
 				nonrun_count = 128;
-			buf[0] = (BYTE)nonrun_count;
-			if(io->write_proc(buf, sizeof(buf[0]), 1, handle) < 1)
-				return rgbe_Error(rgbe_write_error,NULL);
-			if(io->write_proc(&data[cur], sizeof(data[0]) * nonrun_count, 1, handle) < 1)
-				return rgbe_Error(rgbe_write_error,NULL);
+			*out++ = (BYTE)nonrun_count;
+			memcpy(out, &data[cur], nonrun_count);
+			out += nonrun_count;
 			cur += nonrun_count;
 		}
 		// write out next run if one was found 
 		if (run_count >= MINRUNLENGTH) {
-			buf[0] = (BYTE)(128 + run_count);
-			buf[1] = data[beg_run];
-			if(io->write_proc(buf, sizeof(buf[0]) * 2, 1, handle) < 1)
-				return rgbe_Error(rgbe_write_error,NULL);
+			*out++ = (BYTE)(128 + run_count);
+			*out++ = data[beg_run];
 			cur += run_count;
 		}
 	}
 	
-	return TRUE;
+	return (unsigned)(out - dst);
+}
+
+/**
+Size of the work buffer used by rgbe_WritePixels_RLE : a planar scanline, followed by 
+the encoded scanline (in the worst case, a count byte is added every 128 bytes)
+*/
+static inline unsigned 
+rgbe_RLEBufferSize(unsigned scanline_width) {
+	return 4 * scanline_width + 4 + 4 * (scanline_width + scanline_width / 128 + 2);
 }
 
+/**
+Write a scanline. 
+@param io Output stream
+@param handle Output stream handle
+@param data Input scanline
+@param scanline_width Scanline width, in pixels
+@param buffer Work buffer of at least rgbe_RLEBufferSize(scanline_width) bytes
+@return Returns TRUE if successful, returns FALSE otherwise
+*/
 static BOOL 
-rgbe_WritePixels_RLE(FreeImageIO *io, fi_handle handle, FIRGBF *data, unsigned scanline_width, unsigned num_scanlines) {
+rgbe_WritePixels_RLE(FreeImageIO *io, fi_handle handle, FIRGBF *data, unsigned scanline_width, BYTE *buffer) {
 	BYTE rgbe[4];
-	BYTE *buffer;
 	
 	if ((scanline_width < 8)||(scanline_width > 0x7fff)) {
 		// run length encoding is not allowed so write flat
-		return rgbe_WritePixels(io, handle, data, scanline_width * num_scanlines);
-	}
-	buffer = (BYTE*)malloc(sizeof(BYTE) * 4 * scanline_width);
-	if (buffer == NULL) {
-		// no buffer space so write flat 
-		return rgbe_WritePixels(io, handle, data, scanline_width * num_scanlines);
-	}
-	while(num_scanlines-- > 0) {
-		rgbe[0] = (BYTE)2;
-		rgbe[1] = (BYTE)2;
-		rgbe[2] = (BYTE)(scanline_width >> 8);
-		rgbe[3] = (BYTE)(scanline_width & 0xFF);
-		if(io->write_proc(rgbe, sizeof(rgbe), 1, handle) < 1) {
-			free(buffer);
-			return rgbe_Error(rgbe_write_error, NULL);
-		}
-		for(unsigned x = 0; x < scanline_width; x++) {
-			rgbe_FloatToRGBE(rgbe, data);
-			buffer[x] = rgbe[0];
-			buffer[x+scanline_width] = rgbe[1];
-			buffer[x+2*scanline_width] = rgbe[2];
-			buffer[x+3*scanline_width] = rgbe[3];
-			data ++;
-		}
-		// write out each of the four channels separately run length encoded
-		// first red, then green, then blue, then exponent
-		for(int i = 0; i < 4; i++) {
-			BOOL bOK = rgbe_WriteBytes_RLE(io, handle, &buffer[i*scanline_width], scanline_width);
-			if(!bOK) {
-				free(buffer);
-				return bOK;
-			}
-		}
+		return rgbe_WritePixels(io, handle, data, scanline_width);
+	}
+	BYTE *encoded = buffer + 4 * scanline_width;
+
+	encoded[0] = (BYTE)2;
+	encoded[1] = (BYTE)2;
+	encoded[2] = (BYTE)(scanline_width >> 8);
+	encoded[3] = (BYTE)(scanline_width & 0xFF);
+	for(unsigned x = 0; x < scanline_width; x++) {
+		rgbe_FloatToRGBE(rgbe, data);
+		buffer[x] = rgbe[0];
+		buffer[x+scanline_width] = rgbe[1];
+		buffer[x+2*scanline_width] = rgbe[2];
+		buffer[x+3*scanline_width] = rgbe[3];
+		data ++;
+	}
+	// encode each of the four channels separately run length encoded
+	// first red, then green, then blue, then exponent
+	unsigned size = 4;
+	for(int i = 0; i < 4; i++) {
+		size += rgbe_WriteBytes_RLE(&encoded[size], &buffer[i*scanline_width], scanline_width);
+	}
+	// and write the whole scanline at once
+	if(io->write_proc(encoded, size, 1, handle) < 1) {
+		return rgbe_Error(rgbe_write_error, NULL);
 	}
-	free(buffer);
 	
 	return TRUE;
 }
@@ -603,6 +680,57 @@ SupportsNoPixels() {
 
 // --------------------------------------------------------------------------
 
+/// Number of pixels decoded before a conversion to floats (the planar buffer holds 4 bytes per pixel)
+#define HDR_BATCH_PIXELS	(1 << 20)
+/// Number of pixels converted by a work item
+#define HDR_BAND_PIXELS		(1 << 16)
+
+/**
+Conversion of a batch of decoded scanlines to float pixels. 
+The scanlines are read sequentially from the stream, then the batch is 
+converted by bands of rows on one thread per processor.
+*/
+class rgbeConvertTask : public ParallelTask {
+public:
+	/**
+	@param dib Destination image
+	@param buffer Planar scanlines of the batch (4 x width bytes per scanline)
+	@param band_rows Number of rows converted by a work item
+	*/
+	rgbeConvertTask(FIBITMAP *dib, const BYTE *buffer, unsigned band_rows) :
+		_dib(dib), _buffer(buffer), _width(FreeImage_GetWidth(dib)), _height(FreeImage_GetHeight(dib)),
+		_band_rows(band_rows), _first(0), _rows(0) {
+	}
+
+	/**
+	Convert the scanlines [first, first + rows) held by the buffer
+	*/
+	void convert(unsigned first, unsigned rows) {
+		_first = first;
+		_rows = rows;
+		const unsigned band_count = (rows + _band_rows - 1) / _band_rows;
+		ParallelRun(*this, band_count, MIN(GetProcessorCount(), band_count));
+	}
+
+	void run(unsigned item, unsigned thread) {
+		const unsigned end = MIN(_rows, (item + 1) * _band_rows);
+		for(unsigned k = item * _band_rows; k < end; k++) {
+			FIRGBF *scanline = (FIRGBF*)FreeImage_GetScanLine(_dib, _height - 1 - (_first + k));
+			rgbe_PlanarToFloat(scanline, _buffer + k * 4 * _width, (int)_width);
+		}
+	}
+
+private:
+	FIBITMAP *_dib;
+	const BYTE *_buffer;
+	unsigned _width;
+	unsigned _height;
+	unsigned _band_rows;
+	//! first scanline (from the top) and number of scanlines of the current batch
+	unsigned _first;
+	unsigned _rows;
+};
+
 static FIBITMAP * DLL_CALLCONV
 Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 	FIBITMAP *dib = NULL;
@@ -613,13 +741,20 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 
 	BOOL header_only = (flags & FIF_LOAD_NOPIXELS) == FIF_LOAD_NOPIXELS;
 
+	BYTE *scanline_buffer = NULL;
+
 	try {
 
 		rgbeHeaderInfo header_info;
 		unsigned width, height;
 
+		BufferedReader reader(io, handle);
+		if(reader.isNull()) {
+			throw FI_MSG_ERROR_MEMORY;
+		}
+
 		// Read the header
-		if(rgbe_ReadHeader(io, handle, &width, &height, &header_info) == FALSE) {
+		if(rgbe_ReadHeader(reader, &width, &height, &header_info) == FALSE) {
 			return NULL;
 		}
 
@@ -637,22 +772,38 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 			return dib;
 		}
 
-		// read the image pixels and fill the dib
+		// read the image pixels and fill the dib, by batches of scanlines
+
+		const unsigned batch_rows = MIN(height, MAX(1U, HDR_BATCH_PIXELS / width));
+		scanline_buffer = (BYTE*)malloc(batch_rows * 4 * width * sizeof(BYTE));
+		if(!scanline_buffer) {
+			throw FI_MSG_ERROR_MEMORY;
+		}
+
+		rgbeConvertTask task(dib, scanline_buffer, MAX(1U, HDR_BAND_PIXELS / width));
 		
-		for(unsigned y = 0; y < height; y++) {
-			FIRGBF *scanline = (FIRGBF*)FreeImage_GetScanLine(dib, height - 1 - y);
-			if(!rgbe_ReadPixels_RLE(io, handle, scanline, width, 1)) {
-				FreeImage_Unload(dib);
-				return NULL;
+		for(unsigned first = 0; first < height; first += batch_rows) {
+			const unsigned rows = MIN(batch_rows, height - first);
+			for(unsigned k = 0; k < rows; k++) {
+				if(!rgbe_ReadPixels_RLE(reader, scanline_buffer + k * 4 * width, width)) {
+					free(scanline_buffer);
+					FreeImage_Unload(dib);
+					return NULL;
+				}
 			}
+			task.convert(first, rows);
 		}
 
+		free(scanline_buffer);
+
 	}
 	catch(const char *text) {
+		free(scanline_buffer);
 		if(dib != NULL) {
 			FreeImage_Unload(dib);
 		}
 		FreeImage_OutputMessageProc(s_format_id, text);
+		return NULL;
 	}
 
 	return dib;
@@ -685,13 +836,21 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 
 	// write each scanline
 
+	BYTE *buffer = (BYTE*)malloc(rgbe_RLEBufferSize(width) * sizeof(BYTE));
+	if(!buffer) {
+		return rgbe_Error(rgbe_memory_error, "unable to allocate buffer space");
+	}
+
 	for(unsigned y = 0; y < height; y++) {
 		FIRGBF *scanline = (FIRGBF*)FreeImage_GetScanLine(dib, height - 1 - y);
-		if(!rgbe_WritePixels_RLE(io, handle, scanline, width, 1)) {
+		if(!rgbe_WritePixels_RLE(io, handle, scanline, width, buffer)) {
+			free(buffer);
 			return FALSE;
 		}
 	}
 
+	free(buffer);
+
 	return TRUE;
 }
 
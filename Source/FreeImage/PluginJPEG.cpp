@@ -58,6 +58,8 @@ static int s_format_id;
 
 #define INPUT_BUF_SIZE  4096	// choose an efficiently fread'able size 
 #define OUTPUT_BUF_SIZE 4096    // choose an efficiently fwrite'able size
+#define MAX_SCANLINES	16		// number of scanlines read or written per call to the codec
+#define MAX_ORIENTED_SCANLINES	256	// number of scanlines buffered before being oriented
 
 #define EXIF_MARKER		(JPEG_APP0+1)	// EXIF marker / Adobe XMP marker
 #define ICC_MARKER		(JPEG_APP0+2)	// ICC profile marker
@@ -758,6 +760,24 @@ read_markers(j_decompress_ptr cinfo, FIBITMAP *dib) {
 	return TRUE;
 }
 
+/**
+	Read the Exif orientation of the image, before the markers are attached to a dib
+	@return Returns the orientation in the range [1..8], 1 if the image has no orientation tag
+*/
+static WORD 
+read_orientation(j_decompress_ptr cinfo) {
+	WORD orientation = 1;
+
+	// as with read_markers, the last Exif profile wins
+	for(jpeg_saved_marker_ptr marker = cinfo->marker_list; marker != NULL; marker = marker->next) {
+		if(marker->marker == EXIF_MARKER) {
+			jpeg_read_exif_orientation(marker->data, marker->data_length, &orientation);
+		}
+	}
+
+	return orientation;
+}
+
 // ----------------------------------------------------------
 //   Special markers write functions
 // ----------------------------------------------------------
@@ -1088,6 +1108,158 @@ store_size_info(FIBITMAP *dib, JDIMENSION width, JDIMENSION height) {
 	}
 }
 
+// ----------------------------------------------------------
+//   Scanline color order
+// ----------------------------------------------------------
+
+/**
+Get the colorspace used to exchange RGB scanlines with the codec in the FreeImage color order.
+Besides JCS_RGB, this requires the extended colorspaces of libjpeg-turbo.
+@param alpha If TRUE, get a 32-bit layout with an alpha channel
+@return Returns the colorspace, or JCS_UNKNOWN if the linked library does not support the layout
+*/
+static J_COLOR_SPACE
+GetNativeColorSpace(BOOL alpha) {
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+#if defined(JCS_ALPHA_EXTENSIONS)
+	if(alpha) {
+		return JCS_EXT_BGRA;
+	}
+#endif
+#if defined(JCS_EXTENSIONS)
+	if(!alpha) {
+		return JCS_EXT_BGR;
+	}
+#endif
+#else
+#if defined(JCS_ALPHA_EXTENSIONS)
+	if(alpha) {
+		return JCS_EXT_RGBA;
+	}
+#endif
+	if(!alpha) {
+		return JCS_RGB;
+	}
+#endif
+	return JCS_UNKNOWN;
+}
+
+/**
+Convert in place a scanline of RGB samples to the FreeImage color order
+@param line Scanline holding 'width' RGB pixels
+@param width Number of pixels
+@param alpha If TRUE, expand the scanline to 32-bit with an opaque alpha channel
+(the scanline must be 4 * width bytes long)
+*/
+static void
+ConvertLineFromRGB(BYTE *line, unsigned width, BOOL alpha) {
+	if(alpha) {
+		// expand from right to left, so that no sample is overwritten before being read
+		for(int x = (int)width - 1; x >= 0; x--) {
+			const BYTE red   = line[3 * x];
+			const BYTE green = line[3 * x + 1];
+			const BYTE blue  = line[3 * x + 2];
+			BYTE *dst = line + 4 * x;
+			dst[FI_RGBA_RED]   = red;
+			dst[FI_RGBA_GREEN] = green;
+			dst[FI_RGBA_BLUE]  = blue;
+			dst[FI_RGBA_ALPHA] = 0xFF;
+		}
+	} else {
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+		for(unsigned x = 0; x < width; x++) {
+			INPLACESWAP(line[0], line[2]);
+			line += 3;
+		}
+#endif
+	}
+}
+
+/**
+Convert in place a scanline of LibJPEG CMYK samples
+@param line Scanline holding 'width' CMYK pixels
+@param width Number of pixels
+@param rgb If TRUE, convert to 24-bit RGB in the FreeImage color order,
+otherwise convert to standard (non inverted) CMYK
+*/
+static void
+ConvertLineFromCMYK(BYTE *line, unsigned width, BOOL rgb) {
+	if(rgb) {
+		// the samples of a pixel are read before being overwritten by the previous (smaller) pixels
+		const BYTE *src = line;
+		BYTE *dst = line;
+		for(unsigned x = 0; x < width; x++) {
+			const WORD C = (WORD)src[0];
+			const WORD M = (WORD)src[1];
+			const WORD Y = (WORD)src[2];
+			const WORD K = (WORD)src[3];
+			dst[FI_RGBA_RED]   = (BYTE)((K * C) / 255);	// C -> R
+			dst[FI_RGBA_GREEN] = (BYTE)((K * M) / 255);	// M -> G
+			dst[FI_RGBA_BLUE]  = (BYTE)((K * Y) / 255);	// Y -> B
+			src += 4;
+			dst += 3;
+		}
+	} else {
+		// CMYK pixels are inverted
+		for(unsigned i = 0; i < 4 * width; i++) {
+			line[i] = ~line[i];
+		}
+	}
+}
+
+// ----------------------------------------------------------
+//   Exif orientation
+// ----------------------------------------------------------
+
+/**
+Copy a block of decoded scanlines to their final position in a dib oriented according to the Exif orientation.
+Orientations 5 to 8 transpose the image: the dib is allocated as height x width and each decoded scanline
+becomes a column.
+@param dib Destination dib, allocated with the oriented size
+@param block Decoded scanlines, in the pixel format of the dib
+@param pitch Distance in bytes between two scanlines of the block
+@param first Index of the first scanline, counted from the top of the decoded image
+@param count Number of scanlines
+@param width Width of the decoded image
+@param height Height of the decoded image
+@param orientation Exif orientation, in the range [1..8]
+*/
+static void
+PutOrientedScanlines(FIBITMAP *dib, const BYTE *block, unsigned pitch, unsigned first, unsigned count, unsigned width, unsigned height, WORD orientation) {
+	const unsigned bytespp = FreeImage_GetBPP(dib) / 8;
+
+	// mirror the decoded columns, resp. rows, of the image
+	const BOOL flip_x = (orientation == 2) || (orientation == 3) || (orientation == 7) || (orientation == 8);
+	const BOOL flip_y = (orientation == 3) || (orientation == 4) || (orientation == 6) || (orientation == 7);
+
+	if(orientation < 5) {
+		for(unsigned k = 0; k < count; k++) {
+			const unsigned y = flip_y ? height - 1 - (first + k) : first + k;
+			BYTE *dst = FreeImage_GetScanLine(dib, height - 1 - y);
+			const BYTE *src = block + k * pitch;
+
+			if(flip_x) {
+				ReversePixels(dst, src, width, bytespp);
+			} else {
+				memcpy(dst, src, width * bytespp);
+			}
+		}
+	} else {
+		// decoded column x becomes the dib line x (counted from the top), walked backwards unless flip_x is set
+		BYTE *dst = flip_x ? FreeImage_GetBits(dib) : FreeImage_GetScanLine(dib, width - 1);
+		const int dst_pitch = flip_x ? (int)FreeImage_GetPitch(dib) : -(int)FreeImage_GetPitch(dib);
+
+		// decoded scanline y becomes the dib column y, mirrored columns are handled by walking the block backwards
+		if(flip_y) {
+			dst += (height - first - count) * bytespp;
+			TransposePixels(dst, dst_pitch, block + (count - 1) * pitch, -(int)pitch, width, count, bytespp);
+		} else {
+			dst += first * bytespp;
+			TransposePixels(dst, dst_pitch, block, (int)pitch, width, count, bytespp);
+		}
+	}
+}
+
 // ==========================================================
 // Plugin Implementation
 // ==========================================================
@@ -1155,7 +1327,7 @@ SupportsNoPixels() {
 static FIBITMAP * DLL_CALLCONV
 Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 	if (handle) {
-		FIBITMAP *dib = NULL;
+		FIBITMAP *volatile dib = NULL;
 
 		BOOL header_only = (flags & FIF_LOAD_NOPIXELS) == FIF_LOAD_NOPIXELS;
 
@@ -1227,27 +1399,63 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 				cinfo.out_color_space = JCS_GRAYSCALE;
 			}
 
+			// step 4b: get colour scanlines in the FreeImage color order if the codec allows it,
+			// otherwise they are decoded as RGB and converted in place
+
+			const BOOL bLoadAsRGBA = ((flags & JPEG_RGBA) == JPEG_RGBA) && (cinfo.out_color_space == JCS_RGB);
+			BOOL bConvertRGB = FALSE;
+
+			if(cinfo.out_color_space == JCS_RGB) {
+				const J_COLOR_SPACE native_color_space = GetNativeColorSpace(bLoadAsRGBA);
+				if(native_color_space != JCS_UNKNOWN) {
+					cinfo.out_color_space = native_color_space;
+				} else {
+					bConvertRGB = TRUE;
+				}
+			}
+
+			// step 4c: a progressive JPEG limited to its first scans is decoded in buffered-image mode,
+			// so that the refinement scans which are not needed are never entropy decoded
+
+			const int max_scans = (flags >> 8) & 0x7F;
+			const BOOL bBufferedImage = !header_only && (max_scans > 0) && jpeg_has_multiple_scans(&cinfo);
+
+			if(bBufferedImage) {
+				cinfo.buffered_image = TRUE;
+			}
+
 			// step 5a: start decompressor and calculate output width and height
 
 			jpeg_start_decompress(&cinfo);
 
-			// step 5b: allocate dib and init header
+			// step 5b: get the Exif orientation, so that the dib is allocated with its final size
+			// and the decoded scanlines are written at their final position
+
+			WORD orientation = 1;
+			if(!header_only && ((flags & JPEG_EXIFROTATE) == JPEG_EXIFROTATE)) {
+				orientation = read_orientation(&cinfo);
+			}
+			const unsigned dib_width  = (orientation < 5) ? cinfo.output_width : cinfo.output_height;
+			const unsigned dib_height = (orientation < 5) ? cinfo.output_height : cinfo.output_width;
+
+			// step 5c: allocate dib and init header
 
 			if((cinfo.output_components == 4) && (cinfo.out_color_space == JCS_CMYK)) {
 				// CMYK image
 				if((flags & JPEG_CMYK) == JPEG_CMYK) {
 					// load as CMYK
-					dib = FreeImage_AllocateHeader(header_only, cinfo.output_width, cinfo.output_height, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+					dib = FreeImage_AllocateHeader(header_only, dib_width, dib_height, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
 					if(!dib) throw FI_MSG_ERROR_DIB_MEMORY;
 					FreeImage_GetICCProfile(dib)->flags |= FIICC_COLOR_IS_CMYK;
 				} else {
 					// load as CMYK and convert to RGB
-					dib = FreeImage_AllocateHeader(header_only, cinfo.output_width, cinfo.output_height, 24, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+					dib = FreeImage_AllocateHeader(header_only, dib_width, dib_height, 24, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
 					if(!dib) throw FI_MSG_ERROR_DIB_MEMORY;
 				}
 			} else {
 				// RGB or greyscale image
-				dib = FreeImage_AllocateHeader(header_only, cinfo.output_width, cinfo.output_height, 8 * cinfo.output_components, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+				const unsigned bpp = bLoadAsRGBA ? 32 : 8 * cinfo.output_components;
+				dib = FreeImage_AllocateHeader(header_only, dib_width, dib_height, bpp, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
 				if(!dib) throw FI_MSG_ERROR_DIB_MEMORY;
 
 				if (cinfo.output_components == 1) {
@@ -1266,7 +1474,7 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 				store_size_info(dib, cinfo.image_width, cinfo.image_height);
 			}
 
-			// step 5c: handle metrices
+			// step 5d: handle metrices
 
 			if (cinfo.density_unit == 1) {
 				// dots/inch
@@ -1291,93 +1499,97 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 				return dib;
 			}
 
+			// step 6b: absorb the requested scans (or the whole file if it has less scans),
+			// then output the image they describe
+
+			if(bBufferedImage) {
+				int status = JPEG_SUSPENDED;
+				do {
+					status = jpeg_consume_input(&cinfo);
+				} while((status != JPEG_REACHED_EOI) && (status != JPEG_SUSPENDED) && !((status == JPEG_SCAN_COMPLETED) && (cinfo.input_scan_number >= max_scans)));
+
+				jpeg_start_output(&cinfo, cinfo.input_scan_number);
+			}
+
 			// step 7a: while (scan lines remain to be read) jpeg_read_scanlines(...);
+			// Several scanlines are read per call, straight into the dib unless they have to be
+			// converted to a smaller pixel format (CMYK to RGB) or oriented
 
-			if((cinfo.out_color_space == JCS_CMYK) && ((flags & JPEG_CMYK) != JPEG_CMYK)) {
-				// convert from CMYK to RGB
+			const BOOL bConvertCMYK = (cinfo.out_color_space == JCS_CMYK);
+			const BOOL bCMYKtoRGB = bConvertCMYK && ((flags & JPEG_CMYK) != JPEG_CMYK);
 
-				JSAMPARRAY buffer;		// output row buffer
-				unsigned row_stride;	// physical row width in output buffer
+			// Oriented scanlines are buffered by larger blocks, so that each line of a transposed
+			// dib is written (and kept in cache) for many scanlines at once
 
+			BYTE *buffer = NULL;
+			JDIMENSION row_stride = 0;
+			JDIMENSION block = MAX_SCANLINES;
+
+			if(orientation != 1) {
+				block = MAX_ORIENTED_SCANLINES;
+			}
+			if(bCMYKtoRGB || (orientation != 1)) {
 				// JSAMPLEs per row in output buffer
-				row_stride = cinfo.output_width * cinfo.output_components;
-				// make a one-row-high sample array that will go away when done with image
-				buffer = (*cinfo.mem->alloc_sarray)((j_common_ptr) &cinfo, JPOOL_IMAGE, row_stride, 1);
-
-				while (cinfo.output_scanline < cinfo.output_height) {
-					JSAMPROW src = buffer[0];
-					JSAMPROW dst = FreeImage_GetScanLine(dib, cinfo.output_height - cinfo.output_scanline - 1);
-
-					jpeg_read_scanlines(&cinfo, buffer, 1);
-
-					for(unsigned x = 0; x < cinfo.output_width; x++) {
-						WORD K = (WORD)src[3];
-						dst[FI_RGBA_RED]   = (BYTE)((K * src[0]) / 255);	// C -> R
-						dst[FI_RGBA_GREEN] = (BYTE)((K * src[1]) / 255);	// M -> G
-						dst[FI_RGBA_BLUE]  = (BYTE)((K * src[2]) / 255);	// Y -> B
-						src += 4;
-						dst += 3;
-					}
-				}
-			} else if((cinfo.out_color_space == JCS_CMYK) && ((flags & JPEG_CMYK) == JPEG_CMYK)) {
-				// convert from LibJPEG CMYK to standard CMYK
+				row_stride = cinfo.output_width * MAX((unsigned)cinfo.output_components, FreeImage_GetBPP(dib) / 8);
+				// make a block of rows that will go away when done with image
+				buffer = (BYTE*)(*cinfo.mem->alloc_large)((j_common_ptr) &cinfo, JPOOL_IMAGE, (size_t)row_stride * block);
+			}
 
-				JSAMPARRAY buffer;		// output row buffer
-				unsigned row_stride;	// physical row width in output buffer
+			JSAMPROW rows[MAX_ORIENTED_SCANLINES];
 
-				// JSAMPLEs per row in output buffer
-				row_stride = cinfo.output_width * cinfo.output_components;
-				// make a one-row-high sample array that will go away when done with image
-				buffer = (*cinfo.mem->alloc_sarray)((j_common_ptr) &cinfo, JPOOL_IMAGE, row_stride, 1);
-
-				while (cinfo.output_scanline < cinfo.output_height) {
-					JSAMPROW src = buffer[0];
-					JSAMPROW dst = FreeImage_GetScanLine(dib, cinfo.output_height - cinfo.output_scanline - 1);
-
-					jpeg_read_scanlines(&cinfo, buffer, 1);
-
-					for(unsigned x = 0; x < cinfo.output_width; x++) {
-						// CMYK pixels are inverted
-						dst[0] = ~src[0];	// C
-						dst[1] = ~src[1];	// M
-						dst[2] = ~src[2];	// Y
-						dst[3] = ~src[3];	// K
-						src += 4;
-						dst += 4;
-					}
+			while (cinfo.output_scanline < cinfo.output_height) {
+				const JDIMENSION first = cinfo.output_scanline;
+				const JDIMENSION count = MIN(block, cinfo.output_height - first);
+
+				for(JDIMENSION k = 0; k < count; k++) {
+					rows[k] = buffer ? buffer + k * row_stride : FreeImage_GetScanLine(dib, cinfo.output_height - first - k - 1);
 				}
 
-			} else {
-				// normal case (RGB or greyscale image)
+				JDIMENSION read = 0;
+				while(read < count) {
+					const JDIMENSION lines = jpeg_read_scanlines(&cinfo, rows + read, MIN((JDIMENSION)MAX_SCANLINES, count - read));
+					if(lines == 0) {
+						break;
+					}
+					read += lines;
+				}
 
-				while (cinfo.output_scanline < cinfo.output_height) {
-					JSAMPROW dst = FreeImage_GetScanLine(dib, cinfo.output_height - cinfo.output_scanline - 1);
+				// step 7b: convert the scanlines to the pixel format of the dib
+				// RGB scanlines are converted to the FreeImage color order if the codec could not do it
+				// (see LibJPEG/jmorecfg.h: #define RGB_RED, ...)
+				// The default behavior of the JPEG library is kept "as is" because LibTIFF uses
+				// LibJPEG "as is".
 
-					jpeg_read_scanlines(&cinfo, &dst, 1);
+				if(bConvertCMYK) {
+					for(JDIMENSION k = 0; k < read; k++) {
+						ConvertLineFromCMYK(rows[k], cinfo.output_width, bCMYKtoRGB);
+					}
+				} else if(bConvertRGB) {
+					for(JDIMENSION k = 0; k < read; k++) {
+						ConvertLineFromRGB(rows[k], cinfo.output_width, bLoadAsRGBA);
+					}
 				}
 
-				// step 7b: swap red and blue components (see LibJPEG/jmorecfg.h: #define RGB_RED, ...)
-				// The default behavior of the JPEG library is kept "as is" because LibTIFF uses 
-				// LibJPEG "as is".
+				// step 7c: copy buffered scanlines to their (oriented) position in the dib
 
-#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
-				SwapRedBlue32(dib);
-#endif
+				if(buffer) {
+					PutOrientedScanlines(dib, buffer, row_stride, first, read, cinfo.output_width, cinfo.output_height, orientation);
+				}
 			}
 
 			// step 8: finish decompression
+			// (in buffered-image mode, the remaining scans are skipped by not calling jpeg_finish_decompress)
 
-			jpeg_finish_decompress(&cinfo);
+			if(bBufferedImage) {
+				jpeg_finish_output(&cinfo);
+			} else {
+				jpeg_finish_decompress(&cinfo);
+			}
 
 			// step 9: release JPEG decompression object
 
 			jpeg_destroy_decompress(&cinfo);
 
-			// check for automatic Exif rotation
-			if(!header_only && ((flags & JPEG_EXIFROTATE) == JPEG_EXIFROTATE)) {
-				RotateExif(&dib);
-			}
-
 			// everything went well. return the loaded dib
 
 			return dib;
@@ -1460,11 +1672,18 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 					break;
 
 				default :
-					cinfo.in_color_space = JCS_RGB;
+				{
+					// pass colour scanlines in the FreeImage color order if the codec allows it
+					const J_COLOR_SPACE native_color_space = GetNativeColorSpace(FALSE);
+					cinfo.in_color_space = (native_color_space != JCS_UNKNOWN) ? native_color_space : JCS_RGB;
 					cinfo.input_components = 3;
 					break;
+				}
 			}
 
+			// RGB scanlines must be converted if the codec cannot read the FreeImage color order
+			const BOOL bSwapRGB = (cinfo.input_components == 3) && (GetNativeColorSpace(FALSE) == JCS_UNKNOWN);
+
 			jpeg_set_defaults(&cinfo);
 
 		    // progressive-JPEG support
@@ -1497,7 +1716,7 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 
 			// set subsampling options if required
 
-			if(cinfo.in_color_space == JCS_RGB) {
+			if(cinfo.input_components == 3) {
 				if((flags & JPEG_SUBSAMPLING_411) == JPEG_SUBSAMPLING_411) { 
 					// 4:1:1 (4x1 1x1 1x1) - CrH 25% - CbH 25% - CrV 100% - CbV 100%
 					// the horizontal color resolution is quartered
@@ -1577,90 +1796,69 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 			}
 
 			// Step 7: while (scan lines remain to be written) 
-
-			if(color_type == FIC_RGB) {
-				// 24-bit RGB image : need to swap red and blue channels
-				unsigned pitch = FreeImage_GetPitch(dib);
-				BYTE *target = (BYTE*)malloc(pitch * sizeof(BYTE));
-				if (target == NULL) {
+			// Several scanlines are written per call. 24-bit and greyscale scanlines are passed
+			// straight from the dib when the codec reads them as is, other scanlines are
+			// converted into a buffer of MAX_SCANLINES lines.
+
+			const BOOL bDirect = (color_type == FIC_MINISBLACK) || ((color_type == FIC_RGB) && !bSwapRGB);
+			const unsigned line_size = cinfo.image_width * cinfo.input_components;
+			RGBQUAD *palette = FreeImage_GetPalette(dib);
+
+			BYTE *buffer = NULL;
+			if(!bDirect) {
+				buffer = (BYTE*)malloc(MAX_SCANLINES * line_size * sizeof(BYTE));
+				if (buffer == NULL) {
 					throw FI_MSG_ERROR_MEMORY;
 				}
-
-				while (cinfo.next_scanline < cinfo.image_height) {
-					// get a copy of the scanline
-					memcpy(target, FreeImage_GetScanLine(dib, FreeImage_GetHeight(dib) - cinfo.next_scanline - 1), pitch);
-#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
-					// swap R and B channels
-					BYTE *target_p = target;
-					for(unsigned x = 0; x < cinfo.image_width; x++) {
-						INPLACESWAP(target_p[0], target_p[2]);
-						target_p += 3;
-					}
-#endif
-					// write the scanline
-					jpeg_write_scanlines(&cinfo, &target, 1);
-				}
-				free(target);
 			}
-			else if(color_type == FIC_MINISBLACK) {
-				// 8-bit standard greyscale images
-				while (cinfo.next_scanline < cinfo.image_height) {
-					JSAMPROW b = FreeImage_GetScanLine(dib, FreeImage_GetHeight(dib) - cinfo.next_scanline - 1);
 
-					jpeg_write_scanlines(&cinfo, &b, 1);
-				}
-			}
-			else if(color_type == FIC_PALETTE) {
-				// 8-bit palettized images are converted to 24-bit images
-				RGBQUAD *palette = FreeImage_GetPalette(dib);
-				BYTE *target = (BYTE*)malloc(cinfo.image_width * 3);
-				if (target == NULL) {
-					throw FI_MSG_ERROR_MEMORY;
-				}
+			JSAMPROW rows[MAX_SCANLINES];
 
-				while (cinfo.next_scanline < cinfo.image_height) {
-					BYTE *source = FreeImage_GetScanLine(dib, FreeImage_GetHeight(dib) - cinfo.next_scanline - 1);
-					FreeImage_ConvertLine8To24(target, source, cinfo.image_width, palette);
+			while (cinfo.next_scanline < cinfo.image_height) {
+				const JDIMENSION first = cinfo.next_scanline;
+				const JDIMENSION count = MIN((JDIMENSION)MAX_SCANLINES, cinfo.image_height - first);
 
-#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
-					// swap R and B channels
-					BYTE *target_p = target;
-					for(unsigned x = 0; x < cinfo.image_width; x++) {
-						INPLACESWAP(target_p[0], target_p[2]);
-						target_p += 3;
+				for(JDIMENSION k = 0; k < count; k++) {
+					BYTE *source = FreeImage_GetScanLine(dib, cinfo.image_height - first - k - 1);
+					if(bDirect) {
+						rows[k] = source;
+						continue;
 					}
-#endif
-
-
-					jpeg_write_scanlines(&cinfo, &target, 1);
-				}
 
-				free(target);
-			}
-			else if(color_type == FIC_MINISWHITE) {
-				// reverse 8-bit greyscale image, so reverse grey value on the fly
-				unsigned i;
-				BYTE reverse[256];
-				BYTE *target = (BYTE *)malloc(cinfo.image_width);
-				if (target == NULL) {
-					throw FI_MSG_ERROR_MEMORY;
-				}
-
-				for(i = 0; i < 256; i++) {
-					reverse[i] = (BYTE)(255 - i);
-				}
+					BYTE *target = buffer + k * line_size;
+					rows[k] = target;
+
+					switch(color_type) {
+						case FIC_MINISWHITE:
+							// reverse 8-bit greyscale image, so reverse grey value on the fly
+							for(unsigned i = 0; i < cinfo.image_width; i++) {
+								target[i] = (BYTE)(255 - source[i]);
+							}
+							break;
+
+						case FIC_PALETTE:
+							// 8-bit palettized images are converted to 24-bit images
+							FreeImage_ConvertLine8To24(target, source, cinfo.image_width, palette);
+							break;
+
+						default:
+							// 24-bit RGB image
+							memcpy(target, source, line_size);
+							break;
+					}
 
-				while(cinfo.next_scanline < cinfo.image_height) {
-					BYTE *source = FreeImage_GetScanLine(dib, FreeImage_GetHeight(dib) - cinfo.next_scanline - 1);
-					for(i = 0; i < cinfo.image_width; i++) {
-						target[i] = reverse[ source[i] ];
+					if(bSwapRGB) {
+						// swap R and B channels
+						ConvertLineFromRGB(target, cinfo.image_width, FALSE);
 					}
-					jpeg_write_scanlines(&cinfo, &target, 1);
 				}
 
-				free(target);
+				// write the scanlines
+				jpeg_write_scanlines(&cinfo, rows, count);
 			}
 
+			free(buffer);
+
 			// Step 8: Finish compression 
 
 			jpeg_finish_compress(&cinfo);
@@ -25,13 +25,12 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "FreeImageIO.h"
 
 // ----------------------------------------------------------
 //   Constants + headers
 // ----------------------------------------------------------
 
-#define IO_BUF_SIZE	2048
-
 // ----------------------------------------------------------
 
 #ifdef _WIN32
@@ -97,7 +96,7 @@ pcx_validate(FreeImageIO *io, fi_handle handle) {
 }
 
 static unsigned
-readline(FreeImageIO &io, fi_handle handle, BYTE *buffer, unsigned length, BOOL rle, BYTE * ReadBuf, int * ReadPos) {
+readline(BufferedReader &reader, BYTE *buffer, unsigned length, BOOL rle) {
 	// -----------------------------------------------------------//
 	// Read either run-length encoded or normal image data        //
 	//                                                            //
@@ -118,43 +117,30 @@ readline(FreeImageIO &io, fi_handle handle, BYTE *buffer, unsigned length, BOOL
 	if (rle) {
 		// run-length encoded read
 
-		while (length--) {
-			if (count == 0) {
-				if (*ReadPos >= IO_BUF_SIZE - 1 ) {
-					if (*ReadPos == IO_BUF_SIZE - 1) {
-						// we still have one BYTE, copy it to the start pos
-
-						*ReadBuf = ReadBuf[IO_BUF_SIZE - 1];
-
-						io.read_proc(ReadBuf + 1, 1, IO_BUF_SIZE - 1, handle);
-					} else {
-						// read the complete buffer
-
-						io.read_proc(ReadBuf, 1, IO_BUF_SIZE, handle);
-					}
-
-					*ReadPos = 0;
-				}
-
-				value = *(ReadBuf + (*ReadPos)++);
+		while (written < length) {
+			if (!reader.getByte(&value)) {
+				break;
+			}
 
-				if ((value & 0xC0) == 0xC0) {
-					count = value & 0x3F;
-					value = *(ReadBuf + (*ReadPos)++);
-				} else {
-					count = 1;
+			if ((value & 0xC0) == 0xC0) {
+				count = value & 0x3F;
+				if (!reader.getByte(&value)) {
+					break;
 				}
+			} else {
+				count = 1;
 			}
 
-			count--;
-
-			*(buffer + written++) = value;
+			// a run never goes past the end of the line
+			const unsigned run = MIN((unsigned)count, length - written);
+			memset(buffer + written, value, run);
+			written += run;
 		}
 
 	} else {
 		// normal read
 
-		written = io.read_proc(buffer, length, 1, handle);
+		written = reader.read(buffer, length);
 	}
 
 	return written;
@@ -336,7 +322,6 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 	BYTE *bits;			  // Pointer to dib data
 	RGBQUAD *pal;		  // Pointer to dib palette
 	BYTE *line = NULL;	  // PCX raster line
-	BYTE *ReadBuf = NULL; // buffer;
 	BOOL bIsRLE;		  // True if the file is run-length encoded
 
 	if(!handle) {
@@ -480,43 +465,34 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 		line = (BYTE*)malloc(linelength * sizeof(BYTE));
 		if(!line) throw FI_MSG_ERROR_MEMORY;
 		
-		ReadBuf = (BYTE*)malloc(IO_BUF_SIZE * sizeof(BYTE));
-		if(!ReadBuf) throw FI_MSG_ERROR_MEMORY;
+		BufferedReader reader(io, handle);
+		if(reader.isNull()) throw FI_MSG_ERROR_MEMORY;
 		
 		bits = FreeImage_GetScanLine(dib, height - 1);
 
-		int ReadPos = IO_BUF_SIZE;
-
 		if ((header.planes == 1) && ((header.bpp == 1) || (header.bpp == 8))) {
-			BYTE skip;
-			unsigned written;
-
 			for (unsigned y = 0; y < height; y++) {
-				written = readline(*io, handle, bits, linelength, bIsRLE, ReadBuf, &ReadPos);
-
-				// skip trailing garbage at the end of the scanline
-
-				for (unsigned count = written; count < linelength; count++) {
-					if (ReadPos < IO_BUF_SIZE) {
-						ReadPos++;
-					} else {
-						io->read_proc(&skip, sizeof(BYTE), 1, handle);
-					}
+				// the line padding (if any) is read into the dib pitch
+				if (linelength <= pitch) {
+					readline(reader, bits, linelength, bIsRLE);
+				} else {
+					readline(reader, line, linelength, bIsRLE);
+					memcpy(bits, line, pitch);
 				}
 
 				bits -= pitch;
 			}
 		} else if ((header.planes == 4) && (header.bpp == 1)) {
-			BYTE bit,  mask, skip;
+			BYTE bit,  mask;
 			unsigned index;
 			BYTE *buffer;
-			unsigned x, y, written;
+			unsigned x, y;
 
 			buffer = (BYTE*)malloc(width * sizeof(BYTE));
 			if(!buffer) throw FI_MSG_ERROR_MEMORY;
 
 			for (y = 0; y < height; y++) {
-				written = readline(*io, handle, line, linelength, bIsRLE, ReadBuf, &ReadPos);
+				readline(reader, line, linelength, bIsRLE);
 
 				// build a nibble using the 4 planes
 
@@ -538,16 +514,6 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 					bits[x] = (buffer[2*x] << 4) | buffer[2*x+1];
 				}
 
-				// skip trailing garbage at the end of the scanline
-
-				for (unsigned count = written; count < linelength; count++) {
-					if (ReadPos < IO_BUF_SIZE) {
-						ReadPos++;
-					} else {
-						io->read_proc(&skip, sizeof(BYTE), 1, handle);
-					}
-				}
-
 				bits -= pitch;
 			}
 
@@ -557,7 +523,7 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 			BYTE *pline;
 
 			for (unsigned y = 0; y < height; y++) {
-				readline(*io, handle, line, linelength, bIsRLE, ReadBuf, &ReadPos);
+				readline(reader, line, linelength, bIsRLE);
 
 				// convert the plane stream to BGR (RRRRGGGGBBBB -> BGRBGRBGRBGR)
 				// well, now with the FI_RGBA_x macros, on BIGENDIAN we convert to RGB
@@ -587,7 +553,6 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 		}
 
 		free(line);
-		free(ReadBuf);
 
 		return dib;
 
@@ -600,9 +565,6 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 		if (line != NULL) {
 			free(line);
 		}
-		if (ReadBuf != NULL) {
-			free(ReadBuf);
-		}
 
 		FreeImage_OutputMessageProc(s_format_id, text);
 	}
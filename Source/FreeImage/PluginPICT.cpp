@@ -70,6 +70,7 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "FreeImageIO.h"
 
 // ==========================================================
 // Plugin Interface
@@ -83,31 +84,31 @@ static const int outputMessageSize = 256;
 // ==========================================================
 
 static BYTE
-Read8(FreeImageIO *io, fi_handle handle) {
+Read8(BufferedReader &reader) {
 	BYTE i = 0;
-	io->read_proc(&i, 1, 1, handle);
+	reader.getByte(&i);
 	return i;
 }
 
 static WORD
-Read16(FreeImageIO *io, fi_handle handle) {
+Read16(BufferedReader &reader) {
 	// reads a two-byte big-endian integer from the given file and returns its value.
 	// assumes unsigned.
 	
-	unsigned hi = Read8(io, handle);
-	unsigned lo = Read8(io, handle);
+	unsigned hi = Read8(reader);
+	unsigned lo = Read8(reader);
 	return (WORD)(lo + (hi << 8));
 }
 
 static unsigned
-Read32(FreeImageIO *io, fi_handle handle) {
+Read32(BufferedReader &reader) {
 	// reads a four-byte big-endian integer from the given file and returns its value.
 	// assumes unsigned.
 	
-	unsigned b3 = Read8(io, handle);
-	unsigned b2 = Read8(io, handle);
-	unsigned b1 = Read8(io, handle);
-	unsigned b0 = Read8(io, handle);
+	unsigned b3 = Read8(reader);
+	unsigned b2 = Read8(reader);
+	unsigned b1 = Read8(reader);
+	unsigned b0 = Read8(reader);
 	return (b3 << 24) + (b2 << 16) + (b1 << 8) + b0;
 }
 
@@ -342,48 +343,48 @@ struct MacPattern // Klaube
 // ----------------------------------------------------------
 
 static void 
-ReadRect( FreeImageIO *io, fi_handle handle, MacRect* rect ) {
-	rect->top = Read16( io, handle );
-	rect->left = Read16( io, handle );
-	rect->bottom = Read16( io, handle );
-	rect->right = Read16( io, handle );
+ReadRect( BufferedReader &reader, MacRect* rect ) {
+	rect->top = Read16( reader );
+	rect->left = Read16( reader );
+	rect->bottom = Read16( reader );
+	rect->right = Read16( reader );
 }
 
 static void 
-ReadPixmap( FreeImageIO *io, fi_handle handle, MacpixMap* pPixMap ) {
-	pPixMap->version = Read16( io, handle );
-	pPixMap->packType = Read16( io, handle );
-	pPixMap->packSize = Read32( io, handle );
-	pPixMap->hRes = Read16( io, handle );
-	Read16( io, handle );
-	pPixMap->vRes = Read16( io, handle );
-	Read16( io, handle );
-	pPixMap->pixelType = Read16( io, handle );
-	pPixMap->pixelSize = Read16( io, handle );
-	pPixMap->cmpCount = Read16( io, handle );
-	pPixMap->cmpSize = Read16( io, handle );
-	pPixMap->planeBytes = Read32( io, handle );
-	pPixMap->pmTable = Read32( io, handle );
-	pPixMap->pmReserved = Read32( io, handle );
+ReadPixmap( BufferedReader &reader, MacpixMap* pPixMap ) {
+	pPixMap->version = Read16( reader );
+	pPixMap->packType = Read16( reader );
+	pPixMap->packSize = Read32( reader );
+	pPixMap->hRes = Read16( reader );
+	Read16( reader );
+	pPixMap->vRes = Read16( reader );
+	Read16( reader );
+	pPixMap->pixelType = Read16( reader );
+	pPixMap->pixelSize = Read16( reader );
+	pPixMap->cmpCount = Read16( reader );
+	pPixMap->cmpSize = Read16( reader );
+	pPixMap->planeBytes = Read32( reader );
+	pPixMap->pmTable = Read32( reader );
+	pPixMap->pmReserved = Read32( reader );
 }
 
 /**
 Reads a mac color table into a bitmap palette.
 */
 static void 
-ReadColorTable( FreeImageIO *io, fi_handle handle, WORD* pNumColors, RGBQUAD* pPal ) {
+ReadColorTable( BufferedReader &reader, WORD* pNumColors, RGBQUAD* pPal ) {
 	LONG        ctSeed;
 	WORD        ctFlags;
 	WORD        val;
 	int         i;
 	
-	ctSeed = Read32( io, handle );
-	ctFlags = Read16( io, handle );
-	WORD numColors = Read16( io, handle )+1;
+	ctSeed = Read32( reader );
+	ctFlags = Read16( reader );
+	WORD numColors = Read16( reader )+1;
 	*pNumColors = numColors;
 	
 	for (i = 0; i < numColors; i++) {
-		val = Read16( io, handle );
+		val = Read16( reader );
 		if (ctFlags & 0x8000) {
 			// The indicies in a device colour table are bogus and
 			// usually == 0, so I assume we allocate up the list of
@@ -394,9 +395,9 @@ ReadColorTable( FreeImageIO *io, fi_handle handle, WORD* pNumColors, RGBQUAD* pP
 			throw "pixel value greater than color table size.";
 		}
 		// Mac colour tables contain 16-bit values for R, G, and B...
-		pPal[val].rgbRed = ((BYTE) (((WORD) (Read16( io, handle )) >> 8) & 0xFF));
-		pPal[val].rgbGreen = ((BYTE) (((WORD) (Read16( io, handle )) >> 8) & 0xFF));
-		pPal[val].rgbBlue = ((BYTE) (((WORD) (Read16( io, handle )) >> 8) & 0xFF));
+		pPal[val].rgbRed = ((BYTE) (((WORD) (Read16( reader )) >> 8) & 0xFF));
+		pPal[val].rgbGreen = ((BYTE) (((WORD) (Read16( reader )) >> 8) & 0xFF));
+		pPal[val].rgbBlue = ((BYTE) (((WORD) (Read16( reader )) >> 8) & 0xFF));
 	}
 }
 
@@ -405,7 +406,7 @@ skips unneeded packbits.
 pixelSize == Source bits per pixel.
 */
 static void 
-SkipBits( FreeImageIO *io, fi_handle handle, MacRect* bounds, WORD rowBytes, int pixelSize ) {
+SkipBits( BufferedReader &reader, MacRect* bounds, WORD rowBytes, int pixelSize ) {
 	int    i;
 	WORD   pixwidth;           // bytes per row when uncompressed.
 	
@@ -425,17 +426,17 @@ SkipBits( FreeImageIO *io, fi_handle handle, MacRect* bounds, WORD rowBytes, int
 		rowBytes = pixwidth;
 	}
 	if (rowBytes < 8) {
-		io->seek_proc( handle, rowBytes*height, SEEK_CUR );
+		reader.skip(rowBytes*height);
 	}
 	else {
 		for (i = 0; i < height; i++) {
 			int lineLen;            // length of source line in bytes.
 			if (rowBytes > 250) {
-				lineLen = Read16( io, handle );
+				lineLen = Read16( reader );
 			} else {
-				lineLen = Read8( io, handle );
+				lineLen = Read8( reader );
 			}
-			io->seek_proc( handle, lineLen, SEEK_CUR );
+			reader.skip(lineLen);
 		}
 	}
 }
@@ -444,9 +445,9 @@ SkipBits( FreeImageIO *io, fi_handle handle, MacRect* bounds, WORD rowBytes, int
 Skip polygon or region
 */
 static void 
-SkipPolyOrRegion( FreeImageIO *io, fi_handle handle ) {
-	WORD len = Read16( io, handle ) - 2;
-	io->seek_proc(handle, len, SEEK_CUR);	
+SkipPolyOrRegion( BufferedReader &reader ) {
+	WORD len = Read16( reader ) - 2;
+	reader.skip(len);	
 }
 
 /**
@@ -455,11 +456,11 @@ Width in pixels for 16 bpp.
 Expands Width units to 32-bit pixel data.
 */
 static void 
-expandBuf( FreeImageIO *io, fi_handle handle, int width, int bpp, BYTE* dst ) { 
+expandBuf( BufferedReader &reader, int width, int bpp, BYTE* dst ) { 
 	switch (bpp) {
 		case 16:
 			for ( int i=0; i<width; i++) {
-				WORD src = Read16( io, handle );
+				WORD src = Read16( reader );
 				dst[ FI_RGBA_BLUE ] = (src & 31)*8;				// Blue
 				dst[ FI_RGBA_GREEN ] = ((src >> 5) & 31)*8;		// Green
 				dst[ FI_RGBA_RED ] = ((src >> 10) & 31)*8;		// Red
@@ -477,28 +478,28 @@ Expands Width units to 8-bit pixel data.
 Max. 8 bpp source format.
 */
 static void 
-expandBuf8( FreeImageIO *io, fi_handle handle, int width, int bpp, BYTE* dst )
+expandBuf8( BufferedReader &reader, int width, int bpp, BYTE* dst )
 {
 	switch (bpp) {
 		case 8:
-			io->read_proc( dst, width, 1, handle );
+			reader.read(dst, width);
 			break;
 		case 4:
 			for (int i = 0; i < width; i++) {
-				WORD src = Read8( io, handle );
+				WORD src = Read8( reader );
 				*dst = (src >> 4) & 15;
 				*(dst+1) = (src & 15);
 				dst += 2;
 			}
 			if (width & 1) { // Odd Width?
-				WORD src = Read8( io, handle );
+				WORD src = Read8( reader );
 				*dst = (src >> 4) & 15;
 				dst++;
 			}
 			break;
 		case 2:
 			for (int i = 0; i < width; i++) {
-				WORD src = Read8( io, handle );
+				WORD src = Read8( reader );
 				*dst = (src >> 6) & 3;
 				*(dst+1) = (src >> 4) & 3;
 				*(dst+2) = (src >> 2) & 3;
@@ -507,7 +508,7 @@ expandBuf8( FreeImageIO *io, fi_handle handle, int width, int bpp, BYTE* dst )
 			}
 			if (width & 3)  { // Check for leftover pixels
 				for (int i = 6; i > 8 - (width & 3) * 2; i -= 2) {
-					WORD src = Read8( io, handle );
+					WORD src = Read8( reader );
 					*dst = (src >> i) & 3;
 					dst++;
 				}
@@ -515,7 +516,7 @@ expandBuf8( FreeImageIO *io, fi_handle handle, int width, int bpp, BYTE* dst )
 			break;
 		case 1:
 			for (int i = 0; i < width; i++) {
-				WORD src = Read8( io, handle );
+				WORD src = Read8( reader );
 				*dst = (src >> 7) & 1;
 				*(dst+1) = (src >> 6) & 1;
 				*(dst+2) = (src >> 5) & 1;
@@ -528,7 +529,7 @@ expandBuf8( FreeImageIO *io, fi_handle handle, int width, int bpp, BYTE* dst )
 			}
 			if (width & 7) {  // Check for leftover pixels
 				for (int i = 7; i > (8-width & 7); i--) {
-					WORD src = Read8( io, handle );
+					WORD src = Read8( reader );
 					*dst = (src >> i) & 1;
 					dst++;
 				}
@@ -540,17 +541,17 @@ expandBuf8( FreeImageIO *io, fi_handle handle, int width, int bpp, BYTE* dst )
 }
 
 static BYTE* 
-UnpackPictRow( FreeImageIO *io, fi_handle handle, BYTE* pLineBuf, int width, int rowBytes, int srcBytes ) {	
+UnpackPictRow( BufferedReader &reader, BYTE* pLineBuf, int width, int rowBytes, int srcBytes ) {	
 
 	if (rowBytes < 8) { // Ah-ha!  The bits aren't actually packed.  This will be easy.
-		io->read_proc( pLineBuf, rowBytes, 1, handle );
+		reader.read(pLineBuf, rowBytes);
 	}
 	else {
 		BYTE* pCurPixel = pLineBuf;
 		
 		// Unpack RLE. The data is packed bytewise.
 		for (int j = 0; j < srcBytes; )	{
-			BYTE FlagCounter = Read8( io, handle );
+			BYTE FlagCounter = Read8( reader );
 			if (FlagCounter & 0x80) {
 				if (FlagCounter == 0x80) {
 					// Special case: repeat value of 0.
@@ -559,7 +560,7 @@ UnpackPictRow( FreeImageIO *io, fi_handle handle, BYTE* pLineBuf, int width, int
 				} else { 
 					// Packed data.
 					int len = ((FlagCounter ^ 255) & 255) + 2;					
-					BYTE p = Read8( io, handle );
+					BYTE p = Read8( reader );
 					memset( pCurPixel, p, len);
 					pCurPixel += len;
 					j += 2;
@@ -568,7 +569,7 @@ UnpackPictRow( FreeImageIO *io, fi_handle handle, BYTE* pLineBuf, int width, int
 			else { 
 				// Unpacked data
 				int len = (FlagCounter & 255) + 1;
-				io->read_proc( pCurPixel, len, 1, handle );
+				reader.read(pCurPixel, len);
 				pCurPixel += len;
 				j += len + 1;
 			}
@@ -585,7 +586,7 @@ To decode, the routine decompresses each line & then juggles the bytes around to
 NumBitPlanes == 3 if RGB, 4 if RGBA
 */
 static void 
-Unpack32Bits( FreeImageIO *io, fi_handle handle, FIBITMAP* dib, MacRect* bounds, WORD rowBytes, int numPlanes ) {
+Unpack32Bits( BufferedReader &reader, FIBITMAP* dib, MacRect* bounds, WORD rowBytes, int numPlanes ) {
 	int height = bounds->bottom - bounds->top;
 	int width = bounds->right - bounds->left;
 	
@@ -600,12 +601,12 @@ Unpack32Bits( FreeImageIO *io, fi_handle handle, FIBITMAP* dib, MacRect* bounds,
 				// for each line do...
 				int linelen;            // length of source line in bytes.
 				if (rowBytes > 250) {
-					linelen = Read16( io, handle );
+					linelen = Read16( reader );
 				} else {
-					linelen = Read8( io, handle);
+					linelen = Read8( reader );
 				}
 				
-				BYTE* pBuf = UnpackPictRow( io, handle, pLineBuf, width, rowBytes, linelen );
+				BYTE* pBuf = UnpackPictRow( reader, pLineBuf, width, rowBytes, linelen );
 				
 				// Convert plane-oriented data into pixel-oriented data &
 				// copy into destination bitmap.
@@ -649,7 +650,7 @@ This _isn't_ equal to the number of pixels in the row - it seems apple pads the
 Of course, we have to decompress the excess data and then throw it away.
 */
 static void 
-Unpack8Bits( FreeImageIO *io, fi_handle handle, FIBITMAP* dib, MacRect* bounds, WORD rowBytes ) {	
+Unpack8Bits( BufferedReader &reader, FIBITMAP* dib, MacRect* bounds, WORD rowBytes ) {	
 	int height = bounds->bottom - bounds->top;
 	int width = bounds->right - bounds->left;
 	
@@ -663,12 +664,12 @@ Unpack8Bits( FreeImageIO *io, fi_handle handle, FIBITMAP* dib, MacRect* bounds,
 	for ( int i = 0; i < height; i++ ) {
 		int linelen;            // length of source line in bytes.
 		if (rowBytes > 250) {
-			linelen = Read16( io, handle );
+			linelen = Read16( reader );
 		} else {
-			linelen = Read8( io, handle );
+			linelen = Read8( reader );
 		}
 		BYTE* dst = (BYTE*)FreeImage_GetScanLine( dib, height - 1 - i);				
-		dst = UnpackPictRow( io, handle, dst, width, rowBytes, linelen );
+		dst = UnpackPictRow( reader, dst, width, rowBytes, linelen );
 	}
 }
 
@@ -680,7 +681,7 @@ unpack8bits is basically a dumber version of unpackbits.
 pixelSize == Source bits per pixel.
 */
 static void 
-UnpackBits( FreeImageIO *io, fi_handle handle, FIBITMAP* dib, MacRect* bounds, WORD rowBytes, int pixelSize ) {
+UnpackBits( BufferedReader &reader, FIBITMAP* dib, MacRect* bounds, WORD rowBytes, int pixelSize ) {
 	WORD   pixwidth;           // bytes per row when uncompressed.
 	int    pkpixsize;
 	int    PixelPerRLEUnit;
@@ -735,9 +736,9 @@ UnpackBits( FreeImageIO *io, fi_handle handle, FIBITMAP* dib, MacRect* bounds, W
 			for ( int i = 0; i < height; i++ ) {
 				BYTE* dst = (BYTE*)FreeImage_GetScanLine( dib, height - 1 - i);
 				if (pixelSize == 16) {
-					expandBuf( io, handle, width, pixelSize, dst );
+					expandBuf( reader, width, pixelSize, dst );
 				} else {
-					expandBuf8( io, handle, width, pixelSize, dst );
+					expandBuf8( reader, width, pixelSize, dst );
 				}
 			}
 		}
@@ -746,9 +747,9 @@ UnpackBits( FreeImageIO *io, fi_handle handle, FIBITMAP* dib, MacRect* bounds, W
 				// For each line do...
 				int    linelen;            // length of source line in bytes.
 				if (rowBytes > 250) {
-					linelen = Read16( io, handle );
+					linelen = Read16( reader );
 				} else {
-					linelen = Read8( io, handle );
+					linelen = Read8( reader );
 				}
 				
 				BYTE* dst = (BYTE*)FreeImage_GetScanLine( dib, height - 1 - i);
@@ -757,7 +758,7 @@ UnpackBits( FreeImageIO *io, fi_handle handle, FIBITMAP* dib, MacRect* bounds, W
 				// Unpack RLE. The data is packed bytewise - except for
 				// 16 bpp data, which is packed per pixel :-(.
 				for ( int j = 0; j < linelen; ) {
-					FlagCounter = Read8( io, handle );
+					FlagCounter = Read8( reader );
 					if (FlagCounter & 0x80) {
 						if (FlagCounter == 0x80) {
 							// Special case: repeat value of 0.
@@ -770,7 +771,7 @@ UnpackBits( FreeImageIO *io, fi_handle handle, FIBITMAP* dib, MacRect* bounds, W
 							
 							// This is slow for some formats...
 							if (pixelSize == 16) {
-								expandBuf( io, handle, 1, pixelSize, dst );
+								expandBuf( reader, 1, pixelSize, dst );
 								for ( int k = 1; k < len; k++ ) { 
 									// Repeat the pixel len times.
 									memcpy( dst+(k*4*PixelPerRLEUnit), dst,	4*PixelPerRLEUnit);
@@ -778,7 +779,7 @@ UnpackBits( FreeImageIO *io, fi_handle handle, FIBITMAP* dib, MacRect* bounds, W
 								dst += len*4*PixelPerRLEUnit;
 							}
 							else {
-								expandBuf8( io, handle, 1, pixelSize, dst );
+								expandBuf8( reader, 1, pixelSize, dst );
 								for ( int k = 1; k < len; k++ ) { 
 									// Repeat the expanded byte len times.
 									memcpy( dst+(k*PixelPerRLEUnit), dst, PixelPerRLEUnit);
@@ -792,11 +793,11 @@ UnpackBits( FreeImageIO *io, fi_handle handle, FIBITMAP* dib, MacRect* bounds, W
 						// Unpacked data
 						int len = (FlagCounter & 255) + 1;
 						if (pixelSize == 16) {
-							expandBuf( io, handle, len, pixelSize, dst );
+							expandBuf( reader, len, pixelSize, dst );
 							dst += len*4*PixelPerRLEUnit;
 						}
 						else {
-							expandBuf8( io, handle, len, pixelSize, dst );
+							expandBuf8( reader, len, pixelSize, dst );
 							dst += len*PixelPerRLEUnit;
 						}
 						j += ( len * pkpixsize ) + 1;
@@ -808,26 +809,26 @@ UnpackBits( FreeImageIO *io, fi_handle handle, FIBITMAP* dib, MacRect* bounds, W
 }
 
 static void 
-DecodeOp9a( FreeImageIO *io, fi_handle handle, FIBITMAP* dib, MacpixMap* pixMap ) {
+DecodeOp9a( BufferedReader &reader, FIBITMAP* dib, MacpixMap* pixMap ) {
 	// Do the actual unpacking.
 	switch ( pixMap->pixelSize ) {
 		case 32:
-			Unpack32Bits( io, handle, dib, &pixMap->Bounds, 0, pixMap->cmpCount );
+			Unpack32Bits( reader, dib, &pixMap->Bounds, 0, pixMap->cmpCount );
 			break;
 		case 8:
-			Unpack8Bits( io, handle, dib, &pixMap->Bounds, 0 );
+			Unpack8Bits( reader, dib, &pixMap->Bounds, 0 );
 			break;
 		default:
-			UnpackBits( io, handle, dib, &pixMap->Bounds, 0, pixMap->pixelSize );
+			UnpackBits( reader, dib, &pixMap->Bounds, 0, pixMap->pixelSize );
 	}
 }
 
 static void 
-DecodeBitmap( FreeImageIO *io, fi_handle handle, FIBITMAP* dib, BOOL isRegion, MacRect* bounds, WORD rowBytes ) {
-	WORD mode = Read16( io, handle );
+DecodeBitmap( BufferedReader &reader, FIBITMAP* dib, BOOL isRegion, MacRect* bounds, WORD rowBytes ) {
+	WORD mode = Read16( reader );
 	
 	if ( isRegion ) {
-		SkipPolyOrRegion( io, handle );
+		SkipPolyOrRegion( reader );
 	}
 	
 	RGBQUAD* pal = FreeImage_GetPalette( dib );
@@ -842,16 +843,16 @@ DecodeBitmap( FreeImageIO *io, fi_handle handle, FIBITMAP* dib, BOOL isRegion, M
 		pal[i].rgbBlue = val;
 	}
 	
-	UnpackBits( io, handle, dib, bounds, rowBytes, 1 );
+	UnpackBits( reader, dib, bounds, rowBytes, 1 );
 }
 
 static void 
-DecodePixmap( FreeImageIO *io, fi_handle handle, FIBITMAP* dib, BOOL isRegion, MacpixMap* pixMap, WORD rowBytes ) {
+DecodePixmap( BufferedReader &reader, FIBITMAP* dib, BOOL isRegion, MacpixMap* pixMap, WORD rowBytes ) {
 	// Read mac colour table into windows palette.
 	WORD numColors;    // Palette size.
 	RGBQUAD ct[256];
 	
-	ReadColorTable( io, handle, &numColors, ct );
+	ReadColorTable( reader, &numColors, ct );
 	if ( FreeImage_GetBPP( dib ) == 8 ) {
 		RGBQUAD* pal = FreeImage_GetPalette( dib );
 		if ( !pal ) {
@@ -867,23 +868,23 @@ DecodePixmap( FreeImageIO *io, fi_handle handle, FIBITMAP* dib, BOOL isRegion, M
 	
 	// Ignore source & destination rectangle as well as transfer mode.
 	MacRect tempRect;
-	ReadRect( io, handle, &tempRect );
-	ReadRect( io, handle, &tempRect );
-	WORD mode = Read16( io, handle );
+	ReadRect( reader, &tempRect );
+	ReadRect( reader, &tempRect );
+	WORD mode = Read16( reader );
 	
 	if ( isRegion) {
-		SkipPolyOrRegion( io, handle );
+		SkipPolyOrRegion( reader );
 	}
 	
 	switch ( pixMap->pixelSize ) {
 		case 32:
-			Unpack32Bits( io, handle, dib, &pixMap->Bounds, rowBytes, pixMap->cmpCount );
+			Unpack32Bits( reader, dib, &pixMap->Bounds, rowBytes, pixMap->cmpCount );
 			break;
 		case 8:
-			Unpack8Bits( io, handle, dib, &pixMap->Bounds, rowBytes );
+			Unpack8Bits( reader, dib, &pixMap->Bounds, rowBytes );
 			break;
 		default:
-			UnpackBits( io, handle, dib, &pixMap->Bounds, rowBytes, pixMap->pixelSize );
+			UnpackBits( reader, dib, &pixMap->Bounds, rowBytes, pixMap->pixelSize );
 	}
 }
 
@@ -961,20 +962,26 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 		if ( !io->seek_proc(handle, 512, SEEK_CUR) == 0 )
 			return NULL;
 		
+		// parse the opcodes and decode the pixels through a buffered reader
+		BufferedReader reader(io, handle);
+		if ( reader.isNull() ) {
+			throw FI_MSG_ERROR_MEMORY;
+		}
+
 		// Read PICT header
-		Read16( io, handle ); // Skip version 1 picture size
+		Read16( reader ); // Skip version 1 picture size
 		
 		MacRect frame;
-		ReadRect( io, handle, &frame );
+		ReadRect( reader, &frame );
 
 		BYTE b = 0;
-		while ((b = Read8(io, handle)) == 0);
+		while ((b = Read8(reader)) == 0);
 		if ( b != 0x11 ) {
 			throw "invalid header: version number missing.";
 		}
 		
-		int version = Read8( io, handle );
-		if ( version == 2 && Read8( io, handle ) != 0xff ) {
+		int version = Read8( reader );
+		if ( version == 2 && Read8( reader ) != 0xff ) {
 			throw "invalid header: illegal version number.";
 		}
 		
@@ -994,14 +1001,14 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 			WORD opcode = 0;
 
 			// get the current stream position (used to avoid infinite loops)
-			currentPos = io->tell_proc(handle);
+			currentPos = reader.tell();
 			
-			if ((version == 1) || ((io->tell_proc( handle ) % 2) != 0)) {
+			if ((version == 1) || ((reader.tell() % 2) != 0)) {
 				// align to word for version 2
-				opcode = Read8( io, handle );
+				opcode = Read8( reader );
 			}
 			if (version == 2) {
-				opcode = Read16( io, handle );
+				opcode = Read16( reader );
 			}
 			
 			if (opcode == 0xFF || opcode == 0xFFFF) {
@@ -1014,13 +1021,13 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 					{
 						// skip clipping rectangle
 						MacRect clipRect;
-						WORD len = Read16( io, handle );
+						WORD len = Read16( reader );
 
 						if (len == 0x000a) { 
 							/* null rgn */
-							ReadRect( io, handle, &clipRect );
+							ReadRect( reader, &clipRect );
 						} else {
-							io->seek_proc(handle, len - 2, SEEK_CUR);
+							reader.skip(len - 2);
 						}
 						break;
 					}						
@@ -1034,23 +1041,23 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 						MacpixMap  p;
 						WORD       numColors;
 						
-						patType = Read16( io, handle );
+						patType = Read16( reader );
 						
 						switch( patType ) {
 							case 2:
-								io->seek_proc(handle, 8, SEEK_CUR);
-								io->seek_proc(handle, 5, SEEK_CUR);
+								reader.skip(8);
+								reader.skip(5);
 								break;
 							case 1:
 							{
-								io->seek_proc(handle, 8, SEEK_CUR);
-								rowBytes = Read16( io, handle );
-								ReadRect( io, handle, &p.Bounds );
-								ReadPixmap( io, handle, &p);
+								reader.skip(8);
+								rowBytes = Read16( reader );
+								ReadRect( reader, &p.Bounds );
+								ReadPixmap( reader, &p);
 								
 								RGBQUAD ct[256];
-								ReadColorTable(io, handle, &numColors, ct );
-								SkipBits( io, handle, &p.Bounds, rowBytes, p.pixelSize );
+								ReadColorTable(reader, &numColors, ct );
+								SkipBits( reader, &p.Bounds, rowBytes, p.pixelSize );
 								break;
 							}
 							default:
@@ -1068,14 +1075,14 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 					case 0x76:
 					case 0x77:
 					{
-						SkipPolyOrRegion( io, handle );
+						SkipPolyOrRegion( reader );
 						break;
 					}
 					case 0x90:
 					case 0x98:
 					{
 						// Bitmap/pixmap data clipped by a rectangle.
-						rowBytes = Read16( io, handle );    // Bytes per row in source when uncompressed.						
+						rowBytes = Read16( reader );    // Bytes per row in source when uncompressed.						
 						isRegion = FALSE;
 						
 						if ( rowBytes & 0x8000) {
@@ -1090,7 +1097,7 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 					case 0x99:
 					{
 						// Bitmap/pixmap data clipped by a region.
-						rowBytes = Read16( io, handle );    // Bytes per row in source when uncompressed.						
+						rowBytes = Read16( reader );    // Bytes per row in source when uncompressed.						
 						isRegion = TRUE;
 						
 						if ( rowBytes & 0x8000) {
@@ -1104,18 +1111,18 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 					case 0x9a:
 					{
 						// DirectBitsRect.
-						Read32( io, handle );           // Skip fake len and fake EOF.
-						Read16( io, handle );			// bogus row bytes.
+						Read32( reader );           // Skip fake len and fake EOF.
+						Read16( reader );			// bogus row bytes.
 						
 						// Read in the PixMap fields.
-						ReadRect( io, handle, &pixMap.Bounds );
-						ReadPixmap( io, handle, &pixMap );
+						ReadRect( reader, &pixMap.Bounds );
+						ReadPixmap( reader, &pixMap );
 						
 						// Ignore source & destination rectangle as well as transfer mode.
 						MacRect dummy;
-						ReadRect( io, handle, &dummy );
-						ReadRect( io, handle, &dummy );
-						WORD mode = Read16( io, handle );
+						ReadRect( reader, &dummy );
+						ReadRect( reader, &dummy );
+						WORD mode = Read16( reader );
 						
 						pictType=op9a;
 						done = TRUE;
@@ -1127,37 +1134,37 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 						WORD type;
 						WORD len;
 						
-						type = Read16( io, handle );
-						len = Read16( io, handle);
+						type = Read16( reader );
+						len = Read16( reader );
 						if (len > 0) {
-							io->seek_proc(handle, len, SEEK_CUR);
+							reader.skip(len);
 						}
 						break;
 					}
 					default:
 						// No function => skip to next opcode
 						if (optable[opcode].len == WORD_LEN) {
-							WORD len = Read16( io, handle );
-							io->seek_proc(handle, len, SEEK_CUR);
+							WORD len = Read16( reader );
+							reader.skip(len);
 						} else {
-							io->seek_proc(handle, optable[opcode].len, SEEK_CUR);
+							reader.skip(optable[opcode].len);
 						}
 						break;
 				}
 			}
 			else if (opcode == 0xc00) {
 				// version 2 header (26 bytes)
-				WORD minorVersion = Read16( io, handle );	// always FFFE (-2) for extended version 2
-				Read16( io, handle );						// reserved
-				hRes = Read32( io, handle );				// original horizontal resolution in pixels/inch
-				vRes = Read32( io, handle );				// original horizontal resolution in pixels/inch
+				WORD minorVersion = Read16( reader );	// always FFFE (-2) for extended version 2
+				Read16( reader );						// reserved
+				hRes = Read32( reader );				// original horizontal resolution in pixels/inch
+				vRes = Read32( reader );				// original horizontal resolution in pixels/inch
 				MacRect dummy;
-				ReadRect( io, handle, &dummy );				// frame bounds at original resolution
-				Read32( io, handle );						// reserved
+				ReadRect( reader, &dummy );				// frame bounds at original resolution
+				Read32( reader );						// reserved
 			}
 			else if (opcode == 0x8200) {
 				// jpeg
-				long opLen = Read32( io, handle );
+				long opLen = Read32( reader );
 				BOOL found = FALSE;
 				int i = 0;
 				
@@ -1168,16 +1175,17 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 //					ReadRect( io, handle, &dummy );
 //					io->seek_proc( handle, 122, SEEK_CUR );
 //					found = TRUE;
-					BYTE data[ 2 ];
-					if( io->read_proc( data, 2, 1, handle ) ) {
-						io->seek_proc( handle, -2, SEEK_CUR );
-						
+					const BYTE *data = reader.peek( 2 );
+					if( data ) {
 						if ( data[0] == 0xFF && data[1] == 0xD8 ) {
 							found = TRUE;
 						} else {
-							Read8( io, handle );
+							Read8( reader );
 							i++;
 						}
+					} else {
+						// end of stream
+						break;
 					}
 				}
 				
@@ -1191,27 +1199,27 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 			}
 			else if (opcode >= 0xa2 && opcode <= 0xaf) {
 				// reserved
-				WORD len = Read16( io, handle );
-				io->seek_proc(handle, len, SEEK_CUR);
+				WORD len = Read16( reader );
+				reader.skip(len);
 			}
 			else if ((opcode >= 0xb0 && opcode <= 0xcf) || (opcode >= 0x8000 && opcode <= 0x80ff)) {
 				// just a reserved opcode, no data
 			}
 			else if ((opcode >= 0xd0 && opcode <= 0xfe) || opcode >= 8100) {
 				// reserved
-				LONG len = Read32( io, handle );
-				io->seek_proc(handle, len, SEEK_CUR);
+				LONG len = Read32( reader );
+				reader.skip(len);
 			}
 			else if (opcode >= 0x100 && opcode <= 0x7fff) {
 				// reserved
-				io->seek_proc(handle, ((opcode >> 7) & 255), SEEK_CUR);				
+				reader.skip(((opcode >> 7) & 255));				
 			}
 			else {
 				sprintf( outputMessage, "Can't handle opcode %x.\n", opcode );
 				throw outputMessage;
 			}
 
-			if(currentPos == io->tell_proc(handle)) {
+			if(currentPos == reader.tell()) {
 				// we probaly reached the end of file as we can no longer move forward ... 
 				throw "Invalid PICT file";
 			}
@@ -1236,6 +1244,8 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 				
 			case jpeg:
 			{
+				// give back the data read ahead before passing the handle
+				reader.sync();
 				dib = FreeImage_LoadFromHandle( FIF_JPEG, io, handle );					
 				break;
 			}
@@ -1243,8 +1253,8 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 			case pixmap:
 			{
 				// Decode version 2 pixmap
-				ReadRect( io, handle, &pixMap.Bounds );
-				ReadPixmap( io, handle, &pixMap );
+				ReadRect( reader, &pixMap.Bounds );
+				ReadPixmap( reader, &pixMap );
 				
 				bounds = pixMap.Bounds;
 				int width = bounds.right - bounds.left;
@@ -1268,9 +1278,9 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 				WORD width;        // Width in pixels
 				WORD height;       // Height in pixels
 				
-				ReadRect( io, handle, &bounds );
-				ReadRect( io, handle, &srcRect );
-				ReadRect( io, handle, &dstRect );
+				ReadRect( reader, &bounds );
+				ReadRect( reader, &srcRect );
+				ReadRect( reader, &dstRect );
 				
 				width = bounds.right - bounds.left;
 				height = bounds.bottom - bounds.top;
@@ -1291,16 +1301,16 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 			
 			switch( pictType ) {
 				case op9a:
-					DecodeOp9a( io, handle, dib, &pixMap );
+					DecodeOp9a( reader, dib, &pixMap );
 					break;
 				case jpeg:
 					// Already decoded if the embedded format was valid.
 					break;
 				case pixmap:
-					DecodePixmap( io, handle, dib, isRegion, &pixMap, rowBytes );
+					DecodePixmap( reader, dib, isRegion, &pixMap, rowBytes );
 					break;
 				case bitmap:
-					DecodeBitmap( io, handle, dib, isRegion, &bounds, rowBytes );
+					DecodeBitmap( reader, dib, isRegion, &bounds, rowBytes );
 					break;
 				default:
 					throw "invalid pict type";
@@ -29,6 +29,8 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "FreeImageIO.h"
+#include "Parallel.h"
 
 #include "../Metadata/FreeImageTag.h"
 
@@ -36,6 +38,23 @@
 
 #define PNG_BYTES_TO_CHECK 8
 
+/**
+Size of the read ahead buffer used when loading a PNG stream. 
+libpng asks for its data a chunk header, a CRC or a few KB of IDAT at a time : 
+the stream is read in blocks of this size instead (FIMEMORY streams are read in place). 
+*/
+#ifndef PNG_READ_BUFFER_SIZE
+#define PNG_READ_BUFFER_SIZE (256 * 1024)
+#endif
+
+/**
+Number of rows decoded by each call to png_read_rows when loading a PNG stream. 
+The rows are decoded straight into the dib scanlines, through a row pointer array of this size. 
+*/
+#ifndef PNG_READ_ROW_BATCH
+#define PNG_READ_ROW_BATCH 32
+#endif
+
 #undef PNG_Z_DEFAULT_COMPRESSION	// already used in ../LibPNG/pnglibconf.h
 
 // ----------------------------------------------------------
@@ -56,9 +75,8 @@ typedef struct {
 
 static void
 _ReadProc(png_structp png_ptr, unsigned char *data, png_size_t size) {
-    pfi_ioStructure pfio = (pfi_ioStructure)png_get_io_ptr(png_ptr);
-	unsigned n = pfio->s_io->read_proc(data, (unsigned int)size, 1, pfio->s_handle);
-	if(size && (n == 0)) {
+	BufferedReader *reader = (BufferedReader*)png_get_io_ptr(png_ptr);
+	if(reader->read(data, (unsigned)size) != (unsigned)size) {
 		throw "Read error: invalid or corrupted PNG file";
 	}
 }
@@ -510,12 +528,7 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 	int pixel_depth = 0;	// pixel_depth = bit_depth * channels
 
 	FIBITMAP *dib = NULL;
-	png_bytepp row_pointers = NULL;
 
-    fi_ioStructure fio;
-    fio.s_handle = handle;
-	fio.s_io = io;
-    
 	if (handle) {
 		BOOL header_only = (flags & FIF_LOAD_NOPIXELS) == FIF_LOAD_NOPIXELS;
 
@@ -529,6 +542,15 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 			if (png_sig_cmp(png_check, (png_size_t)0, PNG_BYTES_TO_CHECK) != 0) {
 				return NULL;	// Bad signature
 			}
+
+			// read the rest of the stream through a read ahead buffer
+			// (the handle is moved to the end of the PNG stream when the reader is destroyed)
+
+			BufferedReader reader(io, handle, PNG_READ_BUFFER_SIZE);
+
+			if (reader.isNull()) {
+				throw FI_MSG_ERROR_MEMORY;
+			}
 			
 			// create the chunk manage structure
 
@@ -549,7 +571,7 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 
 			// init the IO
 
-			png_set_read_fn(png_ptr, &fio, _ReadProc);
+			png_set_read_fn(png_ptr, &reader, _ReadProc);
 
             if (setjmp(png_jmpbuf(png_ptr))) {
 				png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
@@ -560,11 +582,30 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 
 			png_set_sig_bytes(png_ptr, PNG_BYTES_TO_CHECK);
 
+			// use the SIMD row filters of libpng when they are built in but not enabled by default
+
+#if defined(PNG_SET_OPTION_SUPPORTED)
+#if defined(PNG_ARM_NEON_API_SUPPORTED)
+			png_set_option(png_ptr, PNG_ARM_NEON, PNG_OPTION_ON);
+#endif
+#if defined(PNG_MIPS_MSA_API_SUPPORTED)
+			png_set_option(png_ptr, PNG_MIPS_MSA, PNG_OPTION_ON);
+#endif
+#if defined(PNG_POWERPC_VSX_API_SUPPORTED)
+			png_set_option(png_ptr, PNG_POWERPC_VSX, PNG_OPTION_ON);
+#endif
+#endif // PNG_SET_OPTION_SUPPORTED
+
 			// read the IHDR chunk
 
 			png_read_info(png_ptr, info_ptr);
 			png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type, NULL, NULL, NULL);
 
+			// let libpng expand interlaced rows (must be set before png_read_update_info)
+			// the number of passes is either 1 for non-interlaced images, or 7 for interlaced images
+
+			const int number_passes = png_set_interlace_handling(png_ptr);
+
 			// configure the decoder
 
 			FREE_IMAGE_TYPE image_type = FIT_BITMAP;
@@ -728,26 +769,23 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 				return dib;
 			}
 
-			// set the individual row_pointers to point at the correct offsets
-
-			row_pointers = (png_bytepp)malloc(height * sizeof(png_bytep));
+			// read in the bitmap bits by batches of rows, directly into the dib scanlines
+			// allow loading of PNG with minor errors (such as images with several IDAT chunks)
 
-			if (!row_pointers) {
-				png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-				FreeImage_Unload(dib);
-				return NULL;
-			}
+			png_set_benign_errors(png_ptr, 1);
 
-			// read in the bitmap bits via the pointer table
-			// allow loading of PNG with minor errors (such as images with several IDAT chunks)
+			png_bytep row_batch[PNG_READ_ROW_BATCH];
 
-			for (png_uint_32 k = 0; k < height; k++) {
-				row_pointers[height - 1 - k] = FreeImage_GetScanLine(dib, k);
+			for (int pass = 0; pass < number_passes; pass++) {
+				for (png_uint_32 k = 0; k < height; k += PNG_READ_ROW_BATCH) {
+					const png_uint_32 rows = MIN((png_uint_32)PNG_READ_ROW_BATCH, height - k);
+					for (png_uint_32 i = 0; i < rows; i++) {
+						row_batch[i] = FreeImage_GetScanLine(dib, height - 1 - (k + i));
+					}
+					png_read_rows(png_ptr, row_batch, NULL, rows);
+				}
 			}
 
-			png_set_benign_errors(png_ptr, 1);
-			png_read_image(png_ptr, row_pointers);
-
 			// check if the bitmap contains transparency, if so enable it in the header
 
 			if (FreeImage_GetBPP(dib) == 32) {
@@ -757,13 +795,7 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 					FreeImage_SetTransparent(dib, FALSE);
 				}
 			}
-				
-			// cleanup
 
-			if (row_pointers) {
-				free(row_pointers);
-				row_pointers = NULL;
-			}
 
 			// read the rest of the file, getting any additional chunks in info_ptr
 
@@ -784,9 +816,6 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 			if (png_ptr) {
 				png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
 			}
-			if (row_pointers) {
-				free(row_pointers);
-			}
 			if (dib) {
 				FreeImage_Unload(dib);
 			}
@@ -799,6 +828,745 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 	return NULL;
 }
 
+// ==========================================================
+// Band encoder
+// ==========================================================
+
+/**
+Predictor of the Paeth filter
+*/
+static inline int
+PaethPredictor(int a, int b, int c) {
+	const int p = a + b - c;
+	const int pa = abs(p - a);
+	const int pb = abs(p - b);
+	const int pc = abs(p - c);
+	if((pa <= pb) && (pa <= pc)) {
+		return a;
+	}
+	return (pb <= pc) ? b : c;
+}
+
+#ifdef FREEIMAGE_SSE2
+
+/**
+Paeth predictor of 8 samples held in 16-bit lanes
+*/
+static inline __m128i
+PaethPredictor8(__m128i a, __m128i b, __m128i c) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i bc = _mm_sub_epi16(b, c);
+	const __m128i ac = _mm_sub_epi16(a, c);
+	const __m128i abc = _mm_add_epi16(bc, ac);
+	const __m128i pa = _mm_max_epi16(bc, _mm_sub_epi16(zero, bc));
+	const __m128i pb = _mm_max_epi16(ac, _mm_sub_epi16(zero, ac));
+	const __m128i pc = _mm_max_epi16(abc, _mm_sub_epi16(zero, abc));
+	// not_a : pa > pb or pa > pc, not_b : pb > pc
+	const __m128i not_a = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+	const __m128i not_b = _mm_cmpgt_epi16(pb, pc);
+	const __m128i bc_pred = _mm_or_si128(_mm_andnot_si128(not_b, b), _mm_and_si128(not_b, c));
+	return _mm_or_si128(_mm_andnot_si128(not_a, a), _mm_and_si128(not_a, bc_pred));
+}
+
+#endif // FREEIMAGE_SSE2
+
+/**
+Filter a row of samples
+@param dst Output row of rowbytes + 1 bytes, the filter type byte first
+@param filter Filter type (PNG_FILTER_VALUE_NONE ... PNG_FILTER_VALUE_PAETH)
+@param row Row to filter
+@param prev Previous row (all zeros for the first row of the image)
+@param rowbytes Size of a row, in bytes
+@param bpp Size of a pixel in bytes, rounded up to 1
+*/
+static void
+FilterRow(BYTE *dst, int filter, const BYTE *row, const BYTE *prev, unsigned rowbytes, unsigned bpp) {
+	*dst++ = (BYTE)filter;
+
+	if(filter == PNG_FILTER_VALUE_NONE) {
+		memcpy(dst, row, rowbytes);
+		return;
+	}
+
+	// first pixel : the left neighbours are zero
+	unsigned i = 0;
+	const unsigned first = MIN(bpp, rowbytes);
+	for(; i < first; i++) {
+		switch(filter) {
+			case PNG_FILTER_VALUE_SUB:
+				dst[i] = row[i];
+				break;
+			case PNG_FILTER_VALUE_UP:
+			case PNG_FILTER_VALUE_PAETH:
+				dst[i] = (BYTE)(row[i] - prev[i]);
+				break;
+			case PNG_FILTER_VALUE_AVG:
+				dst[i] = (BYTE)(row[i] - (prev[i] >> 1));
+				break;
+		}
+	}
+
+#ifdef FREEIMAGE_SSE2
+	// the filters only depend on unfiltered samples : 16 bytes at a time
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi8(1);
+	for(; i + 16 <= rowbytes; i += 16) {
+		const __m128i x = _mm_loadu_si128((const __m128i*)(row + i));
+		__m128i pred;
+		switch(filter) {
+			case PNG_FILTER_VALUE_SUB:
+				pred = _mm_loadu_si128((const __m128i*)(row + i - bpp));
+				break;
+			case PNG_FILTER_VALUE_UP:
+				pred = _mm_loadu_si128((const __m128i*)(prev + i));
+				break;
+			case PNG_FILTER_VALUE_AVG:
+			{
+				// floor((a + b) / 2) from the rounded up average
+				const __m128i a = _mm_loadu_si128((const __m128i*)(row + i - bpp));
+				const __m128i b = _mm_loadu_si128((const __m128i*)(prev + i));
+				pred = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+				break;
+			}
+			default:
+			{
+				const __m128i a = _mm_loadu_si128((const __m128i*)(row + i - bpp));
+				const __m128i b = _mm_loadu_si128((const __m128i*)(prev + i));
+				const __m128i c = _mm_loadu_si128((const __m128i*)(prev + i - bpp));
+				const __m128i lo = PaethPredictor8(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+				const __m128i hi = PaethPredictor8(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+				pred = _mm_packus_epi16(lo, hi);
+				break;
+			}
+		}
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_sub_epi8(x, pred));
+	}
+#endif // FREEIMAGE_SSE2
+
+	for(; i < rowbytes; i++) {
+		switch(filter) {
+			case PNG_FILTER_VALUE_SUB:
+				dst[i] = (BYTE)(row[i] - row[i - bpp]);
+				break;
+			case PNG_FILTER_VALUE_UP:
+				dst[i] = (BYTE)(row[i] - prev[i]);
+				break;
+			case PNG_FILTER_VALUE_AVG:
+				dst[i] = (BYTE)(row[i] - ((row[i - bpp] + prev[i]) >> 1));
+				break;
+			case PNG_FILTER_VALUE_PAETH:
+				dst[i] = (BYTE)(row[i] - PaethPredictor(row[i - bpp], prev[i], prev[i - bpp]));
+				break;
+		}
+	}
+}
+
+/**
+Cost of a filtered row used to select the filter of a row, as done by libpng :
+the sum of the filtered bytes taken as signed values, in absolute value
+*/
+static unsigned
+FilteredRowCost(const BYTE *row, unsigned rowbytes) {
+	unsigned sum = 0;
+	unsigned i = 0;
+
+#ifdef FREEIMAGE_SSE2
+	// |v| of a signed byte is min(v, -v) taken as unsigned bytes
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = zero;
+	for(; i + 16 <= rowbytes; i += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(row + i));
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_min_epu8(v, _mm_sub_epi8(zero, v)), zero));
+	}
+	sum = (unsigned)_mm_cvtsi128_si32(acc) + (unsigned)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif // FREEIMAGE_SSE2
+
+	for(; i < rowbytes; i++) {
+		sum += (row[i] < 128) ? row[i] : 256 - row[i];
+	}
+	return sum;
+}
+
+/**
+Filters enabled by Save, given as a PNG_FILTER_NONE ... PNG_FILTER_PAETH mask.
+Palettized and low bit depth images are not filtered (as done by libpng),
+high color images use the filters set with png_set_filter.
+*/
+static int
+GetSaveFilters(int color_type, int bit_depth, int pixel_depth) {
+	if((color_type == PNG_COLOR_TYPE_PALETTE) || (bit_depth < 8)) {
+		return PNG_FILTER_NONE;
+	}
+	if(pixel_depth >= 16) {
+		return PNG_FILTER_NONE | PNG_FILTER_SUB | PNG_FILTER_PAETH;
+	}
+	return PNG_ALL_FILTERS;
+}
+
+/**
+How the band encoder selects the filter of a row
+*/
+typedef enum {
+	//! lowest libpng cost among the enabled filters, for each row
+	PNG_SELECT_ROW_COST = 0,
+	//! lowest libpng cost over a sample of rows, one filter for the whole image
+	PNG_SELECT_IMAGE_COST = 1,
+	//! smallest row after a trial compression with each filter, for each row
+	PNG_SELECT_ROW_TRIAL = 2
+} PNG_FILTER_SELECTION;
+
+/**
+Size of the uncompressed (filtered) data of a band of rows
+*/
+#define PNG_BAND_SIZE (1 << 20)
+
+/**
+Number of rows sampled by PNG_SELECT_IMAGE_COST
+*/
+#define PNG_SAMPLE_ROWS 64
+
+/**
+With PNG_SELECT_ROW_TRIAL, rows are compressed after the previous rows of their group,
+groups starting every PNG_TRIAL_GROUP rows : the filter selected for a row then does not depend on
+where a band starts, so that the dictionary of a band can be rebuilt exactly.
+*/
+#define PNG_TRIAL_GROUP 16
+
+/**
+Encode the IDAT stream of a non-interlaced image on one or more threads, the way pigz does.
+The image is cut into bands of rows holding about PNG_BAND_SIZE bytes of filtered data.
+Each band is filtered and compressed into a raw deflate segment ended by a Z_SYNC_FLUSH,
+using the last 32 KB of filtered data of the previous rows as a preset dictionary,
+so that the segments can be concatenated into a single zlib stream.
+The Adler-32 checksum of the stream is then computed from the checksums of the bands,
+using adler32_combine.
+
+The samples are converted the way libpng does it in Save (png_set_invert_mono, png_set_bgr,
+png_set_swap and the conversion of 32-bit images without alpha to 24-bit).
+*/
+class PNGBandEncoder : public ParallelTask {
+public:
+	/**
+	@param png_ptr PNG handle of the saver, with the header chunks already written
+	@param dib Source image
+	@param rowbytes Size of a PNG row, in bytes
+	@param pixel_bits Size of a PNG pixel, in bits
+	@param filters Enabled filters (PNG_FILTER_NONE ... PNG_FILTER_PAETH mask)
+	@param level ZLib compression level
+	@param strategy ZLib compression strategy
+	*/
+	PNGBandEncoder(png_structp png_ptr, FIBITMAP *dib, unsigned rowbytes, unsigned pixel_bits, int filters, int level, int strategy) :
+		_png_ptr(png_ptr), _dib(dib), _width(FreeImage_GetWidth(dib)), _height(FreeImage_GetHeight(dib)),
+		_rowbytes(rowbytes), _bpp(MAX(1U, pixel_bits / 8)), _filters(filters), _selection(PNG_SELECT_ROW_COST), _level(level), _strategy(strategy),
+		_invert(FALSE), _bgr(FALSE), _swap(FALSE), _strip(FALSE),
+		_groupRows(1), _threads(0), _workspaces(NULL), _first(0), _count(0), _bands(NULL), _sizes(NULL), _adlers(NULL), _lengths(NULL), _adler(1), _error(FALSE) {
+	}
+
+	virtual ~PNGBandEncoder() {
+		freeBands();
+		for(unsigned t = 0; t < _threads; t++) {
+			Workspace *ws = &_workspaces[t];
+			free(ws->buffer);
+			deflateEnd(&ws->stream);
+			if(ws->trial) {
+				deflateEnd(&ws->trial_stream);
+			}
+		}
+		free(_workspaces);
+		free(_bands);
+		free(_sizes);
+		free(_adlers);
+		free(_lengths);
+	}
+
+	/**
+	Set the sample conversions done by libpng in the serial path
+	*/
+	void setTransforms(BOOL invert, BOOL bgr, BOOL swap, BOOL strip) {
+		_invert = invert;
+		_bgr = bgr;
+		_swap = swap;
+		_strip = strip;
+	}
+
+	/**
+	Set how the filter of a row is selected among the enabled filters
+	*/
+	void setFilterSelection(PNG_FILTER_SELECTION selection) {
+		_selection = selection;
+		if((_selection == PNG_SELECT_ROW_TRIAL) && (_level == Z_NO_COMPRESSION)) {
+			// nothing to compare
+			_selection = PNG_SELECT_ROW_COST;
+		}
+	}
+
+	/**
+	Compress the image and write the IDAT chunks
+	@param threads Maximum number of threads
+	@return Returns FALSE if the buffers or the deflate streams could not be allocated
+	*/
+	BOOL encode(unsigned threads) {
+		const unsigned filtered = _rowbytes + 1;
+
+		_groupRows = (_selection == PNG_SELECT_ROW_TRIAL) ? PNG_TRIAL_GROUP : 1;
+		// bands start on a group of rows
+		_bandRows = MAX(1U, PNG_BAND_SIZE / filtered);
+		_bandRows = ((_bandRows + _groupRows - 1) / _groupRows) * _groupRows;
+		_bandCount = (_height + _bandRows - 1) / _bandRows;
+		// rows filtered again to rebuild the 32 KB dictionary of a band (from the start of a group)
+		_dictRows = (32768 + filtered - 1) / filtered;
+		_bufferSize = (size_t)MAX(_bandRows, _dictRows + _groupRows - 1) * filtered;
+
+		if(!open(MAX(1U, MIN(threads, _bandCount)))) {
+			return FALSE;
+		}
+
+		if(_selection == PNG_SELECT_IMAGE_COST) {
+			_filters = selectImageFilter(&_workspaces[0]);
+		}
+
+		// bands of a batch : a few bands per thread
+		const unsigned batchCount = _threads * 4;
+
+		for(_first = 0; _first < _bandCount; _first += batchCount) {
+			_count = MIN(batchCount, _bandCount - _first);
+
+			ParallelRun(*this, _count, _threads);
+			if(hasError()) {
+				break;
+			}
+			writeBands();
+			freeBands();
+		}
+
+		return TRUE;
+	}
+
+	/**
+	Returns TRUE if a band could not be compressed
+	*/
+	BOOL hasError() {
+		ParallelLock lock(_mutex);
+		return _error;
+	}
+
+	void run(unsigned item, unsigned thread) {
+		if(hasError()) {
+			// the image is rejected, skip the remaining bands
+			return;
+		}
+
+		const unsigned band = _first + item;
+		const unsigned filtered = _rowbytes + 1;
+		const unsigned y0 = band * _bandRows;
+		const unsigned y1 = MIN(y0 + _bandRows, _height);
+
+		Workspace *ws = &_workspaces[thread];
+		BYTE *buffer = ws->buffer;
+
+		z_stream *stream = &ws->stream;
+		if(deflateReset(stream) != Z_OK) {
+			setError();
+			return;
+		}
+
+		// rebuild the dictionary from the rows above the band
+
+		unsigned y = (y0 > _dictRows) ? y0 - _dictRows : 0;
+		y -= y % _groupRows;
+		if(y > 0) {
+			convertRow(ws->prev, y - 1, ws->line);
+		} else {
+			memset(ws->prev, 0, _rowbytes);
+		}
+		if(y < y0) {
+			if(!filterRows(ws, y, y0)) {
+				setError();
+				return;
+			}
+
+			const unsigned size = (y0 - y) * filtered;
+			const unsigned dict_size = MIN(size, 32768U);
+			if(deflateSetDictionary(stream, buffer + size - dict_size, dict_size) != Z_OK) {
+				setError();
+				return;
+			}
+		}
+
+		// filter the band
+
+		if(!filterRows(ws, y0, y1)) {
+			setError();
+			return;
+		}
+
+		const unsigned length = (y1 - y0) * filtered;
+		_adlers[item] = adler32(adler32(0L, Z_NULL, 0), buffer, length);
+		_lengths[item] = length;
+
+		// compress the band, leaving room for the zlib header and the Adler-32 trailer
+
+		size_t capacity = (size_t)deflateBound(stream, length) + 16;
+		const size_t offset = (band == 0) ? 2 : 0;
+		BYTE *output = (BYTE*)malloc(capacity + 6);
+		if(!output) {
+			setError();
+			return;
+		}
+
+		const int flush = (band == _bandCount - 1) ? Z_FINISH : Z_SYNC_FLUSH;
+
+		stream->next_in = buffer;
+		stream->avail_in = length;
+		stream->next_out = output + offset;
+		stream->avail_out = (uInt)capacity;
+
+		for(;;) {
+			const int status = deflate(stream, flush);
+			if((status != Z_OK) && (status != Z_STREAM_END) && (status != Z_BUF_ERROR)) {
+				free(output);
+				setError();
+				return;
+			}
+			if((stream->avail_out != 0) || (status == Z_STREAM_END)) {
+				break;
+			}
+			// output buffer full : grow it
+			BYTE *bigger = (BYTE*)realloc(output, 2 * capacity + 6);
+			if(!bigger) {
+				free(output);
+				setError();
+				return;
+			}
+			output = bigger;
+			stream->next_out = output + offset + capacity;
+			stream->avail_out = (uInt)capacity;
+			capacity *= 2;
+		}
+
+		_bands[item] = output;
+		_sizes[item] = offset + (capacity - stream->avail_out);
+	}
+
+private:
+	/**
+	Buffers and deflate streams of a thread
+	*/
+	typedef struct tagWorkspace {
+		//! filtered data of a band
+		BYTE *buffer;
+		//! current and previous rows of samples, a dib line, 5 filtered candidates
+		BYTE *row;
+		BYTE *prev;
+		BYTE *line;
+		BYTE *candidates;
+		//! output of the trial compressions (PNG_SELECT_ROW_TRIAL only)
+		BYTE *trial;
+		size_t trial_size;
+		z_stream stream;
+		z_stream trial_stream;
+	} Workspace;
+
+	void setError() {
+		ParallelLock lock(_mutex);
+		_error = TRUE;
+	}
+
+	/**
+	Allocate the workspaces of up to 'threads' threads
+	*/
+	BOOL open(unsigned threads) {
+		_workspaces = (Workspace*)calloc(threads, sizeof(Workspace));
+		_bands = (BYTE**)calloc(threads * 4, sizeof(BYTE*));
+		_sizes = (size_t*)calloc(threads * 4, sizeof(size_t));
+		_adlers = (uLong*)calloc(threads * 4, sizeof(uLong));
+		_lengths = (uLong*)calloc(threads * 4, sizeof(uLong));
+		if(!_workspaces || !_bands || !_sizes || !_adlers || !_lengths) {
+			return FALSE;
+		}
+
+		const size_t filtered = _rowbytes + 1;
+		const size_t trial_size = (_selection == PNG_SELECT_ROW_TRIAL) ? (size_t)compressBound((uLong)filtered) + 16 : 0;
+		const size_t size = _bufferSize + 2 * _rowbytes + _width * 4 + 5 * filtered + trial_size;
+
+		for(unsigned t = 0; t < threads; t++) {
+			Workspace *ws = &_workspaces[t];
+			ws->buffer = (BYTE*)malloc(size);
+			if(!ws->buffer) {
+				break;
+			}
+			ws->row = ws->buffer + _bufferSize;
+			ws->prev = ws->row + _rowbytes;
+			ws->line = ws->prev + _rowbytes;
+			ws->candidates = ws->line + _width * 4;
+			if(deflateInit2(&ws->stream, _level, Z_DEFLATED, -15, 8, _strategy) != Z_OK) {
+				free(ws->buffer);
+				break;
+			}
+			if(trial_size) {
+				if(deflateInit2(&ws->trial_stream, _level, Z_DEFLATED, -15, 8, _strategy) != Z_OK) {
+					deflateEnd(&ws->stream);
+					free(ws->buffer);
+					break;
+				}
+				ws->trial = ws->candidates + 5 * filtered;
+				ws->trial_size = trial_size;
+			}
+			_threads++;
+		}
+
+		return (_threads > 0);
+	}
+
+	/**
+	Convert the row y of the image (counted from the top) to PNG samples
+	@param dst Output row
+	@param y Row index
+	@param line Work buffer of a 24-bit dib line
+	*/
+	void convertRow(BYTE *dst, unsigned y, BYTE *line) {
+		const BYTE *src = FreeImage_GetScanLine(_dib, _height - 1 - y);
+
+		if(_strip) {
+			FreeImage_ConvertLine32To24(line, (BYTE*)src, _width);
+			src = line;
+		}
+		if(_bgr) {
+			const unsigned bytespp = _bpp;
+			for(unsigned x = 0; x < _rowbytes; x += bytespp) {
+				dst[x + 0] = src[x + 2];
+				dst[x + 1] = src[x + 1];
+				dst[x + 2] = src[x + 0];
+				if(bytespp == 4) {
+					dst[x + 3] = src[x + 3];
+				}
+			}
+		} else if(_swap) {
+			for(unsigned x = 0; x < _rowbytes; x += 2) {
+				dst[x + 0] = src[x + 1];
+				dst[x + 1] = src[x + 0];
+			}
+		} else if(_invert) {
+			for(unsigned x = 0; x < _rowbytes; x++) {
+				dst[x] = (BYTE)~src[x];
+			}
+		} else {
+			memcpy(dst, src, _rowbytes);
+		}
+	}
+
+	/**
+	Compressed size of a filtered row, compressed after the previous rows of its group
+	@return Returns the size in bytes, or 0 if the trial compression failed
+	*/
+	size_t trialSize(Workspace *ws, const BYTE *context, size_t context_size, const BYTE *candidate) {
+		z_stream *stream = &ws->trial_stream;
+		if(deflateReset(stream) != Z_OK) {
+			return 0;
+		}
+		if(context_size) {
+			const size_t dict_size = MIN(context_size, (size_t)32768);
+			if(deflateSetDictionary(stream, context + context_size - dict_size, (uInt)dict_size) != Z_OK) {
+				return 0;
+			}
+		}
+		stream->next_in = (Bytef*)candidate;
+		stream->avail_in = _rowbytes + 1;
+		stream->next_out = ws->trial;
+		stream->avail_out = (uInt)ws->trial_size;
+		if(deflate(stream, Z_SYNC_FLUSH) != Z_OK) {
+			return 0;
+		}
+		return (size_t)stream->total_out;
+	}
+
+	/**
+	Filter the rows [y0, y1) into the band buffer of a workspace.
+	The first row y0 must start a group of rows and ws->prev must hold the converted row y0 - 1
+	(zeros if y0 is 0) : ws->prev is updated with the last converted row.
+	@return Returns FALSE if a trial compression failed
+	*/
+	BOOL filterRows(Workspace *ws, unsigned y0, unsigned y1) {
+		const unsigned filtered = _rowbytes + 1;
+		const BOOL single = ((_filters & (_filters - 1)) == 0);
+
+		for(unsigned y = y0; y < y1; y++) {
+			BYTE *dst = ws->buffer + (y - y0) * filtered;
+
+			convertRow(ws->row, y, ws->line);
+
+			if(single) {
+				int filter = PNG_FILTER_VALUE_NONE;
+				while((PNG_FILTER_NONE << filter) != _filters) {
+					filter++;
+				}
+				FilterRow(dst, filter, ws->row, ws->prev, _rowbytes, _bpp);
+			} else {
+				// keep the filter with the lowest cost
+				size_t best_cost = 0;
+				const BYTE *best = NULL;
+				for(int filter = PNG_FILTER_VALUE_NONE; filter < PNG_FILTER_VALUE_LAST; filter++) {
+					if(_filters & (PNG_FILTER_NONE << filter)) {
+						BYTE *candidate = ws->candidates + filter * filtered;
+						FilterRow(candidate, filter, ws->row, ws->prev, _rowbytes, _bpp);
+
+						size_t cost = 0;
+						if(_selection == PNG_SELECT_ROW_TRIAL) {
+							const unsigned group = y - (y % _groupRows);
+							cost = trialSize(ws, ws->buffer + (group - y0) * filtered, (y - group) * filtered, candidate);
+							if(cost == 0) {
+								return FALSE;
+							}
+						} else {
+							cost = FilteredRowCost(candidate + 1, _rowbytes);
+						}
+						if(!best || (cost < best_cost)) {
+							best = candidate;
+							best_cost = cost;
+						}
+					}
+				}
+				memcpy(dst, best, filtered);
+			}
+
+			memcpy(ws->prev, ws->row, _rowbytes);
+		}
+
+		return TRUE;
+	}
+
+	/**
+	Select the enabled filter with the lowest libpng cost over a sample of rows
+	@return Returns the selected filter, as a PNG_FILTER_NONE ... PNG_FILTER_PAETH mask
+	*/
+	int selectImageFilter(Workspace *ws) {
+		size_t costs[PNG_FILTER_VALUE_LAST] = { 0 };
+
+		const unsigned samples = MIN((unsigned)PNG_SAMPLE_ROWS, _height);
+		for(unsigned s = 0; s < samples; s++) {
+			// rows spread over the image height
+			const unsigned y = (unsigned)((s + 0.5) * _height / samples);
+			if(y > 0) {
+				convertRow(ws->prev, y - 1, ws->line);
+			} else {
+				memset(ws->prev, 0, _rowbytes);
+			}
+			convertRow(ws->row, y, ws->line);
+
+			for(int filter = PNG_FILTER_VALUE_NONE; filter < PNG_FILTER_VALUE_LAST; filter++) {
+				if(_filters & (PNG_FILTER_NONE << filter)) {
+					FilterRow(ws->candidates, filter, ws->row, ws->prev, _rowbytes, _bpp);
+					costs[filter] += FilteredRowCost(ws->candidates + 1, _rowbytes);
+				}
+			}
+		}
+
+		int best = -1;
+		for(int filter = PNG_FILTER_VALUE_NONE; filter < PNG_FILTER_VALUE_LAST; filter++) {
+			if((_filters & (PNG_FILTER_NONE << filter)) && ((best < 0) || (costs[filter] < costs[best]))) {
+				best = filter;
+			}
+		}
+
+		return (best < 0) ? PNG_FILTER_NONE : (PNG_FILTER_NONE << best);
+	}
+
+	/**
+	Write the compressed bands of the current batch as IDAT chunks
+	*/
+	void writeBands() {
+		for(unsigned item = 0; item < _count; item++) {
+			const unsigned band = _first + item;
+			BYTE *output = _bands[item];
+			size_t size = _sizes[item];
+
+			_adler = adler32_combine(_adler, _adlers[item], (z_off_t)_lengths[item]);
+
+			if(band == 0) {
+				// zlib header : deflate with a 32K window, compression level hint
+				int level_hint = 3;
+				if((_strategy >= Z_HUFFMAN_ONLY) || ((_level >= 0) && (_level < 2))) {
+					level_hint = 0;
+				} else if((_level >= 0) && (_level < 6)) {
+					level_hint = 1;
+				} else if((_level == 6) || (_level == Z_DEFAULT_COMPRESSION)) {
+					level_hint = 2;
+				}
+				const unsigned header = (0x78 << 8) | (level_hint << 6);
+				output[0] = 0x78;
+				output[1] = (BYTE)((level_hint << 6) + 31 - (header % 31));
+			}
+			if(band == _bandCount - 1) {
+				// Adler-32 of the uncompressed data, big endian
+				output[size++] = (BYTE)(_adler >> 24);
+				output[size++] = (BYTE)(_adler >> 16);
+				output[size++] = (BYTE)(_adler >> 8);
+				output[size++] = (BYTE)_adler;
+			}
+
+			png_write_chunk(_png_ptr, (png_const_bytep)"IDAT", output, size);
+		}
+	}
+
+	/**
+	Free the compressed bands of the current batch
+	*/
+	void freeBands() {
+		if(!_bands) {
+			return;
+		}
+		for(unsigned item = 0; item < _count; item++) {
+			free(_bands[item]);
+			_bands[item] = NULL;
+		}
+	}
+
+	PNGBandEncoder& operator=(const PNGBandEncoder&); // deleted
+	PNGBandEncoder(const PNGBandEncoder&); // deleted
+
+private:
+	png_structp _png_ptr;
+	FIBITMAP *_dib;
+	unsigned _width;
+	unsigned _height;
+	//! size of a row and of a pixel (at least 1) of PNG samples, in bytes
+	unsigned _rowbytes;
+	unsigned _bpp;
+	//! enabled filters and filter selection
+	int _filters;
+	PNG_FILTER_SELECTION _selection;
+	int _level;
+	int _strategy;
+	//! sample conversions
+	BOOL _invert;
+	BOOL _bgr;
+	BOOL _swap;
+	BOOL _strip;
+	//! rows per group, rows per band, number of bands, rows used to rebuild a dictionary
+	unsigned _groupRows;
+	unsigned _bandRows;
+	unsigned _bandCount;
+	unsigned _dictRows;
+	//! size of the filtered data buffer of a thread
+	size_t _bufferSize;
+	//! number of threads with a workspace
+	unsigned _threads;
+	Workspace *_workspaces;
+	//! first band and number of bands of the current batch
+	unsigned _first;
+	unsigned _count;
+	//! compressed data, compressed size, Adler-32 and uncompressed size of the bands of the current batch
+	BYTE **_bands;
+	size_t *_sizes;
+	uLong *_adlers;
+	uLong *_lengths;
+	//! Adler-32 of the bands written so far
+	uLong _adler;
+	//! protects the error flag
+	ParallelMutex _mutex;
+	BOOL _error;
+};
+
 // --------------------------------------------------------------------------
 
 static BOOL DLL_CALLCONV
@@ -886,15 +1654,17 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 			if((zlib_level >= 1) && (zlib_level <= 9)) {
 				png_set_compression_level(png_ptr, zlib_level);
 			} else if((flags & PNG_Z_NO_COMPRESSION) == PNG_Z_NO_COMPRESSION) {
-				png_set_compression_level(png_ptr, Z_NO_COMPRESSION);
+				zlib_level = Z_NO_COMPRESSION;
+				png_set_compression_level(png_ptr, zlib_level);
+			} else {
+				zlib_level = Z_DEFAULT_COMPRESSION;
 			}
 
 			// filtered strategy works better for high color images
+			const int zlib_strategy = (pixel_depth >= 16) ? Z_FILTERED : Z_DEFAULT_STRATEGY;
+			png_set_compression_strategy(png_ptr, zlib_strategy);
 			if(pixel_depth >= 16){
-				png_set_compression_strategy(png_ptr, Z_FILTERED);
 				png_set_filter(png_ptr, 0, PNG_FILTER_NONE|PNG_FILTER_SUB|PNG_FILTER_PAETH);
-			} else {
-				png_set_compression_strategy(png_ptr, Z_DEFAULT_STRATEGY);
 			}
 
 			FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(dib);
@@ -1028,6 +1798,62 @@ Save(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flags, void
 
 			png_write_info(png_ptr, info_ptr);
 
+			const int filter_flags = flags & (PNG_FILTERS_FAST | PNG_FILTERS_ADAPTIVE | PNG_FILTERS_BRUTE);
+
+			if ((((flags & PNG_MULTITHREAD) == PNG_MULTITHREAD) || filter_flags) && !bInterlaced) {
+				// filter and compress bands of rows (on several threads if PNG_MULTITHREAD is set), 
+				// then write the IDAT and IEND chunks
+
+				const int color_type = png_get_color_type(png_ptr, info_ptr);
+				const unsigned pixel_bits = (unsigned)(bit_depth * png_get_channels(png_ptr, info_ptr));
+
+				// the filter selection flags choose among all filters, whatever the image type
+				const int filters = filter_flags ? PNG_ALL_FILTERS : GetSaveFilters(color_type, bit_depth, pixel_depth);
+
+				PNGBandEncoder encoder(png_ptr, dib, (unsigned)png_get_rowbytes(png_ptr, info_ptr), pixel_bits,
+					filters, zlib_level, zlib_strategy);
+
+				if ((filter_flags & PNG_FILTERS_BRUTE) == PNG_FILTERS_BRUTE) {
+					encoder.setFilterSelection(PNG_SELECT_ROW_TRIAL);
+				} else if ((filter_flags & PNG_FILTERS_ADAPTIVE) == PNG_FILTERS_ADAPTIVE) {
+					encoder.setFilterSelection(PNG_SELECT_ROW_COST);
+				} else if ((filter_flags & PNG_FILTERS_FAST) == PNG_FILTERS_FAST) {
+					encoder.setFilterSelection(PNG_SELECT_IMAGE_COST);
+				}
+
+				const BOOL bInvert = (FreeImage_GetColorType(dib) == FIC_MINISWHITE) && !bIsTransparent;
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+				const BOOL bBGR = (image_type == FIT_BITMAP) && ((color_type == PNG_COLOR_TYPE_RGB) || (color_type == PNG_COLOR_TYPE_RGBA));
+#else
+				const BOOL bBGR = FALSE;
+#endif
+#ifndef FREEIMAGE_BIGENDIAN
+				const BOOL bSwap = (bit_depth == 16);
+#else
+				const BOOL bSwap = FALSE;
+#endif
+				encoder.setTransforms(bInvert, bBGR, bSwap, (pixel_depth == 32) && !has_alpha_channel);
+
+				const unsigned threads = ((flags & PNG_MULTITHREAD) == PNG_MULTITHREAD) ? GetProcessorCount() : 1;
+
+				if (!encoder.encode(threads)) {
+					throw FI_MSG_ERROR_MEMORY;
+				}
+				if (encoder.hasError()) {
+					throw "Failed to compress the image data";
+				}
+
+				png_write_chunk(png_ptr, (png_const_bytep)"IEND", NULL, 0);
+
+				if (palette) {
+					png_free(png_ptr, palette);
+				}
+
+				png_destroy_write_struct(&png_ptr, &info_ptr);
+
+				return TRUE;
+			}
+
 			// write out the image data
 
 #ifndef FREEIMAGE_BIGENDIAN
@@ -21,6 +21,7 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "FreeImageIO.h"
 
 // ----------------------------------------------------------
 //   Constants + headers
@@ -90,41 +91,55 @@ typedef struct tagSUNHEADER {
 // Internal functions
 // ==========================================================
 
+/**
+Run-length decoder state, kept from a call to ReadData to the next one
+*/
+typedef struct tagRASRLE {
+	BYTE repchar;
+	BYTE remaining;
+} RASRLE;
+
 static void
-ReadData(FreeImageIO *io, fi_handle handle, BYTE *buf, DWORD length, BOOL rle) {
+ReadData(BufferedReader &reader, BYTE *buf, DWORD length, BOOL rle, RASRLE *state) {
 	// Read either Run-Length Encoded or normal image data
 
-	static BYTE repchar, remaining= 0;
-
 	if (rle) {
 		// Run-length encoded read
 
-		while(length--) {
+		BYTE &repchar = state->repchar;
+		BYTE &remaining = state->remaining;
+
+		while(length) {
 			if (remaining) {
-				remaining--;
-				*(buf++)= repchar;
+				// continue the current run
+				const DWORD count = MIN((DWORD)remaining, length);
+				memset(buf, repchar, count);
+				buf += count;
+				length -= count;
+				remaining = (BYTE)(remaining - count);
 			} else {
-				io->read_proc(&repchar, 1, 1, handle);
+				reader.getByte(&repchar);
 
 				if (repchar == RESC) {
-					io->read_proc(&remaining, 1, 1, handle);
+					reader.getByte(&remaining);
 
 					if (remaining == 0) {
 						*(buf++)= RESC;
 					} else {
-						io->read_proc(&repchar, 1, 1, handle);
+						reader.getByte(&repchar);
 
 						*(buf++)= repchar;
 					}
 				} else {
 					*(buf++)= repchar;
 				}
+				length--;
 			}
 		}
 	} else {
 		// Normal read
 	
-		io->read_proc(buf, length, 1, handle);
+		reader.read(buf, length);
 	}
 }
 
@@ -368,6 +383,14 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 		unsigned pitch = FreeImage_GetPitch(dib);
 
 		// Read the image data
+
+		BufferedReader reader(io, handle);
+		if(reader.isNull()) {
+			throw FI_MSG_ERROR_MEMORY;
+		}
+
+		RASRLE rle_state;
+		memset(&rle_state, 0, sizeof(RASRLE));
 		
 		switch(header.depth) {
 			case 1:
@@ -376,12 +399,12 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 				bits = FreeImage_GetBits(dib) + (header.height - 1) * pitch;
 
 				for (y = 0; y < header.height; y++) {
-					ReadData(io, handle, bits, linelength, rle);
+					ReadData(reader, bits, linelength, rle, &rle_state);
 
 					bits -= pitch;
 
 					if (fill) {
-						ReadData(io, handle, &fillchar, fill, rle);
+						ReadData(reader, &fillchar, fill, rle, &rle_state);
 					}
 				}
 
@@ -397,7 +420,7 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 				for (y = 0; y < header.height; y++) {
 					bits = FreeImage_GetBits(dib) + (header.height - 1 - y) * pitch;
 
-					ReadData(io, handle, buf, header.width * 3, rle);
+					ReadData(reader, buf, header.width * 3, rle, &rle_state);
 
 					bp = buf;
 
@@ -420,7 +443,7 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 					}
 
 					if (fill) {
-						ReadData(io, handle, &fillchar, fill, rle);
+						ReadData(reader, &fillchar, fill, rle, &rle_state);
 					}
 				}
 
@@ -437,7 +460,7 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 				for (y = 0; y < header.height; y++) {
 					bits = FreeImage_GetBits(dib) + (header.height - 1 - y) * pitch;
 
-					ReadData(io, handle, buf, header.width * 4, rle);
+					ReadData(reader, buf, header.width * 4, rle, &rle_state);
 
 					bp = buf;
 
@@ -464,7 +487,7 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 					}
 
 					if (fill) {
-						ReadData(io, handle, &fillchar, fill, rle);
+						ReadData(reader, &fillchar, fill, rle, &rle_state);
 					}
 				}
 
@@ -30,6 +30,7 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "FreeImageIO.h"
 
 // ----------------------------------------------------------
 //   Constants + headers
@@ -129,12 +130,12 @@ SwapHeader(SGIHeader *header) {
 #endif
 
 static int 
-get_rlechar(FreeImageIO *io, fi_handle handle, RLEStatus *pstatus) {
+get_rlechar(BufferedReader &reader, RLEStatus *pstatus) {
 	if (!pstatus->cnt) {
 		int cnt = 0;
 		while (0 == cnt) {
 			BYTE packed = 0;
-			if(io->read_proc(&packed, sizeof(BYTE), 1, handle) < 1) {
+			if(!reader.getByte(&packed)) {
 				return EOF;
 			}
 			cnt = packed;
@@ -147,7 +148,7 @@ get_rlechar(FreeImageIO *io, fi_handle handle, RLEStatus *pstatus) {
 			pstatus->val = -1;
 		} else {
 			BYTE packed = 0;
-			if(io->read_proc(&packed, sizeof(BYTE), 1, handle) < 1) {
+			if(!reader.getByte(&packed)) {
 				return EOF;
 			}
 			pstatus->val = packed;
@@ -156,7 +157,7 @@ get_rlechar(FreeImageIO *io, fi_handle handle, RLEStatus *pstatus) {
 	pstatus->cnt--;
 	if (pstatus->val == -1) {
 		BYTE packed = 0;
-		if(io->read_proc(&packed, sizeof(BYTE), 1, handle) < 1) {
+		if(!reader.getByte(&packed)) {
 			return EOF;
 		}
 		return packed;
@@ -235,6 +236,12 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 		}
 		
 		BOOL bIsRLE = (sgiHeader.storage == 1) ? TRUE : FALSE;
+
+		// the offset tables and the image data are read through a buffered reader
+		BufferedReader reader(io, handle);
+		if(reader.isNull()) {
+			throw FI_MSG_ERROR_MEMORY;
+		}
 	
 		// check for unsupported image types
 		if (sgiHeader.bpc != 1) {
@@ -269,7 +276,7 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 				throw FI_MSG_ERROR_MEMORY;
 			}
 			
-			if ((unsigned)index_len != io->read_proc(pRowIndex, sizeof(LONG), index_len, handle)) {
+			if (index_len * sizeof(LONG) != reader.read(pRowIndex, index_len * sizeof(LONG))) {
 				throw SGI_EOF_IN_RLE_INDEX;
 			}
 			
@@ -280,11 +287,8 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 			}
 #endif
 			// Discard row size index
-			for (i = 0; i < (int)(index_len * sizeof(LONG)); i++) {
-				BYTE packed = 0;
-				if( io->read_proc(&packed, sizeof(BYTE), 1, handle) < 1 ) {
-					throw SGI_EOF_IN_RLE_INDEX;
-				}
+			if (!reader.skip((long)(index_len * sizeof(LONG)))) {
+				throw SGI_EOF_IN_RLE_INDEX;
 			}
 		}
 		
@@ -351,17 +355,17 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 				BYTE *p = pRow;
 				if (bIsRLE) {
 					my_rle_status.cnt = 0;
-					io->seek_proc(handle, *pri, SEEK_SET);
+					reader.seek(*pri);
 				}
 				for (int k = 0; k < width; k++, p += numChannels) {
 					int ch;
 					BYTE packed = 0;
 					if (bIsRLE) {
-						ch = get_rlechar(io, handle, &my_rle_status);
+						ch = get_rlechar(reader, &my_rle_status);
 						packed = (BYTE)ch;
 					}
 					else {
-						ch = io->read_proc(&packed, sizeof(BYTE), 1, handle);
+						ch = reader.getByte(&packed);
 					}
 					if (ch == EOF) {
 						throw SGI_EOF_IN_IMAGE_DATA;
@@ -27,6 +27,7 @@
 
 #include "FreeImage.h"
 #include "Utilities.h"
+#include "FreeImageIO.h"
 
 // ----------------------------------------------------------
 //   Constants + headers
@@ -201,84 +202,6 @@ FIBITMAP* TargaThumbnail::toFIBITMAP() {
 // Internal functions
 // ==========================================================
 
-/** This class is used when loading RLE compressed images, it implements io cache of fixed size.
-	In general RLE compressed images *should* be compressed line by line with line sizes stored in Scan Line Table section.
-	In reality, however there are images not obeying the specification, compressing image data continuously across lines,
-	making it impossible to load the file cached at every line.
-*/
-class IOCache
-{
-public:
-	IOCache(FreeImageIO *io, fi_handle handle, size_t size) :
-		_ptr(NULL), _begin(NULL), _end(NULL), _size(size), _io(io), _handle(handle)	{
-			_begin = (BYTE*)malloc(size);
-			if (_begin) {
-			_end = _begin + _size;
-			_ptr = _end;	// will force refill on first access
-		}
-	}
-	
-	~IOCache() {
-		if (_begin != NULL) {
-			free(_begin);
-		}	
-	}
-		
-	BOOL isNull() { return _begin == NULL;}
-	
-	inline
-	BYTE getByte() {
-		if (_ptr >= _end) {
-			// need refill
-			_ptr = _begin;
-			_io->read_proc(_ptr, sizeof(BYTE), (unsigned)_size, _handle);	//### EOF - no problem?
-		}
-
-		BYTE result = *_ptr;
-
-		_ptr++;
-
-		return result;
-	}
-	
-	inline
-	BYTE* getBytes(size_t count /*must be < _size!*/) {
-		if (_ptr + count >= _end) {
-			
-			// need refill
-
-			// 'count' bytes might span two cache bounds,
-			// SEEK back to add the remains of the current cache again into the new one
-
-			long read = long(_ptr - _begin);
-			long remaining = long(_size - read);
-
-			_io->seek_proc(_handle, -remaining, SEEK_CUR);
-
-			_ptr = _begin;
-			_io->read_proc(_ptr, sizeof(BYTE), (unsigned)_size, _handle);	//### EOF - no problem?
-		}
-
-		BYTE *result = _ptr;
-
-		_ptr += count;
-
-		return result;
-	}
-
-private:
-	IOCache& operator=(const IOCache& src); // deleted
-	IOCache(const IOCache& other); // deleted
-
-private:
-	BYTE *_ptr;
-	BYTE *_begin;
-	BYTE *_end;
-	const size_t _size;
-	const FreeImageIO *_io;	
-	const fi_handle _handle;	
-};
-
 #ifdef FREEIMAGE_BIGENDIAN
 static void
 SwapHeader(TGAHEADER *header) {
@@ -505,21 +428,21 @@ We use a specific overload based on bits-per-pixel for each type of pixel
 
 template <int nBITS>
 inline static void 
-_assignPixel(BYTE* bits, BYTE* val, BOOL as24bit = FALSE) {
+_assignPixel(BYTE* bits, const BYTE* val, BOOL as24bit = FALSE) {
 	// static assert should go here
 	assert(FALSE);
 }
 
 template <>
 inline void 
-_assignPixel<8>(BYTE* bits, BYTE* val, BOOL as24bit) {
+_assignPixel<8>(BYTE* bits, const BYTE* val, BOOL as24bit) {
 	*bits = *val;
 }
 
 template <>
 inline void 
-_assignPixel<16>(BYTE* bits, BYTE* val, BOOL as24bit) {
-	WORD value(*reinterpret_cast<WORD*>(val));
+_assignPixel<16>(BYTE* bits, const BYTE* val, BOOL as24bit) {
+	WORD value(*reinterpret_cast<const WORD*>(val));
 
 #ifdef FREEIMAGE_BIGENDIAN
 	SwapShort(&value);
@@ -537,7 +460,7 @@ _assignPixel<16>(BYTE* bits, BYTE* val, BOOL as24bit) {
 
 template <>
 inline void 
-_assignPixel<24>(BYTE* bits, BYTE* val, BOOL as24bit) {
+_assignPixel<24>(BYTE* bits, const BYTE* val, BOOL as24bit) {
 	bits[FI_RGBA_BLUE]	= val[0];
 	bits[FI_RGBA_GREEN] = val[1];
 	bits[FI_RGBA_RED]	= val[2];
@@ -545,13 +468,13 @@ _assignPixel<24>(BYTE* bits, BYTE* val, BOOL as24bit) {
 
 template <>
 inline void 
-_assignPixel<32>(BYTE* bits, BYTE* val, BOOL as24bit) {
+_assignPixel<32>(BYTE* bits, const BYTE* val, BOOL as24bit) {
 	if (as24bit) {
 		_assignPixel<24>(bits, val, TRUE);
 
 	} else {
 #if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
-		*(reinterpret_cast<unsigned*>(bits)) = *(reinterpret_cast<unsigned*> (val));
+		*(reinterpret_cast<unsigned*>(bits)) = *(reinterpret_cast<const unsigned*> (val));
 #else // NOTE This is faster then doing reinterpret_cast to int + INPLACESWAP !
 		bits[FI_RGBA_BLUE]	= val[0];
 		bits[FI_RGBA_GREEN] = val[1];
@@ -566,7 +489,7 @@ Generic RLE loader
 */
 template<int bPP>
 static void 
-loadRLE(FIBITMAP* dib, int width, int height, FreeImageIO* io, fi_handle handle, long eof, BOOL as24bit) {
+loadRLE(FIBITMAP* dib, int width, int height, FreeImageIO* io, fi_handle handle, BOOL as24bit) {
 	const int file_pixel_size = bPP/8;
 	const int pixel_size = as24bit ? 3 : file_pixel_size;
 
@@ -582,16 +505,12 @@ loadRLE(FIBITMAP* dib, int width, int height, FreeImageIO* io, fi_handle handle,
 	// this is used to guard against writing beyond the end of the image (on corrupted rle block)
 	const BYTE* dib_end = FreeImage_GetScanLine(dib, height);//< one-past-end row
 
-	// Compute the rough size of a line...
-	long pixels_offset = io->tell_proc(handle);
-	long sz = ((eof - pixels_offset) / height);
-
-	// ...and allocate cache of this size (yields good results)
-	IOCache cache(io, handle, sz);
-	if(cache.isNull()) {
-		FreeImage_Unload(dib);
-		dib = NULL;
-		return;
+	// In general RLE compressed images *should* be compressed line by line with line sizes stored in Scan Line Table section.
+	// In reality, however there are images not obeying the specification, compressing image data continuously across lines,
+	// making it impossible to load the file cached at every line: read the whole pixel data through a buffered reader.
+	BufferedReader reader(io, handle);
+	if(reader.isNull()) {
+		throw FI_MSG_ERROR_MEMORY;
 	}
 		
 	int x = 0, y = 0;
@@ -600,7 +519,11 @@ loadRLE(FIBITMAP* dib, int width, int height, FreeImageIO* io, fi_handle handle,
 
 	while (y < height) {
 
-		rle = cache.getByte();
+		if(!reader.getByte(&rle)) {
+			FreeImage_OutputMessageProc(s_format_id, FI_MSG_ERROR_CORRUPTED);
+			// return what is left from the bitmap
+			return;
+		}
 
 		BOOL has_rle = rle & 0x80;
 		rle &= ~0x80; // remove type-bit
@@ -615,40 +538,32 @@ loadRLE(FIBITMAP* dib, int width, int height, FreeImageIO* io, fi_handle handle,
 			return;
 		}
 
-		if (has_rle) {
-
-			// read a pixel value from file...
-			BYTE *val = cache.getBytes(file_pixel_size);
+		// read a pixel value (rle packet) or packet_count pixel values (raw packet) from file
+		const int packet_size = has_rle ? file_pixel_size : packet_count * file_pixel_size;
+		const BYTE *val = reader.peek(packet_size);
+		if(!val) {
+			FreeImage_OutputMessageProc(s_format_id, FI_MSG_ERROR_CORRUPTED);
+			// return what is left from the bitmap
+			return;
+		}
 
-			//...and fill packet_count pixels with it
+		// fill packet_count pixels with the value (rle packet) or copy them (raw packet)
 
-			for (int ix = 0; ix < packet_count; ix++) {
-				_assignPixel<bPP>((line_bits+x), val, as24bit);
-				x += pixel_size;
+		for (int ix = 0; ix < packet_count; ix++) {
+			_assignPixel<bPP>((line_bits+x), val, as24bit);
+			x += pixel_size;
+			if (!has_rle) {
+				val += file_pixel_size;
+			}
 
-				if (x >= line_size) {
-					x = 0;
-					y++;
-					line_bits = FreeImage_GetScanLine(dib, y);
-				}
+			if (x >= line_size) {
+				x = 0;
+				y++;
+				line_bits = FreeImage_GetScanLine(dib, y);
 			}
+		}
 
-		} else {
-			// no rle commpresion
-
-			// copy packet_count pixels from file to dib
-			for (int ix = 0; ix < packet_count; ix++) {
-				BYTE *val = cache.getBytes(file_pixel_size);
-				_assignPixel<bPP>((line_bits+x), val, as24bit);
-				x += pixel_size;
-
-				if (x >= line_size) {
-					x = 0;
-					y++;
-					line_bits = FreeImage_GetScanLine(dib, y);
-				}
-			} //< packet_count
-		} //< has_rle
+		reader.skip(packet_size);
 
 	} //< while height
 
@@ -671,7 +586,7 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 		// remember the start offset
 		long start_offset = io->tell_proc(handle);
 
-		// remember end-of-file (used for RLE cache)
+		// remember end-of-file (used to locate the footer)
 		io->seek_proc(handle, 0, SEEK_END);
 		long eof = io->tell_proc(handle);
 		io->seek_proc(handle, start_offset, SEEK_SET);
@@ -854,7 +769,7 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 
 					case TGA_RLECMAP:
 					case TGA_RLEMONO: { //(8 bit)
-						loadRLE<8>(dib, header.is_width, header.is_height, io, handle, eof, FALSE);
+						loadRLE<8>(dib, header.is_width, header.is_height, io, handle, FALSE);
 					}
 					break;
 
@@ -953,7 +868,7 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 					break;
 
 					case TGA_RLERGB: { //(16 bit)
-						loadRLE<16>(dib, header.is_width, header.is_height, io, handle, eof, TARGA_LOAD_RGB888 & flags);
+						loadRLE<16>(dib, header.is_width, header.is_height, io, handle, TARGA_LOAD_RGB888 & flags);
 					}
 					break;
 
@@ -992,7 +907,7 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 					break;
 
 					case TGA_RLERGB: { //(24 bit)
-						loadRLE<24>(dib, header.is_width, header.is_height, io, handle, eof, TRUE);
+						loadRLE<24>(dib, header.is_width, header.is_height, io, handle, TRUE);
 					}
 					break;
 
@@ -1043,7 +958,7 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 					break;
 
 					case TGA_RLERGB: { //(32 bit)
-						loadRLE<32>(dib, header.is_width, header.is_height, io, handle, eof, TARGA_LOAD_RGB888 & flags);
+						loadRLE<32>(dib, header.is_width, header.is_height, io, handle, TARGA_LOAD_RGB888 & flags);
 					}
 					break;
 
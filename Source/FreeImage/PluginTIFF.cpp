@@ -43,6 +43,7 @@
 
 #include "FreeImageIO.h"
 #include "PSDParser.h"
+#include "Parallel.h"
 
 // --------------------------------------------------------------------------
 // GeoTIFF profile (see XTIFF.cpp)
@@ -176,6 +177,62 @@ static void
 _tiffUnmapProc(thandle_t, void* base, toff_t size) {
 }
 
+// ----------------------------------------------------------
+//   libtiff interface of the decoding threads
+// ----------------------------------------------------------
+
+/**
+I/O wrapper of a TIFF handle opened by a decoding thread on the stream of the loaded file.
+Each handle keeps its own stream position, reads are serialized on the shared stream.
+*/
+typedef struct {
+	FreeImageIO *io;
+	fi_handle handle;
+	ParallelMutex *mutex;
+	toff_t position;
+	toff_t size;
+} fi_TIFFSharedIO;
+
+static tmsize_t
+_tiffSharedReadProc(thandle_t handle, void *buf, tmsize_t size) {
+	fi_TIFFSharedIO *sio = (fi_TIFFSharedIO*)handle;
+	ParallelLock lock(*sio->mutex);
+	if(sio->io->seek_proc(sio->handle, (long)sio->position, SEEK_SET) != 0) {
+		return 0;
+	}
+	const unsigned count = sio->io->read_proc(buf, 1, (unsigned)size, sio->handle);
+	sio->position += count;
+	return (tmsize_t)count;
+}
+
+static tmsize_t
+_tiffSharedWriteProc(thandle_t handle, void *buf, tmsize_t size) {
+	return 0;
+}
+
+static toff_t
+_tiffSharedSeekProc(thandle_t handle, toff_t off, int whence) {
+	fi_TIFFSharedIO *sio = (fi_TIFFSharedIO*)handle;
+	switch(whence) {
+		case SEEK_SET:
+			sio->position = off;
+			break;
+		case SEEK_CUR:
+			sio->position += off;
+			break;
+		case SEEK_END:
+			sio->position = sio->size + off;
+			break;
+	}
+	return sio->position;
+}
+
+static toff_t
+_tiffSharedSizeProc(thandle_t handle) {
+	fi_TIFFSharedIO *sio = (fi_TIFFSharedIO*)handle;
+	return sio->size;
+}
+
 /**
 Open a TIFF file descriptor for reading or writing
 @param handle File handle
@@ -1208,6 +1265,381 @@ FindLoadMethod(TIFF *tif, FREE_IMAGE_TYPE image_type, int flags) {
 	return loadMethod;
 }
 
+// ==========================================================
+// TIFF strip and tile decoders
+// ==========================================================
+
+/**
+Get the number of threads used to decode or encode the strips or tiles of the current directory
+@param compression TIFFTAG_COMPRESSION tiff tag
+@param flags Load or save flags
+@return Returns 1 unless TIFF_MULTITHREAD is set and the blocks are compressed
+*/
+static unsigned
+GetBlockThreadCount(uint16 compression, int flags) {
+	if(((flags & TIFF_MULTITHREAD) != TIFF_MULTITHREAD) || (compression == COMPRESSION_NONE)) {
+		return 1;
+	}
+	return GetProcessorCount();
+}
+
+/**
+Decode the strips or tiles of the current directory, on one or more threads.
+When several threads are used, each thread opens its own TIFF handle on the stream 
+of the loader, so that the blocks are decompressed concurrently while the stream 
+reads are serialized. A single thread uses the TIFF handle of the loader.
+Derived classes implement run() and write the decoded blocks into the dib.
+*/
+class TIFFBlockDecoder : public ParallelTask {
+public:
+	/**
+	@param fio TIFF I/O wrapper of the loader
+	@param buffer_size Size of the strip or tile buffer of each thread
+	*/
+	TIFFBlockDecoder(fi_TIFFIO *fio, tmsize_t buffer_size) :
+		_fio(fio), _buffer_size(buffer_size), _threads(0), _handles(NULL), _buffers(NULL), _sio(NULL), _error(FALSE) {
+	}
+
+	virtual ~TIFFBlockDecoder() {
+		for(unsigned t = 0; t < _threads; t++) {
+			if(_handles[t] != _fio->tif) {
+				TIFFClose(_handles[t]);
+			}
+			free(_buffers[t]);
+		}
+		free(_handles);
+		free(_buffers);
+		free(_sio);
+	}
+
+	/**
+	Decode all blocks
+	@param count Number of strips or tiles
+	@param threads Maximum number of threads
+	@return Returns FALSE if the buffers could not be allocated
+	*/
+	BOOL decode(unsigned count, unsigned threads) {
+		if(!open(MAX(1U, MIN(threads, count)))) {
+			return FALSE;
+		}
+		ParallelRun(*this, count, _threads);
+		return TRUE;
+	}
+
+	/**
+	Returns TRUE if a block could not be read.
+	The flag is only ever raised, so the workers poll it without taking the lock
+	*/
+	BOOL hasError() const {
+		return _error;
+	}
+
+protected:
+	TIFF* getHandle(unsigned thread) const {
+		return _handles[thread];
+	}
+
+	BYTE* getBuffer(unsigned thread) const {
+		return _buffers[thread];
+	}
+
+	void setError() {
+		ParallelLock lock(_mutex);
+		_error = TRUE;
+	}
+
+private:
+	/**
+	Allocate the buffers and open the handles of up to 'threads' threads
+	*/
+	BOOL open(unsigned threads) {
+		_handles = (TIFF**)calloc(threads, sizeof(TIFF*));
+		_buffers = (BYTE**)calloc(threads, sizeof(BYTE*));
+		_sio = (fi_TIFFSharedIO*)calloc(threads, sizeof(fi_TIFFSharedIO));
+		if(!_handles || !_buffers || !_sio) {
+			return FALSE;
+		}
+
+		TIFF *tif = _fio->tif;
+		const toff_t dir_offset = TIFFCurrentDirOffset(tif);
+		const toff_t size = _tiffSizeProc((thandle_t)_fio);
+
+		// a single thread decodes with the loader handle, 
+		// otherwise all threads read the stream through a shared I/O handle
+		const BOOL shared = (threads > 1);
+
+		for(unsigned t = 0; t < threads; t++) {
+			BYTE *buffer = (BYTE*)malloc(_buffer_size * sizeof(BYTE));
+			if(!buffer) {
+				break;
+			}
+			memset(buffer, 0, _buffer_size * sizeof(BYTE));
+
+			TIFF *handle = tif;
+			if(shared) {
+				fi_TIFFSharedIO *sio = &_sio[t];
+				sio->io = _fio->io;
+				sio->handle = _fio->handle;
+				sio->mutex = &_mutex;
+				sio->position = 0;
+				sio->size = size;
+
+				handle = TIFFClientOpen("", "r", (thandle_t)sio,
+					_tiffSharedReadProc, _tiffSharedWriteProc, _tiffSharedSeekProc, _tiffCloseProc,
+					_tiffSharedSizeProc, _tiffMapProc, _tiffUnmapProc);
+				if(handle && !TIFFSetSubDirectory(handle, dir_offset)) {
+					TIFFClose(handle);
+					handle = NULL;
+				}
+				if(!handle) {
+					free(buffer);
+					break;
+				}
+			}
+			_handles[t] = handle;
+			_buffers[t] = buffer;
+			_threads++;
+		}
+
+		return (_threads > 0);
+	}
+
+	TIFFBlockDecoder& operator=(const TIFFBlockDecoder&); // deleted
+	TIFFBlockDecoder(const TIFFBlockDecoder&); // deleted
+
+private:
+	fi_TIFFIO *_fio;
+	tmsize_t _buffer_size;
+	//! number of threads with a handle and a buffer
+	unsigned _threads;
+	TIFF **_handles;
+	BYTE **_buffers;
+	fi_TIFFSharedIO *_sio;
+	//! protects the stream reads and the raising of the error flag
+	ParallelMutex _mutex;
+	volatile BOOL _error;
+};
+
+/**
+Decoder of the strips of a PLANARCONFIG_CONTIG image (LoadAsGenericStrip)
+*/
+class TIFFContigStripDecoder : public TIFFBlockDecoder {
+public:
+	/**
+	@param fio TIFF I/O wrapper of the loader
+	@param dib Destination image
+	@param height Image height
+	@param rowsperstrip Number of rows per strip
+	@param srcBpp Source bytes per pixel
+	*/
+	TIFFContigStripDecoder(fi_TIFFIO *fio, FIBITMAP *dib, uint32 height, uint32 rowsperstrip, unsigned srcBpp) :
+		TIFFBlockDecoder(fio, TIFFStripSize(fio->tif)),
+		_height(height), _rowsperstrip(rowsperstrip),
+		_src_line(TIFFScanlineSize(fio->tif)), _dst_line(FreeImage_GetLine(dib)), _dst_pitch(FreeImage_GetPitch(dib)),
+		_Bpp(FreeImage_GetBPP(dib) / 8), _srcBpp(srcBpp),
+		_top(FreeImage_GetScanLine(dib, height - 1)) {
+	}
+
+	void run(unsigned item, unsigned thread) {
+		const uint32 y = item * _rowsperstrip;
+		const int32 strips = (y + _rowsperstrip > _height ? _height - y : _rowsperstrip);
+		TIFF *tif = getHandle(thread);
+		BYTE *buf = getBuffer(thread);
+
+		if (TIFFReadEncodedStrip(tif, TIFFComputeStrip(tif, y, 0), buf, strips * _src_line) == -1) {
+			// ignore errors as they can be frequent and not really valid errors, especially with fax images
+			setError();
+		}
+
+		// In the tiff file the lines are saved from up to down
+		// In a DIB the lines must be saved from down to up
+
+		BYTE *bits = _top - (size_t)y * _dst_pitch;
+
+		if(_src_line == _dst_line) {
+			// channel count match
+			for (int l = 0; l < strips; l++) {
+				memcpy(bits, buf + l * _src_line, _src_line);
+				bits -= _dst_pitch;
+			}
+		}
+		else {
+			for (int l = 0; l < strips; l++) {
+				for(BYTE *pixel = bits, *src_pixel =  buf + l * _src_line; pixel < bits + _dst_pitch; pixel += _Bpp, src_pixel += _srcBpp) {
+					AssignPixel(pixel, src_pixel, _Bpp);
+				}
+				bits -= _dst_pitch;
+			}
+		}
+	}
+
+private:
+	uint32 _height;
+	uint32 _rowsperstrip;
+	tmsize_t _src_line;
+	tmsize_t _dst_line;
+	unsigned _dst_pitch;
+	unsigned _Bpp;
+	unsigned _srcBpp;
+	BYTE *_top;
+};
+
+/**
+Decoder of the strips of a PLANARCONFIG_SEPARATE image (LoadAsGenericStrip).
+A work item is a block of rows, with one strip per sample.
+*/
+class TIFFSeparateStripDecoder : public TIFFBlockDecoder {
+public:
+	/**
+	@param fio TIFF I/O wrapper of the loader
+	@param dib Destination image
+	@param height Image height
+	@param rowsperstrip Number of rows per strip
+	@param bitspersample Bits per sample
+	@param samplesperpixel Number of samples (planes) in the file
+	@param chCount Number of samples stored in the dib
+	*/
+	TIFFSeparateStripDecoder(fi_TIFFIO *fio, FIBITMAP *dib, uint32 height, uint32 rowsperstrip, uint16 bitspersample, uint16 samplesperpixel, uint16 chCount) :
+		TIFFBlockDecoder(fio, TIFFStripSize(fio->tif)),
+		_height(height), _rowsperstrip(rowsperstrip), _samplesperpixel(samplesperpixel), _chCount(chCount),
+		_src_line(TIFFScanlineSize(fio->tif)), _dst_pitch(FreeImage_GetPitch(dib)),
+		_Bpp(FreeImage_GetBPP(dib) / 8), _Bpc(bitspersample / 8),
+		_top(FreeImage_GetScanLine(dib, height - 1)) {
+	}
+
+	void run(unsigned item, unsigned thread) {
+		const uint32 y = item * _rowsperstrip;
+		const int32 strips = (y + _rowsperstrip > _height ? _height - y : _rowsperstrip);
+		TIFF *tif = getHandle(thread);
+		BYTE *buf = getBuffer(thread);
+
+		BYTE* dib_strip = _top - (size_t)y * _dst_pitch;
+
+		// - loop for channels (planes) -
+
+		for(uint16 sample = 0; sample < MIN(_samplesperpixel, _chCount); sample++) {
+
+			if (TIFFReadEncodedStrip(tif, TIFFComputeStrip(tif, y, sample), buf, strips * _src_line) == -1) {
+				// ignore errors as they can be frequent and not really valid errors, especially with fax images
+				setError();
+			}
+
+			const unsigned channelOffset = sample * _Bpc;
+
+			// - loop for strips in block -
+
+			BYTE* src_line_begin = buf;
+			BYTE* dst_line_begin = dib_strip;
+			for (int l = 0; l < strips; l++, src_line_begin += _src_line, dst_line_begin -= _dst_pitch ) {
+
+				// - loop for pixels in strip -
+
+				const BYTE* const src_line_end = src_line_begin + _src_line;
+
+				for (BYTE* src_bits = src_line_begin, * dst_bits = dst_line_begin; src_bits < src_line_end; src_bits += _Bpc, dst_bits += _Bpp) {
+					// actually assigns channel
+					AssignPixel(dst_bits + channelOffset, src_bits, _Bpc);
+				} // line
+
+			} // strips
+
+		} // channels
+	}
+
+private:
+	uint32 _height;
+	uint32 _rowsperstrip;
+	uint16 _samplesperpixel;
+	uint16 _chCount;
+	tmsize_t _src_line;
+	unsigned _dst_pitch;
+	unsigned _Bpp;
+	unsigned _Bpc;
+	BYTE *_top;
+};
+
+/**
+Decoder of the tiles of a PLANARCONFIG_CONTIG image (LoadAsTiled).
+Tiles are numbered from left to right and top to bottom.
+*/
+class TIFFTileDecoder : public TIFFBlockDecoder {
+public:
+	/**
+	@param fio TIFF I/O wrapper of the loader
+	@param dib Destination image
+	@param width Image width
+	@param height Image height
+	@param tileWidth Tile width
+	@param tileHeight Tile height
+	*/
+	TIFFTileDecoder(fi_TIFFIO *fio, FIBITMAP *dib, uint32 width, uint32 height, uint32 tileWidth, uint32 tileHeight) :
+		TIFFBlockDecoder(fio, TIFFTileSize(fio->tif)),
+		_width(width), _height(height), _tileWidth(tileWidth), _tileHeight(tileHeight),
+		_tilesAcross((width + tileWidth - 1) / tileWidth),
+		_tileSize(TIFFTileSize(fio->tif)), _tileRowSize((uint32)TIFFTileRowSize(fio->tif)), _imageRowSize((uint32)TIFFScanlineSize(fio->tif)),
+		_dst_pitch(FreeImage_GetPitch(dib)),
+		_top(FreeImage_GetScanLine(dib, height - 1)) {
+	}
+
+	/**
+	Number of tiles in the image
+	*/
+	unsigned getTileCount() const {
+		return _tilesAcross * ((_height + _tileHeight - 1) / _tileHeight);
+	}
+
+	void run(unsigned item, unsigned thread) {
+		if(hasError()) {
+			// the image is rejected, skip the remaining tiles
+			return;
+		}
+
+		const uint32 x = (item % _tilesAcross) * _tileWidth;
+		const uint32 y = (item / _tilesAcross) * _tileHeight;
+		const uint32 rowSize = (item % _tilesAcross) * _tileRowSize;
+		const int32 nrows = (y + _tileHeight > _height ? _height - y : _tileHeight);
+		BYTE *tileBuffer = getBuffer(thread);
+
+		memset(tileBuffer, 0, _tileSize);
+
+		// read one tile
+		if (TIFFReadTile(getHandle(thread), tileBuffer, x, y, 0, 0) < 0) {
+			setError();
+			return;
+		}
+		// convert to strip
+		uint32 src_line = 0;
+		if(x + _tileWidth > _width) {
+			src_line = _imageRowSize - rowSize;
+		} else {
+			src_line = _tileRowSize;
+		}
+
+		// In the tiff file the lines are saved from up to down
+		// In a DIB the lines must be saved from down to up
+
+		BYTE *src_bits = tileBuffer;
+		BYTE *dst_bits = _top - (size_t)y * _dst_pitch + rowSize;
+		for(int k = 0; k < nrows; k++) {
+			memcpy(dst_bits, src_bits, src_line);
+			src_bits += _tileRowSize;
+			dst_bits -= _dst_pitch;
+		}
+	}
+
+private:
+	uint32 _width;
+	uint32 _height;
+	uint32 _tileWidth;
+	uint32 _tileHeight;
+	uint32 _tilesAcross;
+	tmsize_t _tileSize;
+	uint32 _tileRowSize;
+	uint32 _imageRowSize;
+	int _dst_pitch;
+	BYTE *_top;
+};
+
 // ==========================================================
 // TIFF thumbnail routines
 // ==========================================================
@@ -1861,110 +2293,35 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 			ReadPalette(tif, photometric, bitspersample, dib);
 	
 			if(!header_only) {
-				// calculate the line + pitch (separate for scr & dest)
-
-				const tmsize_t src_line = TIFFScanlineSize(tif);
-				const tmsize_t dst_line = FreeImage_GetLine(dib);
-				const unsigned dst_pitch = FreeImage_GetPitch(dib);
-				const unsigned Bpp = FreeImage_GetBPP(dib) / 8;
 				const unsigned srcBpp = bitspersample * samplesperpixel / 8;
 
-				// In the tiff file the lines are save from up to down 
-				// In a DIB the lines must be saved from down to up
-
-				BYTE *bits = FreeImage_GetScanLine(dib, height - 1);
+				// a missing or invalid RowsPerStrip means a single strip
+				if((rowsperstrip == 0) || (rowsperstrip > height)) {
+					rowsperstrip = height;
+				}
+				const unsigned strip_count = (height + rowsperstrip - 1) / rowsperstrip;
 
-				// read the tiff lines and save them in the DIB
+				// read the tiff strips and save them in the DIB, 
+				// using several threads if TIFF_MULTITHREAD is set
 
-				BYTE *buf = (BYTE*)malloc(TIFFStripSize(tif) * sizeof(BYTE));
-				if(buf == NULL) {
-					throw FI_MSG_ERROR_MEMORY;
-				}
-				memset(buf, 0, TIFFStripSize(tif) * sizeof(BYTE));
+				const unsigned threads = GetBlockThreadCount(compression, flags);
 				
 				BOOL bThrowMessage = FALSE;
 				
 				if(planar_config == PLANARCONFIG_CONTIG) {
-
-					for (uint32 y = 0; y < height; y += rowsperstrip) {
-						int32 strips = (y + rowsperstrip > height ? height - y : rowsperstrip);
-
-						if (TIFFReadEncodedStrip(tif, TIFFComputeStrip(tif, y, 0), buf, strips * src_line) == -1) {
-							// ignore errors as they can be frequent and not really valid errors, especially with fax images
-							bThrowMessage = TRUE;							
-							/*
-							free(buf);
-							throw FI_MSG_ERROR_PARSING;
-							*/
-						} 
-						if(src_line == dst_line) {
-							// channel count match
-							for (int l = 0; l < strips; l++) {							
-								memcpy(bits, buf + l * src_line, src_line);
-								bits -= dst_pitch;
-							}
-						}
-						else {
-							for (int l = 0; l < strips; l++) {
-								for(BYTE *pixel = bits, *src_pixel =  buf + l * src_line; pixel < bits + dst_pitch; pixel += Bpp, src_pixel += srcBpp) {
-									AssignPixel(pixel, src_pixel, Bpp);
-								}
-								bits -= dst_pitch;
-							}
-						}
+					TIFFContigStripDecoder decoder(fio, dib, height, rowsperstrip, srcBpp);
+					if(!decoder.decode(strip_count, threads)) {
+						throw FI_MSG_ERROR_MEMORY;
 					}
+					bThrowMessage = decoder.hasError();
 				}
 				else if(planar_config == PLANARCONFIG_SEPARATE) {
-					
-					const unsigned Bpc = bitspersample / 8;
-					BYTE* dib_strip = bits;
-					// - loop for strip blocks -
-					
-					for (uint32 y = 0; y < height; y += rowsperstrip) {
-						const int32 strips = (y + rowsperstrip > height ? height - y : rowsperstrip);
-						
-						// - loop for channels (planes) -
-						
-						for(uint16 sample = 0; sample < samplesperpixel; sample++) {
-							
-							if (TIFFReadEncodedStrip(tif, TIFFComputeStrip(tif, y, sample), buf, strips * src_line) == -1) {
-								// ignore errors as they can be frequent and not really valid errors, especially with fax images
-								bThrowMessage = TRUE;	
-							} 
-									
-							if(sample >= chCount) {
-								// TODO Write to Extra Channel
-								break; 
-							}
-							
-							const unsigned channelOffset = sample * Bpc;			
-							
-							// - loop for strips in block -
-							
-							BYTE* src_line_begin = buf;
-							BYTE* dst_line_begin = dib_strip;
-							for (int l = 0; l < strips; l++, src_line_begin += src_line, dst_line_begin -= dst_pitch ) {
-									
-								// - loop for pixels in strip -
-								
-								const BYTE* const src_line_end = src_line_begin + src_line;
-
-								for (BYTE* src_bits = src_line_begin, * dst_bits = dst_line_begin; src_bits < src_line_end; src_bits += Bpc, dst_bits += Bpp) {
-									// actually assigns channel
-									AssignPixel(dst_bits + channelOffset, src_bits, Bpc); 
-								} // line
-
-							} // strips
-
-						} // channels
-							
-						// done with a strip block, incr to the next
-						dib_strip -= strips * dst_pitch;
-							
-					} // height
-
+					TIFFSeparateStripDecoder decoder(fio, dib, height, rowsperstrip, bitspersample, samplesperpixel, chCount);
+					if(!decoder.decode(strip_count, threads)) {
+						throw FI_MSG_ERROR_MEMORY;
+					}
+					bThrowMessage = decoder.hasError();
 				}
-				free(buf);
 				
 				if(bThrowMessage) {
 					FreeImage_OutputMessageProc(s_format_id, "Warning: parsing error. Image may be incomplete or contain invalid data !");
@@ -1982,7 +2339,6 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 			// ---------------------------------------------------------------------------------
 
 			uint32 tileWidth, tileHeight;
-			uint32 src_line = 0;
 
 			// create a new DIB
 			dib = CreateImageType( header_only, image_type, width, height, bitspersample, samplesperpixel);
@@ -1999,67 +2355,27 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
 			ReadPalette(tif, photometric, bitspersample, dib);
 
 			// get the tile geometry
-			if(!TIFFGetField(tif, TIFFTAG_TILEWIDTH, &tileWidth) || !TIFFGetField(tif, TIFFTAG_TILELENGTH, &tileHeight)) {
+			if(!TIFFGetField(tif, TIFFTAG_TILEWIDTH, &tileWidth) || !TIFFGetField(tif, TIFFTAG_TILELENGTH, &tileHeight) || !tileWidth || !tileHeight) {
 				throw "Invalid tiled TIFF image";
 			}
 
 			// read the tiff lines and save them in the DIB
 
 			if(planar_config == PLANARCONFIG_CONTIG && !header_only) {
-				
-				// get the maximum number of bytes required to contain a tile
-				tmsize_t tileSize = TIFFTileSize(tif);
 
-				// allocate tile buffer
-				BYTE *tileBuffer = (BYTE*)malloc(tileSize * sizeof(BYTE));
-				if(tileBuffer == NULL) {
+				// decode the tiles, using several threads if TIFF_MULTITHREAD is set
+
+				TIFFTileDecoder decoder(fio, dib, width, height, tileWidth, tileHeight);
+				if(!decoder.decode(decoder.getTileCount(), GetBlockThreadCount(compression, flags))) {
 					throw FI_MSG_ERROR_MEMORY;
 				}
-
-				// calculate src line and dst pitch
-				int dst_pitch = FreeImage_GetPitch(dib);
-				uint32 tileRowSize = (uint32)TIFFTileRowSize(tif);
-				uint32 imageRowSize = (uint32)TIFFScanlineSize(tif);
-
-
-				// In the tiff file the lines are saved from up to down 
-				// In a DIB the lines must be saved from down to up
-
-				BYTE *bits = FreeImage_GetScanLine(dib, height - 1);
-				
-				for (uint32 y = 0; y < height; y += tileHeight) {						
-					int32 nrows = (y + tileHeight > height ? height - y : tileHeight);					
-
-					for (uint32 x = 0, rowSize = 0; x < width; x += tileWidth, rowSize += tileRowSize) {
-						memset(tileBuffer, 0, tileSize);
-
-						// read one tile
-						if (TIFFReadTile(tif, tileBuffer, x, y, 0, 0) < 0) {
-							free(tileBuffer);
-							throw "Corrupted tiled TIFF file";
-						}
-						// convert to strip
-						if(x + tileWidth > width) {
-							src_line = imageRowSize - rowSize;
-						} else {
-							src_line = tileRowSize;
-						}
-						BYTE *src_bits = tileBuffer;
-						BYTE *dst_bits = bits + rowSize;
-						for(int k = 0; k < nrows; k++) {
-							memcpy(dst_bits, src_bits, src_line);
-							src_bits += tileRowSize;
-							dst_bits -= dst_pitch;
-						}
-					}
-
-					bits -= nrows * dst_pitch;
+				if(decoder.hasError()) {
+					throw "Corrupted tiled TIFF file";
 				}
 
 #if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
 				SwapRedBlue32(dib);
 #endif
-				free(tileBuffer);
 			}
 			else if(planar_config == PLANARCONFIG_SEPARATE) {
 				throw "Separated tiled TIFF images are not supported"; 
@@ -2233,6 +2549,470 @@ Load(FreeImageIO *io, fi_handle handle, int page, int flags, void *data) {
   
 }
 
+// ==========================================================
+// TIFF strip and tile encoders
+// ==========================================================
+
+/**
+Get the strip height or the tile size requested with the TIFF_BLOCKSIZE save flag
+@param flags Save flags
+@return Returns a size in pixels, or 0 if the default size is used
+*/
+static uint32
+GetBlockSize(int flags) {
+	return ((uint32)(flags >> 20) & 0xFF) << 4;
+}
+
+/**
+Convert a run of pixels of a dib line to TIFF samples
+@param dib Source image
+@param row TIFF row (row 0 is the top line of the dib)
+@param left First pixel of the run
+@param count Number of pixels of the run
+@param photometric TIFFTAG_PHOTOMETRIC tag of the saved image
+@param samplesperpixel TIFFTAG_SAMPLESPERPIXEL tag of the saved image
+@param buffer Output buffer, large enough for 'count' TIFF pixels
+*/
+static void
+ConvertLineToTIFF(FIBITMAP *dib, uint32 row, uint32 left, uint32 count, uint16 photometric, uint16 samplesperpixel, BYTE *buffer) {
+	const unsigned bpp = FreeImage_GetBPP(dib);
+	BYTE *bits = FreeImage_GetScanLine(dib, FreeImage_GetHeight(dib) - row - 1) + ((size_t)left * bpp) / 8;
+
+	if((FreeImage_GetImageType(dib) == FIT_BITMAP) && (bpp == 8) && (samplesperpixel == 2)) {
+		// 8-bit transparent picture : convert to 8-bit + 8-bit alpha
+
+		BYTE *trns = FreeImage_GetTransparencyTable(dib);
+		BYTE *b = buffer;
+
+		for(uint32 x = 0; x < count; x++) {
+			// copy the 8-bit layer
+			b[0] = bits[x];
+			// convert the trns table to a 8-bit alpha layer
+			b[1] = trns[ b[0] ];
+
+			b += samplesperpixel;
+		}
+	}
+	else if(photometric == PHOTOMETRIC_LOGLUV) {
+		// RGBF image => store as XYZ using a LogLuv encoding
+		tiff_ConvertLineRGBToXYZ(buffer, bits, count);
+	}
+	else {
+		// just dump the dib (tiff supports all dib types)
+		memcpy(buffer, bits, ((size_t)count * bpp + 7) / 8);
+
+#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
+		if((FreeImage_GetImageType(dib) == FIT_BITMAP) && ((bpp == 24) || (bpp == 32)) && (photometric != PHOTOMETRIC_SEPARATED)) {
+			// TIFFs store color data RGB(A) instead of BGR(A)
+
+			BYTE *pBuf = buffer;
+
+			for (uint32 x = 0; x < count; x++) {
+				INPLACESWAP(pBuf[0], pBuf[2]);
+				pBuf += samplesperpixel;
+			}
+		}
+#endif
+	}
+}
+
+/**
+Copy the layout and the compression tags of the saved image to a TIFF handle opened for writing
+@param src TIFF handle of the saver
+@param dst Destination handle
+@param length Image length of the destination handle
+*/
+static void
+CopyEncoderTags(TIFF *src, TIFF *dst, uint32 length) {
+	uint32 width = 0;
+	uint16 bitspersample = 1;
+	uint16 samplesperpixel = 1;
+	uint16 photometric = PHOTOMETRIC_MINISBLACK;
+	uint16 fillorder = FILLORDER_MSB2LSB;
+	uint16 compression = COMPRESSION_NONE;
+	uint16 sampleformat = SAMPLEFORMAT_UINT;
+	uint16 extra_count = 0;
+	uint16 *extra_info = NULL;
+
+	TIFFGetField(src, TIFFTAG_IMAGEWIDTH, &width);
+	TIFFGetFieldDefaulted(src, TIFFTAG_BITSPERSAMPLE, &bitspersample);
+	TIFFGetFieldDefaulted(src, TIFFTAG_SAMPLESPERPIXEL, &samplesperpixel);
+	TIFFGetField(src, TIFFTAG_PHOTOMETRIC, &photometric);
+	TIFFGetFieldDefaulted(src, TIFFTAG_FILLORDER, &fillorder);
+	TIFFGetFieldDefaulted(src, TIFFTAG_COMPRESSION, &compression);
+
+	TIFFSetField(dst, TIFFTAG_IMAGEWIDTH, width);
+	TIFFSetField(dst, TIFFTAG_IMAGELENGTH, length);
+	TIFFSetField(dst, TIFFTAG_BITSPERSAMPLE, bitspersample);
+	TIFFSetField(dst, TIFFTAG_SAMPLESPERPIXEL, samplesperpixel);
+	TIFFSetField(dst, TIFFTAG_PHOTOMETRIC, photometric);
+	TIFFSetField(dst, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+	TIFFSetField(dst, TIFFTAG_FILLORDER, fillorder);
+	if(TIFFGetField(src, TIFFTAG_SAMPLEFORMAT, &sampleformat)) {
+		TIFFSetField(dst, TIFFTAG_SAMPLEFORMAT, sampleformat);
+	}
+	if(TIFFGetField(src, TIFFTAG_EXTRASAMPLES, &extra_count, &extra_info)) {
+		TIFFSetField(dst, TIFFTAG_EXTRASAMPLES, extra_count, extra_info);
+	}
+
+	if(TIFFIsTiled(src)) {
+		uint32 tileWidth = 0, tileHeight = 0;
+		TIFFGetField(src, TIFFTAG_TILEWIDTH, &tileWidth);
+		TIFFGetField(src, TIFFTAG_TILELENGTH, &tileHeight);
+		TIFFSetField(dst, TIFFTAG_TILEWIDTH, tileWidth);
+		TIFFSetField(dst, TIFFTAG_TILELENGTH, tileHeight);
+	} else {
+		uint32 rowsperstrip = (uint32)-1;
+		TIFFGetFieldDefaulted(src, TIFFTAG_ROWSPERSTRIP, &rowsperstrip);
+		TIFFSetField(dst, TIFFTAG_ROWSPERSTRIP, rowsperstrip);
+	}
+
+	// codec options (pseudo-tags are only known once the codec is set)
+
+	TIFFSetField(dst, TIFFTAG_COMPRESSION, compression);
+
+	switch(compression) {
+		case COMPRESSION_LZW:
+		case COMPRESSION_DEFLATE:
+		case COMPRESSION_ADOBE_DEFLATE:
+		{
+			uint16 predictor = 1;
+			TIFFGetFieldDefaulted(src, TIFFTAG_PREDICTOR, &predictor);
+			TIFFSetField(dst, TIFFTAG_PREDICTOR, predictor);
+			if(compression != COMPRESSION_LZW) {
+				int quality = 0;
+				if(TIFFGetField(src, TIFFTAG_ZIPQUALITY, &quality)) {
+					TIFFSetField(dst, TIFFTAG_ZIPQUALITY, quality);
+				}
+			}
+			break;
+		}
+		case COMPRESSION_JPEG:
+		{
+			int quality = 75;
+			if(TIFFGetField(src, TIFFTAG_JPEGQUALITY, &quality)) {
+				TIFFSetField(dst, TIFFTAG_JPEGQUALITY, quality);
+			}
+			// the blocks are copied without the JPEGTables tag of the handle,
+			// so that each block must hold its own quantization and Huffman tables
+			TIFFSetField(dst, TIFFTAG_JPEGTABLESMODE, 0);
+			break;
+		}
+		case COMPRESSION_SGILOG:
+		{
+			int datafmt = SGILOGDATAFMT_FLOAT;
+			TIFFGetField(src, TIFFTAG_SGILOGDATAFMT, &datafmt);
+			TIFFSetField(dst, TIFFTAG_SGILOGDATAFMT, datafmt);
+			break;
+		}
+		case COMPRESSION_CCITTFAX3:
+		{
+			uint32 group3options = 0;
+			if(TIFFGetField(src, TIFFTAG_GROUP3OPTIONS, &group3options)) {
+				TIFFSetField(dst, TIFFTAG_GROUP3OPTIONS, group3options);
+			}
+			break;
+		}
+	}
+}
+
+/**
+Encode the strips or tiles of the current directory, on one or more threads.
+A single thread compresses the blocks with the TIFF handle of the saver.
+Otherwise the image is processed in batches of block rows: each thread compresses
+its blocks with a TIFF handle of its own, opened on a memory stream with the layout
+and the compression tags of the saved image, then the compressed blocks are appended
+in order to the saved image with TIFFWriteRawStrip / TIFFWriteRawTile.
+*/
+class TIFFBlockEncoder : public ParallelTask {
+public:
+	/**
+	@param tif TIFF handle of the saver, with all the tags set
+	@param dib Source image
+	@param photometric TIFFTAG_PHOTOMETRIC tag of the saved image
+	@param samplesperpixel TIFFTAG_SAMPLESPERPIXEL tag of the saved image
+	*/
+	TIFFBlockEncoder(TIFF *tif, FIBITMAP *dib, uint16 photometric, uint16 samplesperpixel) :
+		_tif(tif), _dib(dib), _photometric(photometric), _samplesperpixel(samplesperpixel),
+		_width(FreeImage_GetWidth(dib)), _height(FreeImage_GetHeight(dib)), _tiled(TIFFIsTiled(tif)),
+		_threads(0), _first(0), _rows(0), _buffers(NULL), _handles(NULL), _fio(NULL), _owners(NULL), _error(FALSE) {
+
+		if(_tiled) {
+			TIFFGetField(tif, TIFFTAG_TILEWIDTH, &_blockWidth);
+			TIFFGetField(tif, TIFFTAG_TILELENGTH, &_blockHeight);
+			_blockSize = TIFFTileSize(tif);
+			_blockRowSize = TIFFTileRowSize(tif);
+		} else {
+			_blockWidth = _width;
+			TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &_blockHeight);
+			_blockHeight = MIN(_blockHeight, _height);
+			_blockSize = TIFFStripSize(tif);
+			_blockRowSize = TIFFScanlineSize(tif);
+		}
+		_blocksAcross = (_width + _blockWidth - 1) / _blockWidth;
+		_blocksDown = (_height + _blockHeight - 1) / _blockHeight;
+	}
+
+	virtual ~TIFFBlockEncoder() {
+		closeStreams();
+		for(unsigned t = 0; t < _threads; t++) {
+			free(_buffers[t]);
+		}
+		free(_buffers);
+		free(_handles);
+		free(_fio);
+		free(_owners);
+	}
+
+	/**
+	Encode and write all blocks
+	@param threads Maximum number of threads
+	@return Returns FALSE if the buffers or the memory streams could not be allocated
+	*/
+	BOOL encode(unsigned threads) {
+		const unsigned count = _blocksAcross * _blocksDown;
+
+		if(!open(MAX(1U, MIN(threads, count)))) {
+			return FALSE;
+		}
+
+		if(_threads == 1) {
+			// compress the blocks with the saver handle
+			_handles[0] = _tif;
+			_rows = _blocksDown;
+			ParallelRun(*this, count, 1);
+			return TRUE;
+		}
+
+		// block rows of a batch : about 4 MB of pixels per thread
+		const tmsize_t batchSize = (tmsize_t)_threads * (4 << 20);
+		const unsigned batchRows = (unsigned)MAX((tmsize_t)1, batchSize / (_blockSize * _blocksAcross));
+
+		for(_first = 0; _first < _blocksDown; _first += batchRows) {
+			_rows = MIN(batchRows, _blocksDown - _first);
+
+			if(!openStreams()) {
+				return FALSE;
+			}
+			ParallelRun(*this, _rows * _blocksAcross, _threads);
+			if(!hasError()) {
+				writeBlocks();
+			}
+			closeStreams();
+
+			if(hasError()) {
+				break;
+			}
+		}
+
+		return TRUE;
+	}
+
+	/**
+	Returns TRUE if a block could not be written.
+	The flag is only ever raised, so the workers poll it without taking the lock
+	*/
+	BOOL hasError() const {
+		return _error;
+	}
+
+	void run(unsigned item, unsigned thread) {
+		if(hasError()) {
+			// the image is rejected, skip the remaining blocks
+			return;
+		}
+
+		const uint32 x = (item % _blocksAcross) * _blockWidth;
+		const uint32 y = (_first + item / _blocksAcross) * _blockHeight;
+		const uint32 ncols = MIN(_blockWidth, _width - x);
+		const uint32 nrows = MIN(_blockHeight, _height - y);
+		BYTE *buffer = _buffers[thread];
+
+		if(_tiled) {
+			// pad the tiles of the right and bottom edges with zeros
+			memset(buffer, 0, _blockSize);
+		}
+		for(uint32 k = 0; k < nrows; k++) {
+			ConvertLineToTIFF(_dib, y + k, x, ncols, _photometric, _samplesperpixel, buffer + k * _blockRowSize);
+		}
+
+		// blocks are numbered from the first block row of the handle
+		TIFF *handle = _handles[thread];
+		tmsize_t written = 0;
+		if(_tiled) {
+			written = TIFFWriteEncodedTile(handle, item, buffer, _blockSize);
+		} else {
+			written = TIFFWriteEncodedStrip(handle, item, buffer, nrows * _blockRowSize);
+		}
+		if(written < 0) {
+			setError();
+		}
+		if(_owners) {
+			_owners[item] = thread;
+		}
+	}
+
+private:
+	void setError() {
+		ParallelLock lock(_mutex);
+		_error = TRUE;
+	}
+
+	/**
+	Allocate the buffers of up to 'threads' threads
+	*/
+	BOOL open(unsigned threads) {
+		_buffers = (BYTE**)calloc(threads, sizeof(BYTE*));
+		_handles = (TIFF**)calloc(threads, sizeof(TIFF*));
+		if(!_buffers || !_handles) {
+			return FALSE;
+		}
+		if(threads > 1) {
+			_fio = (fi_TIFFIO*)calloc(threads, sizeof(fi_TIFFIO));
+			if(!_fio) {
+				return FALSE;
+			}
+		}
+		for(unsigned t = 0; t < threads; t++) {
+			_buffers[t] = (BYTE*)malloc(_blockSize * sizeof(BYTE));
+			if(!_buffers[t]) {
+				break;
+			}
+			_threads++;
+		}
+		if(_threads > 1) {
+			_owners = (unsigned*)malloc(_blocksDown * _blocksAcross * sizeof(unsigned));
+			if(!_owners) {
+				return FALSE;
+			}
+		}
+
+		return (_threads > 0);
+	}
+
+	/**
+	Open the memory stream and the TIFF handle of each thread for the current batch.
+	The handles hold the block rows [_first, _first + _rows) of the saved image.
+	*/
+	BOOL openStreams() {
+		SetMemoryIO(&_io);
+
+		const uint32 length = MIN(_rows * _blockHeight, _height - _first * _blockHeight);
+
+		for(unsigned t = 0; t < _threads; t++) {
+			fi_TIFFIO *fio = &_fio[t];
+			fio->io = &_io;
+			fio->handle = (fi_handle)FreeImage_OpenMemory();
+			if(!fio->handle) {
+				return FALSE;
+			}
+			TIFF *handle = TIFFClientOpen("", "w", (thandle_t)fio,
+				_tiffReadProc, _tiffWriteProc, _tiffSeekProc, _tiffCloseProc,
+				_tiffSizeProc, _tiffMapProc, _tiffUnmapProc);
+			if(!handle) {
+				return FALSE;
+			}
+			fio->tif = handle;
+			_handles[t] = handle;
+
+			CopyEncoderTags(_tif, handle, length);
+		}
+
+		return TRUE;
+	}
+
+	/**
+	Close the handles and the memory streams of the current batch
+	*/
+	void closeStreams() {
+		if(!_fio) {
+			return;
+		}
+		for(unsigned t = 0; t < _threads; t++) {
+			fi_TIFFIO *fio = &_fio[t];
+			if(fio->tif) {
+				TIFFClose(fio->tif);
+			}
+			if(fio->handle) {
+				FreeImage_CloseMemory((FIMEMORY*)fio->handle);
+			}
+			fio->tif = NULL;
+			fio->handle = NULL;
+			_handles[t] = NULL;
+		}
+	}
+
+	/**
+	Append the compressed blocks of the current batch to the saved image
+	*/
+	void writeBlocks() {
+		const unsigned count = _rows * _blocksAcross;
+
+		for(unsigned item = 0; item < count; item++) {
+			fi_TIFFIO *fio = &_fio[_owners[item]];
+
+			uint64 *offsets = NULL;
+			uint64 *bytecounts = NULL;
+			TIFFGetField(fio->tif, _tiled ? TIFFTAG_TILEOFFSETS : TIFFTAG_STRIPOFFSETS, &offsets);
+			TIFFGetField(fio->tif, _tiled ? TIFFTAG_TILEBYTECOUNTS : TIFFTAG_STRIPBYTECOUNTS, &bytecounts);
+
+			BYTE *data = NULL;
+			DWORD size = 0;
+			FreeImage_AcquireMemory((FIMEMORY*)fio->handle, &data, &size);
+
+			if(!offsets || !bytecounts || (offsets[item] + bytecounts[item] > size)) {
+				setError();
+				return;
+			}
+
+			const uint32 block = _first * _blocksAcross + item;
+			tmsize_t written = 0;
+			if(_tiled) {
+				written = TIFFWriteRawTile(_tif, block, data + offsets[item], (tmsize_t)bytecounts[item]);
+			} else {
+				written = TIFFWriteRawStrip(_tif, block, data + offsets[item], (tmsize_t)bytecounts[item]);
+			}
+			if(written < 0) {
+				setError();
+				return;
+			}
+		}
+	}
+
+	TIFFBlockEncoder& operator=(const TIFFBlockEncoder&); // deleted
+	TIFFBlockEncoder(const TIFFBlockEncoder&); // deleted
+
+private:
+	TIFF *_tif;
+	FIBITMAP *_dib;
+	uint16 _photometric;
+	uint16 _samplesperpixel;
+	uint32 _width;
+	uint32 _height;
+	BOOL _tiled;
+	uint32 _blockWidth;
+	uint32 _blockHeight;
+	tmsize_t _blockSize;
+	tmsize_t _blockRowSize;
+	uint32 _blocksAcross;
+	uint32 _blocksDown;
+	//! number of threads with a buffer
+	unsigned _threads;
+	//! first block row and number of block rows of the current batch
+	uint32 _first;
+	uint32 _rows;
+	BYTE **_buffers;
+	TIFF **_handles;
+	//! memory streams of the threads (multithreaded encoding only)
+	FreeImageIO _io;
+	fi_TIFFIO *_fio;
+	//! thread that compressed each block of the current batch
+	unsigned *_owners;
+	//! protects the raising of the error flag
+	ParallelMutex _mutex;
+	volatile BOOL _error;
+};
+
 // --------------------------------------------------------------------------
 
 static BOOL 
@@ -2413,6 +3193,17 @@ SaveOneTIFF(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flag
 
 		WriteCompression(out, bitspersample, samplesperpixel, photometric, flags);
 
+		// strip or tile layout (overwrite the default RowsPerStrip)
+
+		if((flags & TIFF_TILED) == TIFF_TILED) {
+			const uint32 tileSize = GetBlockSize(flags) ? GetBlockSize(flags) : 256;
+			TIFFUnsetField(out, TIFFTAG_ROWSPERSTRIP);
+			TIFFSetField(out, TIFFTAG_TILEWIDTH, tileSize);
+			TIFFSetField(out, TIFFTAG_TILELENGTH, tileSize);
+		} else if(GetBlockSize(flags) != 0) {
+			TIFFSetField(out, TIFFTAG_ROWSPERSTRIP, GetBlockSize(flags));
+		}
+
 		// metadata
 
 		WriteMetadata(out, dib);
@@ -2426,137 +3217,41 @@ SaveOneTIFF(FreeImageIO *io, FIBITMAP *dib, fi_handle handle, int page, int flag
 			TIFFSetField(out, TIFFTAG_SUBIFD, nsubifd, subifd);
 		}
 
-		// read the DIB lines from bottom to top
-		// and save them in the TIF
-		// -------------------------------------
-		
-		const uint32 pitch = FreeImage_GetPitch(dib);
-
-		if(image_type == FIT_BITMAP) {
-			// standard bitmap type
-		
-			switch(bitsperpixel) {
-				case 1 :
-				case 4 :
-				case 8 :
-				{
-					if((bitsperpixel == 8) && FreeImage_IsTransparent(dib)) {
-						// 8-bit transparent picture : convert to 8-bit + 8-bit alpha
-
-						// get the transparency table
-						BYTE *trns = FreeImage_GetTransparencyTable(dib);
-
-						BYTE *buffer = (BYTE *)malloc(2 * width * sizeof(BYTE));
-						if(buffer == NULL) {
-							throw FI_MSG_ERROR_MEMORY;
-						}
-
-						for (int y = height - 1; y >= 0; y--) {
-							BYTE *bits = FreeImage_GetScanLine(dib, y);
+		// write the pixels, top to bottom
+		// --------------------------------
 
-							BYTE *p = bits, *b = buffer;
+		if(TIFFIsTiled(out) || (GetBlockSize(flags) != 0) || ((flags & TIFF_MULTITHREAD) == TIFF_MULTITHREAD)) {
+			// write whole strips or tiles, compressed on one or more threads
 
-							for(uint32 x = 0; x < width; x++) {
-								// copy the 8-bit layer
-								b[0] = *p;
-								// convert the trns table to a 8-bit alpha layer
-								b[1] = trns[ b[0] ];
-
-								p++;
-								b += samplesperpixel;
-							}
-
-							// write the scanline to disc
-
-							TIFFWriteScanline(out, buffer, height - y - 1, 0);
-						}
-
-						free(buffer);
-					}
-					else {
-						// other cases
-						BYTE *buffer = (BYTE *)malloc(pitch * sizeof(BYTE));
-						if(buffer == NULL) {
-							throw FI_MSG_ERROR_MEMORY;
-						}
-
-						for (uint32 y = 0; y < height; y++) {
-							// get a copy of the scanline
-							memcpy(buffer, FreeImage_GetScanLine(dib, height - y - 1), pitch);
-							// write the scanline to disc
-							TIFFWriteScanline(out, buffer, y, 0);
-						}
-						free(buffer);
-					}
-
-					break;
-				}				
-
-				case 24:
-				case 32:
-				{
-					BYTE *buffer = (BYTE *)malloc(pitch * sizeof(BYTE));
-					if(buffer == NULL) {
-						throw FI_MSG_ERROR_MEMORY;
-					}
-
-					for (uint32 y = 0; y < height; y++) {
-						// get a copy of the scanline
+			uint16 compression = COMPRESSION_NONE;
+			TIFFGetFieldDefaulted(out, TIFFTAG_COMPRESSION, &compression);
 
-						memcpy(buffer, FreeImage_GetScanLine(dib, height - y - 1), pitch);
+			// the SGILOG codec rewrites the BitsPerSample and SampleFormat tags once its encoder
+			// has been used, so LogLuv blocks are always compressed with the saver handle
+			const unsigned threads = (compression == COMPRESSION_SGILOG) ? 1 : GetBlockThreadCount(compression, flags);
 
-#if FREEIMAGE_COLORORDER == FREEIMAGE_COLORORDER_BGR
-						if (photometric != PHOTOMETRIC_SEPARATED) {
-							// TIFFs store color data RGB(A) instead of BGR(A)
-		
-							BYTE *pBuf = buffer;
-		
-							for (uint32 x = 0; x < width; x++) {
-								INPLACESWAP(pBuf[0], pBuf[2]);
-								pBuf += samplesperpixel;
-							}
-						}
-#endif
-						// write the scanline to disc
-
-						TIFFWriteScanline(out, buffer, y, 0);
-					}
-
-					free(buffer);
-
-					break;
-				}
-			}//< switch (bitsperpixel)
-
-		} else if(image_type == FIT_RGBF && (flags & TIFF_LOGLUV) == TIFF_LOGLUV) {
-			// RGBF image => store as XYZ using a LogLuv encoding
-
-			BYTE *buffer = (BYTE *)malloc(pitch * sizeof(BYTE));
-			if(buffer == NULL) {
+			TIFFBlockEncoder encoder(out, dib, photometric, samplesperpixel);
+			if(!encoder.encode(threads)) {
 				throw FI_MSG_ERROR_MEMORY;
 			}
-
-			for (uint32 y = 0; y < height; y++) {
-				// get a copy of the scanline and convert from RGB to XYZ
-				tiff_ConvertLineRGBToXYZ(buffer, FreeImage_GetScanLine(dib, height - y - 1), width);
-				// write the scanline to disc
-				TIFFWriteScanline(out, buffer, y, 0);
+			if(encoder.hasError()) {
+				throw "Failed to write the TIFF strips or tiles";
 			}
-			free(buffer);
 		} else {
-			// just dump the dib (tiff supports all dib types)
-			
-			BYTE *buffer = (BYTE *)malloc(pitch * sizeof(BYTE));
+			// write the scanlines one by one
+
+			BYTE *buffer = (BYTE *)malloc(TIFFScanlineSize(out) * sizeof(BYTE));
 			if(buffer == NULL) {
 				throw FI_MSG_ERROR_MEMORY;
 			}
-			
+
 			for (uint32 y = 0; y < height; y++) {
-				// get a copy of the scanline
-				memcpy(buffer, FreeImage_GetScanLine(dib, height - y - 1), pitch);
+				// get a copy of the scanline in the TIFF sample layout
+				ConvertLineToTIFF(dib, y, 0, width, photometric, samplesperpixel, buffer);
 				// write the scanline to disc
 				TIFFWriteScanline(out, buffer, y, 0);
 			}
+
 			free(buffer);
 		}
 
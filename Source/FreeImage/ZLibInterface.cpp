@@ -221,3 +221,257 @@ FreeImage_ZLibCRC32(DWORD crc, BYTE *source, DWORD source_size) {
 
     return crc32(crc, source, source_size);
 }
+
+// ==========================================================
+// Streaming interface
+// ==========================================================
+
+/**
+State of a FIZSTREAM handle
+*/
+typedef struct tagFIZSTREAMHEADER {
+	//! ZLib stream
+	z_stream zstream;
+	//! TRUE for a compressor, FALSE for a decompressor
+	BOOL compress;
+	//! TRUE once the end of the stream has been reached
+	BOOL finished;
+} FIZSTREAMHEADER;
+
+/**
+Get the ZLib windowBits parameter matching a stream format
+@return Returns the windowBits value, returns 0 if the format is not supported
+*/
+static int 
+GetWindowBits(FREE_IMAGE_ZFORMAT format, BOOL compress) {
+	switch(format) {
+		case FIZ_ZLIB:
+			return MAX_WBITS;
+		case FIZ_GZIP:
+			return MAX_WBITS + 16;
+		case FIZ_RAW:
+			return -MAX_WBITS;
+		case FIZ_AUTO:
+			// automatic header detection is only available when decompressing
+			return compress ? 0 : MAX_WBITS + 32;
+	}
+	return 0;
+}
+
+/**
+Allocate a stream handle and initialize its ZLib stream
+*/
+static FIZSTREAM* 
+OpenStream(FREE_IMAGE_ZFORMAT format, BOOL compress, int level, int strategy) {
+	const int window_bits = GetWindowBits(format, compress);
+	if(window_bits == 0) {
+		FreeImage_OutputMessageProc(FIF_UNKNOWN, "Zlib error : %s", zError(Z_STREAM_ERROR));
+		return NULL;
+	}
+
+	FIZSTREAM *stream = (FIZSTREAM*)malloc(sizeof(FIZSTREAM));
+	if(stream) {
+		stream->data = malloc(sizeof(FIZSTREAMHEADER));
+
+		if(stream->data) {
+			FIZSTREAMHEADER *header = (FIZSTREAMHEADER*)stream->data;
+
+			memset(header, 0, sizeof(FIZSTREAMHEADER));
+			header->compress = compress;
+
+			int zerr = Z_OK;
+			if(compress) {
+				zerr = deflateInit2(&header->zstream, level, Z_DEFLATED, window_bits, 8, strategy);
+			} else {
+				zerr = inflateInit2(&header->zstream, window_bits);
+			}
+			if(zerr == Z_OK) {
+				return stream;
+			}
+
+			FreeImage_OutputMessageProc(FIF_UNKNOWN, "Zlib error : %s", zError(zerr));
+			free(stream->data);
+		}
+		free(stream);
+	}
+
+	return NULL;
+}
+
+/**
+Create a compression stream. 
+The stream compresses the data given to FreeImage_ZLibProcessStream, in one or more chunks, 
+and can be reused for other data after a call to FreeImage_ZLibResetStream. 
+
+@param format Output format : FIZ_ZLIB, FIZ_GZIP or FIZ_RAW
+@param level Compression level, from 0 (no compression) to 9 (best compression), -1 for the ZLib default (6)
+@param strategy ZLib compression strategy : 0 (default), 1 (filtered), 2 (Huffman only), 3 (RLE) or 4 (fixed)
+@return Returns the stream handle, returns NULL if an error occured
+@see FreeImage_ZLibCloseStream
+*/
+FIZSTREAM * DLL_CALLCONV 
+FreeImage_ZLibOpenCompressor(FREE_IMAGE_ZFORMAT format, int level, int strategy) {
+	return OpenStream(format, TRUE, level, strategy);
+}
+
+/**
+Create a decompression stream. 
+The stream decompresses the data given to FreeImage_ZLibProcessStream, in one or more chunks, 
+and can be reused for other data after a call to FreeImage_ZLibResetStream. 
+
+@param format Input format : FIZ_ZLIB, FIZ_GZIP, FIZ_RAW or FIZ_AUTO (ZLib or GZip)
+@return Returns the stream handle, returns NULL if an error occured
+@see FreeImage_ZLibCloseStream
+*/
+FIZSTREAM * DLL_CALLCONV 
+FreeImage_ZLibOpenDecompressor(FREE_IMAGE_ZFORMAT format) {
+	return OpenStream(format, FALSE, 0, 0);
+}
+
+/**
+Destroy a compression or decompression stream
+@param stream Stream handle (may be NULL)
+*/
+void DLL_CALLCONV 
+FreeImage_ZLibCloseStream(FIZSTREAM *stream) {
+	if(stream) {
+		FIZSTREAMHEADER *header = (FIZSTREAMHEADER*)stream->data;
+		if(header) {
+			if(header->compress) {
+				deflateEnd(&header->zstream);
+			} else {
+				inflateEnd(&header->zstream);
+			}
+			free(header);
+		}
+		free(stream);
+	}
+}
+
+/**
+Prepare a stream for new data, keeping its format and its parameters. 
+The memory allocated by ZLib is reused. 
+@param stream Stream handle
+@return Returns TRUE if successful, returns FALSE otherwise
+*/
+BOOL DLL_CALLCONV 
+FreeImage_ZLibResetStream(FIZSTREAM *stream) {
+	if(!stream || !stream->data) {
+		return FALSE;
+	}
+	FIZSTREAMHEADER *header = (FIZSTREAMHEADER*)stream->data;
+
+	const int zerr = header->compress ? deflateReset(&header->zstream) : inflateReset(&header->zstream);
+	if(zerr != Z_OK) {
+		FreeImage_OutputMessageProc(FIF_UNKNOWN, "Zlib error : %s", zError(zerr));
+		return FALSE;
+	}
+	header->finished = FALSE;
+
+	return TRUE;
+}
+
+/**
+Change the compression level and strategy of a compression stream. 
+The function must be called before the first chunk of data of the stream 
+(i.e. after the stream creation or after a call to FreeImage_ZLibResetStream). 
+@param stream Compression stream handle
+@param level Compression level, from 0 to 9, -1 for the ZLib default
+@param strategy ZLib compression strategy
+@return Returns TRUE if successful, returns FALSE otherwise
+@see FreeImage_ZLibOpenCompressor
+*/
+BOOL DLL_CALLCONV 
+FreeImage_ZLibSetStreamParams(FIZSTREAM *stream, int level, int strategy) {
+	if(!stream || !stream->data) {
+		return FALSE;
+	}
+	FIZSTREAMHEADER *header = (FIZSTREAMHEADER*)stream->data;
+	z_stream *zstream = &header->zstream;
+
+	if(!header->compress || (zstream->total_in != 0) || header->finished) {
+		return FALSE;
+	}
+	zstream->next_in = Z_NULL;
+	zstream->avail_in = 0;
+	zstream->next_out = Z_NULL;
+	zstream->avail_out = 0;
+
+	const int zerr = deflateParams(zstream, level, strategy);
+	if(zerr != Z_OK) {
+		FreeImage_OutputMessageProc(FIF_UNKNOWN, "Zlib error : %s", zError(zerr));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+Compress or decompress a chunk of data. 
+The function consumes as much input and produces as much output as possible : 
+call it again with the remaining input, or with more output space, as long as it returns FIZ_STREAM_OK. 
+A compressor gets its last chunk of input with finish set to TRUE : it returns FIZ_STREAM_END 
+once all the compressed data has been written (call it with finish set to TRUE and more 
+output space while it returns FIZ_STREAM_OK). 
+A decompressor returns FIZ_STREAM_END once the end of the compressed data has been decoded. 
+When all the input has been consumed and no more output can be produced, FIZ_STREAM_NEED_INPUT 
+is returned : a decompressor that gets it after its last chunk of input has truncated data. 
+
+@param stream Stream handle
+@param source Input buffer (may be NULL if source_size is 0)
+@param source_size On input, size of the input buffer, in bytes. On output, number of bytes consumed
+@param target Output buffer
+@param target_size On input, size of the output buffer, in bytes. On output, number of bytes written
+@param finish Compression only : TRUE if the source buffer holds the last input bytes
+@return Returns FIZ_STREAM_END, FIZ_STREAM_OK, FIZ_STREAM_NEED_INPUT or FIZ_STREAM_ERROR
+*/
+int DLL_CALLCONV 
+FreeImage_ZLibProcessStream(FIZSTREAM *stream, BYTE *source, DWORD *source_size, BYTE *target, DWORD *target_size, BOOL finish) {
+	if(!stream || !stream->data || !source_size || !target_size) {
+		return FIZ_STREAM_ERROR;
+	}
+	FIZSTREAMHEADER *header = (FIZSTREAMHEADER*)stream->data;
+	z_stream *zstream = &header->zstream;
+
+	const DWORD input_size = source ? *source_size : 0;
+	const DWORD output_size = target ? *target_size : 0;
+	*source_size = 0;
+	*target_size = 0;
+
+	if(header->finished) {
+		// nothing more to do until the stream is reset
+		return FIZ_STREAM_END;
+	}
+
+	zstream->next_in = source;
+	zstream->avail_in = input_size;
+	zstream->next_out = target;
+	zstream->avail_out = output_size;
+
+	int zerr = Z_OK;
+	if(header->compress) {
+		zerr = deflate(zstream, finish ? Z_FINISH : Z_NO_FLUSH);
+	} else {
+		zerr = inflate(zstream, Z_NO_FLUSH);
+	}
+
+	*source_size = input_size - zstream->avail_in;
+	*target_size = output_size - zstream->avail_out;
+
+	switch(zerr) {
+		case Z_STREAM_END:
+			header->finished = TRUE;
+			return FIZ_STREAM_END;
+		case Z_OK:
+			return FIZ_STREAM_OK;
+		case Z_BUF_ERROR:
+			// no progress possible : more output space is needed, or the input is exhausted
+			return (zstream->avail_out == 0) ? FIZ_STREAM_OK : FIZ_STREAM_NEED_INPUT;
+		case Z_NEED_DICT:	// preset dictionaries are not supported
+			zerr = Z_DATA_ERROR;
+			break;
+	}
+
+	FreeImage_OutputMessageProc(FIF_UNKNOWN, "Zlib error : %s", zError(zerr));
+	return FIZ_STREAM_ERROR;
+}
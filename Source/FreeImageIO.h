@@ -60,4 +60,114 @@ void SetDefaultIO(FreeImageIO *io);
 
 void SetMemoryIO(FreeImageIO *io);
 
+// ----------------------------------------------------------
+
+/**
+Buffered input stream layered over a FreeImageIO handle. 
+Decoders reading their data a few bytes at a time (e.g. RLE decoders) use this class 
+instead of calling io->read_proc for each byte. The stream is read ahead in blocks of a fixed size. 
+When the handle is a FIMEMORY stream, the memory buffer is read in place (no copy). 
+
+While the reader is in use, the position of the underlying handle is undefined. 
+Call sync() (or destroy the reader) before using the handle again : 
+the data read ahead but not consumed is then given back to the stream. 
+*/
+class BufferedReader {
+public:
+	/**
+	@param io FreeImage IO
+	@param handle FreeImage IO handle
+	@param size Size of the read ahead buffer, in bytes (unused for FIMEMORY streams)
+	*/
+	BufferedReader(FreeImageIO *io, fi_handle handle, unsigned size = 65536);
+	~BufferedReader();
+
+	/**
+	Returns TRUE if the read ahead buffer could not be allocated
+	*/
+	BOOL isNull() const {
+		return !_memory && (_buffer == NULL);
+	}
+
+	/**
+	Read a single byte
+	@return Returns TRUE if successful, returns FALSE at end of stream
+	*/
+	inline BOOL getByte(BYTE *value) {
+		if((_ptr == _end) && !refill(1)) {
+			return FALSE;
+		}
+		*value = *_ptr++;
+		return TRUE;
+	}
+
+	/**
+	Get a pointer to the next 'count' bytes without consuming them. 
+	Use skip(count) to consume the bytes once processed. 
+	@param count Number of bytes, must be lower than or equal to the buffer size
+	@return Returns a pointer valid until the next call to the reader, returns NULL if less than 'count' bytes are left
+	*/
+	inline const BYTE* peek(unsigned count) {
+		if(((unsigned)(_end - _ptr) < count) && !refill(count)) {
+			return NULL;
+		}
+		return _ptr;
+	}
+
+	/**
+	Read up to 'size' bytes
+	@return Returns the number of bytes read, lower than 'size' at end of stream
+	*/
+	unsigned read(void *buffer, unsigned size);
+
+	/**
+	Move the reading position by 'offset' bytes (may be negative)
+	@return Returns TRUE if successful, returns FALSE otherwise
+	*/
+	inline BOOL skip(long offset) {
+		if((offset >= 0) && (offset <= (long)(_end - _ptr))) {
+			_ptr += offset;
+			return TRUE;
+		}
+		return seek(tell() + offset);
+	}
+
+	/**
+	Move the reading position to an absolute stream position
+	@return Returns TRUE if successful, returns FALSE otherwise
+	*/
+	BOOL seek(long position);
+
+	/**
+	Returns the current reading position
+	*/
+	long tell() const;
+
+	/**
+	Give back the data read ahead to the stream, i.e. move the handle to the reading position
+	*/
+	void sync();
+
+private:
+	BOOL refill(unsigned count);
+
+	BufferedReader& operator=(const BufferedReader&); // deleted
+	BufferedReader(const BufferedReader&); // deleted
+
+private:
+	FreeImageIO *_io;
+	fi_handle _handle;
+	//! TRUE when reading a FIMEMORY stream in place
+	BOOL _memory;
+	//! read ahead buffer (NULL for FIMEMORY streams)
+	BYTE *_buffer;
+	unsigned _size;
+	//! window of the stream available for reading
+	const BYTE *_begin;
+	const BYTE *_ptr;
+	const BYTE *_end;
+	//! stream position of _begin
+	long _position;
+};
+
 #endif // !FREEIMAGEIO_H
@@ -36,8 +36,6 @@
 #include "FreeImage.h"
 #include "Utilities.h"
 
-#define RBLOCK		64	// image blocks of RBLOCK*RBLOCK pixels
-
 // --------------------------------------------------------------------------
 
 /**
@@ -368,41 +366,11 @@ Rotate90(FIBITMAP *src) {
 				}
 			}
 			else if((bpp == 8) || (bpp == 24) || (bpp == 32)) {
-				// anything other than BW :
-				// This optimized version of rotation rotates image by smaller blocks. It is quite
-				// a bit faster than obvious algorithm, because it produces much less CPU cache misses.
-				// This optimization can be tuned by changing block size (RBLOCK). 96 is good value for current
-				// CPUs (tested on Athlon XP and Celeron D). Larger value (if CPU has enough cache) will increase
-				// speed somehow, but once you drop out of CPU's cache, things will slow down drastically.
-				// For older CPUs with less cache, lower value would yield better results.
-
-				BYTE *bsrc  = FreeImage_GetBits(src);  // source pixels
-				BYTE *bdest = FreeImage_GetBits(dst);  // destination pixels
-
-				// calculate the number of bytes per pixel (1 for 8-bit, 3 for 24-bit or 4 for 32-bit)
+				// anything other than BW : the source column x becomes the destination line (dst_height - 1 - x)
 				const unsigned bytespp = FreeImage_GetLine(src) / FreeImage_GetWidth(src);
-				
-				// for all image blocks of RBLOCK*RBLOCK pixels
-				
-				// x-segment
-				for(unsigned xs = 0; xs < dst_width; xs += RBLOCK) {
-					// y-segment
-					for(unsigned ys = 0; ys < dst_height; ys += RBLOCK) {
-						for(unsigned y = ys; y < MIN(dst_height, ys + RBLOCK); y++) {    // do rotation
-							const unsigned y2 = dst_height - y - 1;
-							// point to src pixel at (y2, xs)
-							BYTE *src_bits = bsrc + (xs * src_pitch) + (y2 * bytespp);
-							// point to dst pixel at (xs, y)
-							BYTE *dst_bits = bdest + (y * dst_pitch) + (xs * bytespp);
-							for(unsigned x = xs; x < MIN(dst_width, xs + RBLOCK); x++) {
-								// dst.SetPixel(x, y, src.GetPixel(y2, x));
-								AssignPixel(dst_bits, src_bits, bytespp);
-								dst_bits += bytespp;
-								src_bits += src_pitch;
-							}
-						}
-					}
-				}
+				BYTE *dst_last_line = FreeImage_GetScanLine(dst, dst_height - 1);
+
+				TransposePixels(dst_last_line, -(int)dst_pitch, FreeImage_GetBits(src), (int)src_pitch, src_width, src_height, bytespp);
 			}
 			break;
 		case FIT_UINT16:
@@ -412,21 +380,11 @@ Rotate90(FIBITMAP *src) {
 		case FIT_RGBF:
 		case FIT_RGBAF:
 		{
-			BYTE *bsrc  = FreeImage_GetBits(src);  // source pixels
-			BYTE *bdest = FreeImage_GetBits(dst);  // destination pixels
-
 			// calculate the number of bytes per pixel
 			const unsigned bytespp = FreeImage_GetLine(src) / FreeImage_GetWidth(src);
+			BYTE *dst_last_line = FreeImage_GetScanLine(dst, dst_height - 1);
 
-			for(unsigned y = 0; y < dst_height; y++) {
-				BYTE *src_bits = bsrc + (src_width - 1 - y) * bytespp;
-				BYTE *dst_bits = bdest + (y * dst_pitch);
-				for(unsigned x = 0; x < dst_width; x++) {
-					AssignPixel(dst_bits, src_bits, bytespp);
-					src_bits += src_pitch;
-					dst_bits += bytespp;
-				}
-			}
+			TransposePixels(dst_last_line, -(int)dst_pitch, FreeImage_GetBits(src), (int)src_pitch, src_width, src_height, bytespp);
 		}
 		break;
 	}
@@ -442,7 +400,7 @@ Precise rotation, no filters required.
 */
 static FIBITMAP* 
 Rotate180(FIBITMAP *src) {
-	int x, y, k, pos;
+	int y, k, pos;
 
 	const int bpp = FreeImage_GetBPP(src);
 
@@ -484,15 +442,8 @@ Rotate180(FIBITMAP *src) {
 			const int bytespp = FreeImage_GetLine(src) / FreeImage_GetWidth(src);
 
 			for(y = 0; y < src_height; y++) {
-				BYTE *src_bits = FreeImage_GetScanLine(src, y);
-				BYTE *dst_bits = FreeImage_GetScanLine(dst, dst_height - y - 1) + (dst_width - 1) * bytespp;
-				for(x = 0; x < src_width; x++) {
-					// get pixel at (x, y)
-					// set pixel at (dst_width - x - 1, dst_height - y - 1)
-					AssignPixel(dst_bits, src_bits, bytespp);
-					src_bits += bytespp;
-					dst_bits -= bytespp;					
-				}				
+				// pixel at (x, y) goes to (dst_width - x - 1, dst_height - y - 1)
+				ReversePixels(FreeImage_GetScanLine(dst, dst_height - y - 1), FreeImage_GetScanLine(src, y), src_width, bytespp);
 			}
 		}
 		break;
@@ -510,7 +461,7 @@ Code adapted from CxImage (http://www.xdp.it/cximage.htm)
 */
 static FIBITMAP* 
 Rotate270(FIBITMAP *src) {
-	int x2, dlineup;
+	int dlineup;
 
 	const unsigned bpp = FreeImage_GetBPP(src);
 
@@ -560,41 +511,11 @@ Rotate270(FIBITMAP *src) {
 				}
 			} 
 			else if((bpp == 8) || (bpp == 24) || (bpp == 32)) {
-				// anything other than BW :
-				// This optimized version of rotation rotates image by smaller blocks. It is quite
-				// a bit faster than obvious algorithm, because it produces much less CPU cache misses.
-				// This optimization can be tuned by changing block size (RBLOCK). 96 is good value for current
-				// CPUs (tested on Athlon XP and Celeron D). Larger value (if CPU has enough cache) will increase
-				// speed somehow, but once you drop out of CPU's cache, things will slow down drastically.
-				// For older CPUs with less cache, lower value would yield better results.
-
-				BYTE *bsrc  = FreeImage_GetBits(src);  // source pixels
-				BYTE *bdest = FreeImage_GetBits(dst);  // destination pixels
-
-				// Calculate the number of bytes per pixel (1 for 8-bit, 3 for 24-bit or 4 for 32-bit)
+				// anything other than BW : the source line y becomes the destination column (dst_width - 1 - y)
 				const unsigned bytespp = FreeImage_GetLine(src) / FreeImage_GetWidth(src);
+				const BYTE *src_last_line = FreeImage_GetScanLine(src, src_height - 1);
 
-				// for all image blocks of RBLOCK*RBLOCK pixels
-
-				// x-segment
-				for(unsigned xs = 0; xs < dst_width; xs += RBLOCK) {
-					// y-segment
-					for(unsigned ys = 0; ys < dst_height; ys += RBLOCK) {
-						for(unsigned x = xs; x < MIN(dst_width, xs + RBLOCK); x++) {    // do rotation
-							x2 = dst_width - x - 1;
-							// point to src pixel at (ys, x2)
-							BYTE *src_bits = bsrc + (x2 * src_pitch) + (ys * bytespp);
-							// point to dst pixel at (x, ys)
-							BYTE *dst_bits = bdest + (ys * dst_pitch) + (x * bytespp);
-							for(unsigned y = ys; y < MIN(dst_height, ys + RBLOCK); y++) {
-								// dst.SetPixel(x, y, src.GetPixel(y, x2));
-								AssignPixel(dst_bits, src_bits, bytespp);
-								src_bits += bytespp;
-								dst_bits += dst_pitch;
-							}
-						}
-					}
-				}
+				TransposePixels(FreeImage_GetBits(dst), (int)dst_pitch, src_last_line, -(int)src_pitch, src_width, src_height, bytespp);
 			}
 			break;
 		case FIT_UINT16:
@@ -604,21 +525,11 @@ Rotate270(FIBITMAP *src) {
 		case FIT_RGBF:
 		case FIT_RGBAF:
 		{
-			BYTE *bsrc  = FreeImage_GetBits(src);  // source pixels
-			BYTE *bdest = FreeImage_GetBits(dst);  // destination pixels
-
 			// calculate the number of bytes per pixel
 			const unsigned bytespp = FreeImage_GetLine(src) / FreeImage_GetWidth(src);
+			const BYTE *src_last_line = FreeImage_GetScanLine(src, src_height - 1);
 
-			for(unsigned y = 0; y < dst_height; y++) {
-				BYTE *src_bits = bsrc + (src_height - 1) * src_pitch + y * bytespp;
-				BYTE *dst_bits = bdest + (y * dst_pitch);
-				for(unsigned x = 0; x < dst_width; x++) {
-					AssignPixel(dst_bits, src_bits, bytespp);
-					src_bits -= src_pitch;
-					dst_bits += bytespp;
-				}
-			}
+			TransposePixels(FreeImage_GetBits(dst), (int)dst_pitch, src_last_line, -(int)src_pitch, src_width, src_height, bytespp);
 		}
 		break;
 	}
@@ -477,6 +477,83 @@ CombineSameType(FIBITMAP *dst_dib, FIBITMAP *src_dib, unsigned x, unsigned y) {
 	return TRUE;
 }
 
+// ----------------------------------------------------------
+//   Porter-Duff compositing of 32-bit and RGBA16 images
+// ----------------------------------------------------------
+
+/**
+Porter-Duff factors of the source and destination pixels for each FREE_IMAGE_PORTER_DUFF operator
+*/
+static const int s_porter_duff_factors[][2] = {
+	{ FI_PD_ZERO,		FI_PD_ZERO },		// FIPD_CLEAR
+	{ FI_PD_ONE,		FI_PD_ZERO },		// FIPD_SRC
+	{ FI_PD_ZERO,		FI_PD_ONE },		// FIPD_DST
+	{ FI_PD_ONE,		FI_PD_INV_ALPHA },	// FIPD_SRC_OVER
+	{ FI_PD_INV_ALPHA,	FI_PD_ONE },		// FIPD_DST_OVER
+	{ FI_PD_ALPHA,		FI_PD_ZERO },		// FIPD_SRC_IN
+	{ FI_PD_ZERO,		FI_PD_ALPHA },		// FIPD_DST_IN
+	{ FI_PD_INV_ALPHA,	FI_PD_ZERO },		// FIPD_SRC_OUT
+	{ FI_PD_ZERO,		FI_PD_INV_ALPHA },	// FIPD_DST_OUT
+	{ FI_PD_ALPHA,		FI_PD_INV_ALPHA },	// FIPD_SRC_ATOP
+	{ FI_PD_INV_ALPHA,	FI_PD_ALPHA },		// FIPD_DST_ATOP
+	{ FI_PD_INV_ALPHA,	FI_PD_INV_ALPHA }	// FIPD_XOR
+};
+
+/**
+Rounded a * b / max, max being 255 (BYTE channels) or 65535 (WORD channels)
+*/
+template <class T> static inline unsigned
+MulDivChannel(unsigned a, unsigned b) {
+	const unsigned bits = 8 * sizeof(T);
+	const unsigned x = a * b + (1U << (bits - 1));
+	return (x + (x >> bits)) >> bits;
+}
+
+static inline unsigned
+PorterDuffFactor(int factor, unsigned alpha, unsigned max) {
+	return ((factor & 2) ? alpha : 0) ^ ((factor & 1) ? max : 0);
+}
+
+/**
+Composite a line of RGBA pixels over another one. 
+Straight alpha pixels are premultiplied, composited, then divided by the resulting alpha. 
+This is the reference of the SIMD kernels of FreeImage_CompositeLineSIMD.
+*/
+template <class T> static void
+CompositeLine(T *target, const T *source, int width, int src_factor, int dst_factor, BOOL premultiplied) {
+	const unsigned max = std::numeric_limits<T>::max();
+
+	for(int x = 0; x < width; x++, source += 4, target += 4) {
+		const unsigned as = source[FI_RGBA_ALPHA];
+		const unsigned ad = target[FI_RGBA_ALPHA];
+		unsigned ps[4], pd[4];
+		for(int c = 0; c < 4; c++) {
+			ps[c] = source[c];
+			pd[c] = target[c];
+			if(!premultiplied && (c != FI_RGBA_ALPHA)) {
+				ps[c] = MulDivChannel<T>(ps[c], as);
+				pd[c] = MulDivChannel<T>(pd[c], ad);
+			}
+		}
+
+		const unsigned fa = PorterDuffFactor(src_factor, ad, max);
+		const unsigned fb = PorterDuffFactor(dst_factor, as, max);
+		unsigned po[4];
+		for(int c = 0; c < 4; c++) {
+			po[c] = MIN(max, MulDivChannel<T>(ps[c], fa) + MulDivChannel<T>(pd[c], fb));
+		}
+
+		const unsigned ao = po[FI_RGBA_ALPHA];
+		for(int c = 0; c < 4; c++) {
+			if(premultiplied || (c == FI_RGBA_ALPHA)) {
+				target[c] = (T)po[c];
+			} else {
+				target[c] = ao ? (T)MIN(max, (unsigned)((float)po[c] * (float)max / (float)ao + 0.5f)) : (T)0;
+			}
+		}
+	}
+}
+
 // ----------------------------------------------------------
 //   FreeImage interface
 // ----------------------------------------------------------
@@ -744,6 +821,79 @@ FreeImage_Paste(FIBITMAP *dst, FIBITMAP *src, int left, int top, int alpha) {
 	return bResult;
 }
 
+/**
+Composite a source image with the destination image in place, using a Porter-Duff operator and 
+the alpha channel of both images. Both images must be 32-bit (FIT_BITMAP) images or FIT_RGBA16 images. 
+The source image may lie partially or completely outside the destination image : only the part 
+inside the destination image is processed. The source and destination images must not share pixels 
+(e.g. views of the same image) unless they are the same image pasted at (0, 0).
+@param dst Destination image
+@param src Source image
+@param left Left position of the source image in the destination image, may be negative
+@param top Top position of the source image in the destination image, may be negative
+@param op Porter-Duff operator, FIPD_SRC_OVER being the usual alpha blending
+@param premultiplied TRUE if both images hold premultiplied alpha pixels, FALSE if they hold straight alpha pixels
+@return Returns TRUE if successful, FALSE otherwise.
+@see FreeImage_PreMultiplyWithAlpha
+*/
+BOOL DLL_CALLCONV 
+FreeImage_PasteComposite(FIBITMAP *dst, FIBITMAP *src, int left, int top, FREE_IMAGE_PORTER_DUFF op, BOOL premultiplied) {
+	if(!FreeImage_HasPixels(src) || !FreeImage_HasPixels(dst)) return FALSE;
+
+	if((op < FIPD_CLEAR) || (op > FIPD_XOR)) return FALSE;
+
+	// check data type
+	const FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(dst);
+	if(image_type != FreeImage_GetImageType(src)) {
+		return FALSE;
+	}
+	if(image_type == FIT_BITMAP) {
+		if((FreeImage_GetBPP(dst) != 32) || (FreeImage_GetBPP(src) != 32)) {
+			return FALSE;
+		}
+	} else if(image_type != FIT_RGBA16) {
+		return FALSE;
+	}
+
+	// clip the source image to the destination image
+	const int src_width = (int)FreeImage_GetWidth(src);
+	const int src_height = (int)FreeImage_GetHeight(src);
+	const int dst_width = (int)FreeImage_GetWidth(dst);
+	const int dst_height = (int)FreeImage_GetHeight(dst);
+
+	const int x0 = MAX(left, 0);
+	const int y0 = MAX(top, 0);
+	const int x1 = MIN(left + src_width, dst_width);
+	const int y1 = MIN(top + src_height, dst_height);
+	if((x0 >= x1) || (y0 >= y1)) {
+		// nothing to composite
+		return TRUE;
+	}
+
+	const int width = x1 - x0;
+	const int bytespp = (image_type == FIT_BITMAP) ? 4 : 8;
+	const int src_factor = s_porter_duff_factors[op][0];
+	const int dst_factor = s_porter_duff_factors[op][1];
+
+	for(int y = y0; y < y1; y++) {
+		// (FIBITMAP are stored upside down)
+		BYTE *dst_bits = FreeImage_GetScanLine(dst, dst_height - 1 - y) + x0 * bytespp;
+		const BYTE *src_bits = FreeImage_GetScanLine(src, src_height - 1 - (y - top)) + (x0 - left) * bytespp;
+
+		const int done = FreeImage_CompositeLineSIMD(image_type, dst_bits, src_bits, width, src_factor, dst_factor, premultiplied);
+		dst_bits += done * bytespp;
+		src_bits += done * bytespp;
+
+		if(image_type == FIT_BITMAP) {
+			CompositeLine<BYTE>(dst_bits, src_bits, width - done, src_factor, dst_factor, premultiplied);
+		} else {
+			CompositeLine<WORD>((WORD*)dst_bits, (const WORD*)src_bits, width - done, src_factor, dst_factor, premultiplied);
+		}
+	}
+
+	return TRUE;
+}
+
 // ----------------------------------------------------------
 
 /** @brief Creates a dynamic read/write view into a FreeImage bitmap.
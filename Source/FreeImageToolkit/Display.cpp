@@ -23,6 +23,177 @@
 #include "Utilities.h"
 
 
+// ----------------------------------------------------------
+//   Scalar line routines, also used for the pixels left by the SIMD kernels
+// ----------------------------------------------------------
+
+/**
+Blend 32-bit foreground pixels with 32-bit background pixels : 
+output = (alpha * foreground + (255 - alpha) * background) >> 8, 
+the background being copied for alpha == 0 and the foreground for alpha == 255
+*/
+static void
+BlendBackgroundLine(BYTE *target, const BYTE *fg_bits, const BYTE *bk_bits, int width) {
+	for(int x = 0; x < width; x++, fg_bits += 4, bk_bits += 4, target += 4) {
+		const BYTE alpha = fg_bits[FI_RGBA_ALPHA];
+		if(alpha == 0) {
+			// output = background
+			target[FI_RGBA_BLUE] = bk_bits[FI_RGBA_BLUE];
+			target[FI_RGBA_GREEN] = bk_bits[FI_RGBA_GREEN];
+			target[FI_RGBA_RED] = bk_bits[FI_RGBA_RED];
+		}
+		else if(alpha == 255) {
+			// output = foreground
+			target[FI_RGBA_BLUE] = fg_bits[FI_RGBA_BLUE];
+			target[FI_RGBA_GREEN] = fg_bits[FI_RGBA_GREEN];
+			target[FI_RGBA_RED] = fg_bits[FI_RGBA_RED];
+		}
+		else {
+			// output = alpha * foreground + (1-alpha) * background
+			const BYTE not_alpha = (BYTE)~alpha;
+			target[FI_RGBA_BLUE] = (BYTE)((alpha * (WORD)fg_bits[FI_RGBA_BLUE] + not_alpha * (WORD)bk_bits[FI_RGBA_BLUE]) >> 8);
+			target[FI_RGBA_GREEN] = (BYTE)((alpha * (WORD)fg_bits[FI_RGBA_GREEN] + not_alpha * (WORD)bk_bits[FI_RGBA_GREEN]) >> 8);
+			target[FI_RGBA_RED] = (BYTE)((alpha * (WORD)fg_bits[FI_RGBA_RED] + not_alpha * (WORD)bk_bits[FI_RGBA_RED]) >> 8);
+		}
+	}
+}
+
+/**
+Fill a line of 32-bit pixels with a color
+*/
+static void
+FillLine32(BYTE *bits, int width, BYTE red, BYTE green, BYTE blue) {
+	for(int x = 0; x < width; x++, bits += 4) {
+		bits[FI_RGBA_BLUE] = blue;
+		bits[FI_RGBA_GREEN] = green;
+		bits[FI_RGBA_RED] = red;
+		bits[FI_RGBA_ALPHA] = 0xFF;
+	}
+}
+
+/**
+Multiply the color channels of RGBA pixels by their alpha, 
+as channel = (channel * alpha + max / 2) / max, max being 255 or 65535
+*/
+template <class T> static void
+PreMultiplyLine(T *bits, int width) {
+	const unsigned max = (1U << (8 * sizeof(T))) - 1;
+
+	for(int x = 0; x < width; x++, bits += 4) {
+		const unsigned alpha = bits[FI_RGBA_ALPHA];
+		if(alpha == max) {
+			// nothing to do for alpha == max
+			continue;
+		}
+		for(int c = 0; c < 4; c++) {
+			if(c != FI_RGBA_ALPHA) {
+				bits[c] = (T)((bits[c] * alpha + max / 2) / max);
+			}
+		}
+	}
+}
+
+static void
+PreMultiplyLine(FIRGBAF *bits, int width) {
+	for(int x = 0; x < width; x++, bits++) {
+		bits->red *= bits->alpha;
+		bits->green *= bits->alpha;
+		bits->blue *= bits->alpha;
+	}
+}
+
+/**
+Divide the color channels of premultiplied RGBA pixels by their alpha, 
+as channel = MIN(max, channel * max / alpha + 0.5), computed with floats. 
+Color channels of pixels whose alpha is 0 are set to 0.
+*/
+template <class T> static void
+UnPreMultiplyLine(T *bits, int width) {
+	const unsigned max = (1U << (8 * sizeof(T))) - 1;
+
+	for(int x = 0; x < width; x++, bits += 4) {
+		const unsigned alpha = bits[FI_RGBA_ALPHA];
+		for(int c = 0; c < 4; c++) {
+			if(c != FI_RGBA_ALPHA) {
+				bits[c] = alpha ? (T)MIN(max, (unsigned)((float)bits[c] * (float)max / (float)alpha + 0.5f)) : (T)0;
+			}
+		}
+	}
+}
+
+static void
+UnPreMultiplyLine(FIRGBAF *bits, int width) {
+	for(int x = 0; x < width; x++, bits++) {
+		const float alpha = bits->alpha;
+		if(alpha != 0) {
+			bits->red /= alpha;
+			bits->green /= alpha;
+			bits->blue /= alpha;
+		} else {
+			bits->red = bits->green = bits->blue = 0;
+		}
+	}
+}
+
+/**
+Premultiply (or unpremultiply) each scanline of an image, 
+with the SIMD kernels first and the scalar code for the remaining pixels
+*/
+static BOOL
+ProcessAlpha(FIBITMAP *dib, BOOL premultiply) {
+	if (!FreeImage_HasPixels(dib)) return FALSE;
+
+	const FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(dib);
+	if(image_type == FIT_BITMAP) {
+		if(FreeImage_GetBPP(dib) != 32) {
+			return FALSE;
+		}
+	} else if((image_type != FIT_RGBA16) && (image_type != FIT_RGBAF)) {
+		return FALSE;
+	}
+
+	const int width = FreeImage_GetWidth(dib);
+	const int height = FreeImage_GetHeight(dib);
+	const int bytespp = FreeImage_GetBPP(dib) / 8;
+
+	for(int y = 0; y < height; y++) {
+		BYTE *bits = FreeImage_GetScanLine(dib, y);
+		const int done = premultiply ? FreeImage_PreMultiplyLineSIMD(image_type, bits, width) : FreeImage_UnPreMultiplyLineSIMD(image_type, bits, width);
+		bits += done * bytespp;
+
+		switch(image_type) {
+			case FIT_BITMAP:
+				if(premultiply) {
+					PreMultiplyLine<BYTE>(bits, width - done);
+				} else {
+					UnPreMultiplyLine<BYTE>(bits, width - done);
+				}
+				break;
+			case FIT_RGBA16:
+				if(premultiply) {
+					PreMultiplyLine<WORD>((WORD*)bits, width - done);
+				} else {
+					UnPreMultiplyLine<WORD>((WORD*)bits, width - done);
+				}
+				break;
+			case FIT_RGBAF:
+				if(premultiply) {
+					PreMultiplyLine((FIRGBAF*)bits, width - done);
+				} else {
+					UnPreMultiplyLine((FIRGBAF*)bits, width - done);
+				}
+				break;
+			default:
+				break;
+		}
+	}
+	return TRUE;
+}
+
+// ----------------------------------------------------------
+//   FreeImage interface
+// ----------------------------------------------------------
+
 /**
 @brief Composite a foreground image against a background color or a background image.
 
@@ -57,29 +228,9 @@ FreeImage_Composite(FIBITMAP *fg, BOOL useFileBkg, RGBQUAD *appBkColor, FIBITMAP
 			return NULL;
 	}
 
-	int bytespp = (bpp == 8) ? 1 : 4;
-
-	
-	int x, y, c;
-	BYTE alpha = 0, not_alpha;
-	BYTE index;
-	RGBQUAD fgc;	// foreground color
 	RGBQUAD bkc;	// background color
-
-	memset(&fgc, 0, sizeof(RGBQUAD));
 	memset(&bkc, 0, sizeof(RGBQUAD));
 
-	// allocate the composite image
-	FIBITMAP *composite = FreeImage_Allocate(width, height, 24, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
-	if(!composite) return NULL;
-
-	// get the palette
-	RGBQUAD *pal = FreeImage_GetPalette(fg);
-
-	// retrieve the alpha table from the foreground image
-	BOOL bIsTransparent = FreeImage_IsTransparent(fg);
-	BYTE *trns = FreeImage_GetTransparencyTable(fg);
-
 	// retrieve the background color from the foreground image
 	BOOL bHasBkColor = FALSE;
 
@@ -99,85 +250,78 @@ FreeImage_Composite(FIBITMAP *fg, BOOL useFileBkg, RGBQUAD *appBkColor, FIBITMAP
 		}
 	}
 
-	for(y = 0; y < height; y++) {
-		// foreground
-		BYTE *fg_bits = FreeImage_GetScanLine(fg, y);
-		// background
-		BYTE *bg_bits = FreeImage_GetScanLine(bg, y);
-		// composite image
-		BYTE *cp_bits = FreeImage_GetScanLine(composite, y);
+	// 32-bit working lines : foreground (8-bit images), background (two lines for the checkerboard) and result
+	BYTE *lines = (BYTE*)malloc(4 * width * 4 * sizeof(BYTE));
+	if(!lines) return NULL;
+	BYTE *fg_line = lines;
+	BYTE *bk_lines[2] = { lines + width * 4, lines + 2 * width * 4 };
+	BYTE *cp_line = lines + 3 * width * 4;
 
-		for(x = 0; x < width; x++) {
+	// allocate the composite image
+	FIBITMAP *composite = FreeImage_Allocate(width, height, 24, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK);
+	if(!composite) {
+		free(lines);
+		return NULL;
+	}
 
-			// foreground color + alpha
+	// foreground color and alpha of each palette index (8-bit images)
+	BYTE fg_table[256 * 4];
+	if(bpp == 8) {
+		RGBQUAD *pal = FreeImage_GetPalette(fg);
+		BOOL bIsTransparent = FreeImage_IsTransparent(fg);
+		BYTE *trns = FreeImage_GetTransparencyTable(fg);
 
-			if(bpp == 8) {
-				// get the foreground color
-				index = fg_bits[0];
-				memcpy(&fgc, &pal[index], sizeof(RGBQUAD));
-				// get the alpha
-				if(bIsTransparent) {
-					alpha = trns[index];
-				} else {
-					alpha = 255;
-				}
-			}
-			else if(bpp == 32) {
-				// get the foreground color
-				fgc.rgbBlue  = fg_bits[FI_RGBA_BLUE];
-				fgc.rgbGreen = fg_bits[FI_RGBA_GREEN];
-				fgc.rgbRed   = fg_bits[FI_RGBA_RED];
-				// get the alpha
-				alpha = fg_bits[FI_RGBA_ALPHA];
-			}
+		for(int i = 0; i < 256; i++) {
+			BYTE *entry = fg_table + 4 * i;
+			entry[FI_RGBA_BLUE] = pal[i].rgbBlue;
+			entry[FI_RGBA_GREEN] = pal[i].rgbGreen;
+			entry[FI_RGBA_RED] = pal[i].rgbRed;
+			entry[FI_RGBA_ALPHA] = bIsTransparent ? trns[i] : 0xFF;
+		}
+	}
 
-			// background color
+	// background color, or checkerboard pattern used when there is no background
+	if(bHasBkColor) {
+		FillLine32(bk_lines[0], width, bkc.rgbRed, bkc.rgbGreen, bkc.rgbBlue);
+	} else if(!bg) {
+		// 8x8 squares, rows with (y & 0x8) == 0 in bk_lines[0]
+		for(int x = 0; x < width; x++) {
+			const BYTE c0 = ((x & 0x8) == 0) ? 255 : 192;
+			const BYTE c1 = ((x & 0x8) == 0) ? 192 : 255;
+			FillLine32(bk_lines[0] + 4 * x, 1, c0, c0, c0);
+			FillLine32(bk_lines[1] + 4 * x, 1, c1, c1, c1);
+		}
+	}
 
-			if(!bHasBkColor) {
-				if(bg) {
-					// get the background color from the background image
-					bkc.rgbBlue  = bg_bits[FI_RGBA_BLUE];
-					bkc.rgbGreen = bg_bits[FI_RGBA_GREEN];
-					bkc.rgbRed   = bg_bits[FI_RGBA_RED];
-				}
-				else {
-					// use a checkerboard pattern
-					c = (((y & 0x8) == 0) ^ ((x & 0x8) == 0)) * 192;
-					c = c ? c : 255;
-					bkc.rgbBlue  = (BYTE)c;
-					bkc.rgbGreen = (BYTE)c;
-					bkc.rgbRed   = (BYTE)c;
-				}
+	for(int y = 0; y < height; y++) {
+		// foreground
+		BYTE *fg_bits = FreeImage_GetScanLine(fg, y);
+		if(bpp == 8) {
+			for(int x = 0; x < width; x++) {
+				memcpy(fg_line + 4 * x, fg_table + 4 * fg_bits[x], 4);
 			}
+			fg_bits = fg_line;
+		}
 
-			// composition
-
-			if(alpha == 0) {
-				// output = background
-				cp_bits[FI_RGBA_BLUE] = bkc.rgbBlue;
-				cp_bits[FI_RGBA_GREEN] = bkc.rgbGreen;
-				cp_bits[FI_RGBA_RED] = bkc.rgbRed;
-			}
-			else if(alpha == 255) {
-				// output = foreground
-				cp_bits[FI_RGBA_BLUE] = fgc.rgbBlue;
-				cp_bits[FI_RGBA_GREEN] = fgc.rgbGreen;
-				cp_bits[FI_RGBA_RED] = fgc.rgbRed;
-			}
-			else {
-				// output = alpha * foreground + (1-alpha) * background
-				not_alpha = (BYTE)~alpha;
-				cp_bits[FI_RGBA_BLUE] = (BYTE)((alpha * (WORD)fgc.rgbBlue  + not_alpha * (WORD)bkc.rgbBlue) >> 8);
-				cp_bits[FI_RGBA_GREEN] = (BYTE)((alpha * (WORD)fgc.rgbGreen + not_alpha * (WORD)bkc.rgbGreen) >> 8);
-				cp_bits[FI_RGBA_RED] = (BYTE)((alpha * (WORD)fgc.rgbRed   + not_alpha * (WORD)bkc.rgbRed) >> 8);
+		// background
+		BYTE *bk_bits = bk_lines[0];
+		if(!bHasBkColor) {
+			if(bg) {
+				FreeImage_ConvertLine24To32(bk_bits, FreeImage_GetScanLine(bg, y), width);
+			} else {
+				bk_bits = bk_lines[(y & 0x8) ? 1 : 0];
 			}
-
-			fg_bits += bytespp;
-			bg_bits += 3;
-			cp_bits += 3;
 		}
+
+		// composition
+		const int done = FreeImage_BlendBackgroundLineSIMD(cp_line, fg_bits, bk_bits, width);
+		BlendBackgroundLine(cp_line + 4 * done, fg_bits + 4 * done, bk_bits + 4 * done, width - done);
+
+		FreeImage_ConvertLine32To24(FreeImage_GetScanLine(composite, y), cp_line, width);
 	}
 
+	free(lines);
+
 	// copy metadata from src to dst
 	FreeImage_CloneMetadata(composite, fg);
 	
@@ -189,42 +333,28 @@ Pre-multiplies a 32-bit image's red-, green- and blue channels with it's alpha c
 for to be used with e.g. the Windows GDI function AlphaBlend(). 
 The transformation changes the red-, green- and blue channels according to the following equation:  
 channel(x, y) = channel(x, y) * alpha_channel(x, y) / 255  
+FIT_RGBA16 images (channel * alpha / 65535) and FIT_RGBAF images (channel * alpha) are also supported.
 @param dib Input/Output dib to be premultiplied
 @return Returns TRUE on success, FALSE otherwise (e.g. when the bitdepth of the source dib cannot be handled). 
+@see FreeImage_UnPreMultiplyWithAlpha
 */
 BOOL DLL_CALLCONV 
 FreeImage_PreMultiplyWithAlpha(FIBITMAP *dib) {
-	if (!FreeImage_HasPixels(dib)) return FALSE;
-	
-	if ((FreeImage_GetBPP(dib) != 32) || (FreeImage_GetImageType(dib) != FIT_BITMAP)) {
-		return FALSE;
-	}
-
-	int width = FreeImage_GetWidth(dib);
-	int height = FreeImage_GetHeight(dib);
-
-	for(int y = 0; y < height; y++) {
-		BYTE *bits = FreeImage_GetScanLine(dib, y);
-		for (int x = 0; x < width; x++, bits += 4) {
-			const BYTE alpha = bits[FI_RGBA_ALPHA];
-			// slightly faster: care for two special cases
-			if(alpha == 0x00) {
-				// special case for alpha == 0x00
-				// color * 0x00 / 0xFF = 0x00
-				bits[FI_RGBA_BLUE] = 0x00;
-				bits[FI_RGBA_GREEN] = 0x00;
-				bits[FI_RGBA_RED] = 0x00;
-			} else if(alpha == 0xFF) {
-				// nothing to do for alpha == 0xFF
-				// color * 0xFF / 0xFF = color
-				continue;
-			} else {
-				bits[FI_RGBA_BLUE] = (BYTE)( (alpha * (WORD)bits[FI_RGBA_BLUE] + 127) / 255 );
-				bits[FI_RGBA_GREEN] = (BYTE)( (alpha * (WORD)bits[FI_RGBA_GREEN] + 127) / 255 );
-				bits[FI_RGBA_RED] = (BYTE)( (alpha * (WORD)bits[FI_RGBA_RED] + 127) / 255 );
-			}
-		}
-	}
-	return TRUE;
+	return ProcessAlpha(dib, TRUE);
 }
 
+/**
+Reverts FreeImage_PreMultiplyWithAlpha : divides the red-, green- and blue channels of a 32-bit, 
+FIT_RGBA16 or FIT_RGBAF image by its alpha channel, according to the following equation:  
+channel(x, y) = channel(x, y) * 255 / alpha_channel(x, y) (65535 for FIT_RGBA16 images, 1 for FIT_RGBAF images)  
+The result is rounded and clamped to the channel range. Channels of fully transparent pixels are set to 0. 
+The colors of translucent pixels are only recovered approximately, 
+the precision lost by the premultiplication growing as alpha decreases.
+@param dib Input/Output dib to be unpremultiplied
+@return Returns TRUE on success, FALSE otherwise (e.g. when the bitdepth of the source dib cannot be handled). 
+@see FreeImage_PreMultiplyWithAlpha
+*/
+BOOL DLL_CALLCONV 
+FreeImage_UnPreMultiplyWithAlpha(FIBITMAP *dib) {
+	return ProcessAlpha(dib, FALSE);
+}
@@ -24,6 +24,141 @@
 #include "FreeImage.h"
 #include "Utilities.h"
 
+// ----------------------------------------------------------
+//   Pixel transposition and mirroring
+//   (shared by the flip, right-angle rotation and Exif orientation code)
+// ----------------------------------------------------------
+
+/**
+Transpose pixels one at a time, with the pixel size known at compile time.
+The source rectangle [x_begin, x_end) x [y_begin, y_end) is processed one destination line at a time.
+Parameter T is a pixel type of the requested size (BYTE, WORD, RGBTRIPLE, ...).
+@see TransposePixels
+*/
+template <class T> static void
+TransposeScalarT(BYTE *dst, int dst_pitch, const BYTE *src, int src_pitch, unsigned x_begin, unsigned x_end, unsigned y_begin, unsigned y_end) {
+	for(unsigned x = x_begin; x < x_end; x++) {
+		T *dst_bits = (T*)(dst + (ptrdiff_t)x * dst_pitch) + y_begin;
+		const BYTE *src_bits = src + (ptrdiff_t)y_begin * src_pitch + x * sizeof(T);
+		for(unsigned y = y_begin; y < y_end; y++) {
+			*dst_bits++ = *(const T*)src_bits;
+			src_bits += src_pitch;
+		}
+	}
+}
+
+static void
+TransposeScalar(BYTE *dst, int dst_pitch, const BYTE *src, int src_pitch, unsigned x_begin, unsigned x_end, unsigned y_begin, unsigned y_end, unsigned bytespp) {
+	switch(bytespp) {
+		case 1:
+			TransposeScalarT<BYTE>(dst, dst_pitch, src, src_pitch, x_begin, x_end, y_begin, y_end);
+			break;
+		case 2:
+			TransposeScalarT<WORD>(dst, dst_pitch, src, src_pitch, x_begin, x_end, y_begin, y_end);
+			break;
+		case 3:
+			TransposeScalarT<RGBTRIPLE>(dst, dst_pitch, src, src_pitch, x_begin, x_end, y_begin, y_end);
+			break;
+		case 4:
+			TransposeScalarT<DWORD>(dst, dst_pitch, src, src_pitch, x_begin, x_end, y_begin, y_end);
+			break;
+		case 6:
+			TransposeScalarT<FIRGB16>(dst, dst_pitch, src, src_pitch, x_begin, x_end, y_begin, y_end);
+			break;
+		case 8:
+			TransposeScalarT<FIRGBA16>(dst, dst_pitch, src, src_pitch, x_begin, x_end, y_begin, y_end);
+			break;
+		case 12:
+			TransposeScalarT<FIRGBF>(dst, dst_pitch, src, src_pitch, x_begin, x_end, y_begin, y_end);
+			break;
+		case 16:
+			TransposeScalarT<FIRGBAF>(dst, dst_pitch, src, src_pitch, x_begin, x_end, y_begin, y_end);
+			break;
+	}
+}
+
+/**
+Transpose a tile small enough to stay in the cache
+@see TransposePixels
+*/
+static void
+TransposeTile(BYTE *dst, int dst_pitch, const BYTE *src, int src_pitch, unsigned width, unsigned height, unsigned bytespp) {
+	// transpose most of the tile by square blocks with the SIMD kernel of the pixel size
+	const unsigned block = (unsigned)FreeImage_TransposeTileSIMD(dst, dst_pitch, src, src_pitch, (int)width, (int)height, bytespp);
+	const unsigned block_width  = block ? width - (width % block) : 0;
+	const unsigned block_height = block ? height - (height % block) : 0;
+
+	// remaining pixels : right border of the tile, then bottom border
+	TransposeScalar(dst, dst_pitch, src, src_pitch, block_width, width, 0, height, bytespp);
+	TransposeScalar(dst, dst_pitch, src, src_pitch, 0, block_width, block_height, height, bytespp);
+}
+
+void
+TransposePixels(BYTE *dst, int dst_pitch, const BYTE *src, int src_pitch, unsigned width, unsigned height, unsigned bytespp) {
+	// tiles of at most 16 KB for the source and destination pixels, so that the lines of a tile
+	// stay in the cache and the TLB while the tile is transposed
+	const unsigned tile = (bytespp <= 4) ? 64 : 32;
+
+	for(unsigned y = 0; y < height; y += tile) {
+		for(unsigned x = 0; x < width; x += tile) {
+			const BYTE *src_bits = src + (ptrdiff_t)y * src_pitch + x * bytespp;
+			BYTE *dst_bits = dst + (ptrdiff_t)x * dst_pitch + y * bytespp;
+
+			TransposeTile(dst_bits, dst_pitch, src_bits, src_pitch, MIN(tile, width - x), MIN(tile, height - y), bytespp);
+		}
+	}
+}
+
+/**
+Reverse pixels one at a time, with the pixel size known at compile time
+@see ReversePixels
+*/
+template <class T> static void
+ReverseScalarT(BYTE *dst, const BYTE *src, unsigned x_begin, unsigned width) {
+	T *dst_bits = (T*)dst + (width - 1 - x_begin);
+	const T *src_bits = (const T*)src + x_begin;
+	for(unsigned x = x_begin; x < width; x++) {
+		*dst_bits-- = *src_bits++;
+	}
+}
+
+void
+ReversePixels(BYTE *dst, const BYTE *src, unsigned width, unsigned bytespp) {
+	// leading pixels with the SIMD kernel of the pixel size, written at the end of the destination line
+	const unsigned x = (unsigned)FreeImage_ReverseLineSIMD(dst, src, (int)width, bytespp);
+
+	if(x < width) {
+		switch(bytespp) {
+			case 1:
+				ReverseScalarT<BYTE>(dst, src, x, width);
+				break;
+			case 2:
+				ReverseScalarT<WORD>(dst, src, x, width);
+				break;
+			case 3:
+				ReverseScalarT<RGBTRIPLE>(dst, src, x, width);
+				break;
+			case 4:
+				ReverseScalarT<DWORD>(dst, src, x, width);
+				break;
+			case 6:
+				ReverseScalarT<FIRGB16>(dst, src, x, width);
+				break;
+			case 8:
+				ReverseScalarT<FIRGBA16>(dst, src, x, width);
+				break;
+			case 12:
+				ReverseScalarT<FIRGBF>(dst, src, x, width);
+				break;
+			case 16:
+				ReverseScalarT<FIRGBAF>(dst, src, x, width);
+				break;
+		}
+	}
+}
+
+// ----------------------------------------------------------
+
 /**
 Flip the image horizontally along the vertical axis.
 @param src Input image to be processed.
@@ -64,55 +199,33 @@ FreeImage_FlipHorizontal(FIBITMAP *src) {
 
 			case 4 :
 			{
-				for(unsigned c = 0; c < line; c++) {
-					bits[c] = new_bits[line - c - 1];
-
-					BYTE nibble = (bits[c] & 0xF0) >> 4;
-
-					bits[c] = bits[c] << 4;
-					bits[c] |= nibble;
-				}
-			}
-			break;
-
-			case 8:
-			{				
-				BYTE *dst_data = (BYTE*) bits; 				
-				BYTE *src_data = (BYTE*) (new_bits + line - bytespp); 				
-				for(unsigned c = 0; c < width; c++) { 			
-					*dst_data++ = *src_data--;  
-				} 
-			}
-			break;
+				if((width & 1) == 0) {
+					// reverse the bytes, then swap the nibbles of each byte
+					for(unsigned c = 0; c < line; c++) {
+						bits[c] = new_bits[line - c - 1];
 
-			case 16:
-			{				
-				WORD *dst_data = (WORD*) bits; 				
-				WORD *src_data = (WORD*) (new_bits + line - bytespp); 				
-				for(unsigned c = 0; c < width; c++) { 			
-					*dst_data++ = *src_data--;  
-				} 
-			}
-			break;
+						BYTE nibble = (bits[c] & 0xF0) >> 4;
 
-			case 24 :
-			case 32 :
-			case 48:
-			case 64:
-			case 96:
-			case 128:
-			{				
-				BYTE *dst_data = (BYTE*) bits; 				
-				BYTE *src_data = (BYTE*) (new_bits + line - bytespp); 				
-				for(unsigned c = 0; c < width; c++) { 		
-					for(unsigned k = 0; k < bytespp; k++) {
-						*dst_data++ = src_data[k];  
+						bits[c] = bits[c] << 4;
+						bits[c] |= nibble;
+					}
+				} else {
+					// odd width : the last byte holds a padding nibble, which must stay at the end of the line
+					for(unsigned x = 0; x < width; x++) {
+						// get pixel at (x, y)
+						const BYTE value = (x & 1) ? (new_bits[x >> 1] & 0x0F) : (new_bits[x >> 1] >> 4);
+						// set pixel at (new_x, y)
+						const unsigned new_x = width - 1 - x;
+						BYTE *dst_bits = &bits[new_x >> 1];
+						*dst_bits = (new_x & 1) ? (BYTE)((*dst_bits & 0xF0) | value) : (BYTE)((*dst_bits & 0x0F) | (value << 4));
 					}
-					src_data -= bytespp;
-				} 
+				}
 			}
 			break;
 
+			default:
+				ReversePixels(bits, new_bits, width, bytespp);
+				break;
 		}
 	}
 
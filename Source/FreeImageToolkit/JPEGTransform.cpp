@@ -63,9 +63,7 @@ ls_jpeg_error_exit (j_common_ptr cinfo) {
 	// allow JPEG with a premature end of file
 	if((cinfo)->err->msg_parm.i[0] != 13) {
 
-		// let the memory manager delete any temp files before we die
-		jpeg_destroy(cinfo);
-
+		// the caller releases or resets the objects, which may be reused
 		throw FIF_JPEG;
 	}
 }
@@ -84,6 +82,150 @@ ls_jpeg_output_message (j_common_ptr cinfo) {
 	FreeImage_OutputMessageProc(FIF_JPEG, buffer);
 }
 
+// ----------------------------------------------------------
+//   In-place memory source manager
+// ----------------------------------------------------------
+
+/**
+Source manager reading a memory stream in place, without copying it to a buffer
+*/
+typedef struct tagMemorySourceManager {
+	//! public fields
+	struct jpeg_source_mgr pub;
+	//! first byte of the JPEG stream
+	const JOCTET *data;
+	//! size of the JPEG stream
+	size_t size;
+	//! TRUE when the reader went past the end of the stream
+	BOOL eof;
+} MemorySourceManager;
+
+METHODDEF(void)
+mem_init_source (j_decompress_ptr cinfo) {
+}
+
+/**
+	The whole stream is already in memory: being called means that the input
+	is truncated. Insert a fake EOI marker, as the standard source managers do.
+*/
+METHODDEF(boolean)
+mem_fill_input_buffer (j_decompress_ptr cinfo) {
+	static const JOCTET fake_eoi[2] = { (JOCTET)0xFF, (JOCTET)JPEG_EOI };
+
+	MemorySourceManager *src = (MemorySourceManager*)cinfo->src;
+
+	WARNMS(cinfo, JWRN_JPEG_EOF);
+
+	src->pub.next_input_byte = fake_eoi;
+	src->pub.bytes_in_buffer = 2;
+	src->eof = TRUE;
+
+	return TRUE;
+}
+
+METHODDEF(void)
+mem_skip_input_data (j_decompress_ptr cinfo, long num_bytes) {
+	MemorySourceManager *src = (MemorySourceManager*)cinfo->src;
+
+	if(num_bytes > 0) {
+		if((size_t)num_bytes > src->pub.bytes_in_buffer) {
+			mem_fill_input_buffer(cinfo);
+		} else {
+			src->pub.next_input_byte += (size_t)num_bytes;
+			src->pub.bytes_in_buffer -= (size_t)num_bytes;
+		}
+	}
+}
+
+METHODDEF(void)
+mem_term_source (j_decompress_ptr cinfo) {
+}
+
+/**
+Read the remaining part of a memory stream in place
+*/
+static void
+jpeg_memory_src(j_decompress_ptr cinfo, MemorySourceManager *src, FIMEMORY *stream) {
+	FIMEMORYHEADER *mem_header = (FIMEMORYHEADER*)(stream->data);
+	const long position = MIN(mem_header->current_position, mem_header->file_length);
+
+	src->pub.init_source = mem_init_source;
+	src->pub.fill_input_buffer = mem_fill_input_buffer;
+	src->pub.skip_input_data = mem_skip_input_data;
+	src->pub.resync_to_restart = jpeg_resync_to_restart; // use default method
+	src->pub.term_source = mem_term_source;
+	src->data = (const JOCTET*)mem_header->data + position;
+	src->size = (size_t)(mem_header->file_length - position);
+	src->pub.next_input_byte = src->data;
+	src->pub.bytes_in_buffer = src->size;
+	src->eof = FALSE;
+
+	cinfo->src = &src->pub;
+}
+
+/**
+Move the read position of a memory stream after the bytes consumed by the decoder
+*/
+static void
+jpeg_memory_src_sync(MemorySourceManager *src, FIMEMORY *stream) {
+	FIMEMORYHEADER *mem_header = (FIMEMORYHEADER*)(stream->data);
+	const size_t consumed = src->eof ? src->size : (size_t)(src->pub.next_input_byte - src->data);
+
+	mem_header->current_position = (long)((const BYTE*)src->data + consumed - (const BYTE*)mem_header->data);
+}
+
+// ----------------------------------------------------------
+//   Transformation context
+// ----------------------------------------------------------
+
+/**
+libjpeg objects used by a transformation. 
+They are created once and reset between images, so that a batch of 
+transformations reuses the same memory pools and managers.
+*/
+typedef struct tagJPEGTransformer {
+	jpeg_decompress_struct srcinfo;
+	jpeg_compress_struct dstinfo;
+	jpeg_error_mgr jsrcerr;
+	jpeg_error_mgr jdsterr;
+	//! source manager used by the FreeImageIO source (allocated by libjpeg)
+	struct jpeg_source_mgr *io_src;
+	//! source manager used by the memory source
+	MemorySourceManager mem_src;
+} JPEGTransformer;
+
+static BOOL
+CreateTransformer(JPEGTransformer *transformer) {
+	memset(transformer, 0, sizeof(JPEGTransformer));
+
+	try {
+		// Initialize the JPEG decompression object with default error handling
+		transformer->srcinfo.err = jpeg_std_error(&transformer->jsrcerr);
+		transformer->srcinfo.err->error_exit = ls_jpeg_error_exit;
+		transformer->srcinfo.err->output_message = ls_jpeg_output_message;
+		jpeg_create_decompress(&transformer->srcinfo);
+
+		// Initialize the JPEG compression object with default error handling
+		transformer->dstinfo.err = jpeg_std_error(&transformer->jdsterr);
+		transformer->dstinfo.err->error_exit = ls_jpeg_error_exit;
+		transformer->dstinfo.err->output_message = ls_jpeg_output_message;
+		jpeg_create_compress(&transformer->dstinfo);
+	}
+	catch(...) {
+		jpeg_destroy_compress(&transformer->dstinfo);
+		jpeg_destroy_decompress(&transformer->srcinfo);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+DestroyTransformer(JPEGTransformer *transformer) {
+	jpeg_destroy_compress(&transformer->dstinfo);
+	jpeg_destroy_decompress(&transformer->srcinfo);
+}
+
 // ----------------------------------------------------------
 //   Main program
 // ----------------------------------------------------------
@@ -148,18 +290,72 @@ getCropString(char* crop, int* left, int* top, int* right, int* bottom, int widt
 	return TRUE;
 }
 
+/**
+Mapping of each lossless operation, as a 2x2 matrix {a, b, c, d} acting on pixel 
+coordinates relative to the image center (x' = a.x + b.y, y' = c.x + d.y, y axis pointing down)
+*/
+static const int JPEG_OPERATION_MATRIX[8][4] = {
+	{  1,  0,  0,  1 },	// FIJPEG_OP_NONE
+	{ -1,  0,  0,  1 },	// FIJPEG_OP_FLIP_H
+	{  1,  0,  0, -1 },	// FIJPEG_OP_FLIP_V
+	{  0,  1,  1,  0 },	// FIJPEG_OP_TRANSPOSE
+	{  0, -1, -1,  0 },	// FIJPEG_OP_TRANSVERSE
+	{  0, -1,  1,  0 },	// FIJPEG_OP_ROTATE_90
+	{ -1,  0,  0, -1 },	// FIJPEG_OP_ROTATE_180
+	{  0,  1, -1,  0 }	// FIJPEG_OP_ROTATE_270
+};
+
+/**
+Reduce a sequence of rotations and flips to the single equivalent operation, 
+so that the coefficients are transformed only once. 
+Unknown operations are treated as FIJPEG_OP_NONE.
+
+@param operations Operations, in the order they are applied
+@param count Number of operations
+@return Returns the equivalent operation
+*/
+static FREE_IMAGE_JPEG_OPERATION
+composeOperations(const FREE_IMAGE_JPEG_OPERATION *operations, int count) {
+	int m[4] = { 1, 0, 0, 1 };
+
+	for(int i = 0; i < count; i++) {
+		const int op = (int)operations[i];
+		if((op < FIJPEG_OP_NONE) || (op > FIJPEG_OP_ROTATE_270)) {
+			continue;
+		}
+		const int *t = JPEG_OPERATION_MATRIX[op];
+		const int r[4] = {
+			t[0] * m[0] + t[1] * m[2], t[0] * m[1] + t[1] * m[3],
+			t[2] * m[0] + t[3] * m[2], t[2] * m[1] + t[3] * m[3]
+		};
+		memcpy(m, r, sizeof(m));
+	}
+
+	for(int op = FIJPEG_OP_NONE; op <= FIJPEG_OP_ROTATE_270; op++) {
+		if(memcmp(m, JPEG_OPERATION_MATRIX[op], sizeof(m)) == 0) {
+			return (FREE_IMAGE_JPEG_OPERATION)op;
+		}
+	}
+
+	return FIJPEG_OP_NONE;
+}
+
+/**
+Apply a lossless transformation, an optional crop and the FIJPEG_xxx options to a JPEG stream, 
+in a single pass over the DCT coefficients. 
+The libjpeg objects of the transformer are left ready for the next image, even on failure.
+*/
 static BOOL
-JPEGTransformFromHandle(FreeImageIO* src_io, fi_handle src_handle, FreeImageIO* dst_io, fi_handle dst_handle, FREE_IMAGE_JPEG_OPERATION operation, int* left, int* top, int* right, int* bottom, BOOL perfect) {
+JPEGTransformWith(JPEGTransformer *transformer, FreeImageIO* src_io, fi_handle src_handle, FreeImageIO* dst_io, fi_handle dst_handle, FREE_IMAGE_JPEG_OPERATION operation, int* left, int* top, int* right, int* bottom, int flags) {
 	const BOOL onlyReturnCropRect = (dst_io == NULL) || (dst_handle == NULL);
 	const long stream_start = onlyReturnCropRect ? 0 : dst_io->tell_proc(dst_handle);
 	BOOL swappedDim = FALSE;
 	BOOL trimH = FALSE;
 	BOOL trimV = FALSE;
 
-	// Set up the jpeglib structures
-	jpeg_decompress_struct srcinfo;
-	jpeg_compress_struct dstinfo;
-	jpeg_error_mgr jsrcerr, jdsterr;
+	// Use the jpeglib structures of the transformer
+	jpeg_decompress_struct &srcinfo = transformer->srcinfo;
+	jpeg_compress_struct &dstinfo = transformer->dstinfo;
 	jvirt_barray_ptr *src_coef_arrays = NULL;
 	jvirt_barray_ptr *dst_coef_arrays = NULL;
 	// Support for copying optional markers from source to destination file
@@ -167,18 +363,19 @@ JPEGTransformFromHandle(FreeImageIO* src_io, fi_handle src_handle, FreeImageIO*
 	// Image transformation options
 	jpeg_transform_info transfoptions;
 
+	// Memory streams are decoded in place
+	FreeImageIO mem_io;
+	SetMemoryIO(&mem_io);
+	const BOOL isMemorySource = (src_io->read_proc == mem_io.read_proc) ? TRUE : FALSE;
+
 	// Initialize structures
-	memset(&srcinfo, 0, sizeof(srcinfo));
-	memset(&jsrcerr, 0, sizeof(jsrcerr));
-	memset(&jdsterr, 0, sizeof(jdsterr));
-	memset(&dstinfo, 0, sizeof(dstinfo));
 	memset(&transfoptions, 0, sizeof(transfoptions));
 
 	// Copy all extra markers from source file
 	copyoption = JCOPYOPT_ALL;
 
 	// Set up default JPEG parameters
-	transfoptions.force_grayscale = FALSE;
+	transfoptions.force_grayscale = (flags & FIJPEG_GRAYSCALE) ? TRUE : FALSE;
 	transfoptions.crop = FALSE;
 
 	// Select the transform option
@@ -222,26 +419,20 @@ JPEGTransformFromHandle(FreeImageIO* src_io, fi_handle src_handle, FreeImageIO*
 			break;
 	}
 	// (perfect == TRUE) ==> fail if there is non-transformable edge blocks
-	transfoptions.perfect = (perfect == TRUE) ? TRUE : FALSE;
+	transfoptions.perfect = (flags & FIJPEG_PERFECT) ? TRUE : FALSE;
 	// Drop non-transformable edge blocks: trim off any partial edge MCUs that the transform can't handle.
 	transfoptions.trim = TRUE;
 
 	try {
 
-		// Initialize the JPEG decompression object with default error handling
-		srcinfo.err = jpeg_std_error(&jsrcerr);
-		srcinfo.err->error_exit = ls_jpeg_error_exit;
-		srcinfo.err->output_message = ls_jpeg_output_message;
-		jpeg_create_decompress(&srcinfo);
-
-		// Initialize the JPEG compression object with default error handling
-		dstinfo.err = jpeg_std_error(&jdsterr);
-		dstinfo.err->error_exit = ls_jpeg_error_exit;
-		dstinfo.err->output_message = ls_jpeg_output_message;
-		jpeg_create_compress(&dstinfo);
-
 		// Specify data source for decompression
-		jpeg_freeimage_src(&srcinfo, src_handle, src_io);
+		if(isMemorySource) {
+			jpeg_memory_src(&srcinfo, &transformer->mem_src, (FIMEMORY*)src_handle);
+		} else {
+			srcinfo.src = transformer->io_src;
+			jpeg_freeimage_src(&srcinfo, src_handle, src_io);
+			transformer->io_src = srcinfo.src;
+		}
 
 		// Enable saving of extra markers that we want to copy
 		jcopy_markers_setup(&srcinfo, copyoption);
@@ -309,8 +500,7 @@ JPEGTransformFromHandle(FreeImageIO* src_io, fi_handle src_handle, FreeImageIO*
 		// if only the crop rect is requested, we are done
 
 		if(onlyReturnCropRect) {
-			jpeg_destroy_compress(&dstinfo);
-			jpeg_destroy_decompress(&srcinfo);
+			jpeg_abort_decompress(&srcinfo);
 			return TRUE;
 		}
 
@@ -324,6 +514,14 @@ JPEGTransformFromHandle(FreeImageIO* src_io, fi_handle src_handle, FreeImageIO*
 		// also find out which set of coefficient arrays will hold the output
 		dst_coef_arrays = jtransform_adjust_parameters(&srcinfo, &dstinfo, src_coef_arrays, &transfoptions);
 
+		// Entropy coding options of the re-encoded stream
+		if(flags & FIJPEG_OPTIMIZE) {
+			dstinfo.optimize_coding = TRUE;
+		}
+		if(flags & FIJPEG_PROGRESSIVE) {
+			jpeg_simple_progression(&dstinfo);
+		}
+
 		// Note: we assume that jpeg_read_coefficients consumed all input
 		// until JPEG_REACHED_EOI, and that jpeg_finish_decompress will
 		// only consume more while (! cinfo->inputctl->eoi_reached).
@@ -332,6 +530,8 @@ JPEGTransformFromHandle(FreeImageIO* src_io, fi_handle src_handle, FreeImageIO*
 
 		if(src_handle == dst_handle) {
 			dst_io->seek_proc(dst_handle, stream_start, SEEK_SET);
+		} else if(isMemorySource) {
+			jpeg_memory_src_sync(&transformer->mem_src, (FIMEMORY*)src_handle);
 		}
 
 		// Specify data destination for compression
@@ -346,22 +546,36 @@ JPEGTransformFromHandle(FreeImageIO* src_io, fi_handle src_handle, FreeImageIO*
 		// Execute image transformation, if any
 		jtransform_execute_transformation(&srcinfo, &dstinfo, src_coef_arrays, &transfoptions);
 
-		// Finish compression and release memory
+		// Finish compression and release the image memory
 		jpeg_finish_compress(&dstinfo);
-		jpeg_destroy_compress(&dstinfo);
 		jpeg_finish_decompress(&srcinfo);
-		jpeg_destroy_decompress(&srcinfo);
 
 	}
 	catch(...) {
-		jpeg_destroy_compress(&dstinfo);
-		jpeg_destroy_decompress(&srcinfo);
+		jpeg_abort_compress(&dstinfo);
+		jpeg_abort_decompress(&srcinfo);
 		return FALSE;
 	}
 
 	return TRUE;
 }
 
+static BOOL
+JPEGTransformFromHandle(FreeImageIO* src_io, fi_handle src_handle, FreeImageIO* dst_io, fi_handle dst_handle, FREE_IMAGE_JPEG_OPERATION operation, int* left, int* top, int* right, int* bottom, BOOL perfect) {
+	JPEGTransformer transformer;
+
+	if(!CreateTransformer(&transformer)) {
+		return FALSE;
+	}
+
+	const BOOL bResult = JPEGTransformWith(&transformer, src_io, src_handle, dst_io, dst_handle, operation, left, top, right, bottom, (perfect == TRUE) ? FIJPEG_PERFECT : 0);
+
+	DestroyTransformer(&transformer);
+
+	return bResult;
+}
+
+
 // ----------------------------------------------------------
 //   FreeImage interface
 // ----------------------------------------------------------
@@ -621,3 +835,86 @@ FreeImage_JPEGTransformCombinedFromMemory(FIMEMORY* src_stream, FIMEMORY* dst_st
 	return FreeImage_JPEGTransformFromHandle(&io, src, &io, dst, operation, left, top, right, bottom, perfect);
 }
 
+// --------------------------------------------------------------------------
+
+/**
+Create a transformation context for FreeImage_JPEGTransformEx. 
+Reusing the context over a batch of images avoids the creation and destruction 
+of the libjpeg decompression and compression objects for each image.
+@return Returns the new context if successful, returns NULL otherwise
+*/
+FIJPEGTRANSFORMER * DLL_CALLCONV
+FreeImage_JPEGOpenTransformer() {
+	FIJPEGTRANSFORMER *transformer = (FIJPEGTRANSFORMER*)malloc(sizeof(FIJPEGTRANSFORMER));
+	if(transformer) {
+		transformer->data = malloc(sizeof(JPEGTransformer));
+		if(transformer->data && CreateTransformer((JPEGTransformer*)transformer->data)) {
+			return transformer;
+		}
+		free(transformer->data);
+		free(transformer);
+	}
+	FreeImage_OutputMessageProc(FIF_JPEG, FI_MSG_ERROR_MEMORY);
+	return NULL;
+}
+
+/**
+Release a context created by FreeImage_JPEGOpenTransformer
+*/
+void DLL_CALLCONV
+FreeImage_JPEGCloseTransformer(FIJPEGTRANSFORMER *transformer) {
+	if(transformer) {
+		if(transformer->data) {
+			DestroyTransformer((JPEGTransformer*)transformer->data);
+			free(transformer->data);
+		}
+		free(transformer);
+	}
+}
+
+/**
+Lossless transformation of a JPEG memory stream into another memory stream. 
+The sequence of rotations and flips is reduced to a single operation, then 
+the crop and the options are applied in the same pass over the DCT coefficients. 
+The source stream is read in place (a stream wrapping a memory mapped file is not copied).
+
+@param transformer Context returned by FreeImage_JPEGOpenTransformer, or NULL to use a temporary one
+@param src_stream Source JPEG stream, read from its current position
+@param dst_stream Destination stream, or NULL to only compute the crop rectangle
+@param operations Lossless operations, in the order they are applied (may be NULL if count is 0)
+@param count Number of operations
+@param left Crop rectangle in the transformed image (see FreeImage_JPEGTransformCombined), or NULL
+@param top Crop rectangle in the transformed image, or NULL
+@param right Crop rectangle in the transformed image, or NULL
+@param bottom Crop rectangle in the transformed image, or NULL
+@param flags Combination of FIJPEG_PERFECT, FIJPEG_GRAYSCALE, FIJPEG_PROGRESSIVE and FIJPEG_OPTIMIZE
+@return Returns TRUE if successful, returns FALSE otherwise
+*/
+BOOL DLL_CALLCONV
+FreeImage_JPEGTransformEx(FIJPEGTRANSFORMER *transformer, FIMEMORY* src_stream, FIMEMORY* dst_stream, const FREE_IMAGE_JPEG_OPERATION *operations, int count, int* left, int* top, int* right, int* bottom, int flags) {
+	FreeImageIO io;
+	fi_handle src;
+	fi_handle dst;
+
+	if(!src_stream || (count > 0 && !operations)) {
+		return FALSE;
+	}
+	if(!getMemIO(src_stream, dst_stream, &io, &src, &dst)) {
+		return FALSE;
+	}
+
+	const FREE_IMAGE_JPEG_OPERATION operation = (count > 0) ? composeOperations(operations, count) : FIJPEG_OP_NONE;
+
+	if(transformer && transformer->data) {
+		return JPEGTransformWith((JPEGTransformer*)transformer->data, &io, src, &io, dst, operation, left, top, right, bottom, flags);
+	}
+
+	JPEGTransformer temporary;
+	if(!CreateTransformer(&temporary)) {
+		return FALSE;
+	}
+	const BOOL bResult = JPEGTransformWith(&temporary, &io, src, &io, dst, operation, left, top, right, bottom, flags);
+	DestroyTransformer(&temporary);
+
+	return bResult;
+}
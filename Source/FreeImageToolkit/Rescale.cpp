@@ -73,7 +73,7 @@ FreeImage_RescaleRect(FIBITMAP *src, int dst_width, int dst_height, int src_left
 		return NULL;
 	}
 
-	CResizeEngine Engine(pFilter);
+	CResizeEngine Engine(pFilter, (int)filter);
 
 	dst = Engine.scale(src, dst_width, dst_height, src_left, src_top,
 			src_right - src_left, src_bottom - src_top, flags);
@@ -130,6 +130,26 @@ FreeImage_MakeThumbnail(FIBITMAP *dib, int max_pixel_size, BOOL convert) {
 
 	switch(image_type) {
 		case FIT_BITMAP:
+		{
+			const unsigned bpp = FreeImage_GetBPP(dib);
+			if(((bpp == 24) || (bpp == 32) || ((bpp == 8) && (FreeImage_GetColorType(dib) == FIC_MINISBLACK)))
+				&& (width >= 8 * new_width) && (height >= 8 * new_height)) {
+				// large ratios : average the source pixels down to at most twice 
+				// the thumbnail size, then finish with the bilinear filter
+				const int area_width = MAX(new_width, MIN(2 * new_width, width / 8));
+				const int area_height = MAX(new_height, MIN(2 * new_height, height / 8));
+				FIBITMAP *area = FreeImage_Rescale(dib, area_width, area_height, FILTER_BOX);
+				if(area && ((area_width != new_width) || (area_height != new_height))) {
+					thumbnail = FreeImage_Rescale(area, new_width, new_height, FILTER_BILINEAR);
+					FreeImage_Unload(area);
+				} else {
+					thumbnail = area;
+				}
+				break;
+			}
+		}
+		// fall through
+
 		case FIT_UINT16:
 		case FIT_RGB16:
 		case FIT_RGBA16:
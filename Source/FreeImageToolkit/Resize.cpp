@@ -22,6 +22,9 @@
 // ==========================================================
 
 #include "Resize.h"
+#include "Parallel.h"
+
+#include <list>
 
 /**
 Returns the color type of a bitmap. In contrast to FreeImage_GetColorType,
@@ -136,9 +139,27 @@ GetRGBAPalette(FIBITMAP *dib, RGBQUAD * const buffer) {
 	return buffer;
 }
 
+/**
+Divide the color sums of a pixel filtered with alpha weighted weights (see FI_RESCALE_ALPHA_WEIGHTED) 
+by the alpha sum, that is, the sum of (weight * alpha) is the alpha of the pixel and the sum of 
+(weight * alpha * color) is its premultiplied color. The colors of transparent pixels are set to 0. 
+Negative sums (filter ringing) are divided as well, so that the second filter pass, multiplying 
+the colors of the temporary image by their alpha again, still sees the premultiplied colors.
+*/
+static inline void
+DivideByAlphaSum(double &r, double &g, double &b, double a) {
+	if (a != 0) {
+		r /= a;
+		g /= a;
+		b /= a;
+	} else {
+		r = g = b = 0;
+	}
+}
+
 // --------------------------------------------------------------------------
 
-CWeightsTable::CWeightsTable(CGenericFilter *pFilter, unsigned uDstSize, unsigned uSrcSize) {
+CWeightsTable::CWeightsTable(CGenericFilter *pFilter, unsigned uDstSize, unsigned uSrcSize, unsigned uFormats) {
 	double dWidth;
 	double dFScale;
 	const double dFilterWidth = pFilter->GetWidth();
@@ -163,11 +184,21 @@ CWeightsTable::CWeightsTable(CGenericFilter *pFilter, unsigned uDstSize, unsigne
 	// length of dst line (no. of rows / cols) 
 	m_LineLength = uDstSize; 
 
+	m_FloatWeights = NULL;
+	m_FixedWeights = NULL;
+
 	 // allocate list of contributions 
-	m_WeightTable = (Contribution*)malloc(m_LineLength * sizeof(Contribution));
+	m_WeightTable = (Contribution*)calloc(m_LineLength, sizeof(Contribution));
+	if(!m_WeightTable) {
+		return;
+	}
 	for(unsigned u = 0; u < m_LineLength; u++) {
 		// allocate contributions for every pixel
 		m_WeightTable[u].Weights = (double*)malloc(m_WindowSize * sizeof(double));
+		if(!m_WeightTable[u].Weights) {
+			destroy();
+			return;
+		}
 	}
 
 	// offset for discrete to continuous coordinate conversion
@@ -216,15 +247,799 @@ CWeightsTable::CWeightsTable(CGenericFilter *pFilter, unsigned uDstSize, unsigne
 		}
 
 	} // next dst pixel
+
+	// single precision and fixed point copies of the weights, for the filters of float and 16-bit images
+	if(uFormats & FI_WEIGHTS_FLOAT) {
+		m_FloatWeights = (float*)malloc(m_LineLength * m_WindowSize * sizeof(float));
+		if(!m_FloatWeights) {
+			destroy();
+			return;
+		}
+		for(unsigned u = 0; u < m_LineLength; u++) {
+			float *const float_weights = m_FloatWeights + u * m_WindowSize;
+			for(unsigned i = 0; i < m_WeightTable[u].Right - m_WeightTable[u].Left; i++) {
+				float_weights[i] = (float)m_WeightTable[u].Weights[i];
+			}
+		}
+	}
+	if(uFormats & FI_WEIGHTS_FIXED) {
+		// the fixed point weights are the differences of the rounded cumulative weights, 
+		// so that they sum to 1 exactly and rounding errors do not accumulate along the window
+		m_FixedWeights = (short*)malloc(m_LineLength * m_WindowSize * sizeof(short));
+		if(!m_FixedWeights) {
+			destroy();
+			return;
+		}
+		for(unsigned u = 0; u < m_LineLength; u++) {
+			short *const fixed_weights = m_FixedWeights + u * m_WindowSize;
+			double dSum = 0;
+			int iPrevious = 0;
+			for(unsigned i = 0; i < m_WeightTable[u].Right - m_WeightTable[u].Left; i++) {
+				dSum += m_WeightTable[u].Weights[i];
+				const int iCurrent = (int)floor(dSum * (1 << FI_WEIGHT_BITS) + 0.5);
+				fixed_weights[i] = (short)CLAMP<int>(iCurrent - iPrevious, -32768, 32767);
+				iPrevious = iCurrent;
+			}
+		}
+	}
 }
 
 CWeightsTable::~CWeightsTable() {
-	for(unsigned u = 0; u < m_LineLength; u++) {
-		// free contributions for every pixel
-		free(m_WeightTable[u].Weights);
+	destroy();
+}
+
+void CWeightsTable::destroy() {
+	if(m_WeightTable) {
+		for(unsigned u = 0; u < m_LineLength; u++) {
+			// free contributions for every pixel
+			free(m_WeightTable[u].Weights);
+		}
+		// free list of pixels contributions
+		free(m_WeightTable);
+		m_WeightTable = NULL;
+	}
+	free(m_FloatWeights);
+	m_FloatWeights = NULL;
+	free(m_FixedWeights);
+	m_FixedWeights = NULL;
+}
+
+// --------------------------------------------------------------------------
+//   Weights tables cache
+// --------------------------------------------------------------------------
+
+/// Maximum number of weights tables kept in the cache
+#define WEIGHTS_CACHE_ENTRIES	16
+/// Maximum number of weights of a cached table (tables of larger lines are not cached)
+#define WEIGHTS_CACHE_MAX_SIZE	(64 * 1024)
+
+/**
+LRU cache of the weights tables. Tables are reference counted while in use 
+and are only evicted when unused.
+*/
+class CWeightsTableCache
+{
+	typedef struct tagEntry {
+		int filter;
+		unsigned formats;
+		double width;
+		unsigned dst_size;
+		unsigned src_size;
+		CWeightsTable *table;
+		unsigned refs;
+	} Entry;
+
+	/// cached tables, most recently used first
+	std::list<Entry> m_entries;
+	ParallelMutex m_mutex;
+
+	/// destroy the least recently used unused tables in excess
+	void trim() {
+		std::list<Entry>::iterator it = m_entries.end();
+		while((m_entries.size() > WEIGHTS_CACHE_ENTRIES) && (it != m_entries.begin())) {
+			--it;
+			if(it->refs == 0) {
+				delete it->table;
+				it = m_entries.erase(it);
+			}
+		}
+	}
+
+public:
+	~CWeightsTableCache() {
+		for(std::list<Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+			delete it->table;
+		}
+	}
+
+	/**
+	Get a shared table, computing it if needed
+	@param bCached Receives TRUE if the table is cached and must be returned with release, 
+	FALSE if the table is too large to be cached (or invalid) and must be deleted by the caller
+	@return Returns the table, or NULL if memory allocation failed
+	*/
+	const CWeightsTable* acquire(CGenericFilter *pFilter, int filter, unsigned formats, unsigned dst_size, unsigned src_size, BOOL &bCached) {
+		const double width = pFilter->GetWidth();
+		{
+			ParallelLock lock(m_mutex);
+			for(std::list<Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+				if((it->filter == filter) && (it->formats == formats) && (it->width == width) && (it->dst_size == dst_size) && (it->src_size == src_size)) {
+					it->refs++;
+					m_entries.splice(m_entries.begin(), m_entries, it);
+					bCached = TRUE;
+					return it->table;
+				}
+			}
+		}
+
+		// compute the table outside of the lock
+		CWeightsTable *table = new(std::nothrow) CWeightsTable(pFilter, dst_size, src_size, formats);
+		if(!table || !table->isValid() || (table->getSize() > WEIGHTS_CACHE_MAX_SIZE)) {
+			bCached = FALSE;
+			return table;
+		}
+
+		ParallelLock lock(m_mutex);
+		for(std::list<Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+			if((it->filter == filter) && (it->formats == formats) && (it->width == width) && (it->dst_size == dst_size) && (it->src_size == src_size)) {
+				// computed meanwhile by another thread
+				delete table;
+				it->refs++;
+				bCached = TRUE;
+				return it->table;
+			}
+		}
+		Entry entry = { filter, formats, width, dst_size, src_size, table, 1 };
+		m_entries.push_front(entry);
+		trim();
+		bCached = TRUE;
+		return table;
+	}
+
+	/**
+	Return a table obtained from acquire
+	*/
+	void release(const CWeightsTable *table) {
+		ParallelLock lock(m_mutex);
+		for(std::list<Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+			if(it->table == table) {
+				it->refs--;
+				break;
+			}
+		}
+		trim();
+	}
+};
+
+static CWeightsTableCache s_weights_cache;
+
+CSharedWeightsTable::CSharedWeightsTable(CGenericFilter *pFilter, int iFilterKey, unsigned uDstSize, unsigned uSrcSize, unsigned uFormats) {
+	m_bCached = FALSE;
+	m_pTable = (iFilterKey >= 0) ? s_weights_cache.acquire(pFilter, iFilterKey, uFormats, uDstSize, uSrcSize, m_bCached) : new(std::nothrow) CWeightsTable(pFilter, uDstSize, uSrcSize, uFormats);
+	if(m_pTable && !m_pTable->isValid()) {
+		// out of memory : invalid tables are never cached
+		delete m_pTable;
+		m_pTable = NULL;
+	}
+}
+
+CSharedWeightsTable::~CSharedWeightsTable() {
+	if(m_bCached) {
+		s_weights_cache.release(m_pTable);
+	} else {
+		delete m_pTable;
+	}
+}
+
+// --------------------------------------------------------------------------
+//   Linear light resampling (FI_RESCALE_LINEAR_LIGHT)
+// --------------------------------------------------------------------------
+
+/**
+sRGB transfer function tables, built when the library is loaded.<br>
+Color channels are decoded from 8-bit sRGB values to 16-bit linear values, 
+and encoded back from the 12 most significant bits of the 16-bit linear values. 
+Every 8-bit value is recovered by a decode / encode round trip.
+*/
+class CLinearLightTables
+{
+public:
+	/// 8-bit sRGB value to 16-bit linear value
+	WORD decode[256];
+	/// 16-bit linear value >> 4 to 8-bit sRGB value
+	BYTE encode[4096];
+
+	CLinearLightTables() {
+		for (unsigned i = 0; i < 256; i++) {
+			const double v = i / 255.0;
+			const double linear = (v <= 0.04045) ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4);
+			decode[i] = (WORD)(linear * 65535 + 0.5);
+		}
+		for (unsigned i = 0; i < 4096; i++) {
+			// center of the range of 16-bit values sharing the index i
+			const double linear = (i * 16 + 7.5) / 65535;
+			const double v = (linear <= 0.0031308) ? linear * 12.92 : 1.055 * pow(linear, 1 / 2.4) - 0.055;
+			encode[i] = (BYTE)CLAMP<int>((int)(v * 255 + 0.5), 0, 0xFF);
+		}
+	}
+};
+
+static const CLinearLightTables s_linear_light;
+
+// 8-bit sRGB pixels (decoded and encoded through the tables) or 16-bit linear pixels of the 
+// temporary image, channels being kept in the order of the source pixels; the alpha channel 
+// (channel 3) is not gamma encoded and is only scaled
+
+static inline double
+LinearLoad(const BYTE *pixel, unsigned c) {
+	return (c == 3) ? pixel[c] * 257.0 : (double)s_linear_light.decode[pixel[c]];
+}
+
+static inline double
+LinearLoad(const WORD *pixel, unsigned c) {
+	return (double)pixel[c];
+}
+
+static inline void
+LinearStore(BYTE *pixel, unsigned c, double value) {
+	if (c == 3) {
+		pixel[c] = (BYTE)CLAMP<int>((int)(value / 257 + 0.5), 0, 0xFF);
+	} else {
+		pixel[c] = s_linear_light.encode[CLAMP<int>((int)(value + 0.5), 0, 0xFFFF) >> 4];
+	}
+}
+
+static inline void
+LinearStore(WORD *pixel, unsigned c, double value) {
+	pixel[c] = (WORD)CLAMP<int>((int)(value + 0.5), 0, 0xFFFF);
+}
+
+/**
+Horizontal linear light filtering of 24- or 32-bit (CHANNELS = 3 or 4) rows
+*/
+template <class SrcT, class DstT, unsigned CHANNELS> static void
+HorizontalFilterLinear(const CWeightsTable &weightsTable, FIBITMAP *const src, unsigned height, unsigned src_offset_x, unsigned src_offset_y, FIBITMAP *const dst, unsigned dst_width, BOOL bAlphaWeighted) {
+	const BOOL bWeightColors = bAlphaWeighted && (CHANNELS == 4);
+
+	for (unsigned y = 0; y < height; y++) {
+		// scale each row
+		const SrcT *const src_bits = (SrcT *)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x * CHANNELS;
+		DstT *dst_bits = (DstT *)FreeImage_GetScanLine(dst, y);
+
+		for (unsigned x = 0; x < dst_width; x++) {
+			// loop through row
+			const unsigned iLeft = weightsTable.getLeftBoundary(x);				// retrieve left boundary
+			const unsigned iLimit = weightsTable.getRightBoundary(x) - iLeft;	// retrieve right boundary
+			const SrcT *pixel = src_bits + iLeft * CHANNELS;
+			double value[4] = {0, 0, 0, 0};
+
+			for (unsigned i = 0; i < iLimit; i++) {
+				// accumulate weighted effect of each neighboring pixel
+				const double weight = weightsTable.getWeight(x, i);
+				const double alpha = (CHANNELS == 4) ? LinearLoad(pixel, 3) : 0;
+				const double color_weight = bWeightColors ? weight * alpha : weight;
+				value[0] += (color_weight * LinearLoad(pixel, 0));
+				value[1] += (color_weight * LinearLoad(pixel, 1));
+				value[2] += (color_weight * LinearLoad(pixel, 2));
+				value[3] += (weight * alpha);
+				pixel += CHANNELS;
+			}
+
+			if (bWeightColors) {
+				DivideByAlphaSum(value[0], value[1], value[2], value[3]);
+			}
+
+			// clamp and place result in destination pixel
+			for (unsigned c = 0; c < CHANNELS; c++) {
+				LinearStore(dst_bits, c, value[c]);
+			}
+			dst_bits += CHANNELS;
+		}
+	}
+}
+
+/**
+Vertical linear light filtering of 24- or 32-bit (CHANNELS = 3 or 4) rows.<br>
+Contrary to CResizeEngine::verticalFilter, the destination rows are computed one at a time, 
+accumulating whole source rows into a line buffer.
+*/
+template <class SrcT, class DstT, unsigned CHANNELS> static BOOL
+VerticalFilterLinear(const CWeightsTable &weightsTable, FIBITMAP *const src, unsigned width, unsigned src_offset_x, unsigned src_offset_y, FIBITMAP *const dst, unsigned dst_height, BOOL bAlphaWeighted) {
+	const BOOL bWeightColors = bAlphaWeighted && (CHANNELS == 4);
+
+	// sums of the color and alpha channels of a destination row
+	double *const line = (double *)malloc(width * 4 * sizeof(double));
+	if (!line) {
+		return FALSE;
+	}
+
+	for (unsigned y = 0; y < dst_height; y++) {
+		// scale each row
+		const unsigned iLeft = weightsTable.getLeftBoundary(y);				// retrieve left boundary
+		const unsigned iLimit = weightsTable.getRightBoundary(y) - iLeft;	// retrieve right boundary
+		memset(line, 0, width * 4 * sizeof(double));
+
+		for (unsigned i = 0; i < iLimit; i++) {
+			// accumulate weighted effect of each neighboring row
+			const double weight = weightsTable.getWeight(y, i);
+			const SrcT *pixel = (SrcT *)FreeImage_GetScanLine(src, iLeft + i + src_offset_y) + src_offset_x * CHANNELS;
+			double *value = line;
+
+			for (unsigned x = 0; x < width; x++) {
+				const double alpha = (CHANNELS == 4) ? LinearLoad(pixel, 3) : 0;
+				const double color_weight = bWeightColors ? weight * alpha : weight;
+				value[0] += (color_weight * LinearLoad(pixel, 0));
+				value[1] += (color_weight * LinearLoad(pixel, 1));
+				value[2] += (color_weight * LinearLoad(pixel, 2));
+				value[3] += (weight * alpha);
+				pixel += CHANNELS;
+				value += 4;
+			}
+		}
+
+		// clamp and place result in destination row
+		DstT *dst_bits = (DstT *)FreeImage_GetScanLine(dst, y);
+		double *value = line;
+		for (unsigned x = 0; x < width; x++) {
+			if (bWeightColors) {
+				DivideByAlphaSum(value[0], value[1], value[2], value[3]);
+			}
+			for (unsigned c = 0; c < CHANNELS; c++) {
+				LinearStore(dst_bits, c, value[c]);
+			}
+			dst_bits += CHANNELS;
+			value += 4;
+		}
+	}
+
+	free(line);
+	return TRUE;
+}
+
+template <unsigned CHANNELS> static BOOL
+ScaleLinearLight(CGenericFilter *pFilter, int iFilterKey, FIBITMAP *src, unsigned src_offset_x, unsigned src_offset_y, unsigned src_width, unsigned src_height, FIBITMAP *dst, unsigned dst_width, unsigned dst_height, BOOL bAlphaWeighted) {
+	if (src_height == dst_height) {
+		// horizontal filtering only
+		CSharedWeightsTable sharedTable(pFilter, iFilterKey, dst_width, src_width);
+		if (!sharedTable.isValid()) {
+			return FALSE;
+		}
+		HorizontalFilterLinear<BYTE, BYTE, CHANNELS>(sharedTable.get(), src, src_height, src_offset_x, src_offset_y, dst, dst_width, bAlphaWeighted);
+		return TRUE;
+	}
+	if (src_width == dst_width) {
+		// vertical filtering only
+		CSharedWeightsTable sharedTable(pFilter, iFilterKey, dst_height, src_height);
+		if (!sharedTable.isValid()) {
+			return FALSE;
+		}
+		return VerticalFilterLinear<BYTE, BYTE, CHANNELS>(sharedTable.get(), src, src_width, src_offset_x, src_offset_y, dst, dst_height, bAlphaWeighted);
+	}
+
+	// the temporary image holds 16-bit linear values
+	const FREE_IMAGE_TYPE tmp_type = (CHANNELS == 4) ? FIT_RGBA16 : FIT_RGB16;
+	BOOL bResult = FALSE;
+
+	if (dst_width <= src_width) {
+		// xy filtering
+		FIBITMAP *tmp = FreeImage_AllocateT(tmp_type, dst_width, src_height);
+		if (tmp) {
+			CSharedWeightsTable sharedX(pFilter, iFilterKey, dst_width, src_width);
+			CSharedWeightsTable sharedY(pFilter, iFilterKey, dst_height, src_height);
+			if (sharedX.isValid() && sharedY.isValid()) {
+				HorizontalFilterLinear<BYTE, WORD, CHANNELS>(sharedX.get(), src, src_height, src_offset_x, src_offset_y, tmp, dst_width, bAlphaWeighted);
+				bResult = VerticalFilterLinear<WORD, BYTE, CHANNELS>(sharedY.get(), tmp, dst_width, 0, 0, dst, dst_height, bAlphaWeighted);
+			}
+			FreeImage_Unload(tmp);
+		}
+	} else {
+		// yx filtering
+		FIBITMAP *tmp = FreeImage_AllocateT(tmp_type, src_width, dst_height);
+		if (tmp) {
+			CSharedWeightsTable sharedY(pFilter, iFilterKey, dst_height, src_height);
+			CSharedWeightsTable sharedX(pFilter, iFilterKey, dst_width, src_width);
+			if (sharedX.isValid() && sharedY.isValid()) {
+				bResult = VerticalFilterLinear<BYTE, WORD, CHANNELS>(sharedY.get(), src, src_width, src_offset_x, src_offset_y, tmp, dst_height, bAlphaWeighted);
+				if (bResult) {
+					HorizontalFilterLinear<WORD, BYTE, CHANNELS>(sharedX.get(), tmp, dst_height, 0, 0, dst, dst_width, bAlphaWeighted);
+				}
+			}
+			FreeImage_Unload(tmp);
+		}
+	}
+
+	return bResult;
+}
+
+// --------------------------------------------------------------------------
+//   Area averaging (FILTER_BOX downscaling)
+// --------------------------------------------------------------------------
+
+/**
+Returns TRUE if a box filter downscaling is computed by area averaging : 
+for integer factors (where both are equivalent) and for factors of 8 and more
+*/
+static BOOL
+IsAreaAverage(unsigned src_width, unsigned src_height, unsigned dst_width, unsigned dst_height) {
+	if ((dst_width > src_width) || (dst_height > src_height)) {
+		return FALSE;
+	}
+	if (((src_width % dst_width) == 0) && ((src_height % dst_height) == 0)) {
+		return TRUE;
+	}
+	return ((src_width >= 8 * dst_width) && (src_height >= 8 * dst_height)) ? TRUE : FALSE;
+}
+
+/**
+Compute the source areas of the destination pixels of a line, in 1/256 of source pixels : 
+destination pixel u covers [bounds[u], bounds[u + 1])
+*/
+static void
+GetAreaBounds(unsigned *bounds, unsigned dst_size, unsigned src_size) {
+	for (unsigned u = 0; u <= dst_size; u++) {
+		bounds[u] = (unsigned)(((UINT64)u * src_size * 256) / dst_size);
+	}
+}
+
+/**
+Returns the weight (in 1/256) of source pixel i in the area [left, right)
+*/
+static inline unsigned
+GetAreaWeight(unsigned i, unsigned left, unsigned right) {
+	return MIN((i + 1) << 8, right) - MAX(i << 8, left);
+}
+
+/**
+Downscale an 8-bit greyscale, 24- or 32-bit image by averaging the source area of each destination pixel.<br>
+Whole source pixels are summed with integer weights, only the pixels crossing the edges of an area 
+get a fractional weight. The rows of an area are first summed into a line of 32-bit column sums 
+(with the SIMD kernel selected for the CPU), which are then summed for each destination pixel.
+*/
+static BOOL
+AreaAverage(FIBITMAP *const src, unsigned src_offset_x, unsigned src_offset_y, unsigned src_width, unsigned src_height, FIBITMAP *const dst, unsigned dst_width, unsigned dst_height) {
+	const unsigned bytespp = FreeImage_GetBPP(src) / 8;
+	const unsigned line = src_width * bytespp;
+
+	unsigned *x_bounds = (unsigned*)malloc((dst_width + 1) * sizeof(unsigned));
+	unsigned *y_bounds = (unsigned*)malloc((dst_height + 1) * sizeof(unsigned));
+	DWORD *sums = (DWORD*)malloc(line * sizeof(DWORD));
+	if (!x_bounds || !y_bounds || !sums) {
+		free(x_bounds);
+		free(y_bounds);
+		free(sums);
+		return FALSE;
+	}
+
+	GetAreaBounds(x_bounds, dst_width, src_width);
+	GetAreaBounds(y_bounds, dst_height, src_height);
+
+	for (unsigned y = 0; y < dst_height; y++) {
+		const unsigned top = y_bounds[y];
+		const unsigned bottom = y_bounds[y + 1];
+
+		// sum the weighted rows of the area
+		memset(sums, 0, line * sizeof(DWORD));
+		for (unsigned i = top >> 8; (i << 8) < bottom; i++) {
+			const unsigned weight = GetAreaWeight(i, top, bottom);
+			const BYTE *const src_bits = FreeImage_GetScanLine(src, i + src_offset_y) + src_offset_x * bytespp;
+			for (unsigned k = (unsigned)FreeImage_AccumulateLineSIMD(sums, src_bits, (int)line, weight); k < line; k++) {
+				sums[k] += src_bits[k] * weight;
+			}
+		}
+
+		// sum the weighted columns of each area
+		BYTE *dst_bits = FreeImage_GetScanLine(dst, y);
+		for (unsigned x = 0; x < dst_width; x++) {
+			const unsigned left = x_bounds[x];
+			const unsigned right = x_bounds[x + 1];
+			const UINT64 area = (UINT64)(right - left) * (bottom - top);
+			UINT64 value[4] = {0, 0, 0, 0};
+
+			for (unsigned i = left >> 8; (i << 8) < right; i++) {
+				const UINT64 weight = GetAreaWeight(i, left, right);
+				const DWORD *const column = sums + i * bytespp;
+				for (unsigned c = 0; c < bytespp; c++) {
+					value[c] += column[c] * weight;
+				}
+			}
+			for (unsigned c = 0; c < bytespp; c++) {
+				dst_bits[c] = (BYTE)((value[c] + area / 2) / area);
+			}
+			dst_bits += bytespp;
+		}
+	}
+
+	free(x_bounds);
+	free(y_bounds);
+	free(sums);
+
+	return TRUE;
+}
+
+// --------------------------------------------------------------------------
+//   16-bit and float resampling
+// --------------------------------------------------------------------------
+
+/**
+Samples of the 16-bit images (FIT_UINT16, FIT_RGB16 and FIT_RGBA16).<br>
+The samples are biased to signed values and filtered with FI_WEIGHT_BITS fixed point weights 
+into 32-bit sums. Since the weights sum to 1 << FI_WEIGHT_BITS, the bias is added back after 
+the rounding shift.
+*/
+struct CSamples16 {
+	typedef WORD Sample;
+	typedef int Sum;
+	typedef short Weight;
+	/// weight format of the CWeightsTable
+	enum { Formats = FI_WEIGHTS_FIXED };
+
+	static const Weight* getWeights(const CWeightsTable &weightsTable, unsigned dst_pos) {
+		return weightsTable.getFixedWeights(dst_pos);
+	}
+	static Sum load(Sample value) {
+		return (int)value - 0x8000;
+	}
+	static Sample store(Sum value) {
+		return (WORD)CLAMP<int>(((value + (1 << (FI_WEIGHT_BITS - 1))) >> FI_WEIGHT_BITS) + 0x8000, 0, 0xFFFF);
+	}
+	static void accumulate(Sum *sums, const Sample *source0, const Sample *source1, unsigned count, Weight weight0, Weight weight1) {
+		for (unsigned k = (unsigned)FreeImage_AccumulateLine16SIMD(sums, source0, source1, (int)count, weight0, weight1); k < count; k++) {
+			sums[k] += load(source0[k]) * weight0 + load(source1[k]) * weight1;
+		}
+	}
+};
+
+/**
+Samples of the float images (FIT_FLOAT, FIT_RGBF and FIT_RGBAF), filtered with float weights into float sums
+*/
+struct CSamplesFloat {
+	typedef float Sample;
+	typedef float Sum;
+	typedef float Weight;
+	/// weight format of the CWeightsTable
+	enum { Formats = FI_WEIGHTS_FLOAT };
+
+	static const Weight* getWeights(const CWeightsTable &weightsTable, unsigned dst_pos) {
+		return weightsTable.getFloatWeights(dst_pos);
+	}
+	static Sum load(Sample value) {
+		return value;
+	}
+	static Sample store(Sum value) {
+		return value;
+	}
+	static void accumulate(Sum *sums, const Sample *source0, const Sample *source1, unsigned count, Weight weight0, Weight weight1) {
+		for (unsigned k = (unsigned)FreeImage_AccumulateLineFSIMD(sums, source0, (int)count, weight0); k < count; k++) {
+			sums[k] += source0[k] * weight0;
+		}
+		if (weight1 != 0) {
+			for (unsigned k = (unsigned)FreeImage_AccumulateLineFSIMD(sums, source1, (int)count, weight1); k < count; k++) {
+				sums[k] += source1[k] * weight1;
+			}
+		}
+	}
+};
+
+/**
+Filter a destination pixel of SPP samples from count source pixels
+*/
+template <unsigned SPP> static inline void
+FilterPixel(int *value, const WORD *pixel, const short *weights, unsigned count) {
+	unsigned i = 0;
+#if defined(FREEIMAGE_SSE2)
+	if ((SPP == 3) || (SPP == 4)) {
+		// pairs of pixels, interleaved and multiplied-added with their weights
+		const __m128i bias = _mm_set1_epi16((short)0x8000);
+		__m128i sum = _mm_setzero_si128();
+		for (; i + 2 <= count; i += 2) {
+			const WORD *const p = pixel + i * SPP;
+			const __m128i w = _mm_set1_epi32((int)(((unsigned)(WORD)weights[i + 1] << 16) | (WORD)weights[i]));
+			__m128i v0, v1;
+			if (SPP == 4) {
+				v0 = _mm_loadu_si128((const __m128i*)p);
+				v1 = _mm_srli_si128(v0, 8);
+			} else {
+				// the 4th samples are the next red samples, and are ignored
+				v0 = _mm_loadl_epi64((const __m128i*)p);
+				v1 = _mm_srli_epi64(_mm_loadl_epi64((const __m128i*)(p + 2)), 16);
+			}
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi16(_mm_xor_si128(v0, bias), _mm_xor_si128(v1, bias)), w));
+		}
+		int sums[4];
+		_mm_storeu_si128((__m128i*)sums, sum);
+		for (unsigned c = 0; c < SPP; c++) {
+			value[c] = sums[c];
+		}
+	}
+#endif // FREEIMAGE_SSE2
+	for (; i < count; i++) {
+		const WORD *const p = pixel + i * SPP;
+		for (unsigned c = 0; c < SPP; c++) {
+			value[c] += CSamples16::load(p[c]) * weights[i];
+		}
+	}
+}
+
+template <unsigned SPP> static inline void
+FilterPixel(float *value, const float *pixel, const float *weights, unsigned count) {
+	unsigned i = 0;
+#if defined(FREEIMAGE_SSE2)
+	if ((SPP == 3) || (SPP == 4)) {
+		__m128 sum = _mm_setzero_ps();
+		for (; i < count; i++) {
+			const float *const p = pixel + i * SPP;
+			const __m128 v = (SPP == 4) ? _mm_loadu_ps(p) : _mm_movelh_ps(_mm_castpd_ps(_mm_load_sd((const double*)p)), _mm_load_ss(p + 2));
+			sum = _mm_add_ps(sum, _mm_mul_ps(v, _mm_set1_ps(weights[i])));
+		}
+		float sums[4];
+		_mm_storeu_ps(sums, sum);
+		for (unsigned c = 0; c < SPP; c++) {
+			value[c] = sums[c];
+		}
+	}
+#endif // FREEIMAGE_SSE2
+	for (; i < count; i++) {
+		const float *const p = pixel + i * SPP;
+		for (unsigned c = 0; c < SPP; c++) {
+			value[c] += p[c] * weights[i];
+		}
+	}
+}
+
+/**
+Horizontal filtering of 16-bit or float rows of SPP samples per pixel
+*/
+template <class T, unsigned SPP> static void
+HorizontalFilterPixels(const CWeightsTable &weightsTable, FIBITMAP *const src, unsigned height, unsigned src_offset_x, unsigned src_offset_y, FIBITMAP *const dst, unsigned dst_width) {
+	typedef typename T::Sample Sample;
+	typedef typename T::Sum Sum;
+
+	for (unsigned y = 0; y < height; y++) {
+		// scale each row
+		const Sample *const src_bits = (Sample *)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x * SPP;
+		Sample *dst_bits = (Sample *)FreeImage_GetScanLine(dst, y);
+
+		for (unsigned x = 0; x < dst_width; x++) {
+			// loop through row
+			const unsigned iLeft = weightsTable.getLeftBoundary(x);				// retrieve left boundary
+			const unsigned iLimit = weightsTable.getRightBoundary(x) - iLeft;	// retrieve right boundary
+			Sum value[SPP];
+			for (unsigned c = 0; c < SPP; c++) {
+				value[c] = 0;
+			}
+
+			// accumulate weighted effect of each neighboring pixel
+			FilterPixel<SPP>(value, src_bits + iLeft * SPP, T::getWeights(weightsTable, x), iLimit);
+
+			// clamp and place result in destination pixel
+			for (unsigned c = 0; c < SPP; c++) {
+				dst_bits[c] = T::store(value[c]);
+			}
+			dst_bits += SPP;
+		}
+	}
+}
+
+/**
+Vertical filtering of 16-bit or float rows of spp samples per pixel.<br>
+The destination rows are computed one at a time, accumulating pairs of source rows 
+into a line of sums with the SIMD kernels selected for the CPU.
+*/
+template <class T> static BOOL
+VerticalFilterSamples(const CWeightsTable &weightsTable, FIBITMAP *const src, unsigned width, unsigned spp, unsigned src_offset_x, unsigned src_offset_y, FIBITMAP *const dst, unsigned dst_height) {
+	typedef typename T::Sample Sample;
+	typedef typename T::Sum Sum;
+	typedef typename T::Weight Weight;
+
+	const unsigned line = width * spp;
+	Sum *const sums = (Sum *)malloc(line * sizeof(Sum));
+	if (!sums) {
+		return FALSE;
+	}
+
+	for (unsigned y = 0; y < dst_height; y++) {
+		// scale each row
+		const unsigned iLeft = weightsTable.getLeftBoundary(y);				// retrieve left boundary
+		const unsigned iLimit = weightsTable.getRightBoundary(y) - iLeft;	// retrieve right boundary
+		const Weight *const weights = T::getWeights(weightsTable, y);
+		memset(sums, 0, line * sizeof(Sum));
+
+		for (unsigned i = 0; i < iLimit; i += 2) {
+			// accumulate weighted effect of each pair of neighboring rows
+			const Sample *const src_bits0 = (Sample *)FreeImage_GetScanLine(src, iLeft + i + src_offset_y) + src_offset_x * spp;
+			if (i + 1 < iLimit) {
+				const Sample *const src_bits1 = (Sample *)FreeImage_GetScanLine(src, iLeft + i + 1 + src_offset_y) + src_offset_x * spp;
+				T::accumulate(sums, src_bits0, src_bits1, line, weights[i], weights[i + 1]);
+			} else {
+				T::accumulate(sums, src_bits0, src_bits0, line, weights[i], 0);
+			}
+		}
+
+		// clamp and place result in destination row
+		Sample *const dst_bits = (Sample *)FreeImage_GetScanLine(dst, y);
+		for (unsigned k = 0; k < line; k++) {
+			dst_bits[k] = T::store(sums[k]);
+		}
+	}
+
+	free(sums);
+	return TRUE;
+}
+
+template <class T> static void
+HorizontalFilterSamples(const CWeightsTable &weightsTable, unsigned spp, FIBITMAP *const src, unsigned height, unsigned src_offset_x, unsigned src_offset_y, FIBITMAP *const dst, unsigned dst_width) {
+	switch (spp) {
+		case 1:
+			HorizontalFilterPixels<T, 1>(weightsTable, src, height, src_offset_x, src_offset_y, dst, dst_width);
+			break;
+		case 3:
+			HorizontalFilterPixels<T, 3>(weightsTable, src, height, src_offset_x, src_offset_y, dst, dst_width);
+			break;
+		case 4:
+			HorizontalFilterPixels<T, 4>(weightsTable, src, height, src_offset_x, src_offset_y, dst, dst_width);
+			break;
+	}
+}
+
+/**
+Scale a 16-bit or float image, filtering with single precision (float images) 
+or 32-bit integer (16-bit images) arithmetic
+*/
+template <class T> static BOOL
+ScaleSamples(CGenericFilter *pFilter, int iFilterKey, FIBITMAP *src, unsigned src_offset_x, unsigned src_offset_y, unsigned src_width, unsigned src_height, FIBITMAP *dst, unsigned dst_width, unsigned dst_height) {
+	const FREE_IMAGE_TYPE image_type = FreeImage_GetImageType(src);
+	// number of samples per pixel (1, 3 or 4)
+	const unsigned spp = FreeImage_GetBPP(src) / (8 * sizeof(typename T::Sample));
+
+	if (src_height == dst_height) {
+		// horizontal filtering only
+		CSharedWeightsTable sharedTable(pFilter, iFilterKey, dst_width, src_width, T::Formats);
+		if (!sharedTable.isValid()) {
+			return FALSE;
+		}
+		HorizontalFilterSamples<T>(sharedTable.get(), spp, src, src_height, src_offset_x, src_offset_y, dst, dst_width);
+		return TRUE;
+	}
+	if (src_width == dst_width) {
+		// vertical filtering only
+		CSharedWeightsTable sharedTable(pFilter, iFilterKey, dst_height, src_height, T::Formats);
+		if (!sharedTable.isValid()) {
+			return FALSE;
+		}
+		return VerticalFilterSamples<T>(sharedTable.get(), src, src_width, spp, src_offset_x, src_offset_y, dst, dst_height);
+	}
+
+	BOOL bResult = FALSE;
+
+	if (dst_width <= src_width) {
+		// xy filtering
+		FIBITMAP *tmp = FreeImage_AllocateT(image_type, dst_width, src_height);
+		if (tmp) {
+			CSharedWeightsTable sharedX(pFilter, iFilterKey, dst_width, src_width, T::Formats);
+			CSharedWeightsTable sharedY(pFilter, iFilterKey, dst_height, src_height, T::Formats);
+			if (sharedX.isValid() && sharedY.isValid()) {
+				HorizontalFilterSamples<T>(sharedX.get(), spp, src, src_height, src_offset_x, src_offset_y, tmp, dst_width);
+				bResult = VerticalFilterSamples<T>(sharedY.get(), tmp, dst_width, spp, 0, 0, dst, dst_height);
+			}
+			FreeImage_Unload(tmp);
+		}
+	} else {
+		// yx filtering
+		FIBITMAP *tmp = FreeImage_AllocateT(image_type, src_width, dst_height);
+		if (tmp) {
+			CSharedWeightsTable sharedY(pFilter, iFilterKey, dst_height, src_height, T::Formats);
+			CSharedWeightsTable sharedX(pFilter, iFilterKey, dst_width, src_width, T::Formats);
+			if (sharedX.isValid() && sharedY.isValid()) {
+				bResult = VerticalFilterSamples<T>(sharedY.get(), src, src_width, spp, src_offset_x, src_offset_y, tmp, dst_height);
+				if (bResult) {
+					HorizontalFilterSamples<T>(sharedX.get(), spp, tmp, dst_height, 0, 0, dst, dst_width);
+				}
+			}
+			FreeImage_Unload(tmp);
+		}
 	}
-	// free list of pixels contributions
-	free(m_WeightTable);
+
+	return bResult;
 }
 
 // --------------------------------------------------------------------------
@@ -355,11 +1170,52 @@ FIBITMAP* CResizeEngine::scale(FIBITMAP *src, unsigned dst_width, unsigned dst_h
 		*/
 	}
 
+	// with FI_RESCALE_ALPHA_WEIGHTED, the color channels of RGBA pixels are weighted by their alpha
+	// while filtering, so each pass (and the temporary image) keeps straight alpha pixels
+	const BOOL bAlphaWeighted = ((flags & FI_RESCALE_ALPHA_WEIGHTED) == FI_RESCALE_ALPHA_WEIGHTED);
+
 	// calculate x and y offsets; since FreeImage uses bottom-up bitmaps, the
 	// value of src_offset_y is measured from the bottom of the image
 	unsigned src_offset_x = src_left;
 	unsigned src_offset_y = FreeImage_GetHeight(src) - src_height - src_top;
 
+	if (((flags & FI_RESCALE_LINEAR_LIGHT) == FI_RESCALE_LINEAR_LIGHT) && (image_type == FIT_BITMAP) && ((src_bpp == 24) || (src_bpp == 32))) {
+		// filter 24- and 32-bit images in linear light
+		const BOOL bResult = (src_bpp == 24) ?
+			ScaleLinearLight<3>(m_pFilter, m_iFilterKey, src, src_offset_x, src_offset_y, src_width, src_height, dst, dst_width, dst_height, bAlphaWeighted) :
+			ScaleLinearLight<4>(m_pFilter, m_iFilterKey, src, src_offset_x, src_offset_y, src_width, src_height, dst, dst_width, dst_height, bAlphaWeighted);
+		if (!bResult) {
+			FreeImage_Unload(dst);
+			return NULL;
+		}
+		return dst;
+	}
+
+	if ((m_iFilterKey == FILTER_BOX) && !bAlphaWeighted && (image_type == FIT_BITMAP) && (dst_bpp == src_bpp)
+		&& ((src_bpp == 24) || (src_bpp == 32) || ((src_bpp == 8) && (color_type == FIC_MINISBLACK)))
+		&& IsAreaAverage(src_width, src_height, dst_width, dst_height)) {
+		// box filter downscaling by area averaging
+		if (!AreaAverage(src, src_offset_x, src_offset_y, src_width, src_height, dst, dst_width, dst_height)) {
+			FreeImage_Unload(dst);
+			return NULL;
+		}
+		return dst;
+	}
+
+	if ((image_type == FIT_UINT16) || (image_type == FIT_RGB16) || (image_type == FIT_FLOAT) || (image_type == FIT_RGBF)
+		|| (((image_type == FIT_RGBA16) || (image_type == FIT_RGBAF)) && !bAlphaWeighted)) {
+		// filter 16-bit images with integer arithmetic and float images with single precision arithmetic
+		// (alpha weighted RGBA pixels use the double precision filters below)
+		const BOOL bResult = ((image_type == FIT_FLOAT) || (image_type == FIT_RGBF) || (image_type == FIT_RGBAF)) ?
+			ScaleSamples<CSamplesFloat>(m_pFilter, m_iFilterKey, src, src_offset_x, src_offset_y, src_width, src_height, dst, dst_width, dst_height) :
+			ScaleSamples<CSamples16>(m_pFilter, m_iFilterKey, src, src_offset_x, src_offset_y, src_width, src_height, dst, dst_width, dst_height);
+		if (!bResult) {
+			FreeImage_Unload(dst);
+			return NULL;
+		}
+		return dst;
+	}
+
 	/*
 	Decide which filtering order (xy or yx) is faster for this mapping. 
 	--- The theory ---
@@ -403,7 +1259,13 @@ FIBITMAP* CResizeEngine::scale(FIBITMAP *src, unsigned dst_width, unsigned dst_h
 			}
 
 			// scale source image horizontally into temporary (or destination) image
-			horizontalFilter(src, src_height, src_width, src_offset_x, src_offset_y, src_pal, tmp, dst_width);
+			if (!horizontalFilter(src, src_height, src_width, src_offset_x, src_offset_y, src_pal, tmp, dst_width, bAlphaWeighted)) {
+				if (tmp != dst) {
+					FreeImage_Unload(tmp);
+				}
+				FreeImage_Unload(dst);
+				return NULL;
+			}
 
 			// set x and y offsets to zero for the second filter method
 			// invocation (the temporary image only contains the portion of
@@ -426,7 +1288,13 @@ FIBITMAP* CResizeEngine::scale(FIBITMAP *src, unsigned dst_width, unsigned dst_h
 		if (src_height != dst_height) {
 			// source and destination heights are different so, scale
 			// temporary (or source) image vertically into destination image
-			verticalFilter(tmp, dst_width, src_height, src_offset_x, src_offset_y, src_pal, dst, dst_height);
+			if (!verticalFilter(tmp, dst_width, src_height, src_offset_x, src_offset_y, src_pal, dst, dst_height, bAlphaWeighted)) {
+				if (tmp != src) {
+					FreeImage_Unload(tmp);
+				}
+				FreeImage_Unload(dst);
+				return NULL;
+			}
 		}
 
 		// free temporary image, if not pointing to either src or dst
@@ -469,7 +1337,13 @@ FIBITMAP* CResizeEngine::scale(FIBITMAP *src, unsigned dst_width, unsigned dst_h
 			}
 
 			// scale source image vertically into temporary (or destination) image
-			verticalFilter(src, src_width, src_height, src_offset_x, src_offset_y, src_pal, tmp, dst_height);
+			if (!verticalFilter(src, src_width, src_height, src_offset_x, src_offset_y, src_pal, tmp, dst_height, bAlphaWeighted)) {
+				if (tmp != dst) {
+					FreeImage_Unload(tmp);
+				}
+				FreeImage_Unload(dst);
+				return NULL;
+			}
 
 			// set x and y offsets to zero for the second filter method
 			// invocation (the temporary image only contains the portion of
@@ -493,7 +1367,13 @@ FIBITMAP* CResizeEngine::scale(FIBITMAP *src, unsigned dst_width, unsigned dst_h
 		if (src_width != dst_width) {
 			// source and destination heights are different so, scale
 			// temporary (or source) image horizontally into destination image
-			horizontalFilter(tmp, dst_height, src_width, src_offset_x, src_offset_y, src_pal, dst, dst_width);
+			if (!horizontalFilter(tmp, dst_height, src_width, src_offset_x, src_offset_y, src_pal, dst, dst_width, bAlphaWeighted)) {
+				if (tmp != src) {
+					FreeImage_Unload(tmp);
+				}
+				FreeImage_Unload(dst);
+				return NULL;
+			}
 		}
 
 		// free temporary image, if not pointing to either src or dst
@@ -505,10 +1385,14 @@ FIBITMAP* CResizeEngine::scale(FIBITMAP *src, unsigned dst_width, unsigned dst_h
 	return dst;
 } 
 
-void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsigned src_width, unsigned src_offset_x, unsigned src_offset_y, const RGBQUAD *const src_pal, FIBITMAP *const dst, unsigned dst_width) {
+BOOL CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsigned src_width, unsigned src_offset_x, unsigned src_offset_y, const RGBQUAD *const src_pal, FIBITMAP *const dst, unsigned dst_width, BOOL bAlphaWeighted) {
 
 	// allocate and calculate the contributions
-	CWeightsTable weightsTable(m_pFilter, dst_width, src_width);
+	CSharedWeightsTable sharedTable(m_pFilter, m_iFilterKey, dst_width, src_width);
+	if (!sharedTable.isValid()) {
+		return FALSE;
+	}
+	const CWeightsTable &weightsTable = sharedTable.get();
 
 	// step through rows
 	switch(FreeImage_GetImageType(src)) {
@@ -666,10 +1550,16 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 										const double weight = weightsTable.getWeight(x, i - iLeft);
 										const unsigned pixel = (src_bits[i >> 3] & (0x80 >> (i & 0x07))) != 0;
 										const BYTE * const entry = (BYTE *)&src_pal[pixel];
-										r += (weight * (double)entry[FI_RGBA_RED]);
-										g += (weight * (double)entry[FI_RGBA_GREEN]);
-										b += (weight * (double)entry[FI_RGBA_BLUE]);
-										a += (weight * (double)entry[FI_RGBA_ALPHA]);
+										const double alpha = (double)entry[FI_RGBA_ALPHA];
+										const double color_weight = bAlphaWeighted ? weight * alpha : weight;
+										r += (color_weight * (double)entry[FI_RGBA_RED]);
+										g += (color_weight * (double)entry[FI_RGBA_GREEN]);
+										b += (color_weight * (double)entry[FI_RGBA_BLUE]);
+										a += (weight * alpha);
+									}
+
+									if (bAlphaWeighted) {
+										DivideByAlphaSum(r, g, b, a);
 									}
 
 									// clamp and place result in destination pixel
@@ -781,10 +1671,16 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 										const double weight = weightsTable.getWeight(x, i - iLeft);
 										const unsigned pixel = i & 0x01 ? src_bits[i >> 1] & 0x0F : src_bits[i >> 1] >> 4;
 										const BYTE * const entry = (BYTE *)&src_pal[pixel];
-										r += (weight * (double)entry[FI_RGBA_RED]);
-										g += (weight * (double)entry[FI_RGBA_GREEN]);
-										b += (weight * (double)entry[FI_RGBA_BLUE]);
-										a += (weight * (double)entry[FI_RGBA_ALPHA]);
+										const double alpha = (double)entry[FI_RGBA_ALPHA];
+										const double color_weight = bAlphaWeighted ? weight * alpha : weight;
+										r += (color_weight * (double)entry[FI_RGBA_RED]);
+										g += (color_weight * (double)entry[FI_RGBA_GREEN]);
+										b += (color_weight * (double)entry[FI_RGBA_BLUE]);
+										a += (weight * alpha);
+									}
+
+									if (bAlphaWeighted) {
+										DivideByAlphaSum(r, g, b, a);
 									}
 
 									// clamp and place result in destination pixel
@@ -953,10 +1849,16 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 										// accumulate weighted effect of each neighboring pixel
 										const double weight = weightsTable.getWeight(x, i);
 										const BYTE * const entry = (BYTE *)&src_pal[pixel[i]];
-										r += (weight * (double)entry[FI_RGBA_RED]);
-										g += (weight * (double)entry[FI_RGBA_GREEN]);
-										b += (weight * (double)entry[FI_RGBA_BLUE]);
-										a += (weight * (double)entry[FI_RGBA_ALPHA]);
+										const double alpha = (double)entry[FI_RGBA_ALPHA];
+										const double color_weight = bAlphaWeighted ? weight * alpha : weight;
+										r += (color_weight * (double)entry[FI_RGBA_RED]);
+										g += (color_weight * (double)entry[FI_RGBA_GREEN]);
+										b += (color_weight * (double)entry[FI_RGBA_BLUE]);
+										a += (weight * alpha);
+									}
+
+									if (bAlphaWeighted) {
+										DivideByAlphaSum(r, g, b, a);
 									}
 
 									// clamp and place result in destination pixel
@@ -1100,13 +2002,19 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 								// scan between boundaries
 								// accumulate weighted effect of each neighboring pixel
 								const double weight = weightsTable.getWeight(x, i);
-								r += (weight * (double)pixel[FI_RGBA_RED]);
-								g += (weight * (double)pixel[FI_RGBA_GREEN]);
-								b += (weight * (double)pixel[FI_RGBA_BLUE]);
-								a += (weight * (double)pixel[FI_RGBA_ALPHA]);
+								const double alpha = (double)pixel[FI_RGBA_ALPHA];
+								const double color_weight = bAlphaWeighted ? weight * alpha : weight;
+								r += (color_weight * (double)pixel[FI_RGBA_RED]);
+								g += (color_weight * (double)pixel[FI_RGBA_GREEN]);
+								b += (color_weight * (double)pixel[FI_RGBA_BLUE]);
+								a += (weight * alpha);
 								pixel += 4;
 							}
 
+							if (bAlphaWeighted) {
+								DivideByAlphaSum(r, g, b, a);
+							}
+
 							// clamp and place result in destination pixel
 							dst_bits[FI_RGBA_RED]	= (BYTE)CLAMP<int>((int)(r + 0.5), 0, 0xFF);
 							dst_bits[FI_RGBA_GREEN]	= (BYTE)CLAMP<int>((int)(g + 0.5), 0, 0xFF);
@@ -1128,7 +2036,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 
 			for (unsigned y = 0; y < height; y++) {
 				// scale each row
-				const WORD *src_bits = (WORD*)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x / sizeof(WORD);
+				const WORD *src_bits = (WORD*)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x * wordspp;
 				WORD *dst_bits = (WORD*)FreeImage_GetScanLine(dst, y);
 
 				for (unsigned x = 0; x < dst_width; x++) {
@@ -1162,7 +2070,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 
 			for (unsigned y = 0; y < height; y++) {
 				// scale each row
-				const WORD *src_bits = (WORD*)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x / sizeof(WORD);
+				const WORD *src_bits = (WORD*)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x * wordspp;
 				WORD *dst_bits = (WORD*)FreeImage_GetScanLine(dst, y);
 
 				for (unsigned x = 0; x < dst_width; x++) {
@@ -1200,7 +2108,7 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 
 			for (unsigned y = 0; y < height; y++) {
 				// scale each row
-				const WORD *src_bits = (WORD*)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x / sizeof(WORD);
+				const WORD *src_bits = (WORD*)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x * wordspp;
 				WORD *dst_bits = (WORD*)FreeImage_GetScanLine(dst, y);
 
 				for (unsigned x = 0; x < dst_width; x++) {
@@ -1215,13 +2123,19 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 						// scan between boundaries
 						// accumulate weighted effect of each neighboring pixel
 						const double weight = weightsTable.getWeight(x, i);						
-						r += (weight * (double)pixel[0]);
-						g += (weight * (double)pixel[1]);
-						b += (weight * (double)pixel[2]);
-						a += (weight * (double)pixel[3]);
+						const double alpha = (double)pixel[3];
+						const double color_weight = bAlphaWeighted ? weight * alpha : weight;
+						r += (color_weight * (double)pixel[0]);
+						g += (color_weight * (double)pixel[1]);
+						b += (color_weight * (double)pixel[2]);
+						a += (weight * alpha);
 						pixel += wordspp;
 					}
 
+					if (bAlphaWeighted) {
+						DivideByAlphaSum(r, g, b, a);
+					}
+
 					// clamp and place result in destination pixel
 					dst_bits[0] = (WORD)CLAMP<int>((int)(r + 0.5), 0, 0xFFFF);
 					dst_bits[1] = (WORD)CLAMP<int>((int)(g + 0.5), 0, 0xFFFF);
@@ -1239,10 +2153,13 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 		{
 			// Calculate the number of floats per pixel (1 for 32-bit, 3 for 96-bit or 4 for 128-bit)
 			const unsigned floatspp = (FreeImage_GetLine(src) / src_width) / sizeof(float);
+			// with FI_RESCALE_ALPHA_WEIGHTED, the first 3 floats of RGBAF pixels are weighted by the 4th one
+			const BOOL bWeightColors = bAlphaWeighted && (floatspp == 4);
+			const unsigned color_count = bWeightColors ? 3 : floatspp;
 
 			for(unsigned y = 0; y < height; y++) {
 				// scale each row
-				const float *src_bits = (float*)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x / sizeof(float);
+				const float *src_bits = (float*)FreeImage_GetScanLine(src, y + src_offset_y) + src_offset_x * floatspp;
 				float *dst_bits = (float*)FreeImage_GetScanLine(dst, y);
 
 				for(unsigned x = 0; x < dst_width; x++) {
@@ -1256,12 +2173,20 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 						// accumulate weighted effect of each neighboring pixel
 						const double weight = weightsTable.getWeight(x, i-iLeft);
 
-						unsigned index = i * floatspp;	// pixel index
-						for (unsigned j = 0; j < floatspp; j++) {
-							value[j] += (weight * (double)src_bits[index++]);
+						const float *pixel = src_bits + i * floatspp;
+						const double color_weight = bWeightColors ? weight * (double)pixel[3] : weight;
+						for (unsigned j = 0; j < color_count; j++) {
+							value[j] += (color_weight * (double)pixel[j]);
+						}
+						if (bWeightColors) {
+							value[3] += (weight * (double)pixel[3]);
 						}
 					}
 
+					if (bWeightColors) {
+						DivideByAlphaSum(value[0], value[1], value[2], value[3]);
+					}
+
 					// place result in destination pixel
 					for (unsigned j = 0; j < floatspp; j++) {
 						dst_bits[j] = (float)value[j];
@@ -1273,13 +2198,19 @@ void CResizeEngine::horizontalFilter(FIBITMAP *const src, unsigned height, unsig
 		}
 		break;
 	}
+
+	return TRUE;
 }
 
 /// Performs vertical image filtering
-void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned src_height, unsigned src_offset_x, unsigned src_offset_y, const RGBQUAD *const src_pal, FIBITMAP *const dst, unsigned dst_height) {
+BOOL CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned src_height, unsigned src_offset_x, unsigned src_offset_y, const RGBQUAD *const src_pal, FIBITMAP *const dst, unsigned dst_height, BOOL bAlphaWeighted) {
 
 	// allocate and calculate the contributions
-	CWeightsTable weightsTable(m_pFilter, dst_height, src_height);
+	CSharedWeightsTable sharedTable(m_pFilter, m_iFilterKey, dst_height, src_height);
+	if (!sharedTable.isValid()) {
+		return FALSE;
+	}
+	const CWeightsTable &weightsTable = sharedTable.get();
 
 	// step through columns
 	switch(FreeImage_GetImageType(src)) {
@@ -1459,13 +2390,19 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 										const double weight = weightsTable.getWeight(y, i);
 										const unsigned pixel = (*src_bits & mask) != 0;
 										const BYTE * const entry = (BYTE *)&src_pal[pixel];
-										r += (weight * (double)entry[FI_RGBA_RED]);
-										g += (weight * (double)entry[FI_RGBA_GREEN]);
-										b += (weight * (double)entry[FI_RGBA_BLUE]);
-										a += (weight * (double)entry[FI_RGBA_ALPHA]);
+										const double alpha = (double)entry[FI_RGBA_ALPHA];
+										const double color_weight = bAlphaWeighted ? weight * alpha : weight;
+										r += (color_weight * (double)entry[FI_RGBA_RED]);
+										g += (color_weight * (double)entry[FI_RGBA_GREEN]);
+										b += (color_weight * (double)entry[FI_RGBA_BLUE]);
+										a += (weight * alpha);
 										src_bits += src_pitch;
 									}
 
+									if (bAlphaWeighted) {
+										DivideByAlphaSum(r, g, b, a);
+									}
+
 									// clamp and place result in destination pixel
 									dst_bits[FI_RGBA_RED]	= (BYTE)CLAMP<int>((int)(r + 0.5), 0, 0xFF);
 									dst_bits[FI_RGBA_GREEN]	= (BYTE)CLAMP<int>((int)(g + 0.5), 0, 0xFF);
@@ -1581,13 +2518,19 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 										const double weight = weightsTable.getWeight(y, i);
 										const unsigned pixel = x & 0x01 ? *src_bits & 0x0F : *src_bits >> 4;
 										const BYTE *const entry = (BYTE *)&src_pal[pixel];
-										r += (weight * (double)entry[FI_RGBA_RED]);
-										g += (weight * (double)entry[FI_RGBA_GREEN]);
-										b += (weight * (double)entry[FI_RGBA_BLUE]);
-										a += (weight * (double)entry[FI_RGBA_ALPHA]);
+										const double alpha = (double)entry[FI_RGBA_ALPHA];
+										const double color_weight = bAlphaWeighted ? weight * alpha : weight;
+										r += (color_weight * (double)entry[FI_RGBA_RED]);
+										g += (color_weight * (double)entry[FI_RGBA_GREEN]);
+										b += (color_weight * (double)entry[FI_RGBA_BLUE]);
+										a += (weight * alpha);
 										src_bits += src_pitch;
 									}
 
+									if (bAlphaWeighted) {
+										DivideByAlphaSum(r, g, b, a);
+									}
+
 									// clamp and place result in destination pixel
 									dst_bits[FI_RGBA_RED]	= (BYTE)CLAMP<int>((int)(r + 0.5), 0, 0xFF);
 									dst_bits[FI_RGBA_GREEN]	= (BYTE)CLAMP<int>((int)(g + 0.5), 0, 0xFF);
@@ -1756,13 +2699,19 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 										// accumulate weighted effect of each neighboring pixel
 										const double weight = weightsTable.getWeight(y, i);
 										const BYTE * const entry = (BYTE *)&src_pal[*src_bits];
-										r += (weight * (double)entry[FI_RGBA_RED]);
-										g += (weight * (double)entry[FI_RGBA_GREEN]);
-										b += (weight * (double)entry[FI_RGBA_BLUE]);
-										a += (weight * (double)entry[FI_RGBA_ALPHA]);
+										const double alpha = (double)entry[FI_RGBA_ALPHA];
+										const double color_weight = bAlphaWeighted ? weight * alpha : weight;
+										r += (color_weight * (double)entry[FI_RGBA_RED]);
+										g += (color_weight * (double)entry[FI_RGBA_GREEN]);
+										b += (color_weight * (double)entry[FI_RGBA_BLUE]);
+										a += (weight * alpha);
 										src_bits += src_pitch;
 									}
 
+									if (bAlphaWeighted) {
+										DivideByAlphaSum(r, g, b, a);
+									}
+
 									// clamp and place result in destination pixel
 									dst_bits[FI_RGBA_RED]	= (BYTE)CLAMP<int>((int)(r + 0.5), 0, 0xFF);
 									dst_bits[FI_RGBA_GREEN]	= (BYTE)CLAMP<int>((int)(g + 0.5), 0, 0xFF);
@@ -1911,13 +2860,19 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 								// scan between boundaries
 								// accumulate weighted effect of each neighboring pixel
 								const double weight = weightsTable.getWeight(y, i);
-								r += (weight * (double)src_bits[FI_RGBA_RED]);
-								g += (weight * (double)src_bits[FI_RGBA_GREEN]);
-								b += (weight * (double)src_bits[FI_RGBA_BLUE]);
-								a += (weight * (double)src_bits[FI_RGBA_ALPHA]);
+								const double alpha = (double)src_bits[FI_RGBA_ALPHA];
+								const double color_weight = bAlphaWeighted ? weight * alpha : weight;
+								r += (color_weight * (double)src_bits[FI_RGBA_RED]);
+								g += (color_weight * (double)src_bits[FI_RGBA_GREEN]);
+								b += (color_weight * (double)src_bits[FI_RGBA_BLUE]);
+								a += (weight * alpha);
 								src_bits += src_pitch;
 							}
 
+							if (bAlphaWeighted) {
+								DivideByAlphaSum(r, g, b, a);
+							}
+
 							// clamp and place result in destination pixel
 							dst_bits[FI_RGBA_RED]	= (BYTE)CLAMP<int>((int) (r + 0.5), 0, 0xFF);
 							dst_bits[FI_RGBA_GREEN]	= (BYTE)CLAMP<int>((int) (g + 0.5), 0, 0xFF);
@@ -2047,14 +3002,20 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 						// scan between boundaries
 						// accumulate weighted effect of each neighboring pixel
 						const double weight = weightsTable.getWeight(y, i);					
-						r += (weight * (double)src_bits[0]);
-						g += (weight * (double)src_bits[1]);
-						b += (weight * (double)src_bits[2]);
-						a += (weight * (double)src_bits[3]);
+						const double alpha = (double)src_bits[3];
+						const double color_weight = bAlphaWeighted ? weight * alpha : weight;
+						r += (color_weight * (double)src_bits[0]);
+						g += (color_weight * (double)src_bits[1]);
+						b += (color_weight * (double)src_bits[2]);
+						a += (weight * alpha);
 
 						src_bits += src_pitch;
 					}
 
+					if (bAlphaWeighted) {
+						DivideByAlphaSum(r, g, b, a);
+					}
+
 					// clamp and place result in destination pixel
 					dst_bits[0] = (WORD)CLAMP<int>((int)(r + 0.5), 0, 0xFFFF);
 					dst_bits[1] = (WORD)CLAMP<int>((int)(g + 0.5), 0, 0xFFFF);
@@ -2073,6 +3034,9 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 		{
 			// Calculate the number of floats per pixel (1 for 32-bit, 3 for 96-bit or 4 for 128-bit)
 			const unsigned floatspp = (FreeImage_GetLine(src) / width) / sizeof(float);
+			// with FI_RESCALE_ALPHA_WEIGHTED, the first 3 floats of RGBAF pixels are weighted by the 4th one
+			const BOOL bWeightColors = bAlphaWeighted && (floatspp == 4);
+			const unsigned color_count = bWeightColors ? 3 : floatspp;
 
 			const unsigned dst_pitch = FreeImage_GetPitch(dst) / sizeof(float);
 			float *const dst_base = (float *)FreeImage_GetBits(dst);
@@ -2097,12 +3061,20 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 						// scan between boundaries
 						// accumulate weighted effect of each neighboring pixel
 						const double weight = weightsTable.getWeight(y, i - iLeft);
-						for (unsigned j = 0; j < floatspp; j++) {
-							value[j] += (weight * (double)src_bits[j]);
+						const double color_weight = bWeightColors ? weight * (double)src_bits[3] : weight;
+						for (unsigned j = 0; j < color_count; j++) {
+							value[j] += (color_weight * (double)src_bits[j]);
+						}
+						if (bWeightColors) {
+							value[3] += (weight * (double)src_bits[3]);
 						}
 						src_bits += src_pitch;
 					}
 
+					if (bWeightColors) {
+						DivideByAlphaSum(value[0], value[1], value[2], value[3]);
+					}
+
 					// place result in destination pixel
 					for (unsigned j = 0; j < floatspp; j++) {
 						dst_bits[j] = (float)value[j];
@@ -2113,4 +3085,6 @@ void CResizeEngine::verticalFilter(FIBITMAP *const src, unsigned width, unsigned
 		}
 		break;
 	}
+
+	return TRUE;
 }
@@ -28,6 +28,14 @@
 #include "Utilities.h"
 #include "Filters.h" 
 
+/// Number of fractional bits of the fixed point weights used to filter 16-bit images
+#define FI_WEIGHT_BITS	14
+
+/// CWeightsTable option: also store the weights as floats (see CWeightsTable::getFloatWeights)
+#define FI_WEIGHTS_FLOAT	0x01
+/// CWeightsTable option: also store the weights as fixed point values (see CWeightsTable::getFixedWeights)
+#define FI_WEIGHTS_FIXED	0x02
+
 /**
   Filter weights table.<br>
   This class stores contribution information for an entire line (row or column).
@@ -52,6 +60,13 @@ private:
 	unsigned m_WindowSize;
 	/// Length of line (no. of rows / cols) 
 	unsigned m_LineLength;
+	/// Weights converted to floats (m_WindowSize per pixel), NULL without FI_WEIGHTS_FLOAT
+	float *m_FloatWeights;
+	/// Weights converted to FI_WEIGHT_BITS fixed point values (m_WindowSize per pixel), summing to 1 << FI_WEIGHT_BITS, NULL without FI_WEIGHTS_FIXED
+	short *m_FixedWeights;
+
+	/// Free the allocated tables
+	void destroy();
 
 public:
 	/** 
@@ -60,8 +75,9 @@ public:
 	@param pFilter Filter used for upsampling or downsampling
 	@param uDstSize Length (in pixels) of the destination line buffer
 	@param uSrcSize Length (in pixels) of the source line buffer
+	@param uFormats Additional weight formats to store, a combination of FI_WEIGHTS_FLOAT and FI_WEIGHTS_FIXED
 	*/
-	CWeightsTable(CGenericFilter *pFilter, unsigned uDstSize, unsigned uSrcSize);
+	CWeightsTable(CGenericFilter *pFilter, unsigned uDstSize, unsigned uSrcSize, unsigned uFormats = 0);
 
 	/**
 	Destructor<br>
@@ -69,12 +85,17 @@ public:
 	*/
 	~CWeightsTable();
 
+	/// Returns FALSE if the table could not be allocated
+	BOOL isValid() const {
+		return (m_WeightTable != NULL);
+	}
+
 	/** Retrieve a filter weight, given source and destination positions
 	@param dst_pos Pixel position in destination line buffer
 	@param src_pos Pixel position in source line buffer
 	@return Returns the filter weight
 	*/
-	double getWeight(unsigned dst_pos, unsigned src_pos) {
+	double getWeight(unsigned dst_pos, unsigned src_pos) const {
 		return m_WeightTable[dst_pos].Weights[src_pos];
 	}
 
@@ -82,7 +103,7 @@ public:
 	@param dst_pos Pixel position in destination line buffer
 	@return Returns the left boundary of source line buffer
 	*/
-	unsigned getLeftBoundary(unsigned dst_pos) {
+	unsigned getLeftBoundary(unsigned dst_pos) const {
 		return m_WeightTable[dst_pos].Left;
 	}
 
@@ -90,9 +111,79 @@ public:
 	@param dst_pos Pixel position in destination line buffer
 	@return Returns the right boundary of source line buffer
 	*/
-	unsigned getRightBoundary(unsigned dst_pos) {
+	unsigned getRightBoundary(unsigned dst_pos) const {
 		return m_WeightTable[dst_pos].Right;
 	}
+
+	/** Retrieve the filter weights of a destination pixel, as floats
+	@param dst_pos Pixel position in destination line buffer
+	@return Returns the weights of the source pixels, from the left boundary
+	*/
+	const float* getFloatWeights(unsigned dst_pos) const {
+		return m_FloatWeights + dst_pos * m_WindowSize;
+	}
+
+	/** Retrieve the filter weights of a destination pixel, as FI_WEIGHT_BITS fixed point values
+	@param dst_pos Pixel position in destination line buffer
+	@return Returns the weights of the source pixels, from the left boundary
+	*/
+	const short* getFixedWeights(unsigned dst_pos) const {
+		return m_FixedWeights + dst_pos * m_WindowSize;
+	}
+
+	/// Returns the number of weights stored in the table
+	size_t getSize() const {
+		return (size_t)m_LineLength * m_WindowSize;
+	}
+};
+
+// ---------------------------------------------
+
+/**
+  Shared filter weights table.<br>
+  Weights tables are immutable once computed : tables of small lines are kept in a 
+  process wide LRU cache, keyed by filter and line lengths, and shared by all threads 
+  resizing between the same dimensions. Larger tables, and tables of filters without 
+  a key, are computed for each use and freed with the CSharedWeightsTable.
+*/
+class CSharedWeightsTable
+{
+private:
+	/// Cached or private weights table
+	const CWeightsTable *m_pTable;
+	/// TRUE if m_pTable has been acquired from the cache
+	BOOL m_bCached;
+
+	CSharedWeightsTable& operator=(const CSharedWeightsTable&); // deleted
+	CSharedWeightsTable(const CSharedWeightsTable&); // deleted
+
+public:
+	/**
+	Constructor<br>
+	Retrieve the weights table from the cache, or compute it
+	@param pFilter Filter used for upsampling or downsampling
+	@param iFilterKey Filter identifier used as a cache key (a FREE_IMAGE_FILTER), -1 to bypass the cache
+	@param uDstSize Length (in pixels) of the destination line buffer
+	@param uSrcSize Length (in pixels) of the source line buffer
+	@param uFormats Additional weight formats to store, a combination of FI_WEIGHTS_FLOAT and FI_WEIGHTS_FIXED
+	*/
+	CSharedWeightsTable(CGenericFilter *pFilter, int iFilterKey, unsigned uDstSize, unsigned uSrcSize, unsigned uFormats = 0);
+
+	/**
+	Destructor<br>
+	Return the weights table to the cache, or destroy it
+	*/
+	~CSharedWeightsTable();
+
+	/// Returns FALSE if the table could not be allocated (get must not be called then)
+	BOOL isValid() const {
+		return (m_pTable != NULL);
+	}
+
+	/// Returns the weights table
+	const CWeightsTable& get() const {
+		return *m_pTable;
+	}
 };
 
 // ---------------------------------------------
@@ -116,14 +207,17 @@ class CResizeEngine
 private:
 	/// Pointer to the FIR / IIR filter
 	CGenericFilter* m_pFilter;
+	/// Filter identifier used to share the weights tables (see CSharedWeightsTable)
+	int m_iFilterKey;
 
 public:
 
 	/**
 	Constructor
 	@param filter FIR /IIR filter to be used
+	@param filter_key Filter identifier (a FREE_IMAGE_FILTER) used to cache the weights tables, -1 to compute them for each call
 	*/
-	CResizeEngine(CGenericFilter* filter):m_pFilter(filter) {}
+	CResizeEngine(CGenericFilter* filter, int filter_key = -1):m_pFilter(filter), m_iFilterKey(filter_key) {}
 
 	/// Destructor
 	virtual ~CResizeEngine() {}
@@ -172,10 +266,12 @@ private:
 	@param src_pal
 	@param dst Destination image
 	@param dst_width Destination image width
+	@param bAlphaWeighted TRUE to weight the color channels of RGBA pixels by their alpha (see FI_RESCALE_ALPHA_WEIGHTED)
+	@return Returns FALSE if the weights table could not be allocated
 	*/
-	void horizontalFilter(FIBITMAP * const src, const unsigned height, const unsigned src_width,
+	BOOL horizontalFilter(FIBITMAP * const src, const unsigned height, const unsigned src_width,
 			const unsigned src_offset_x, const unsigned src_offset_y, const RGBQUAD * const src_pal,
-			FIBITMAP * const dst, const unsigned dst_width);
+			FIBITMAP * const dst, const unsigned dst_width, BOOL bAlphaWeighted);
 
 	/**
 	Performs vertical image filtering
@@ -187,10 +283,12 @@ private:
 	@param src_pal
 	@param dst Destination image
 	@param dst_height Destination image height
+	@param bAlphaWeighted TRUE to weight the color channels of RGBA pixels by their alpha (see FI_RESCALE_ALPHA_WEIGHTED)
+	@return Returns FALSE if the weights table could not be allocated
 	*/
-	void verticalFilter(FIBITMAP * const src, const unsigned width, const unsigned src_height,
+	BOOL verticalFilter(FIBITMAP * const src, const unsigned width, const unsigned src_height,
 			const unsigned src_offset_x, const unsigned src_offset_y, const RGBQUAD * const src_pal,
-			FIBITMAP * const dst, const unsigned dst_height);
+			FIBITMAP * const dst, const unsigned dst_height, BOOL bAlphaWeighted);
 };
 
 #endif //   _RESIZE_H_
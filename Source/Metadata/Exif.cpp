@@ -873,6 +873,75 @@ jpeg_read_exif_profile(FIBITMAP *dib, const BYTE *data, unsigned length) {
 	return FALSE;
 }
 
+/**
+Read the Exif orientation from a JPEG_APP1 marker, without decoding the whole profile.
+Only the 0th IFD is scanned, so that the value is the one RotateExif would read from the FIMD_EXIF_MAIN model.
+@param data Pointer to the APP1 marker
+@param length APP1 marker length
+@param orientation Output orientation, in the range [1..8]
+@return Returns TRUE if the marker is an Exif profile with a valid orientation tag, returns FALSE otherwise
+@see PluginJPEG.cpp
+*/
+BOOL  
+jpeg_read_exif_orientation(const BYTE *data, unsigned length, WORD *orientation) {
+    // marker identifying string for Exif = "Exif\0\0"
+    BYTE exif_signature[6] = { 0x45, 0x78, 0x69, 0x66, 0x00, 0x00 };
+	BYTE lsb_first[4] = { 0x49, 0x49, 0x2A, 0x00 };		// Classic TIFF signature - little-endian order
+	BYTE msb_first[4] = { 0x4D, 0x4D, 0x00, 0x2A };		// Classic TIFF signature - big-endian order
+
+	// the marker should hold at least the identifying string and the TIFF header
+	if(length < sizeof(exif_signature) + 8) {
+		return FALSE;
+	}
+	if(memcmp(exif_signature, data, sizeof(exif_signature)) != 0) {
+		return FALSE;
+	}
+
+	const BYTE *pbProfile = data + sizeof(exif_signature);
+	const DWORD dwProfileLength = (DWORD)(length - sizeof(exif_signature));
+
+	// check the endianess order
+
+	BOOL bBigEndian = TRUE;
+
+	if(memcmp(pbProfile, lsb_first, sizeof(lsb_first)) == 0) {
+		bBigEndian = FALSE;
+	} else if(memcmp(pbProfile, msb_first, sizeof(msb_first)) != 0) {
+		// Invalid Exif alignment marker
+		return FALSE;
+	}
+
+	// scan the 0th IFD (2 bytes entry count, then 12 bytes entries)
+
+	const DWORD dwIfdOffset = ReadUint32(bBigEndian, pbProfile + 4);
+	if((dwIfdOffset > dwProfileLength) || (dwProfileLength - dwIfdOffset < 2)) {
+		return FALSE;
+	}
+	const DWORD dwEntries = ReadUint16(bBigEndian, pbProfile + dwIfdOffset);
+	if(dwEntries > (dwProfileLength - dwIfdOffset - 2) / 12) {
+		return FALSE;
+	}
+
+	for(DWORD i = 0; i < dwEntries; i++) {
+		const BYTE *entry = pbProfile + dwIfdOffset + 2 + 12 * i;
+
+		if(ReadUint16(bBigEndian, entry) == TAG_ORIENTATION) {
+			// type SHORT, the value is stored in the entry itself
+			if((ReadUint16(bBigEndian, entry + 2) != FIDT_SHORT) || (ReadUint32(bBigEndian, entry + 4) < 1)) {
+				return FALSE;
+			}
+			const WORD value = ReadUint16(bBigEndian, entry + 8);
+			if((value < 1) || (value > 8)) {
+				return FALSE;
+			}
+			*orientation = value;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
 // ==========================================================
 // Exif JPEG helper routines
 // ==========================================================
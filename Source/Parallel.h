@@ -0,0 +1,148 @@
+// ==========================================================
+// Parallel execution helpers
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+#ifndef FREEIMAGE_PARALLEL_H
+#define FREEIMAGE_PARALLEL_H
+
+#include "FreeImage.h"
+
+// ==========================================================
+//   Thread helpers used by the plugins to split independent
+//   blocks of work (strips, tiles, ...) among worker threads
+// ==========================================================
+
+/**
+Get the number of processors available to the process
+@return Returns the number of online processors, at least 1
+*/
+unsigned GetProcessorCount();
+
+/**
+Simple non-recursive mutex
+*/
+class ParallelMutex {
+public:
+	ParallelMutex();
+	~ParallelMutex();
+
+	void lock();
+	void unlock();
+
+private:
+	ParallelMutex& operator=(const ParallelMutex&); // deleted
+	ParallelMutex(const ParallelMutex&); // deleted
+
+private:
+	void *_mutex;
+};
+
+/**
+Scoped lock of a ParallelMutex
+*/
+class ParallelLock {
+public:
+	ParallelLock(ParallelMutex &mutex) : _mutex(mutex) {
+		_mutex.lock();
+	}
+	~ParallelLock() {
+		_mutex.unlock();
+	}
+
+private:
+	ParallelLock& operator=(const ParallelLock&); // deleted
+	ParallelLock(const ParallelLock&); // deleted
+
+private:
+	ParallelMutex &_mutex;
+};
+
+/**
+Block of work to be run by ParallelRun.
+*/
+class ParallelTask {
+public:
+	virtual ~ParallelTask() {}
+
+	/**
+	Process one work item. The function is called concurrently
+	from several threads and must not throw.
+	@param item Index of the work item, in [0, count)
+	@param thread Index of the calling thread, in [0, threads),
+	used to address per-thread resources
+	*/
+	virtual void run(unsigned item, unsigned thread) = 0;
+};
+
+/**
+Run task.run(item, thread) for every item in [0, count).
+Items are handed out in increasing order to the calling thread
+and up to (threads - 1) worker threads; the function returns when
+all items have been processed. If the worker threads cannot be
+created, the remaining items are processed by the calling thread.
+@param task Work to run
+@param count Number of work items
+@param threads Maximum number of threads, the calling thread included
+*/
+void ParallelRun(ParallelTask &task, unsigned count, unsigned threads);
+
+// ==========================================================
+//   Per-thread data kept by the plugins between two calls
+//   (e.g. decoder contexts reused from one image to the next)
+// ==========================================================
+
+/**
+Object stored in a ParallelThreadSlot
+*/
+class ParallelThreadData {
+public:
+	virtual ~ParallelThreadData() {}
+};
+
+/**
+Thread local storage slot, holding one ParallelThreadData object per thread. 
+The object of a thread is deleted when the thread exits. Slots are meant to be 
+static objects : when a slot is destroyed, only the object of the calling thread is deleted.
+*/
+class ParallelThreadSlot {
+public:
+	ParallelThreadSlot();
+	~ParallelThreadSlot();
+
+	/**
+	Remove the object of the calling thread from the slot. 
+	The caller owns the object until it is given back with put().
+	@return Returns the object, or NULL if the slot of the calling thread is empty
+	*/
+	ParallelThreadData* take();
+
+	/**
+	Store an object in the slot of the calling thread. 
+	If the slot is not empty or if thread local storage is not available, the object is deleted.
+	@param data Object to store, may be NULL
+	*/
+	void put(ParallelThreadData *data);
+
+private:
+	ParallelThreadSlot& operator=(const ParallelThreadSlot&); // deleted
+	ParallelThreadSlot(const ParallelThreadSlot&); // deleted
+
+private:
+	void *_key;
+};
+
+#endif // FREEIMAGE_PARALLEL_H
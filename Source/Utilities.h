@@ -52,6 +52,192 @@
 #include <limits>
 #include <memory>
 
+// ==========================================================
+//   SIMD support
+// ==========================================================
+
+// SSE2 is part of every x86-64 target and of x86 builds using /arch:SSE2 or -msse2.
+// Define FREEIMAGE_NO_SIMD to build the portable C++ code paths only.
+#if !defined(FREEIMAGE_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+#define FREEIMAGE_SSE2
+#include <emmintrin.h>
+#endif
+
+// SSSE3 and AVX2 code paths are compiled for their own target, whatever the compiler options,
+// and are only called when FreeImage_GetCPUFeatures reports the instruction set at run time.
+#if defined(FREEIMAGE_SSE2)
+#if defined(__clang__) || (defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))))
+#define FREEIMAGE_SSSE3
+#define FREEIMAGE_AVX2
+#define FI_TARGET_SSSE3	__attribute__((target("ssse3")))
+#define FI_TARGET_AVX2	__attribute__((target("avx2")))
+#elif defined(_MSC_VER)
+#if (_MSC_VER >= 1500)
+#define FREEIMAGE_SSSE3
+#define FI_TARGET_SSSE3
+#endif
+#if (_MSC_VER >= 1700)
+#define FREEIMAGE_AVX2
+#define FI_TARGET_AVX2
+#endif
+#endif
+#endif // FREEIMAGE_SSE2
+
+/**
+Line conversions with SIMD kernels selected from the CPU features (see ConversionSIMD.cpp)
+*/
+enum FI_LINE_CONVERSION {
+	FI_LINE_32TO24 = 0,
+	FI_LINE_24TO32,
+	FI_LINE_16TO24_555,
+	FI_LINE_16TO24_565,
+	FI_LINE_16TO32_555,
+	FI_LINE_16TO32_565,
+	FI_LINE_24TO16_555,
+	FI_LINE_24TO16_565,
+	FI_LINE_32TO16_555,
+	FI_LINE_32TO16_565,
+	FI_LINE_16_565_TO16_555,
+	FI_LINE_16_555_TO16_565,
+	FI_LINE_24TO8,
+	FI_LINE_32TO8,
+	FI_LINE_CONVERSION_COUNT
+};
+
+/**
+Convert the leading pixels of a scanline with the SIMD kernel selected for the CPU.
+The result is identical to the one of the scalar FreeImage_ConvertLine function.
+@param conversion Line conversion
+@param target Output line
+@param source Input line
+@param width_in_pixels Line width
+@return Returns the number of pixels converted (0 when there is no suitable kernel),
+the caller converts the remaining pixels
+*/
+int FreeImage_ConvertLineSIMD(FI_LINE_CONVERSION conversion, BYTE *target, const BYTE *source, int width_in_pixels);
+
+/**
+Find the minimum and maximum values of the leading samples of a greyscale image line
+with the SIMD kernel selected for the CPU. NaN samples are ignored.
+@param type Image type, one of FIT_UINT16, FIT_INT16, FIT_UINT32, FIT_INT32, FIT_FLOAT or FIT_DOUBLE
+@param source Input line
+@param width Line width
+@param min Minimum value, a sample of the image type updated with the samples processed
+@param max Maximum value, a sample of the image type updated with the samples processed
+@return Returns the number of samples processed (0 when there is no suitable kernel),
+the caller processes the remaining samples
+*/
+int FreeImage_FindMinMaxLineSIMD(FREE_IMAGE_TYPE type, const BYTE *source, int width, double& min, double& max);
+
+/**
+Scale the leading samples of a greyscale image line to 8-bit values with the SIMD kernel selected 
+for the CPU. Each sample v gives MIN(MAX(scale * (v - low) + 0.5, 0), 255) truncated to an integer, 
+NaN values giving 0. The difference (v - low) is computed in single precision for FIT_FLOAT samples
+and in double precision for the other types, the result is identical to the one of the scalar code.
+@param type Image type, one of FIT_UINT16, FIT_INT16, FIT_UINT32, FIT_INT32, FIT_FLOAT or FIT_DOUBLE
+@param target Output line
+@param source Input line
+@param width Line width
+@param low Low bound of the scaling, an integer value for 16-bit samples
+@param scale Scaling factor
+@return Returns the number of samples processed (0 when there is no suitable kernel),
+the caller processes the remaining samples
+*/
+int FreeImage_ScaleLineToByteSIMD(FREE_IMAGE_TYPE type, BYTE *target, const BYTE *source, int width, double low, double scale);
+
+/**
+Porter-Duff factors of the source and destination pixels of a compositing operator.
+Bit 1 selects the alpha of the other pixel instead of 1, bit 0 complements the factor.
+*/
+#define FI_PD_ZERO		0	// 0
+#define FI_PD_ONE		1	// 1
+#define FI_PD_ALPHA		2	// alpha of the other pixel
+#define FI_PD_INV_ALPHA	3	// 1 - alpha of the other pixel
+
+/**
+Composite the leading pixels of a source line over a target line with the SIMD kernel selected 
+for the CPU. The result is identical to the one of the scalar code of FreeImage_PasteComposite.
+@param type FIT_BITMAP (32-bit pixels) or FIT_RGBA16
+@param target Destination line, overwritten by the result
+@param source Source line
+@param width Line width in pixels
+@param src_factor Porter-Duff factor of the source pixels (FI_PD_ZERO to FI_PD_INV_ALPHA)
+@param dst_factor Porter-Duff factor of the destination pixels
+@param premultiplied TRUE if both lines hold premultiplied alpha pixels, FALSE for straight alpha
+@return Returns the number of pixels processed (0 when there is no suitable kernel),
+the caller processes the remaining pixels
+*/
+int FreeImage_CompositeLineSIMD(FREE_IMAGE_TYPE type, BYTE *target, const BYTE *source, int width, int src_factor, int dst_factor, BOOL premultiplied);
+
+/**
+Multiply the color channels of the leading pixels of a line by their alpha with the SIMD kernel selected for the CPU 
+(see FreeImage_PreMultiplyWithAlpha)
+@param type FIT_BITMAP (32-bit pixels), FIT_RGBA16 or FIT_RGBAF
+@param bits Line of pixels, processed in place
+@param width Line width in pixels
+@return Returns the number of pixels processed (0 when there is no suitable kernel),
+the caller processes the remaining pixels
+*/
+int FreeImage_PreMultiplyLineSIMD(FREE_IMAGE_TYPE type, BYTE *bits, int width);
+
+/**
+Divide the color channels of the leading pixels of a line by their alpha with the SIMD kernel selected for the CPU 
+(see FreeImage_UnPreMultiplyWithAlpha). Parameters and return value are the ones of FreeImage_PreMultiplyLineSIMD.
+*/
+int FreeImage_UnPreMultiplyLineSIMD(FREE_IMAGE_TYPE type, BYTE *bits, int width);
+
+/**
+Blend the leading pixels of a 32-bit foreground line with a 32-bit background line, as FreeImage_Composite, 
+with the SIMD kernel selected for the CPU. The alpha channel of the target line is left undefined.
+@return Returns the number of pixels processed, the caller processes the remaining pixels
+*/
+int FreeImage_BlendBackgroundLineSIMD(BYTE *target, const BYTE *foreground, const BYTE *background, int width);
+
+/**
+Add the leading samples of a line of bytes, multiplied by a weight, to 32-bit sums 
+with the SIMD kernel selected for the CPU (see the area averaging of CResizeEngine)
+@param sums Sums of the samples, updated in place
+@param source Line of samples
+@param count Number of samples
+@param weight Weight of the samples, from 0 to 256
+@return Returns the number of samples processed, the caller processes the remaining samples
+*/
+int FreeImage_AccumulateLineSIMD(DWORD *sums, const BYTE *source, int count, unsigned weight);
+
+/**
+Add the leading samples of a line of floats, multiplied by a weight, to float sums 
+with the SIMD kernel selected for the CPU (see the 16-bit and float resampling of CResizeEngine)
+@return Returns the number of samples processed, the caller processes the remaining samples
+*/
+int FreeImage_AccumulateLineFSIMD(float *sums, const float *source, int count, float weight);
+
+/**
+Add the leading samples of two lines of 16-bit samples to 32-bit sums with the SIMD kernel selected for the CPU : 
+sums[i] += (source0[i] - 0x8000) * weight0 + (source1[i] - 0x8000) * weight1
+@param weight0 Fixed point weight of the first line, in the range of a short
+@param weight1 Fixed point weight of the second line, in the range of a short
+@return Returns the number of samples processed, the caller processes the remaining samples
+*/
+int FreeImage_AccumulateLine16SIMD(int *sums, const WORD *source0, const WORD *source1, int count, int weight0, int weight1);
+
+/**
+Transpose the leading pixels of a tile with the SIMD kernel selected for the CPU (see TransposePixels) :
+the (width - width % block) x (height - height % block) top-left source pixels are transposed by square blocks
+@param bytespp # of bytes per pixel
+@return Returns the size of the blocks in pixels (0 when there is no suitable kernel),
+the caller transposes the remaining pixels
+*/
+int FreeImage_TransposeTileSIMD(BYTE *dst, int dst_pitch, const BYTE *src, int src_pitch, int width, int height, unsigned bytespp);
+
+/**
+Copy the leading pixels of a line in reverse order with the SIMD kernel selected for the CPU (see ReversePixels) :
+the first pixels of the source line are written at the end of the destination line
+@param bytespp # of bytes per pixel
+@return Returns the number of pixels processed (0 when there is no suitable kernel),
+the caller copies the remaining source pixels to the start of the destination line
+*/
+int FreeImage_ReverseLineSIMD(BYTE *dst, const BYTE *src, int width, unsigned bytespp);
+
 // ==========================================================
 //   Bitmap palette and pixels alignment
 // ==========================================================
@@ -356,6 +542,32 @@ AssignPixel(BYTE* dst, const BYTE* src, unsigned bytesperpixel) {
 	}
 }
 
+/**
+Transpose a block of pixels: the pixel at column x of source line y is copied to column y of destination line x.
+The block is processed by cache-sized tiles, using SIMD micro-kernels when available.
+Lines can be walked backwards by passing a pointer to the last line and a negative pitch, so that
+all right-angle rotations and flips of an image reduce to one call.
+@param dst Destination pixel at (0, 0)
+@param dst_pitch Signed distance in bytes between two destination lines
+@param src Source pixel at (0, 0)
+@param src_pitch Signed distance in bytes between two source lines
+@param width Number of source columns (destination lines)
+@param height Number of source lines (destination columns)
+@param bytespp # of bytes per pixel (1, 2, 3, 4, 6, 8, 12 or 16)
+@see See definition in Flip.cpp
+*/
+void TransposePixels(BYTE *dst, int dst_pitch, const BYTE *src, int src_pitch, unsigned width, unsigned height, unsigned bytespp);
+
+/**
+Copy a line of pixels in reverse order. Source and destination must not overlap.
+@param dst Destination line
+@param src Source line
+@param width Number of pixels
+@param bytespp # of bytes per pixel (1, 2, 3, 4, 6, 8, 12 or 16)
+@see See definition in Flip.cpp
+*/
+void ReversePixels(BYTE *dst, const BYTE *src, unsigned width, unsigned bytespp);
+
 /**
 Swap red and blue channels in a 24- or 32-bit dib. 
 @return Returns TRUE if successful, returns FALSE otherwise
@@ -59,6 +59,17 @@ int main(int argc, char *argv[]) {
 	// initialize our own FreeImage error handler
 	FreeImage_SetOutputMessage(FreeImageErrorHandler);
 
+	// 'Test bench' : run the benchmarks only
+	if((argc > 1) && (strcmp(argv[1], "bench") == 0)) {
+		benchConvertLine();
+		benchFlipRotate();
+		benchPNG();
+#if defined(FREEIMAGE_LIB) || !defined(WIN32)
+		FreeImage_DeInitialise();
+#endif
+		return 0;
+	}
+
 	// test plugins capabilities
 	showPlugins();
 
@@ -87,6 +98,11 @@ int main(int argc, char *argv[]) {
 	// test JPEG lossless transform & cropping
 	testJPEG();
 
+#ifndef TEST_WITHOUT_EXR
+	// test OpenEXR region loading
+	testEXR();
+#endif
+
 	// test get/set channel
 	testImageChannels(width, height);
 
@@ -102,6 +118,27 @@ int main(int argc, char *argv[]) {
 	// test wrapped user buffer
 	testWrappedBuffer("exif.jpg", 0);
 
+	// test the SIMD line conversions against the scalar ones
+	testConvertLine();
+
+	// test the right-angle rotations and the flips with every instruction set
+	testFlipRotate();
+
+	// test the Porter-Duff compositing and alpha premultiplication
+	testComposite();
+
+	// test the row pipeline against the chained conversions
+	testRowPipeline();
+
+	// test the resampling options
+	testResize();
+
+	// test the ZLib compression and decompression streams
+	testZLib();
+
+	// test the PNG round trips, plain and interlaced
+	testPNG();
+
 #if defined(FREEIMAGE_LIB) || !defined(WIN32)
 	FreeImage_DeInitialise();
 #endif
@@ -29,6 +29,8 @@
 #include <assert.h>
 #include <sys/stat.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #if (defined(WIN32) || defined(__WIN32__))
 #if (defined(_DEBUG))
@@ -77,6 +79,11 @@ void testMultiPageMemory(const char *lpszPathName);
 
 void testJPEG();
 
+// OpenEXR test suite
+// ==========================================================
+
+void testEXR();
+
 // Channels test suite
 // ==========================================================
 
@@ -92,6 +99,44 @@ void testThumbnail(const char *lpszPathName, int flags);
 
 void testWrappedBuffer(const char *lpszPathName, int flags);
 
+// Line conversion test suite
+// ==========================================================
+
+void testConvertLine();
+void benchConvertLine();
+
+// Rotation and flipping test suite
+// ==========================================================
+
+void testFlipRotate();
+void benchFlipRotate();
+
+// Compositing test suite
+// ==========================================================
+
+void testComposite();
+
+// Row pipeline test suite
+// ==========================================================
+
+void testRowPipeline();
+
+// Resampling test suite
+// ==========================================================
+
+void testResize();
+
+// PNG test suite
+// ==========================================================
+
+void testPNG();
+void benchPNG();
+
+// ZLib streams test suite
+// ==========================================================
+
+void testZLib();
+
 #endif // TEST_FREEIMAGE_API_H
 
 
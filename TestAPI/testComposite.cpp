@@ -0,0 +1,581 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+// Local test functions
+// ----------------------------------------------------------
+
+// instruction sets tested, the scalar code (no feature) being the reference
+static const unsigned s_feature_levels[] = {
+	0,
+	FI_CPU_SSE2,
+	FI_CPU_SSE2 | FI_CPU_SSSE3,
+	FI_CPU_SSE2 | FI_CPU_SSSE3 | FI_CPU_AVX2
+};
+
+static const int s_level_count = sizeof(s_feature_levels) / sizeof(s_feature_levels[0]);
+
+/**
+Returns TRUE if the CPU supports every feature of the level
+*/
+static BOOL
+selectFeatureLevel(int level) {
+	const unsigned features = s_feature_levels[level];
+	return (FreeImage_SetCPUFeatures(features) == features) ? TRUE : FALSE;
+}
+
+/**
+Fill a 32-bit image with a single straight alpha pixel
+*/
+static void
+fillPixel(FIBITMAP *dib, BYTE red, BYTE green, BYTE blue, BYTE alpha) {
+	for(unsigned y = 0; y < FreeImage_GetHeight(dib); y++) {
+		BYTE *bits = FreeImage_GetScanLine(dib, y);
+		for(unsigned x = 0; x < FreeImage_GetWidth(dib); x++, bits += 4) {
+			bits[FI_RGBA_RED] = red;
+			bits[FI_RGBA_GREEN] = green;
+			bits[FI_RGBA_BLUE] = blue;
+			bits[FI_RGBA_ALPHA] = alpha;
+		}
+	}
+}
+
+/**
+Returns TRUE if every pixel of a 32-bit image is the given pixel
+*/
+static BOOL
+checkPixel(FIBITMAP *dib, BYTE red, BYTE green, BYTE blue, BYTE alpha) {
+	for(unsigned y = 0; y < FreeImage_GetHeight(dib); y++) {
+		const BYTE *bits = FreeImage_GetScanLine(dib, y);
+		for(unsigned x = 0; x < FreeImage_GetWidth(dib); x++, bits += 4) {
+			if((bits[FI_RGBA_RED] != red) || (bits[FI_RGBA_GREEN] != green) || (bits[FI_RGBA_BLUE] != blue) || (bits[FI_RGBA_ALPHA] != alpha)) {
+				return FALSE;
+			}
+		}
+	}
+	return TRUE;
+}
+
+/**
+Fill an image with pseudo random bytes
+*/
+static void
+fillRandom(FIBITMAP *dib, unsigned &seed) {
+	for(unsigned y = 0; y < FreeImage_GetHeight(dib); y++) {
+		BYTE *bits = FreeImage_GetScanLine(dib, y);
+		for(unsigned i = 0; i < FreeImage_GetLine(dib); i++) {
+			seed = seed * 1103515245 + 12345;
+			bits[i] = (BYTE)(seed >> 16);
+		}
+	}
+}
+
+/**
+Check Porter-Duff identities with any destination pixels, with every instruction set : 
+SRC_OVER of an opaque source replaces the destination, SRC_OVER of a fully transparent 
+source leaves it unchanged (exactly for premultiplied pixels and opaque straight pixels)
+*/
+static void
+testPorterDuffIdentities(FREE_IMAGE_TYPE image_type) {
+	const int width = 37;
+	const int height = 5;
+	const unsigned bytespp = (image_type == FIT_BITMAP) ? 4 : 8;
+	unsigned seed = 8642;
+
+	FIBITMAP *dst = (image_type == FIT_BITMAP) ? FreeImage_Allocate(width, height, 32) : FreeImage_AllocateT(image_type, width, height);
+	FIBITMAP *opaque = FreeImage_Clone(dst);
+	FIBITMAP *transparent = FreeImage_Clone(dst);
+	assert(dst && opaque && transparent);
+	fillRandom(dst, seed);
+	fillRandom(opaque, seed);
+	fillRandom(transparent, seed);
+
+	// opaque source pixels, and transparent source pixels (black, as premultiplied pixels)
+	for(int y = 0; y < height; y++) {
+		BYTE *opaque_bits = FreeImage_GetScanLine(opaque, y);
+		BYTE *transparent_bits = FreeImage_GetScanLine(transparent, y);
+		for(int x = 0; x < width; x++) {
+			if(image_type == FIT_BITMAP) {
+				opaque_bits[4 * x + FI_RGBA_ALPHA] = 0xFF;
+				memset(transparent_bits + 4 * x, 0, 4);
+			} else {
+				((FIRGBA16*)opaque_bits)[x].alpha = 0xFFFF;
+				memset((FIRGBA16*)transparent_bits + x, 0, sizeof(FIRGBA16));
+			}
+		}
+	}
+
+	// opaque straight alpha destination
+	FIBITMAP *opaque_dst = FreeImage_Clone(dst);
+	assert(opaque_dst != NULL);
+	for(int y = 0; y < height; y++) {
+		BYTE *bits = FreeImage_GetScanLine(opaque_dst, y);
+		for(int x = 0; x < width; x++) {
+			if(image_type == FIT_BITMAP) {
+				bits[4 * x + FI_RGBA_ALPHA] = 0xFF;
+			} else {
+				((FIRGBA16*)bits)[x].alpha = 0xFFFF;
+			}
+		}
+	}
+
+	for(int level = 0; level < s_level_count; level++) {
+		if(!selectFeatureLevel(level)) {
+			continue;
+		}
+		for(int premultiplied = 0; premultiplied < 2; premultiplied++) {
+			// an opaque source replaces the destination
+			FIBITMAP *target = FreeImage_Clone(dst);
+			assert(FreeImage_PasteComposite(target, opaque, 0, 0, FIPD_SRC_OVER, premultiplied));
+			for(int y = 0; y < height; y++) {
+				assert(memcmp(FreeImage_GetScanLine(target, y), FreeImage_GetScanLine(opaque, y), width * bytespp) == 0);
+			}
+			FreeImage_Unload(target);
+
+			// a fully transparent source leaves the destination unchanged
+			FIBITMAP *reference = premultiplied ? dst : opaque_dst;
+			target = FreeImage_Clone(reference);
+			assert(FreeImage_PasteComposite(target, transparent, 0, 0, FIPD_SRC_OVER, premultiplied));
+			for(int y = 0; y < height; y++) {
+				assert(memcmp(FreeImage_GetScanLine(target, y), FreeImage_GetScanLine(reference, y), width * bytespp) == 0);
+			}
+			FreeImage_Unload(target);
+		}
+	}
+	FreeImage_SetCPUFeatures(0xFFFFFFFF);
+
+	FreeImage_Unload(opaque_dst);
+	FreeImage_Unload(transparent);
+	FreeImage_Unload(opaque);
+	FreeImage_Unload(dst);
+}
+
+/**
+Check hand computed results of Porter-Duff operators on 50% alpha pixels, with every instruction set
+*/
+static void
+testPorterDuffValues() {
+	const int width = 37;
+	const int height = 2;
+
+	FIBITMAP *dst = FreeImage_Allocate(width, height, 32);
+	FIBITMAP *src = FreeImage_Allocate(width, height, 32);
+	assert(dst && src);
+
+	for(int level = 0; level < s_level_count; level++) {
+		if(!selectFeatureLevel(level)) {
+			continue;
+		}
+
+		// DST_IN : the opaque destination gets the source alpha
+		// colors are premultiplied by 1 (exact), scaled by 128 / 255, then divided by 128 / 255 : 
+		// red round(200 * 128 / 255) = 100 -> round(100 * 255 / 128) = 199, green 100 -> 50 -> 100, blue 50 -> 25 -> 50
+		fillPixel(dst, 200, 100, 50, 255);
+		fillPixel(src, 10, 20, 30, 128);
+		assert(FreeImage_PasteComposite(dst, src, 0, 0, FIPD_DST_IN, FALSE));
+		assert(checkPixel(dst, 199, 100, 50, 128));
+
+		// XOR of a 50% red source and a 50% blue destination : 
+		// alpha = 0.5 * (1 - 0.5) + 0.5 * (1 - 0.5) = 0.5, color = (0.25 * red + 0.25 * blue) / 0.5
+		// premultiplied red = round(255 * 128 / 255) = 128, scaled by 127 / 255 = 64, divided by 128 / 255 = 128
+		fillPixel(dst, 0, 0, 255, 128);
+		fillPixel(src, 255, 0, 0, 128);
+		assert(FreeImage_PasteComposite(dst, src, 0, 0, FIPD_XOR, FALSE));
+		assert(checkPixel(dst, 128, 0, 128, 128));
+
+		// same operators on premultiplied pixels (no division by the resulting alpha)
+		fillPixel(dst, 200, 100, 50, 255);
+		fillPixel(src, 10, 20, 30, 128);
+		assert(FreeImage_PasteComposite(dst, src, 0, 0, FIPD_DST_IN, TRUE));
+		assert(checkPixel(dst, 100, 50, 25, 128));
+
+		fillPixel(dst, 0, 0, 128, 128);
+		fillPixel(src, 128, 0, 0, 128);
+		assert(FreeImage_PasteComposite(dst, src, 0, 0, FIPD_XOR, TRUE));
+		assert(checkPixel(dst, 64, 0, 64, 128));
+	}
+	FreeImage_SetCPUFeatures(0xFFFFFFFF);
+
+	FreeImage_Unload(src);
+	FreeImage_Unload(dst);
+}
+
+/**
+Get a channel (0 = red, 1 = green, 2 = blue, 3 = alpha) of a 32-bit, RGBA16 or RGBAF pixel
+*/
+static double
+getChannel(FIBITMAP *dib, unsigned x, unsigned y, int channel) {
+	static const int byte_index[4] = { FI_RGBA_RED, FI_RGBA_GREEN, FI_RGBA_BLUE, FI_RGBA_ALPHA };
+	BYTE *bits = FreeImage_GetScanLine(dib, y);
+	switch(FreeImage_GetImageType(dib)) {
+		case FIT_BITMAP:
+			return bits[4 * x + byte_index[channel]];
+		case FIT_RGBA16:
+			return ((WORD*)bits)[4 * x + channel];
+		default:
+			return ((float*)bits)[4 * x + channel];
+	}
+}
+
+static void
+setChannel(FIBITMAP *dib, unsigned x, unsigned y, int channel, double value) {
+	static const int byte_index[4] = { FI_RGBA_RED, FI_RGBA_GREEN, FI_RGBA_BLUE, FI_RGBA_ALPHA };
+	BYTE *bits = FreeImage_GetScanLine(dib, y);
+	switch(FreeImage_GetImageType(dib)) {
+		case FIT_BITMAP:
+			bits[4 * x + byte_index[channel]] = (BYTE)value;
+			break;
+		case FIT_RGBA16:
+			((WORD*)bits)[4 * x + channel] = (WORD)value;
+			break;
+		default:
+			((float*)bits)[4 * x + channel] = (float)value;
+			break;
+	}
+}
+
+/**
+Check FreeImage_PreMultiplyWithAlpha on known values, with every instruction set : 
+half intensity at half alpha gives a quarter intensity, alpha 0 zeroes the colors 
+and opaque pixels are left unchanged
+*/
+static void
+testPreMultiplyValues(FREE_IMAGE_TYPE image_type) {
+	const int width = 37;
+	// channel maximum and half, and premultiplied half intensity at half alpha : 
+	// round(128 * 128 / 255) = 64, round(32768 * 32768 / 65535) = 16384
+	const double max = (image_type == FIT_BITMAP) ? 255 : (image_type == FIT_RGBA16) ? 65535 : 1;
+	const double half = (image_type == FIT_BITMAP) ? 128 : (image_type == FIT_RGBA16) ? 32768 : 0.5;
+	const double quarter = (image_type == FIT_BITMAP) ? 64 : (image_type == FIT_RGBA16) ? 16384 : 0.25;
+
+	FIBITMAP *src = (image_type == FIT_BITMAP) ? FreeImage_Allocate(width, 1, 32) : FreeImage_AllocateT(image_type, width, 1);
+	assert(src != NULL);
+
+	for(int x = 0; x < width; x++) {
+		// some color, less than max
+		const double color = (image_type == FIT_RGBAF) ? x / 64.0 : (double)(x * 3 + 1);
+		switch(x % 3) {
+			case 0:
+				setChannel(src, x, 0, 0, half);
+				setChannel(src, x, 0, 1, max);
+				setChannel(src, x, 0, 2, 0);
+				setChannel(src, x, 0, 3, half);
+				break;
+			case 1:
+				setChannel(src, x, 0, 0, color);
+				setChannel(src, x, 0, 1, max);
+				setChannel(src, x, 0, 2, half);
+				setChannel(src, x, 0, 3, 0);
+				break;
+			case 2:
+				setChannel(src, x, 0, 0, color);
+				setChannel(src, x, 0, 1, max);
+				setChannel(src, x, 0, 2, half);
+				setChannel(src, x, 0, 3, max);
+				break;
+		}
+	}
+
+	for(int level = 0; level < s_level_count; level++) {
+		if(!selectFeatureLevel(level)) {
+			continue;
+		}
+		FIBITMAP *dst = FreeImage_Clone(src);
+		assert(FreeImage_PreMultiplyWithAlpha(dst));
+		for(int x = 0; x < width; x++) {
+			switch(x % 3) {
+				case 0:
+					assert(getChannel(dst, x, 0, 0) == quarter);
+					assert(getChannel(dst, x, 0, 1) == half);
+					assert(getChannel(dst, x, 0, 2) == 0);
+					assert(getChannel(dst, x, 0, 3) == half);
+					break;
+				case 1:
+					for(int c = 0; c < 4; c++) {
+						assert(getChannel(dst, x, 0, c) == 0);
+					}
+					break;
+				case 2:
+					for(int c = 0; c < 4; c++) {
+						assert(getChannel(dst, x, 0, c) == getChannel(src, x, 0, c));
+					}
+					break;
+			}
+		}
+		FreeImage_Unload(dst);
+	}
+	FreeImage_SetCPUFeatures(0xFFFFFFFF);
+
+	FreeImage_Unload(src);
+}
+
+/**
+Check that FreeImage_UnPreMultiplyWithAlpha reverts FreeImage_PreMultiplyWithAlpha within the rounding 
+errors, with every instruction set : each row has its own alpha (every 8-bit value, 256 values spread 
+over the range for the other types) and the pixels of a row have every color of the same range. 
+A color c premultiplied by alpha a is rounded by at most 1/2, which becomes max / (2 a) once divided 
+by a, plus 1/2 for the rounding of the division. Fully transparent pixels become black.
+*/
+static void
+testPreMultiplyRoundTrip(FREE_IMAGE_TYPE image_type) {
+	const int size = 256;
+	const double max = (image_type == FIT_BITMAP) ? 255 : (image_type == FIT_RGBA16) ? 65535 : 1;
+
+	FIBITMAP *src = (image_type == FIT_BITMAP) ? FreeImage_Allocate(size, size, 32) : FreeImage_AllocateT(image_type, size, size);
+	assert(src != NULL);
+
+	for(int y = 0; y < size; y++) {
+		for(int x = 0; x < size; x++) {
+			// 0 to 255, 0 to 65535, 0 to 1
+			const double color = (image_type == FIT_BITMAP) ? x : (image_type == FIT_RGBA16) ? x * 257 : x / 255.0;
+			setChannel(src, x, y, 0, color);
+			setChannel(src, x, y, 1, max - color);
+			setChannel(src, x, y, 2, (image_type == FIT_RGBAF) ? color / 3 : floor(color / 3));
+			setChannel(src, x, y, 3, (image_type == FIT_BITMAP) ? y : (image_type == FIT_RGBA16) ? y * 257 : y / 255.0);
+		}
+	}
+
+	for(int level = 0; level < s_level_count; level++) {
+		if(!selectFeatureLevel(level)) {
+			continue;
+		}
+		FIBITMAP *dst = FreeImage_Clone(src);
+		assert(FreeImage_PreMultiplyWithAlpha(dst));
+		assert(FreeImage_UnPreMultiplyWithAlpha(dst));
+		for(int y = 0; y < size; y++) {
+			for(int x = 0; x < size; x++) {
+				const double alpha = getChannel(src, x, y, 3);
+				assert(getChannel(dst, x, y, 3) == alpha);
+				for(int c = 0; c < 3; c++) {
+					const double value = getChannel(dst, x, y, c);
+					if(alpha == 0) {
+						assert(value == 0);
+					} else if(image_type == FIT_RGBAF) {
+						assert(fabs(value - getChannel(src, x, y, c)) <= 1e-6);
+					} else {
+						assert(fabs(value - getChannel(src, x, y, c)) <= max / (2 * alpha) + 0.5);
+					}
+				}
+			}
+		}
+		FreeImage_Unload(dst);
+	}
+	FreeImage_SetCPUFeatures(0xFFFFFFFF);
+
+	FreeImage_Unload(src);
+}
+
+/**
+Compare the SIMD and scalar code paths of FreeImage_PreMultiplyWithAlpha and FreeImage_UnPreMultiplyWithAlpha 
+on images of every width up to 40 pixels
+*/
+static void
+testPreMultiplyLevels(FREE_IMAGE_TYPE image_type) {
+	const int height = 3;
+	unsigned seed = 2468;
+
+	for(int width = 1; width <= 40; width++) {
+		FIBITMAP *src = (image_type == FIT_BITMAP) ? FreeImage_Allocate(width, height, 32) : FreeImage_AllocateT(image_type, width, height);
+		assert(src != NULL);
+		for(int y = 0; y < height; y++) {
+			BYTE *bits = FreeImage_GetScanLine(src, y);
+			for(int x = 0; x < 4 * width; x++) {
+				seed = seed * 1103515245 + 12345;
+				const unsigned value = (seed >> 16) & 0xFF;
+				switch(image_type) {
+					case FIT_BITMAP:
+						bits[x] = (BYTE)value;
+						break;
+					case FIT_RGBA16:
+						((WORD*)bits)[x] = (WORD)(value * 257 + (seed & 0xFF));
+						break;
+					default:
+						// some fully transparent pixels
+						((float*)bits)[x] = (value < 32) ? 0 : (float)value / 255;
+						break;
+				}
+			}
+		}
+
+		for(int premultiply = 0; premultiply < 2; premultiply++) {
+			selectFeatureLevel(0);
+			FIBITMAP *reference = FreeImage_Clone(src);
+			assert(premultiply ? FreeImage_PreMultiplyWithAlpha(reference) : FreeImage_UnPreMultiplyWithAlpha(reference));
+
+			for(int level = 1; level < s_level_count; level++) {
+				if(selectFeatureLevel(level)) {
+					FIBITMAP *dst = FreeImage_Clone(src);
+					assert(premultiply ? FreeImage_PreMultiplyWithAlpha(dst) : FreeImage_UnPreMultiplyWithAlpha(dst));
+					for(int y = 0; y < height; y++) {
+						assert(memcmp(FreeImage_GetScanLine(dst, y), FreeImage_GetScanLine(reference, y), FreeImage_GetLine(src)) == 0);
+					}
+					FreeImage_Unload(dst);
+				}
+			}
+			FreeImage_Unload(reference);
+		}
+
+		FreeImage_Unload(src);
+	}
+}
+
+
+/**
+Compare the SIMD and scalar code paths of FreeImage_PasteComposite for every Porter-Duff operator, 
+on source images of every width up to 40 pixels pasted partially outside the destination image
+*/
+static void
+testPasteCompositeLevels(FREE_IMAGE_TYPE image_type) {
+	const int dst_width = 24;
+	const int height = 3;
+	unsigned seed = 4321;
+
+	FIBITMAP *dst = (image_type == FIT_BITMAP) ? FreeImage_Allocate(dst_width, height, 32) : FreeImage_AllocateT(image_type, dst_width, height);
+	assert(dst != NULL);
+	const unsigned pitch = FreeImage_GetPitch(dst);
+	const unsigned line = FreeImage_GetLine(dst);
+	for(int y = 0; y < height; y++) {
+		BYTE *bits = FreeImage_GetScanLine(dst, y);
+		for(unsigned i = 0; i < line; i++) {
+			seed = seed * 1103515245 + 12345;
+			bits[i] = (BYTE)(seed >> 16);
+		}
+	}
+
+	for(int width = 1; width <= 40; width++) {
+		FIBITMAP *src = (image_type == FIT_BITMAP) ? FreeImage_Allocate(width, height, 32) : FreeImage_AllocateT(image_type, width, height);
+		assert(src != NULL);
+		for(int y = 0; y < height; y++) {
+			BYTE *bits = FreeImage_GetScanLine(src, y);
+			for(unsigned i = 0; i < FreeImage_GetLine(src); i++) {
+				seed = seed * 1103515245 + 12345;
+				bits[i] = (BYTE)(seed >> 16);
+			}
+		}
+		const int left = (width % 7) - 3;
+		const int top = (width % 3) - 1;
+
+		for(int op = FIPD_CLEAR; op <= FIPD_XOR; op++) {
+			for(int premultiplied = 0; premultiplied < 2; premultiplied++) {
+				selectFeatureLevel(0);
+				FIBITMAP *reference = FreeImage_Clone(dst);
+				assert(FreeImage_PasteComposite(reference, src, left, top, (FREE_IMAGE_PORTER_DUFF)op, premultiplied));
+
+				// premultiplied destination pixels are left unchanged by FIPD_DST
+				if((op == FIPD_DST) && premultiplied) {
+					assert(memcmp(FreeImage_GetBits(reference), FreeImage_GetBits(dst), pitch * height) == 0);
+				}
+
+				for(int level = 1; level < s_level_count; level++) {
+					if(selectFeatureLevel(level)) {
+						FIBITMAP *target = FreeImage_Clone(dst);
+						assert(FreeImage_PasteComposite(target, src, left, top, (FREE_IMAGE_PORTER_DUFF)op, premultiplied));
+						for(int y = 0; y < height; y++) {
+							assert(memcmp(FreeImage_GetScanLine(target, y), FreeImage_GetScanLine(reference, y), line) == 0);
+						}
+						FreeImage_Unload(target);
+					}
+				}
+				FreeImage_Unload(reference);
+			}
+		}
+
+		FreeImage_Unload(src);
+	}
+
+	FreeImage_Unload(dst);
+}
+
+
+/**
+Compare the SIMD and scalar code paths of FreeImage_Composite against the checkerboard and a background image
+*/
+static void
+testCompositeLevels() {
+	const int width = 37;
+	const int height = 19;
+	unsigned seed = 1357;
+
+	FIBITMAP *fg = FreeImage_Allocate(width, height, 32);
+	FIBITMAP *bg = FreeImage_Allocate(width, height, 24);
+	assert((fg != NULL) && (bg != NULL));
+	for(int y = 0; y < height; y++) {
+		BYTE *fg_bits = FreeImage_GetScanLine(fg, y);
+		BYTE *bg_bits = FreeImage_GetScanLine(bg, y);
+		for(int x = 0; x < 4 * width; x++) {
+			seed = seed * 1103515245 + 12345;
+			fg_bits[x] = (BYTE)(seed >> 16);
+			if(x < 3 * width) {
+				bg_bits[x] = (BYTE)(seed >> 8);
+			}
+		}
+		// fully transparent and opaque pixels
+		fg_bits[FI_RGBA_ALPHA] = 0;
+		fg_bits[4 + FI_RGBA_ALPHA] = 0xFF;
+	}
+
+	for(int use_bg = 0; use_bg < 2; use_bg++) {
+		selectFeatureLevel(0);
+		FIBITMAP *reference = FreeImage_Composite(fg, FALSE, NULL, use_bg ? bg : NULL);
+		assert(reference != NULL);
+
+		for(int level = 1; level < s_level_count; level++) {
+			if(selectFeatureLevel(level)) {
+				FIBITMAP *dst = FreeImage_Composite(fg, FALSE, NULL, use_bg ? bg : NULL);
+				assert(dst != NULL);
+				for(int y = 0; y < height; y++) {
+					assert(memcmp(FreeImage_GetScanLine(dst, y), FreeImage_GetScanLine(reference, y), 3 * width) == 0);
+				}
+				FreeImage_Unload(dst);
+			}
+		}
+		FreeImage_Unload(reference);
+	}
+
+	FreeImage_Unload(fg);
+	FreeImage_Unload(bg);
+}
+
+// ----------------------------------------------------------
+
+void testComposite() {
+	printf("testComposite (CPU features = 0x%X) ...\n", FreeImage_GetCPUFeatures());
+
+	testPorterDuffIdentities(FIT_BITMAP);
+	testPorterDuffIdentities(FIT_RGBA16);
+	testPorterDuffValues();
+
+	testPasteCompositeLevels(FIT_BITMAP);
+	testPasteCompositeLevels(FIT_RGBA16);
+	testCompositeLevels();
+
+	testPreMultiplyValues(FIT_BITMAP);
+	testPreMultiplyValues(FIT_RGBA16);
+	testPreMultiplyValues(FIT_RGBAF);
+	testPreMultiplyRoundTrip(FIT_BITMAP);
+	testPreMultiplyRoundTrip(FIT_RGBA16);
+	testPreMultiplyRoundTrip(FIT_RGBAF);
+	testPreMultiplyLevels(FIT_BITMAP);
+	testPreMultiplyLevels(FIT_RGBA16);
+	testPreMultiplyLevels(FIT_RGBAF);
+
+	// restore every feature supported by the CPU
+	FreeImage_SetCPUFeatures(0xFFFFFFFF);
+}
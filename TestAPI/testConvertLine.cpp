@@ -0,0 +1,304 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+// Local test functions
+// ----------------------------------------------------------
+
+typedef void (DLL_CALLCONV *ConvertLineProc)(BYTE *target, BYTE *source, int width_in_pixels);
+
+typedef struct tagConvertLineInfo {
+	const char *name;
+	ConvertLineProc convert;
+	int src_bpp;
+	int dst_bpp;
+} ConvertLineInfo;
+
+static const ConvertLineInfo s_conversions[] = {
+	{ "32To24",			FreeImage_ConvertLine32To24,			32, 24 },
+	{ "24To32",			FreeImage_ConvertLine24To32,			24, 32 },
+	{ "16To24_555",		FreeImage_ConvertLine16To24_555,		16, 24 },
+	{ "16To24_565",		FreeImage_ConvertLine16To24_565,		16, 24 },
+	{ "16To32_555",		FreeImage_ConvertLine16To32_555,		16, 32 },
+	{ "16To32_565",		FreeImage_ConvertLine16To32_565,		16, 32 },
+	{ "24To16_555",		FreeImage_ConvertLine24To16_555,		24, 16 },
+	{ "24To16_565",		FreeImage_ConvertLine24To16_565,		24, 16 },
+	{ "32To16_555",		FreeImage_ConvertLine32To16_555,		32, 16 },
+	{ "32To16_565",		FreeImage_ConvertLine32To16_565,		32, 16 },
+	{ "16_565_To16_555",	FreeImage_ConvertLine16_565_To16_555,	16, 16 },
+	{ "16_555_To16_565",	FreeImage_ConvertLine16_555_To16_565,	16, 16 },
+	{ "24To8",			FreeImage_ConvertLine24To8,				24, 8 },
+	{ "32To8",			FreeImage_ConvertLine32To8,				32, 8 }
+};
+
+static const int s_conversion_count = sizeof(s_conversions) / sizeof(s_conversions[0]);
+
+// instruction sets tested, the scalar code (no feature) being the reference
+static const unsigned s_feature_levels[] = {
+	0,
+	FI_CPU_SSE2,
+	FI_CPU_SSE2 | FI_CPU_SSSE3,
+	FI_CPU_SSE2 | FI_CPU_SSSE3 | FI_CPU_AVX2
+};
+
+static const char *s_feature_names[] = { "scalar", "SSE2", "SSSE3", "AVX2" };
+
+static const int s_level_count = sizeof(s_feature_levels) / sizeof(s_feature_levels[0]);
+
+/**
+Returns TRUE if the CPU supports every feature of the level
+*/
+static BOOL
+selectFeatureLevel(int level) {
+	const unsigned features = s_feature_levels[level];
+	return (FreeImage_SetCPUFeatures(features) == features) ? TRUE : FALSE;
+}
+
+/**
+Fill a source line with every possible 16-bit pixel, or with every 24-bit color having a given red component
+*/
+static void
+fillExhaustiveLine(BYTE *line, int bpp, unsigned red) {
+	for(unsigned i = 0; i < 65536; i++) {
+		if(bpp == 16) {
+			((WORD*)line)[i] = (WORD)i;
+		} else {
+			BYTE *pixel = line + i * (bpp / 8);
+			pixel[FI_RGBA_RED] = (BYTE)red;
+			pixel[FI_RGBA_GREEN] = (BYTE)(i >> 8);
+			pixel[FI_RGBA_BLUE] = (BYTE)i;
+			if(bpp == 32) {
+				pixel[FI_RGBA_ALPHA] = (BYTE)(i * 7 + red);
+			}
+		}
+	}
+}
+
+/**
+Convert every possible source pixel and compare each SIMD code path with the scalar one
+*/
+static void
+testConvertLineExhaustive(const ConvertLineInfo& info) {
+	const int width = 65536;
+	BYTE *source = (BYTE*)malloc(width * 4);
+	BYTE *reference = (BYTE*)malloc(width * 4);
+	BYTE *target = (BYTE*)malloc(width * 4);
+	assert(source && reference && target);
+
+	const unsigned red_count = (info.src_bpp == 16) ? 1 : 256;
+	const int dst_size = width * info.dst_bpp / 8;
+
+	for(unsigned red = 0; red < red_count; red++) {
+		fillExhaustiveLine(source, info.src_bpp, red);
+
+		selectFeatureLevel(0);
+		info.convert(reference, source, width);
+
+		for(int level = 1; level < s_level_count; level++) {
+			if(selectFeatureLevel(level)) {
+				memset(target, 0, dst_size);
+				info.convert(target, source, width);
+				assert(memcmp(target, reference, dst_size) == 0);
+			}
+		}
+	}
+
+	free(source);
+	free(reference);
+	free(target);
+}
+
+/**
+Compare the SIMD and scalar code paths on short lines of every width, at every alignment,
+and check that nothing is written after the end of the line
+*/
+static void
+testConvertLineTails(const ConvertLineInfo& info) {
+	const int max_width = 160;
+	const int guard = 64;
+	BYTE source[max_width * 4 + 4];
+	BYTE reference[max_width * 4 + 4 + guard];
+	BYTE target[max_width * 4 + 4 + guard];
+
+	unsigned seed = 12345;
+	for(unsigned i = 0; i < sizeof(source); i++) {
+		seed = seed * 1103515245 + 12345;
+		source[i] = (BYTE)(seed >> 16);
+	}
+
+	for(int width = 0; width <= max_width; width++) {
+		const int dst_size = width * info.dst_bpp / 8;
+
+		for(int offset = 0; offset < 4; offset++) {
+			// unaligned source and target, 16-bit pixels being kept WORD aligned
+			const int src_offset = (info.src_bpp == 16) ? (offset & 2) : offset;
+			const int dst_offset = (info.dst_bpp == 16) ? ((3 - offset) & 2) : (3 - offset);
+
+			selectFeatureLevel(0);
+			memset(reference, 0xA5, sizeof(reference));
+			info.convert(reference + dst_offset, source + src_offset, width);
+
+			for(int level = 1; level < s_level_count; level++) {
+				if(selectFeatureLevel(level)) {
+					memset(target, 0xA5, sizeof(target));
+					info.convert(target + dst_offset, source + src_offset, width);
+					assert(memcmp(target, reference, dst_offset + dst_size + guard) == 0);
+				}
+			}
+		}
+	}
+}
+
+/**
+Compare the SIMD and scalar code paths of FreeImage_ConvertToStandardType on images of every width
+up to 70 samples, with values spanning the whole range of the image type
+*/
+template <class T> static void
+testConvertToStandardTypeLevels(FREE_IMAGE_TYPE image_type) {
+	const int height = 3;
+	unsigned seed = 6789;
+
+	for(int width = 1; width <= 70; width++) {
+		FIBITMAP *src = FreeImage_AllocateT(image_type, width, height);
+		assert(src != NULL);
+		for(int y = 0; y < height; y++) {
+			BYTE *bits = FreeImage_GetScanLine(src, y);
+			for(unsigned i = 0; i < width * sizeof(T); i++) {
+				seed = seed * 1103515245 + 12345;
+				bits[i] = (BYTE)(seed >> 16);
+			}
+			if((image_type == FIT_FLOAT) || (image_type == FIT_DOUBLE)) {
+				// keep the values finite
+				T *values = (T*)bits;
+				for(int x = 0; x < width; x++) {
+					values[x] = (T)((seed % 20000) - 10000.0) * (T)(x + 1) / (T)7;
+					seed = seed * 1103515245 + 12345;
+				}
+			}
+		}
+
+		for(int scale_linear = 0; scale_linear < 2; scale_linear++) {
+			selectFeatureLevel(0);
+			FIBITMAP *reference = FreeImage_ConvertToStandardType(src, scale_linear);
+			FIBITMAP *window_reference = FreeImage_ConvertToStandardTypeWindow(src, 1, 99);
+			assert((reference != NULL) && (window_reference != NULL));
+
+			for(int level = 1; level < s_level_count; level++) {
+				if(selectFeatureLevel(level)) {
+					FIBITMAP *dst = FreeImage_ConvertToStandardType(src, scale_linear);
+					FIBITMAP *window = FreeImage_ConvertToStandardTypeWindow(src, 1, 99);
+					assert((dst != NULL) && (window != NULL));
+					for(int y = 0; y < height; y++) {
+						assert(memcmp(FreeImage_GetScanLine(dst, y), FreeImage_GetScanLine(reference, y), width) == 0);
+						assert(memcmp(FreeImage_GetScanLine(window, y), FreeImage_GetScanLine(window_reference, y), width) == 0);
+					}
+					FreeImage_Unload(dst);
+					FreeImage_Unload(window);
+				}
+			}
+			FreeImage_Unload(reference);
+			FreeImage_Unload(window_reference);
+		}
+
+		FreeImage_Unload(src);
+	}
+}
+
+
+// ----------------------------------------------------------
+
+void testConvertLine() {
+	printf("testConvertLine (CPU features = 0x%X) ...\n", FreeImage_GetCPUFeatures());
+
+	for(int i = 0; i < s_conversion_count; i++) {
+		testConvertLineTails(s_conversions[i]);
+		testConvertLineExhaustive(s_conversions[i]);
+	}
+
+	testConvertToStandardTypeLevels<WORD>(FIT_UINT16);
+	testConvertToStandardTypeLevels<short>(FIT_INT16);
+	testConvertToStandardTypeLevels<DWORD>(FIT_UINT32);
+	testConvertToStandardTypeLevels<LONG>(FIT_INT32);
+	testConvertToStandardTypeLevels<float>(FIT_FLOAT);
+	testConvertToStandardTypeLevels<double>(FIT_DOUBLE);
+
+
+	// restore every feature supported by the CPU
+	FreeImage_SetCPUFeatures(0xFFFFFFFF);
+}
+
+/**
+Print the throughput of each line conversion for each instruction set,
+counting the bytes read and written
+*/
+void benchConvertLine() {
+	const int width = 1920;
+	const int height = 1080;
+	const size_t image_size = (size_t)width * height * 4;
+
+	BYTE *source = (BYTE*)malloc(image_size);
+	BYTE *target = (BYTE*)malloc(image_size);
+	assert(source && target);
+	for(size_t i = 0; i < image_size; i++) {
+		source[i] = (BYTE)((i * 2654435761U) >> 13);
+	}
+
+	printf("benchConvertLine (%dx%d, GB/s read + written)\n", width, height);
+	printf("%-16s", "ConvertLine");
+	for(int level = 0; level < s_level_count; level++) {
+		printf("%9s", s_feature_names[level]);
+	}
+	printf("\n");
+
+	for(int i = 0; i < s_conversion_count; i++) {
+		const ConvertLineInfo& info = s_conversions[i];
+		const int src_pitch = width * info.src_bpp / 8;
+		const int dst_pitch = width * info.dst_bpp / 8;
+
+		printf("%-16s", info.name);
+		for(int level = 0; level < s_level_count; level++) {
+			if(!selectFeatureLevel(level)) {
+				printf("%9s", "-");
+				continue;
+			}
+			// convert the image until at least 0.25 second is elapsed
+			unsigned images = 0;
+			const clock_t start = clock();
+			clock_t elapsed = 0;
+			do {
+				for(int y = 0; y < height; y++) {
+					info.convert(target + y * dst_pitch, source + y * src_pitch, width);
+				}
+				images++;
+				elapsed = clock() - start;
+			} while(elapsed < CLOCKS_PER_SEC / 4);
+
+			const double seconds = (double)elapsed / CLOCKS_PER_SEC;
+			const double bytes = (double)images * height * (src_pitch + dst_pitch);
+			printf("%9.2f", bytes / seconds / 1e9);
+		}
+		printf("\n");
+	}
+
+	FreeImage_SetCPUFeatures(0xFFFFFFFF);
+
+	free(source);
+	free(target);
+}
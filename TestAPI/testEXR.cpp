@@ -0,0 +1,168 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+// Local test functions
+// ----------------------------------------------------------
+
+static unsigned DLL_CALLCONV
+myReadProc(void *buffer, unsigned size, unsigned count, fi_handle handle) {
+	return (unsigned)fread(buffer, size, count, (FILE *)handle);
+}
+
+static unsigned DLL_CALLCONV
+myWriteProc(void *buffer, unsigned size, unsigned count, fi_handle handle) {
+	return (unsigned)fwrite(buffer, size, count, (FILE *)handle);
+}
+
+static int DLL_CALLCONV
+mySeekProc(fi_handle handle, long offset, int origin) {
+	return fseek((FILE *)handle, offset, origin);
+}
+
+static long DLL_CALLCONV
+myTellProc(fi_handle handle) {
+	return ftell((FILE *)handle);
+}
+
+/**
+Create a FIT_FLOAT, FIT_RGBF or FIT_RGBAF image whose samples are exact half floats
+*/
+static FIBITMAP*
+createEXRTestImage(FREE_IMAGE_TYPE image_type, int width, int height) {
+	FIBITMAP *dib = FreeImage_AllocateT(image_type, width, height);
+	assert(dib != NULL);
+	const int samples = width * (FreeImage_GetLine(dib) / (width * sizeof(float)));
+	for(int y = 0; y < height; y++) {
+		float *bits = (float*)FreeImage_GetScanLine(dib, y);
+		for(int i = 0; i < samples; i++) {
+			bits[i] = (float)((i * 7 + y * 13) % 256) / 16;
+		}
+	}
+	return dib;
+}
+
+/**
+Load a region of an EXR file
+*/
+static FIBITMAP*
+loadEXRRegion(const char *lpszPathName, int left, int top, int right, int bottom, int flags) {
+	FreeImageIO io;
+
+	io.read_proc  = myReadProc;
+	io.write_proc = myWriteProc;
+	io.seek_proc  = mySeekProc;
+	io.tell_proc  = myTellProc;
+
+	FILE *file = fopen(lpszPathName, "rb");
+	assert(file != NULL);
+	FIBITMAP *dib = FreeImage_LoadEXRRegionFromHandle(&io, (fi_handle)file, left, top, right, bottom, flags);
+	fclose(file);
+
+	return dib;
+}
+
+/**
+Returns TRUE if a region of an image has the pixels of the same region of another image
+*/
+static BOOL
+sameRegion(FIBITMAP *region, FIBITMAP *dib, int left, int top) {
+	FIBITMAP *crop = FreeImage_Copy(dib, left, top, left + FreeImage_GetWidth(region), top + FreeImage_GetHeight(region));
+	assert(crop != NULL);
+
+	BOOL bResult = (FreeImage_GetImageType(region) == FreeImage_GetImageType(crop));
+	for(unsigned y = 0; bResult && (y < FreeImage_GetHeight(crop)); y++) {
+		bResult = (memcmp(FreeImage_GetScanLine(region, y), FreeImage_GetScanLine(crop, y), FreeImage_GetLine(crop)) == 0);
+	}
+
+	FreeImage_Unload(crop);
+	return bResult;
+}
+
+/**
+Compare region loads with the same crop of a full load. 
+The regions cross the blocks of scan lines of the compression methods (16 lines for ZIP, 
+32 lines for PIZ and B44), touch the edges of the image or go past them (and are clipped). 
+The size of the image is even, as required by EXR_LC.
+*/
+static void
+testEXRRegion(FREE_IMAGE_TYPE image_type, int save_flags) {
+	const char *lpszPathName = "exr_region.exr";
+	const int width = 132;
+	const int height = 98;
+
+	FIBITMAP *dib = createEXRTestImage(image_type, width, height);
+	BOOL bResult = FreeImage_Save(FIF_EXR, dib, lpszPathName, save_flags);
+	assert(bResult);
+	FreeImage_Unload(dib);
+
+	FIBITMAP *full = FreeImage_Load(FIF_EXR, lpszPathName, 0);
+	assert(full != NULL);
+	assert((FreeImage_GetWidth(full) == width) && (FreeImage_GetHeight(full) == height));
+
+	// left, top, right, bottom (right and bottom excluded)
+	static const int regions[][4] = {
+		{ 37, 21, 87, 54 }, { 0, 0, 1, 1 }, { 0, 30, 131, 70 }, { 100, 80, 132, 98 }, { 120, 90, 200, 150 }, { 0, 0, 132, 98 }
+	};
+
+	for(int i = 0; i < (int)(sizeof(regions) / sizeof(regions[0])); i++) {
+		const int *r = regions[i];
+		for(int flags = 0; flags <= EXR_MULTITHREAD; flags += EXR_MULTITHREAD) {
+			FIBITMAP *region = loadEXRRegion(lpszPathName, r[0], r[1], r[2], r[3], flags);
+			assert(region != NULL);
+			assert((int)FreeImage_GetWidth(region) == ((r[2] < width) ? r[2] : width) - r[0]);
+			assert((int)FreeImage_GetHeight(region) == ((r[3] < height) ? r[3] : height) - r[1]);
+			assert(sameRegion(region, full, r[0], r[1]));
+			FreeImage_Unload(region);
+		}
+	}
+
+	// the rectangle is normalized
+	FIBITMAP *region = loadEXRRegion(lpszPathName, 87, 54, 37, 21, 0);
+	assert(region != NULL);
+	assert(sameRegion(region, full, 37, 21));
+	FreeImage_Unload(region);
+
+	// invalid regions
+	assert(loadEXRRegion(lpszPathName, -1, 0, 10, 10, 0) == NULL);
+	assert(loadEXRRegion(lpszPathName, 10, 10, 10, 20, 0) == NULL);
+	assert(loadEXRRegion(lpszPathName, 200, 0, 210, 10, 0) == NULL);
+
+	FreeImage_Unload(full);
+}
+
+// ----------------------------------------------------------
+
+void testEXR() {
+	printf("testEXR ...\n");
+
+	if(!FreeImage_FIFSupportsWriting(FIF_EXR)) {
+		printf("testEXR : the EXR plugin is not available, skipped\n");
+		return;
+	}
+
+	testEXRRegion(FIT_RGBF, EXR_NONE);
+	testEXRRegion(FIT_RGBF, EXR_ZIP);
+	testEXRRegion(FIT_RGBF, EXR_PIZ | EXR_FLOAT);
+	testEXRRegion(FIT_RGBAF, EXR_PIZ);
+	testEXRRegion(FIT_RGBAF, EXR_B44);
+	testEXRRegion(FIT_RGBF, EXR_LC);
+	testEXRRegion(FIT_FLOAT, EXR_ZIP);
+}
@@ -0,0 +1,297 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+// Local test functions
+// ----------------------------------------------------------
+
+// instruction sets tested
+static const unsigned s_feature_levels[] = {
+	0,
+	FI_CPU_SSE2,
+	FI_CPU_SSE2 | FI_CPU_SSSE3,
+	FI_CPU_SSE2 | FI_CPU_SSSE3 | FI_CPU_AVX2
+};
+
+static const char *s_feature_names[] = { "scalar", "SSE2", "SSSE3", "AVX2" };
+
+static const int s_level_count = sizeof(s_feature_levels) / sizeof(s_feature_levels[0]);
+
+/**
+Returns TRUE if the CPU supports every feature of the level
+*/
+static BOOL
+selectFeatureLevel(int level) {
+	const unsigned features = s_feature_levels[level];
+	return (FreeImage_SetCPUFeatures(features) == features) ? TRUE : FALSE;
+}
+
+typedef struct tagFlipRotateFormat {
+	const char *name;
+	FREE_IMAGE_TYPE type;
+	int bpp;
+	BOOL rotate;	// supported by FreeImage_Rotate
+} FlipRotateFormat;
+
+// one format for each pixel size, from 1-bit to 128-bit
+static const FlipRotateFormat s_formats[] = {
+	{ "1-bit",		FIT_BITMAP,	1,		TRUE },
+	{ "4-bit",		FIT_BITMAP,	4,		FALSE },
+	{ "8-bit",		FIT_BITMAP,	8,		TRUE },
+	{ "16-bit",		FIT_BITMAP,	16,		FALSE },
+	{ "24-bit",		FIT_BITMAP,	24,		TRUE },
+	{ "32-bit",		FIT_BITMAP,	32,		TRUE },
+	{ "UINT16",		FIT_UINT16,	16,		TRUE },
+	{ "RGB16",		FIT_RGB16,	48,		TRUE },
+	{ "FLOAT",		FIT_FLOAT,	32,		TRUE },
+	{ "RGBA16",		FIT_RGBA16,	64,		TRUE },
+	{ "DOUBLE",		FIT_DOUBLE,	64,		FALSE },
+	{ "RGBF",		FIT_RGBF,	96,		TRUE },
+	{ "RGBAF",		FIT_RGBAF,	128,	TRUE }
+};
+
+static const int s_format_count = sizeof(s_formats) / sizeof(s_formats[0]);
+
+/**
+Fill an image with pseudo random bytes
+*/
+static void
+fillRandom(FIBITMAP *dib, unsigned &seed) {
+	for(unsigned y = 0; y < FreeImage_GetHeight(dib); y++) {
+		BYTE *bits = FreeImage_GetScanLine(dib, y);
+		for(unsigned i = 0; i < FreeImage_GetLine(dib); i++) {
+			seed = seed * 1103515245 + 12345;
+			bits[i] = (BYTE)(seed >> 16);
+		}
+	}
+}
+
+/**
+Returns TRUE if the pixel (x1, y1) of dib1 equals the pixel (x2, y2) of dib2
+(the palette index for 1- and 4-bit images)
+*/
+static BOOL
+samePixel(FIBITMAP *dib1, unsigned x1, unsigned y1, FIBITMAP *dib2, unsigned x2, unsigned y2) {
+	const unsigned bpp = FreeImage_GetBPP(dib1);
+	const BYTE *bits1 = FreeImage_GetScanLine(dib1, y1);
+	const BYTE *bits2 = FreeImage_GetScanLine(dib2, y2);
+
+	switch(bpp) {
+		case 1:
+			return ((bits1[x1 >> 3] >> (7 - (x1 & 7))) & 1) == ((bits2[x2 >> 3] >> (7 - (x2 & 7))) & 1);
+		case 4:
+			return ((bits1[x1 >> 1] >> ((x1 & 1) ? 0 : 4)) & 0xF) == ((bits2[x2 >> 1] >> ((x2 & 1) ? 0 : 4)) & 0xF);
+		default:
+			return memcmp(bits1 + x1 * (bpp / 8), bits2 + x2 * (bpp / 8), bpp / 8) == 0;
+	}
+}
+
+enum FlipRotateOperation {
+	OP_ROTATE_90 = 0,
+	OP_ROTATE_180,
+	OP_ROTATE_270,
+	OP_FLIP_HORIZONTAL,
+	OP_FLIP_VERTICAL,
+	OP_COUNT
+};
+
+static const char *s_operation_names[] = { "Rotate 90", "Rotate 180", "Rotate 270", "FlipHorizontal", "FlipVertical" };
+
+/**
+Apply an operation to a copy of an image
+@return Returns the new image, or NULL if the operation is not supported
+*/
+static FIBITMAP*
+applyOperation(FIBITMAP *src, int operation) {
+	switch(operation) {
+		case OP_ROTATE_90:
+			return FreeImage_Rotate(src, 90);
+		case OP_ROTATE_180:
+			return FreeImage_Rotate(src, 180);
+		case OP_ROTATE_270:
+			return FreeImage_Rotate(src, 270);
+		default:
+		{
+			FIBITMAP *dst = FreeImage_Clone(src);
+			assert(dst != NULL);
+			BOOL bResult = (operation == OP_FLIP_HORIZONTAL) ? FreeImage_FlipHorizontal(dst) : FreeImage_FlipVertical(dst);
+			assert(bResult);
+			return dst;
+		}
+	}
+}
+
+/**
+Check every pixel of the result of an operation against the source pixel it comes from.
+Scan lines are stored bottom-up, so that a counter-clockwise rotation by 90 degrees
+moves the source pixel (x, y) to (height - 1 - y, x).
+*/
+static BOOL
+checkOperation(FIBITMAP *src, FIBITMAP *dst, int operation) {
+	const unsigned width = FreeImage_GetWidth(src);
+	const unsigned height = FreeImage_GetHeight(src);
+	const BOOL transposed = (operation == OP_ROTATE_90) || (operation == OP_ROTATE_270);
+
+	if((FreeImage_GetImageType(dst) != FreeImage_GetImageType(src)) || (FreeImage_GetBPP(dst) != FreeImage_GetBPP(src))) {
+		return FALSE;
+	}
+	if((FreeImage_GetWidth(dst) != (transposed ? height : width)) || (FreeImage_GetHeight(dst) != (transposed ? width : height))) {
+		return FALSE;
+	}
+
+	for(unsigned y = 0; y < FreeImage_GetHeight(dst); y++) {
+		for(unsigned x = 0; x < FreeImage_GetWidth(dst); x++) {
+			unsigned src_x = x;
+			unsigned src_y = y;
+			switch(operation) {
+				case OP_ROTATE_90:
+					src_x = y;
+					src_y = height - 1 - x;
+					break;
+				case OP_ROTATE_180:
+					src_x = width - 1 - x;
+					src_y = height - 1 - y;
+					break;
+				case OP_ROTATE_270:
+					src_x = width - 1 - y;
+					src_y = x;
+					break;
+				case OP_FLIP_HORIZONTAL:
+					src_x = width - 1 - x;
+					break;
+				case OP_FLIP_VERTICAL:
+					src_y = height - 1 - y;
+					break;
+			}
+			if(!samePixel(dst, x, y, src, src_x, src_y)) {
+				return FALSE;
+			}
+		}
+	}
+	return TRUE;
+}
+
+/**
+Check the right-angle rotations and the flips of a format with every instruction set,
+on sizes crossing the SIMD blocks and the cache tiles of the transposition
+*/
+static void
+testFlipRotateFormat(const FlipRotateFormat& format) {
+	static const unsigned sizes[][2] = {
+		{ 1, 1 }, { 1, 9 }, { 13, 1 }, { 7, 5 }, { 16, 8 }, { 67, 45 }, { 130, 77 }
+	};
+	unsigned seed = 97531;
+
+	for(int i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+		FIBITMAP *src = FreeImage_AllocateT(format.type, sizes[i][0], sizes[i][1], format.bpp);
+		assert(src != NULL);
+		fillRandom(src, seed);
+
+		for(int level = 0; level < s_level_count; level++) {
+			if(!selectFeatureLevel(level)) {
+				continue;
+			}
+			for(int operation = 0; operation < OP_COUNT; operation++) {
+				FIBITMAP *dst = applyOperation(src, operation);
+				if((operation <= OP_ROTATE_270) && !format.rotate) {
+					assert(dst == NULL);
+					continue;
+				}
+				assert(dst != NULL);
+				assert(checkOperation(src, dst, operation));
+				FreeImage_Unload(dst);
+			}
+		}
+
+		FreeImage_Unload(src);
+	}
+
+	FreeImage_SetCPUFeatures(0xFFFFFFFF);
+}
+
+// ----------------------------------------------------------
+
+void testFlipRotate() {
+	printf("testFlipRotate ...\n");
+
+	for(int i = 0; i < s_format_count; i++) {
+		testFlipRotateFormat(s_formats[i]);
+	}
+}
+
+/**
+Measure the right-angle rotations and the horizontal flip of a large image, for each pixel size
+and each instruction set
+*/
+void benchFlipRotate() {
+	const unsigned width = 3000;
+	const unsigned height = 2000;
+	static const int operations[] = { OP_ROTATE_90, OP_ROTATE_180, OP_FLIP_HORIZONTAL };
+
+	printf("benchFlipRotate (%ux%u, ms per image)\n", width, height);
+	printf("%-24s", "FlipRotate");
+	for(int level = 0; level < s_level_count; level++) {
+		printf("%9s", s_feature_names[level]);
+	}
+	printf("\n");
+
+	unsigned seed = 1234;
+
+	for(int i = 0; i < s_format_count; i++) {
+		const FlipRotateFormat& format = s_formats[i];
+		if(!format.rotate || (format.bpp == 1) || (format.type == FIT_FLOAT)) {
+			continue;
+		}
+		FIBITMAP *src = FreeImage_AllocateT(format.type, width, height, format.bpp);
+		assert(src != NULL);
+		fillRandom(src, seed);
+
+		for(int k = 0; k < (int)(sizeof(operations) / sizeof(operations[0])); k++) {
+			char name[64];
+			sprintf(name, "%s %s", format.name, s_operation_names[operations[k]]);
+			printf("%-24s", name);
+
+			for(int level = 0; level < s_level_count; level++) {
+				if(!selectFeatureLevel(level)) {
+					printf("%9s", "-");
+					continue;
+				}
+				// repeat the operation until at least 0.25 second is elapsed
+				unsigned images = 0;
+				const clock_t start = clock();
+				clock_t elapsed = 0;
+				do {
+					FIBITMAP *dst = applyOperation(src, operations[k]);
+					assert(dst != NULL);
+					FreeImage_Unload(dst);
+					images++;
+					elapsed = clock() - start;
+				} while(elapsed < CLOCKS_PER_SEC / 4);
+
+				printf("%9.2f", 1000.0 * elapsed / CLOCKS_PER_SEC / images);
+			}
+			printf("\n");
+		}
+
+		FreeImage_Unload(src);
+	}
+
+	FreeImage_SetCPUFeatures(0xFFFFFFFF);
+}
@@ -21,6 +21,7 @@
 
 
 #include "TestSuite.h"
+#include <limits>
 
 // Local test functions
 // ----------------------------------------------------------
@@ -416,6 +417,110 @@ BOOL testLoadSaveConvertComplexType(FIBITMAP *src, FREE_IMAGE_COLOR_CHANNEL chan
 	return TRUE;
 }
 
+/**
+Set sample x of scanline y of a greyscale image of type FIT_UINT16 .. FIT_DOUBLE
+*/
+static void setSample(FIBITMAP *image, unsigned x, unsigned y, double value) {
+	BYTE *bits = FreeImage_GetScanLine(image, y);
+	switch(FreeImage_GetImageType(image)) {
+		case FIT_UINT16:
+			((unsigned short*)bits)[x] = (unsigned short)value;
+			break;
+		case FIT_INT16:
+			((short*)bits)[x] = (short)value;
+			break;
+		case FIT_UINT32:
+			((DWORD*)bits)[x] = (DWORD)value;
+			break;
+		case FIT_INT32:
+			((LONG*)bits)[x] = (LONG)value;
+			break;
+		case FIT_FLOAT:
+			((float*)bits)[x] = (float)value;
+			break;
+		case FIT_DOUBLE:
+			((double*)bits)[x] = value;
+			break;
+		default:
+			break;
+	}
+}
+
+/**
+Window a ramp of 990 samples (0, 16, ..., 15824) followed by 10 outliers (32767) 
+between its 1st and 99th percentiles : the samples of rank 10 and 989 (160 and 15824)
+*/
+BOOL testConvertToStandardTypeWindow(FREE_IMAGE_TYPE image_type) {
+	FIBITMAP *image = NULL;
+	FIBITMAP *dst = NULL;
+
+	const unsigned width = 100, height = 10;
+	const double step = 16, outlier = 32767;
+	const double low = 10 * step, high = 989 * step;
+
+	try {
+		image = FreeImage_AllocateT(image_type, width, height);
+		if(!image) throw(1);
+
+		for(unsigned y = 0; y < height; y++) {
+			for(unsigned x = 0; x < width; x++) {
+				const unsigned k = y * width + x;
+				setSample(image, x, y, (k < 990) ? k * step : outlier);
+			}
+		}
+
+		// invalid percentile ranges
+		if(FreeImage_ConvertToStandardTypeWindow(image, 60, 40)) throw(1);
+		if(FreeImage_ConvertToStandardTypeWindow(image, -1, 99)) throw(1);
+		if(FreeImage_ConvertToStandardTypeWindow(image, 1, 101)) throw(1);
+
+		dst = FreeImage_ConvertToStandardTypeWindow(image, 1, 99);
+		if(!dst) throw(1);
+		if((FreeImage_GetImageType(dst) != FIT_BITMAP) || (FreeImage_GetBPP(dst) != 8)) throw(1);
+
+		BYTE previous = 0;
+		for(unsigned y = 0; y < height; y++) {
+			const BYTE *bits = FreeImage_GetScanLine(dst, y);
+			for(unsigned x = 0; x < width; x++) {
+				const unsigned k = y * width + x;
+				const double value = (k < 990) ? k * step : outlier;
+				if((value <= low) && (bits[x] != 0)) throw(1);
+				if((value >= high) && (bits[x] != 255)) throw(1);
+				if((k == 500) && ((bits[x] < 127) || (bits[x] > 128))) throw(1);
+				if(bits[x] < previous) throw(1);
+				previous = bits[x];
+			}
+		}
+		FreeImage_Unload(dst);
+		dst = NULL;
+
+		if((image_type == FIT_FLOAT) || (image_type == FIT_DOUBLE)) {
+			// NaN samples are left out of the percentiles and map to black
+			const double nan = std::numeric_limits<double>::quiet_NaN();
+			setSample(image, 0, height - 1, nan);
+			setSample(image, 1, height - 1, nan);
+
+			dst = FreeImage_ConvertToStandardTypeWindow(image, 0, 100);
+			if(!dst) throw(1);
+			const BYTE *bits = FreeImage_GetScanLine(dst, height - 1);
+			if((bits[0] != 0) || (bits[1] != 0) || (bits[width - 1] != 255)) throw(1);
+			bits = FreeImage_GetScanLine(dst, 0);
+			if(bits[0] != 0) throw(1);
+			FreeImage_Unload(dst);
+			dst = NULL;
+		}
+
+		FreeImage_Unload(image);
+
+	} catch(int) {
+		if(image) FreeImage_Unload(image);
+		if(dst) FreeImage_Unload(dst);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 // Main test functions
 // ----------------------------------------------------------
 
@@ -448,6 +553,20 @@ void testImageType(unsigned width, unsigned height) {
 	assert(bResult);
 	bResult = testAllocateCloneUnloadType(FIT_RGBAF, width, height);
 	assert(bResult);
+
+	// percentile window conversion
+	bResult = testConvertToStandardTypeWindow(FIT_UINT16);
+	assert(bResult);
+	bResult = testConvertToStandardTypeWindow(FIT_INT16);
+	assert(bResult);
+	bResult = testConvertToStandardTypeWindow(FIT_UINT32);
+	assert(bResult);
+	bResult = testConvertToStandardTypeWindow(FIT_INT32);
+	assert(bResult);
+	bResult = testConvertToStandardTypeWindow(FIT_FLOAT);
+	assert(bResult);
+	bResult = testConvertToStandardTypeWindow(FIT_DOUBLE);
+	assert(bResult);
 }
 
 
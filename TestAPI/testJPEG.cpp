@@ -194,6 +194,241 @@ void testJPEGSameFile(const char *src_file) {
 	assert(bResult);
 }
 
+/**
+Create a 24-bit image with smooth gradients and a sine pattern
+*/
+static FIBITMAP*
+createJPEGTestImage(int width, int height) {
+	FIBITMAP *dib = FreeImage_Allocate(width, height, 24);
+	assert(dib != NULL);
+	for(int y = 0; y < height; y++) {
+		BYTE *bits = FreeImage_GetScanLine(dib, y);
+		for(int x = 0; x < width; x++, bits += 3) {
+			bits[FI_RGBA_RED] = (BYTE)((x * 255) / width);
+			bits[FI_RGBA_GREEN] = (BYTE)((y * 255) / height);
+			bits[FI_RGBA_BLUE] = (BYTE)(128 + 100 * sin(x / 5.0) * cos(y / 7.0));
+		}
+	}
+	return dib;
+}
+
+/**
+Load a JPEG memory stream from its start
+*/
+static FIBITMAP*
+loadJPEGStream(FIMEMORY *stream, int flags) {
+	FreeImage_SeekMemory(stream, 0, SEEK_SET);
+	return FreeImage_LoadFromMemory(FIF_JPEG, stream, flags);
+}
+
+/**
+Compare two images of the same size and bit depth
+@param max_diff Receives the largest difference between two samples
+@return Returns the mean absolute difference between the samples
+*/
+static double
+compareJPEGImages(FIBITMAP *dib1, FIBITMAP *dib2, int *max_diff) {
+	assert(FreeImage_GetWidth(dib1) == FreeImage_GetWidth(dib2));
+	assert(FreeImage_GetHeight(dib1) == FreeImage_GetHeight(dib2));
+	assert(FreeImage_GetBPP(dib1) == FreeImage_GetBPP(dib2));
+
+	double sum = 0;
+	*max_diff = 0;
+	const unsigned line = FreeImage_GetLine(dib1);
+	for(unsigned y = 0; y < FreeImage_GetHeight(dib1); y++) {
+		const BYTE *bits1 = FreeImage_GetScanLine(dib1, y);
+		const BYTE *bits2 = FreeImage_GetScanLine(dib2, y);
+		for(unsigned i = 0; i < line; i++) {
+			const int diff = abs((int)bits1[i] - (int)bits2[i]);
+			sum += diff;
+			if(diff > *max_diff) *max_diff = diff;
+		}
+	}
+	return sum / ((double)line * FreeImage_GetHeight(dib1));
+}
+
+/**
+Progressive JPEG round trip : a progressive save decodes to the pixels of a baseline save 
+with the same quality, loading all its scans with JPEG_SCANS gives the same pixels, 
+loading its first scan only gives a coarser image of the same size. 
+JPEG_SCANS has no effect on a baseline JPEG.
+*/
+void testJPEGProgressive() {
+	int max_diff = 0;
+
+	FIBITMAP *dib = createJPEGTestImage(256, 200);
+
+	FIMEMORY *baseline = FreeImage_OpenMemory();
+	FIMEMORY *progressive = FreeImage_OpenMemory();
+	BOOL bResult = FreeImage_SaveToMemory(FIF_JPEG, dib, baseline, JPEG_QUALITYSUPERB);
+	assert(bResult);
+	bResult = FreeImage_SaveToMemory(FIF_JPEG, dib, progressive, JPEG_QUALITYSUPERB | JPEG_PROGRESSIVE);
+	assert(bResult);
+
+	FIBITMAP *baseline_dib = loadJPEGStream(baseline, JPEG_ACCURATE);
+	FIBITMAP *progressive_dib = loadJPEGStream(progressive, JPEG_ACCURATE);
+	assert(baseline_dib && progressive_dib);
+	assert(compareJPEGImages(baseline_dib, dib, &max_diff) < 2);
+
+	// same quantized coefficients, same pixels
+	assert(compareJPEGImages(progressive_dib, baseline_dib, &max_diff) == 0);
+
+	// all the scans
+	FIBITMAP *all_scans = loadJPEGStream(progressive, JPEG_ACCURATE | JPEG_SCANS(127));
+	assert(all_scans != NULL);
+	assert(compareJPEGImages(all_scans, progressive_dib, &max_diff) == 0);
+	FreeImage_Unload(all_scans);
+
+	// first scan only : DC coefficients and the first AC coefficients
+	FIBITMAP *first_scan = loadJPEGStream(progressive, JPEG_ACCURATE | JPEG_SCANS(1));
+	assert(first_scan != NULL);
+	const double first_scan_error = compareJPEGImages(first_scan, dib, &max_diff);
+	assert((first_scan_error > 2) && (first_scan_error < 40));
+	FreeImage_Unload(first_scan);
+
+	// baseline JPEG
+	FIBITMAP *baseline_scans = loadJPEGStream(baseline, JPEG_ACCURATE | JPEG_SCANS(1));
+	assert(baseline_scans != NULL);
+	assert(compareJPEGImages(baseline_scans, baseline_dib, &max_diff) == 0);
+	FreeImage_Unload(baseline_scans);
+
+	FreeImage_Unload(progressive_dib);
+	FreeImage_Unload(baseline_dib);
+	FreeImage_CloseMemory(progressive);
+	FreeImage_CloseMemory(baseline);
+	FreeImage_Unload(dib);
+}
+
+/**
+Transform a JPEG stream with FreeImage_JPEGTransformEx and decode the result
+*/
+static FIBITMAP*
+transformJPEGStream(FIJPEGTRANSFORMER *transformer, FIMEMORY *src_stream, const FREE_IMAGE_JPEG_OPERATION *operations, int count, int left, int top, int right, int bottom, int flags) {
+	FIMEMORY *dst_stream = FreeImage_OpenMemory();
+	assert(dst_stream != NULL);
+
+	FreeImage_SeekMemory(src_stream, 0, SEEK_SET);
+	const BOOL crop = (right > left);
+	BOOL bResult = FreeImage_JPEGTransformEx(transformer, src_stream, dst_stream, operations, count, crop ? &left : NULL, crop ? &top : NULL, crop ? &right : NULL, crop ? &bottom : NULL, flags);
+	assert(bResult);
+
+	FIBITMAP *dib = loadJPEGStream(dst_stream, JPEG_ACCURATE);
+	assert(dib != NULL);
+	FreeImage_CloseMemory(dst_stream);
+	return dib;
+}
+
+/**
+Lossless transformations of a JPEG memory stream, compared with the same operations on the decoded image. 
+The image is saved without chroma subsampling and with a size multiple of the iMCU size, 
+so that every transformation is perfect; the inverse DCT rounds differently rotated blocks, 
+hence the small differences allowed with FreeImage_Rotate.
+*/
+void testJPEGTransformEx() {
+	int max_diff = 0;
+	const int width = 128;
+	const int height = 96;
+
+	FIBITMAP *dib = createJPEGTestImage(width, height);
+	FIMEMORY *src_stream = FreeImage_OpenMemory();
+	BOOL bResult = FreeImage_SaveToMemory(FIF_JPEG, dib, src_stream, JPEG_QUALITYSUPERB | JPEG_SUBSAMPLING_444);
+	assert(bResult);
+	FreeImage_Unload(dib);
+
+	FIBITMAP *decoded = loadJPEGStream(src_stream, JPEG_ACCURATE);
+	assert(decoded != NULL);
+
+	FIJPEGTRANSFORMER *transformer = FreeImage_JPEGOpenTransformer();
+	assert(transformer != NULL);
+
+	// rotations (FreeImage_Rotate turns counter-clockwise) and flips
+
+	const FREE_IMAGE_JPEG_OPERATION rotations[] = { FIJPEG_OP_ROTATE_90, FIJPEG_OP_ROTATE_180, FIJPEG_OP_ROTATE_270 };
+	const double angles[] = { 270, 180, 90 };
+	for(int i = 0; i < 3; i++) {
+		FIBITMAP *transformed = transformJPEGStream(transformer, src_stream, &rotations[i], 1, 0, 0, 0, 0, FIJPEG_PERFECT);
+		FIBITMAP *rotated = FreeImage_Rotate(decoded, angles[i]);
+		assert(rotated != NULL);
+		assert(FreeImage_GetWidth(transformed) == FreeImage_GetWidth(rotated));
+		assert(FreeImage_GetHeight(transformed) == FreeImage_GetHeight(rotated));
+		assert(compareJPEGImages(transformed, rotated, &max_diff) < 0.5);
+		assert(max_diff <= 4);
+		FreeImage_Unload(rotated);
+		FreeImage_Unload(transformed);
+	}
+
+	const FREE_IMAGE_JPEG_OPERATION flips[] = { FIJPEG_OP_FLIP_H, FIJPEG_OP_FLIP_V };
+	for(int i = 0; i < 2; i++) {
+		FIBITMAP *transformed = transformJPEGStream(transformer, src_stream, &flips[i], 1, 0, 0, 0, 0, FIJPEG_PERFECT);
+		FIBITMAP *flipped = FreeImage_Clone(decoded);
+		assert(flipped != NULL);
+		bResult = (flips[i] == FIJPEG_OP_FLIP_H) ? FreeImage_FlipHorizontal(flipped) : FreeImage_FlipVertical(flipped);
+		assert(bResult);
+		assert(compareJPEGImages(transformed, flipped, &max_diff) < 0.5);
+		assert(max_diff <= 4);
+		FreeImage_Unload(flipped);
+		FreeImage_Unload(transformed);
+	}
+
+	// a sequence of operations is reduced to the equivalent operation
+
+	const FREE_IMAGE_JPEG_OPERATION twice_90[] = { FIJPEG_OP_ROTATE_90, FIJPEG_OP_ROTATE_90 };
+	const FREE_IMAGE_JPEG_OPERATION flip_hv[] = { FIJPEG_OP_FLIP_H, FIJPEG_OP_FLIP_V };
+	FIBITMAP *rotated_180 = transformJPEGStream(transformer, src_stream, &rotations[1], 1, 0, 0, 0, 0, FIJPEG_PERFECT);
+	FIBITMAP *transformed = transformJPEGStream(transformer, src_stream, twice_90, 2, 0, 0, 0, 0, FIJPEG_PERFECT);
+	assert(compareJPEGImages(transformed, rotated_180, &max_diff) == 0);
+	FreeImage_Unload(transformed);
+	transformed = transformJPEGStream(transformer, src_stream, flip_hv, 2, 0, 0, 0, 0, FIJPEG_PERFECT);
+	assert(compareJPEGImages(transformed, rotated_180, &max_diff) == 0);
+	FreeImage_Unload(transformed);
+
+	// the temporary context of a NULL transformer gives the same result
+	transformed = transformJPEGStream(NULL, src_stream, &rotations[1], 1, 0, 0, 0, 0, FIJPEG_PERFECT);
+	assert(compareJPEGImages(transformed, rotated_180, &max_diff) == 0);
+	FreeImage_Unload(transformed);
+	FreeImage_Unload(rotated_180);
+
+	// crop on block boundaries : same pixels as the crop of the decoded image
+
+	transformed = transformJPEGStream(transformer, src_stream, NULL, 0, 16, 8, 80, 72, FIJPEG_PERFECT);
+	FIBITMAP *cropped = FreeImage_Copy(decoded, 16, 8, 80, 72);
+	assert(cropped != NULL);
+	assert(compareJPEGImages(transformed, cropped, &max_diff) == 0);
+	FreeImage_Unload(cropped);
+	FreeImage_Unload(transformed);
+
+	// rotation and crop in a single pass (crop rectangle in the rotated image)
+
+	transformed = transformJPEGStream(transformer, src_stream, &rotations[0], 1, 8, 16, 72, 112, FIJPEG_PERFECT);
+	FIBITMAP *rotated = FreeImage_Rotate(decoded, 270);
+	cropped = FreeImage_Copy(rotated, 8, 16, 72, 112);
+	assert(cropped != NULL);
+	assert((FreeImage_GetWidth(transformed) == 64) && (FreeImage_GetHeight(transformed) == 96));
+	assert(compareJPEGImages(transformed, cropped, &max_diff) < 0.5);
+	assert(max_diff <= 4);
+	FreeImage_Unload(cropped);
+	FreeImage_Unload(rotated);
+	FreeImage_Unload(transformed);
+
+	// without destination, the crop rectangle is only adjusted to the iMCU boundaries
+	{
+		int left = 10, top = 12, right = 50, bottom = 60;
+		FreeImage_SeekMemory(src_stream, 0, SEEK_SET);
+		bResult = FreeImage_JPEGTransformEx(transformer, src_stream, NULL, NULL, 0, &left, &top, &right, &bottom, 0);
+		assert(bResult);
+		assert((left == 8) && (top == 8) && (right == 50) && (bottom == 60));
+	}
+
+	// greyscale output
+	transformed = transformJPEGStream(transformer, src_stream, &rotations[1], 1, 0, 0, 0, 0, FIJPEG_PERFECT | FIJPEG_GRAYSCALE | FIJPEG_PROGRESSIVE | FIJPEG_OPTIMIZE);
+	assert((FreeImage_GetBPP(transformed) == 8) && (FreeImage_GetWidth(transformed) == (unsigned)width));
+	FreeImage_Unload(transformed);
+
+	FreeImage_JPEGCloseTransformer(transformer);
+	FreeImage_Unload(decoded);
+	FreeImage_CloseMemory(src_stream);
+}
+
 // Main test function
 // ----------------------------------------------------------
 
@@ -213,4 +448,10 @@ void testJPEG() {
 
 	// using the same file for src & dst is allowed
 	testJPEGSameFile(src_file);
+
+	// lossless transforms and crop of memory streams, compared with the decoded image
+	testJPEGTransformEx();
+
+	// progressive JPEG saved and loaded from all or some of its scans
+	testJPEGProgressive();
 }
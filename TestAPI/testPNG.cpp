@@ -0,0 +1,182 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+// Local test functions
+// ----------------------------------------------------------
+
+typedef struct tagPNGFormat {
+	const char *name;
+	FREE_IMAGE_TYPE type;
+	int bpp;
+} PNGFormat;
+
+static const PNGFormat s_formats[] = {
+	{ "8-bit",	FIT_BITMAP,	8 },
+	{ "24-bit",	FIT_BITMAP,	24 },
+	{ "32-bit",	FIT_BITMAP,	32 },
+	{ "UINT16",	FIT_UINT16,	16 },
+	{ "RGB16",	FIT_RGB16,	48 },
+	{ "RGBA16",	FIT_RGBA16,	64 }
+};
+
+static const int s_format_count = sizeof(s_formats) / sizeof(s_formats[0]);
+
+/**
+Create an image with smooth gradients and some noise, compressible like a photo
+*/
+static FIBITMAP*
+createPNGTestImage(const PNGFormat& format, unsigned width, unsigned height) {
+	FIBITMAP *dib = FreeImage_AllocateT(format.type, width, height, format.bpp);
+	assert(dib != NULL);
+	const unsigned bytespp = format.bpp / 8;
+	unsigned seed = 4321;
+	for(unsigned y = 0; y < height; y++) {
+		BYTE *bits = FreeImage_GetScanLine(dib, y);
+		for(unsigned i = 0; i < width * bytespp; i++) {
+			seed = seed * 1103515245 + 12345;
+			bits[i] = (BYTE)((i / bytespp + 3 * y + (i % bytespp) * 40) / 4 + ((seed >> 16) & 7));
+		}
+	}
+	return dib;
+}
+
+/**
+Save an image to a memory stream as PNG
+*/
+static FIMEMORY*
+savePNGToMemory(FIBITMAP *dib, int flags) {
+	FIMEMORY *hmem = FreeImage_OpenMemory();
+	assert(hmem != NULL);
+	BOOL bResult = FreeImage_SaveToMemory(FIF_PNG, dib, hmem, flags);
+	assert(bResult);
+	return hmem;
+}
+
+/**
+Returns TRUE if two images have the same type and the same pixels
+*/
+static BOOL
+samePixels(FIBITMAP *dib1, FIBITMAP *dib2) {
+	if((FreeImage_GetImageType(dib1) != FreeImage_GetImageType(dib2)) || (FreeImage_GetBPP(dib1) != FreeImage_GetBPP(dib2))) {
+		return FALSE;
+	}
+	if((FreeImage_GetWidth(dib1) != FreeImage_GetWidth(dib2)) || (FreeImage_GetHeight(dib1) != FreeImage_GetHeight(dib2))) {
+		return FALSE;
+	}
+	const unsigned line = FreeImage_GetWidth(dib1) * FreeImage_GetBPP(dib1) / 8;
+	for(unsigned y = 0; y < FreeImage_GetHeight(dib1); y++) {
+		if(memcmp(FreeImage_GetScanLine(dib1, y), FreeImage_GetScanLine(dib2, y), line) != 0) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+Save and reload a format, plain and interlaced, with heights below, at and across
+the batches of rows decoded by the loader
+*/
+static void
+testPNGRoundTrip(const PNGFormat& format) {
+	static const unsigned sizes[][2] = {
+		{ 1, 1 }, { 5, 3 }, { 33, 32 }, { 100, 77 }
+	};
+	static const int save_flags[] = { PNG_DEFAULT, PNG_INTERLACED };
+
+	for(int i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+		FIBITMAP *dib = createPNGTestImage(format, sizes[i][0], sizes[i][1]);
+
+		for(int j = 0; j < (int)(sizeof(save_flags) / sizeof(save_flags[0])); j++) {
+			FIMEMORY *hmem = savePNGToMemory(dib, save_flags[j]);
+			FreeImage_SeekMemory(hmem, 0, SEEK_SET);
+			FIBITMAP *loaded = FreeImage_LoadFromMemory(FIF_PNG, hmem, PNG_DEFAULT);
+			assert(loaded != NULL);
+			assert(samePixels(dib, loaded));
+			FreeImage_Unload(loaded);
+			FreeImage_CloseMemory(hmem);
+		}
+
+		FreeImage_Unload(dib);
+	}
+}
+
+// ----------------------------------------------------------
+
+void testPNG() {
+	printf("testPNG ...\n");
+
+	for(int i = 0; i < s_format_count; i++) {
+		testPNGRoundTrip(s_formats[i]);
+	}
+}
+
+/**
+Measure the decoding of large PNG images from memory, plain and interlaced,
+counting the bytes of decoded pixels
+*/
+void benchPNG() {
+	const unsigned width = 3000;
+	const unsigned height = 2000;
+	static const int save_flags[] = { PNG_DEFAULT, PNG_INTERLACED };
+	static const char *flag_names[] = { "", " interlaced" };
+
+	printf("benchPNG (%ux%u, decode from memory)\n", width, height);
+	printf("%-20s%12s%12s%12s\n", "PNG", "file MB", "ms", "MB/s");
+
+	for(int i = 0; i < s_format_count; i++) {
+		const PNGFormat& format = s_formats[i];
+		if((format.type != FIT_BITMAP) && (format.type != FIT_RGBA16)) {
+			continue;
+		}
+		FIBITMAP *dib = createPNGTestImage(format, width, height);
+
+		for(int j = 0; j < (int)(sizeof(save_flags) / sizeof(save_flags[0])); j++) {
+			FIMEMORY *hmem = savePNGToMemory(dib, save_flags[j]);
+			BYTE *data = NULL;
+			DWORD size_in_bytes = 0;
+			FreeImage_AcquireMemory(hmem, &data, &size_in_bytes);
+
+			// decode the image until at least 0.5 second is elapsed
+			unsigned images = 0;
+			const clock_t start = clock();
+			clock_t elapsed = 0;
+			do {
+				FreeImage_SeekMemory(hmem, 0, SEEK_SET);
+				FIBITMAP *loaded = FreeImage_LoadFromMemory(FIF_PNG, hmem, PNG_DEFAULT);
+				assert(loaded != NULL);
+				FreeImage_Unload(loaded);
+				images++;
+				elapsed = clock() - start;
+			} while(elapsed < CLOCKS_PER_SEC / 2);
+
+			const double seconds = (double)elapsed / CLOCKS_PER_SEC;
+			const double bytes = (double)images * width * height * (format.bpp / 8);
+
+			char name[64];
+			sprintf(name, "%s%s", format.name, flag_names[j]);
+			printf("%-20s%12.2f%12.2f%12.1f\n", name, size_in_bytes / 1e6, 1000.0 * seconds / images, bytes / seconds / 1e6);
+
+			FreeImage_CloseMemory(hmem);
+		}
+
+		FreeImage_Unload(dib);
+	}
+}
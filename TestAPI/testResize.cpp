@@ -0,0 +1,510 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+// Local test functions
+// ----------------------------------------------------------
+
+static const FREE_IMAGE_FILTER s_filters[] = {
+	FILTER_BOX, FILTER_BILINEAR, FILTER_BSPLINE, FILTER_BICUBIC, FILTER_CATMULLROM, FILTER_LANCZOS3
+};
+
+static const int s_filter_count = sizeof(s_filters) / sizeof(s_filters[0]);
+
+/**
+Create a sprite : an opaque red square with a soft edge, on transparent black pixels
+*/
+static FIBITMAP*
+createSprite(FREE_IMAGE_TYPE image_type, unsigned bpp) {
+	const int width = 64;
+	const int height = 48;
+
+	FIBITMAP *dib = FreeImage_AllocateT(image_type, width, height, bpp);
+	assert(dib != NULL);
+
+	if(bpp == 8) {
+		// index 0 is transparent black, index i > 0 is red with alpha i
+		RGBQUAD *pal = FreeImage_GetPalette(dib);
+		BYTE table[256];
+		for(int i = 0; i < 256; i++) {
+			pal[i].rgbRed = (i > 0) ? 255 : 0;
+			pal[i].rgbGreen = pal[i].rgbBlue = 0;
+			table[i] = (BYTE)i;
+		}
+		FreeImage_SetTransparencyTable(dib, table, 256);
+	}
+
+	for(int y = 0; y < height; y++) {
+		BYTE *bits = FreeImage_GetScanLine(dib, y);
+		for(int x = 0; x < width; x++) {
+			// alpha is 1 inside the square, decreasing over 4 pixels outside
+			const int dx = abs(2 * x - width) - 32;
+			const int dy = abs(2 * y - height) - 24;
+			const int distance = (dx > dy) ? dx : dy;
+			const double alpha = (distance <= 0) ? 1 : (distance >= 8) ? 0 : 1.0 - distance / 8.0;
+			const double red = (alpha > 0) ? 1 : 0;
+
+			switch(image_type) {
+				case FIT_BITMAP:
+					if(bpp == 8) {
+						bits[x] = (BYTE)(alpha * 255 + 0.5);
+					} else {
+						bits[4 * x + FI_RGBA_RED] = (BYTE)(red * 255);
+						bits[4 * x + FI_RGBA_GREEN] = 0;
+						bits[4 * x + FI_RGBA_BLUE] = 0;
+						bits[4 * x + FI_RGBA_ALPHA] = (BYTE)(alpha * 255 + 0.5);
+					}
+					break;
+				case FIT_RGBA16:
+				{
+					FIRGBA16 *pixel = (FIRGBA16*)bits + x;
+					pixel->red = (WORD)(red * 65535);
+					pixel->green = pixel->blue = 0;
+					pixel->alpha = (WORD)(alpha * 65535 + 0.5);
+				}
+				break;
+				case FIT_RGBAF:
+				{
+					FIRGBAF *pixel = (FIRGBAF*)bits + x;
+					pixel->red = (float)red;
+					pixel->green = pixel->blue = 0;
+					pixel->alpha = (float)alpha;
+				}
+				break;
+				default:
+					break;
+			}
+		}
+	}
+
+	return dib;
+}
+
+/**
+Get the color of a 32-bit, RGBA16 or RGBAF pixel, as fractions in the range 0 to 1
+*/
+static void
+getPixel(FIBITMAP *dib, unsigned x, unsigned y, double rgba[4]) {
+	BYTE *bits = FreeImage_GetScanLine(dib, y);
+	switch(FreeImage_GetImageType(dib)) {
+		case FIT_BITMAP:
+			rgba[0] = bits[4 * x + FI_RGBA_RED] / 255.0;
+			rgba[1] = bits[4 * x + FI_RGBA_GREEN] / 255.0;
+			rgba[2] = bits[4 * x + FI_RGBA_BLUE] / 255.0;
+			rgba[3] = bits[4 * x + FI_RGBA_ALPHA] / 255.0;
+			break;
+		case FIT_RGBA16:
+		{
+			const FIRGBA16 *pixel = (FIRGBA16*)bits + x;
+			rgba[0] = pixel->red / 65535.0;
+			rgba[1] = pixel->green / 65535.0;
+			rgba[2] = pixel->blue / 65535.0;
+			rgba[3] = pixel->alpha / 65535.0;
+		}
+		break;
+		default:
+		{
+			const FIRGBAF *pixel = (FIRGBAF*)bits + x;
+			rgba[0] = pixel->red;
+			rgba[1] = pixel->green;
+			rgba[2] = pixel->blue;
+			rgba[3] = pixel->alpha;
+		}
+		break;
+	}
+}
+
+/**
+Rescale a red sprite with FI_RESCALE_ALPHA_WEIGHTED : every visible pixel must stay pure red,
+while the default resampling darkens the edge of the sprite
+*/
+static void
+testAlphaWeightedResize(FREE_IMAGE_TYPE image_type, unsigned bpp) {
+	FIBITMAP *src = createSprite(image_type, bpp);
+	const unsigned sizes[][2] = { { 23, 17 }, { 150, 113 }, { 41, 90 } };
+	BOOL bDarkened = FALSE;
+
+	for(int f = 0; f < s_filter_count; f++) {
+		for(int s = 0; s < 3; s++) {
+			const unsigned width = sizes[s][0];
+			const unsigned height = sizes[s][1];
+			const unsigned src_width = FreeImage_GetWidth(src);
+			const unsigned src_height = FreeImage_GetHeight(src);
+
+			FIBITMAP *weighted = FreeImage_RescaleRect(src, width, height, 0, 0, src_width, src_height, s_filters[f], FI_RESCALE_ALPHA_WEIGHTED);
+			FIBITMAP *plain = FreeImage_RescaleRect(src, width, height, 0, 0, src_width, src_height, s_filters[f], FI_RESCALE_DEFAULT);
+			assert((weighted != NULL) && (plain != NULL));
+
+			for(unsigned y = 0; y < height; y++) {
+				for(unsigned x = 0; x < width; x++) {
+					double rgba[4];
+					getPixel(weighted, x, y, rgba);
+					if(rgba[3] > 0) {
+						assert(fabs(rgba[0] - 1) < 1e-6);
+						assert((rgba[1] == 0) && (rgba[2] == 0));
+					}
+					getPixel(plain, x, y, rgba);
+					if((rgba[3] > 0.05) && (rgba[0] < 0.9)) {
+						bDarkened = TRUE;
+					}
+				}
+			}
+			FreeImage_Unload(weighted);
+			FreeImage_Unload(plain);
+		}
+	}
+	assert(bDarkened);
+
+	FreeImage_Unload(src);
+}
+
+/**
+Rescale a flat color and a black and white checkerboard with FI_RESCALE_LINEAR_LIGHT : 
+the flat color must be preserved, while the checkerboard must average to the 
+sRGB value of half the linear light (188) instead of half the sRGB value (128)
+*/
+static void
+testLinearLightResize(unsigned bpp) {
+	const unsigned bytespp = bpp / 8;
+	const unsigned sizes[][2] = { { 16, 16 }, { 16, 32 }, { 32, 16 } };
+	FIBITMAP *flat = FreeImage_Allocate(64, 64, bpp);
+	FIBITMAP *checker = FreeImage_Allocate(64, 64, bpp);
+	assert((flat != NULL) && (checker != NULL));
+
+	for(unsigned y = 0; y < 64; y++) {
+		BYTE *flat_bits = FreeImage_GetScanLine(flat, y);
+		BYTE *checker_bits = FreeImage_GetScanLine(checker, y);
+		for(unsigned x = 0; x < 64; x++) {
+			const BYTE value = ((x + y) & 1) ? 255 : 0;
+			for(unsigned c = 0; c < bytespp; c++) {
+				flat_bits[x * bytespp + c] = (BYTE)(37 + 50 * c);
+				checker_bits[x * bytespp + c] = (c == 3) ? 255 : value;
+			}
+		}
+	}
+
+	for(unsigned s = 0; s < 3; s++) {
+		const unsigned width = sizes[s][0];
+		const unsigned height = sizes[s][1];
+
+		FIBITMAP *flat_dst = FreeImage_RescaleRect(flat, width, height, 0, 0, 64, 64, FILTER_BOX, FI_RESCALE_LINEAR_LIGHT);
+		FIBITMAP *checker_dst = FreeImage_RescaleRect(checker, width, height, 0, 0, 64, 64, FILTER_BOX, FI_RESCALE_LINEAR_LIGHT);
+		FIBITMAP *checker_plain = FreeImage_RescaleRect(checker, width, height, 0, 0, 64, 64, FILTER_BOX, FI_RESCALE_DEFAULT);
+		assert((flat_dst != NULL) && (checker_dst != NULL) && (checker_plain != NULL));
+
+		for(unsigned y = 0; y < height; y++) {
+			const BYTE *flat_bits = FreeImage_GetScanLine(flat_dst, y);
+			const BYTE *checker_bits = FreeImage_GetScanLine(checker_dst, y);
+			const BYTE *plain_bits = FreeImage_GetScanLine(checker_plain, y);
+			for(unsigned x = 0; x < width; x++) {
+				for(unsigned c = 0; c < bytespp; c++) {
+					assert(flat_bits[x * bytespp + c] == (BYTE)(37 + 50 * c));
+					if(c == 3) {
+						assert(checker_bits[x * bytespp + c] == 255);
+					} else {
+						assert(abs(checker_bits[x * bytespp + c] - 188) <= 1);
+						assert(abs(plain_bits[x * bytespp + c] - 128) <= 1);
+					}
+				}
+			}
+		}
+		FreeImage_Unload(flat_dst);
+		FreeImage_Unload(checker_dst);
+		FreeImage_Unload(checker_plain);
+	}
+
+	FreeImage_Unload(flat);
+	FreeImage_Unload(checker);
+}
+
+/**
+Rescale an image to more geometries than the weights tables cache holds, with all the filters, 
+twice : the results of each (filter, geometry) pair must not depend on the previous resizes
+*/
+static void
+testSharedWeightsTables() {
+	const unsigned geometry_count = 24;
+	FIBITMAP *results[s_filter_count][geometry_count];
+
+	FIBITMAP *src = FreeImage_Allocate(40, 30, 24);
+	assert(src != NULL);
+	for(unsigned y = 0; y < 30; y++) {
+		BYTE *bits = FreeImage_GetScanLine(src, y);
+		for(unsigned x = 0; x < 40 * 3; x++) {
+			bits[x] = (BYTE)((x * 7 + y * 13) & 0xFF);
+		}
+	}
+
+	for(int pass = 0; pass < 2; pass++) {
+		for(unsigned g = 0; g < geometry_count; g++) {
+			for(int f = 0; f < s_filter_count; f++) {
+				FIBITMAP *dst = FreeImage_Rescale(src, 8 + 3 * g, 60 - 2 * g, s_filters[f]);
+				assert(dst != NULL);
+				if(pass == 0) {
+					results[f][g] = dst;
+				} else {
+					const unsigned line = FreeImage_GetLine(dst);
+					for(unsigned y = 0; y < FreeImage_GetHeight(dst); y++) {
+						assert(memcmp(FreeImage_GetScanLine(dst, y), FreeImage_GetScanLine(results[f][g], y), line) == 0);
+					}
+					FreeImage_Unload(dst);
+					FreeImage_Unload(results[f][g]);
+				}
+			}
+		}
+	}
+
+	// a 2:1 box downscale averages pairs of pixels (up to the rounding of both passes), 
+	// whichever filter was used before with the same geometry
+	FIBITMAP *box = FreeImage_Rescale(src, 20, 15, FILTER_BOX);
+	assert(box != NULL);
+	for(unsigned y = 0; y < 15; y++) {
+		const BYTE *bits = FreeImage_GetScanLine(box, y);
+		const BYTE *src0 = FreeImage_GetScanLine(src, 2 * y);
+		const BYTE *src1 = FreeImage_GetScanLine(src, 2 * y + 1);
+		for(unsigned x = 0; x < 20; x++) {
+			for(unsigned c = 0; c < 3; c++) {
+				const unsigned i = 6 * x + c;
+				const int sum = src0[i] + src0[i + 3] + src1[i] + src1[i + 3];
+				assert(abs(4 * bits[3 * x + c] - sum) <= 4);
+			}
+		}
+	}
+	FreeImage_Unload(box);
+
+	FreeImage_Unload(src);
+}
+
+/**
+Downscale by area averaging (FILTER_BOX with an integer factor, or a factor of 8 and more) at every CPU 
+feature level : integer factors must average the source blocks exactly, other factors must not depend 
+on the kernels, and thumbnails of large images must keep a flat color
+*/
+static void
+testAreaAverage(unsigned bpp) {
+	const unsigned levels[] = { 0, FI_CPU_SSE2, FI_CPU_AVX2 };
+	const unsigned bytespp = bpp / 8;
+	const unsigned width = 120;
+	const unsigned height = 90;
+
+	FIBITMAP *src = FreeImage_Allocate(width, height, bpp);
+	assert(src != NULL);
+	for(unsigned y = 0; y < height; y++) {
+		BYTE *bits = FreeImage_GetScanLine(src, y);
+		for(unsigned x = 0; x < width * bytespp; x++) {
+			bits[x] = (BYTE)((x * x * 7 + y * 131 + (x ^ y)) & 0xFF);
+		}
+	}
+
+	FIBITMAP *reference = NULL;
+	for(int level = 0; level < 3; level++) {
+		if(FreeImage_SetCPUFeatures(levels[level]) != levels[level]) {
+			continue;
+		}
+
+		// 4 x 3 blocks
+		FIBITMAP *dst = FreeImage_Rescale(src, width / 4, height / 3, FILTER_BOX);
+		assert(dst != NULL);
+		for(unsigned y = 0; y < height / 3; y++) {
+			const BYTE *bits = FreeImage_GetScanLine(dst, y);
+			for(unsigned x = 0; x < width / 4; x++) {
+				for(unsigned c = 0; c < bytespp; c++) {
+					unsigned sum = 0;
+					for(unsigned j = 0; j < 3; j++) {
+						const BYTE *src_bits = FreeImage_GetScanLine(src, 3 * y + j);
+						for(unsigned i = 0; i < 4; i++) {
+							sum += src_bits[(4 * x + i) * bytespp + c];
+						}
+					}
+					assert(bits[x * bytespp + c] == (sum + 6) / 12);
+				}
+			}
+		}
+		FreeImage_Unload(dst);
+
+		// factors of 8.6 and 9
+		dst = FreeImage_Rescale(src, 14, 10, FILTER_BOX);
+		assert(dst != NULL);
+		if(!reference) {
+			reference = dst;
+		} else {
+			for(unsigned y = 0; y < 10; y++) {
+				assert(memcmp(FreeImage_GetScanLine(dst, y), FreeImage_GetScanLine(reference, y), 14 * bytespp) == 0);
+			}
+			FreeImage_Unload(dst);
+		}
+	}
+	FreeImage_SetCPUFeatures(0xFFFFFFFF);
+	FreeImage_Unload(reference);
+	FreeImage_Unload(src);
+
+	// thumbnail of a flat image
+	src = FreeImage_Allocate(1000, 700, bpp);
+	assert(src != NULL);
+	for(unsigned y = 0; y < 700; y++) {
+		memset(FreeImage_GetScanLine(src, y), 0x5A, 1000 * bytespp);
+	}
+	FIBITMAP *thumbnail = FreeImage_MakeThumbnail(src, 64, FALSE);
+	assert(thumbnail != NULL);
+	assert((FreeImage_GetWidth(thumbnail) == 64) && (FreeImage_GetHeight(thumbnail) == 45) && (FreeImage_GetBPP(thumbnail) == bpp));
+	for(unsigned y = 0; y < 45; y++) {
+		const BYTE *bits = FreeImage_GetScanLine(thumbnail, y);
+		for(unsigned x = 0; x < 64 * bytespp; x++) {
+			assert(bits[x] == 0x5A);
+		}
+	}
+	FreeImage_Unload(thumbnail);
+	FreeImage_Unload(src);
+}
+
+/**
+Get sample c of pixel x of a 16-bit or float image, as a double
+*/
+static double
+getSample(FIBITMAP *dib, unsigned x, unsigned y, unsigned c) {
+	const unsigned bytespp = FreeImage_GetLine(dib) / FreeImage_GetWidth(dib);
+	const BYTE *bits = FreeImage_GetScanLine(dib, y);
+	switch(FreeImage_GetImageType(dib)) {
+		case FIT_UINT16:
+		case FIT_RGB16:
+		case FIT_RGBA16:
+			return ((const WORD*)bits)[x * (bytespp / sizeof(WORD)) + c];
+		default:
+			return ((const float*)bits)[x * (bytespp / sizeof(float)) + c];
+	}
+}
+
+/**
+Rescale 16-bit and float images (filtered with integer and single precision arithmetic) and compare them 
+with the double precision filters, used for alpha weighted RGBA images : since the alpha is opaque, 
+both must give the same results up to the precision of the weights. The results must not depend on the 
+CPU features.
+@param image_type FIT_RGBA16 or FIT_RGBAF
+@param other_type Type of the image holding the first samples of the RGBA pixels (FIT_UINT16, FIT_RGB16, FIT_FLOAT or FIT_RGBF)
+*/
+static void
+testSampleResize(FREE_IMAGE_TYPE image_type, FREE_IMAGE_TYPE other_type) {
+	const unsigned levels[] = { 0, FI_CPU_SSE2, FI_CPU_AVX2 };
+	const unsigned sizes[][2] = { { 37, 29 }, { 150, 100 }, { 200, 61 }, { 80, 9 }, { 23, 140 } };
+	const BOOL bFloat = (image_type == FIT_RGBAF) ? TRUE : FALSE;
+	const unsigned width = 80;
+	const unsigned height = 61;
+
+	// noise in the first sample, gradients in the others
+	FIBITMAP *rgba = FreeImage_AllocateT(image_type, width, height);
+	FIBITMAP *other = FreeImage_AllocateT(other_type, width, height);
+	assert((rgba != NULL) && (other != NULL));
+	const unsigned spp = FreeImage_GetLine(other) / width / (bFloat ? sizeof(float) : sizeof(WORD));
+	unsigned seed = 1;
+	for(unsigned y = 0; y < height; y++) {
+		BYTE *rgba_bits = FreeImage_GetScanLine(rgba, y);
+		BYTE *other_bits = FreeImage_GetScanLine(other, y);
+		for(unsigned x = 0; x < width; x++) {
+			for(unsigned c = 0; c < 4; c++) {
+				seed = seed * 1103515245 + 12345;
+				const WORD value = (c == 3) ? 0xFFFF : (c == 0) ? (WORD)(seed >> 16) : (WORD)(x * 800 + y * 300 * c);
+				if(bFloat) {
+					((float*)rgba_bits)[4 * x + c] = (c == 3) ? 1.0F : value / 16384.0F;
+					if(c < spp) ((float*)other_bits)[spp * x + c] = value / 16384.0F;
+				} else {
+					((WORD*)rgba_bits)[4 * x + c] = value;
+					if(c < spp) ((WORD*)other_bits)[spp * x + c] = value;
+				}
+			}
+		}
+	}
+
+	for(int f = 0; f < s_filter_count; f++) {
+		for(int s = 0; s < 5; s++) {
+			const unsigned dst_width = sizes[s][0];
+			const unsigned dst_height = sizes[s][1];
+			FIBITMAP *reference = FreeImage_RescaleRect(rgba, dst_width, dst_height, 0, 0, width, height, s_filters[f], FI_RESCALE_ALPHA_WEIGHTED);
+			assert(reference != NULL);
+
+			FIBITMAP *results[2] = { NULL, NULL };
+			for(int level = 0; level < 3; level++) {
+				if(FreeImage_SetCPUFeatures(levels[level]) != levels[level]) {
+					continue;
+				}
+				FIBITMAP *dsts[2];
+				dsts[0] = FreeImage_RescaleRect(rgba, dst_width, dst_height, 0, 0, width, height, s_filters[f], FI_RESCALE_DEFAULT);
+				dsts[1] = FreeImage_RescaleRect(other, dst_width, dst_height, 0, 0, width, height, s_filters[f], FI_RESCALE_DEFAULT);
+				assert((dsts[0] != NULL) && (dsts[1] != NULL));
+
+				for(int k = 0; k < 2; k++) {
+					if(!results[k]) {
+						// compare the samples with the double precision reference
+						const unsigned count = (k == 0) ? 4 : spp;
+						for(unsigned y = 0; y < dst_height; y++) {
+							for(unsigned x = 0; x < dst_width; x++) {
+								for(unsigned c = 0; c < count; c++) {
+									const double expected = getSample(reference, x, y, c);
+									const double error = fabs(getSample(dsts[k], x, y, c) - expected);
+									assert(bFloat ? (error <= 1e-5 * (1 + fabs(expected))) : (error <= 16));
+								}
+							}
+						}
+						results[k] = dsts[k];
+					} else {
+						// the results of all the CPU features are identical
+						const unsigned line = FreeImage_GetLine(dsts[k]);
+						for(unsigned y = 0; y < dst_height; y++) {
+							assert(memcmp(FreeImage_GetScanLine(dsts[k], y), FreeImage_GetScanLine(results[k], y), line) == 0);
+						}
+						FreeImage_Unload(dsts[k]);
+					}
+				}
+			}
+			FreeImage_SetCPUFeatures(0xFFFFFFFF);
+
+			FreeImage_Unload(results[0]);
+			FreeImage_Unload(results[1]);
+			FreeImage_Unload(reference);
+		}
+	}
+
+	FreeImage_Unload(rgba);
+	FreeImage_Unload(other);
+}
+
+// ----------------------------------------------------------
+
+void testResize() {
+	printf("testResize ...\n");
+
+	testAlphaWeightedResize(FIT_BITMAP, 32);
+	testAlphaWeightedResize(FIT_BITMAP, 8);
+	testAlphaWeightedResize(FIT_RGBA16, 64);
+	testAlphaWeightedResize(FIT_RGBAF, 128);
+
+	testLinearLightResize(24);
+	testLinearLightResize(32);
+
+	testSharedWeightsTables();
+
+	testAreaAverage(8);
+	testAreaAverage(24);
+	testAreaAverage(32);
+
+	testSampleResize(FIT_RGBA16, FIT_UINT16);
+	testSampleResize(FIT_RGBA16, FIT_RGB16);
+	testSampleResize(FIT_RGBAF, FIT_FLOAT);
+	testSampleResize(FIT_RGBAF, FIT_RGBF);
+}
@@ -0,0 +1,354 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+// Local test functions
+// ----------------------------------------------------------
+
+/**
+Fill an image with pseudo random bytes
+*/
+static void
+fillRandom(FIBITMAP *dib, unsigned &seed) {
+	for(unsigned y = 0; y < FreeImage_GetHeight(dib); y++) {
+		BYTE *bits = FreeImage_GetScanLine(dib, y);
+		for(unsigned i = 0; i < FreeImage_GetLine(dib); i++) {
+			seed = seed * 1103515245 + 12345;
+			bits[i] = (BYTE)(seed >> 16);
+		}
+	}
+}
+
+/**
+Create a source image with random pixels. 
+Palettized images get a random palette, and a random transparency table when 'transparent' is TRUE.
+8-bit images with 'palettized' FALSE keep their greyscale palette.
+*/
+static FIBITMAP*
+createSource(int bpp, int width, int height, BOOL palettized, BOOL transparent, unsigned &seed) {
+	FIBITMAP *dib = NULL;
+	if(bpp == 16) {
+		// 565 when 'palettized' is FALSE, 555 otherwise
+		dib = palettized ? 
+			FreeImage_Allocate(width, height, 16, FI16_555_RED_MASK, FI16_555_GREEN_MASK, FI16_555_BLUE_MASK) :
+			FreeImage_Allocate(width, height, 16, FI16_565_RED_MASK, FI16_565_GREEN_MASK, FI16_565_BLUE_MASK);
+	} else {
+		dib = FreeImage_Allocate(width, height, bpp);
+	}
+	assert(dib != NULL);
+	fillRandom(dib, seed);
+
+	if((bpp <= 8) && palettized) {
+		RGBQUAD *pal = FreeImage_GetPalette(dib);
+		for(unsigned i = 0; i < FreeImage_GetColorsUsed(dib); i++) {
+			seed = seed * 1103515245 + 12345;
+			pal[i].rgbRed = (BYTE)(seed >> 8);
+			pal[i].rgbGreen = (BYTE)(seed >> 16);
+			pal[i].rgbBlue = (BYTE)(seed >> 24);
+		}
+		if(transparent) {
+			BYTE table[256];
+			for(int i = 0; i < 256; i++) {
+				seed = seed * 1103515245 + 12345;
+				table[i] = (BYTE)(seed >> 16);
+			}
+			FreeImage_SetTransparencyTable(dib, table, (int)FreeImage_GetColorsUsed(dib));
+		}
+	}
+
+	return dib;
+}
+
+/**
+Copy an image to a bottom-up buffer whose pitch is not a multiple of 4 and wrap the buffer
+*/
+static FIBITMAP*
+wrapImage(FIBITMAP *dib, BYTE **buffer) {
+	const unsigned width = FreeImage_GetWidth(dib);
+	const unsigned height = FreeImage_GetHeight(dib);
+	const unsigned bpp = FreeImage_GetBPP(dib);
+	const int pitch = (int)FreeImage_GetLine(dib) + 7;
+
+	*buffer = (BYTE*)malloc(pitch * height);
+	assert(*buffer != NULL);
+	for(unsigned y = 0; y < height; y++) {
+		memcpy(*buffer + y * pitch, FreeImage_GetScanLine(dib, y), FreeImage_GetLine(dib));
+	}
+
+	FIBITMAP *wrapper = FreeImage_ConvertFromRawBitsEx(FALSE, *buffer, FIT_BITMAP, width, height, pitch, bpp, FreeImage_GetRedMask(dib), FreeImage_GetGreenMask(dib), FreeImage_GetBlueMask(dib), FALSE);
+	assert(wrapper != NULL);
+	assert(FreeImage_GetScanLine(wrapper, 1) == FreeImage_GetScanLine(wrapper, 0) + pitch);
+	if(bpp <= 8) {
+		memcpy(FreeImage_GetPalette(wrapper), FreeImage_GetPalette(dib), FreeImage_GetColorsUsed(dib) * sizeof(RGBQUAD));
+		FreeImage_SetTransparencyTable(wrapper, FreeImage_GetTransparencyTable(dib), FreeImage_GetTransparencyCount(dib));
+	}
+
+	return wrapper;
+}
+
+/**
+Copy an image into an image owning its pixels 
+(the clone of a wrapped buffer still uses the buffer of the wrapper)
+*/
+static FIBITMAP*
+copyImage(FIBITMAP *dib) {
+	FIBITMAP *copy = FreeImage_Allocate(FreeImage_GetWidth(dib), FreeImage_GetHeight(dib), FreeImage_GetBPP(dib), FreeImage_GetRedMask(dib), FreeImage_GetGreenMask(dib), FreeImage_GetBlueMask(dib));
+	assert(copy != NULL);
+	for(unsigned y = 0; y < FreeImage_GetHeight(dib); y++) {
+		memcpy(FreeImage_GetScanLine(copy, y), FreeImage_GetScanLine(dib, y), FreeImage_GetLine(dib));
+	}
+	if(FreeImage_GetBPP(dib) <= 8) {
+		memcpy(FreeImage_GetPalette(copy), FreeImage_GetPalette(dib), FreeImage_GetColorsUsed(dib) * sizeof(RGBQUAD));
+		FreeImage_SetTransparencyTable(copy, FreeImage_GetTransparencyTable(dib), FreeImage_GetTransparencyCount(dib));
+	}
+	return copy;
+}
+
+/**
+Apply the operations of a pipeline one at a time, with the equivalent image functions
+*/
+static FIBITMAP*
+applyOperations(FIBITMAP *src, const FIROWOPERATION *operations, int count) {
+	FIBITMAP *dib = copyImage(src);
+
+	// working format
+	if((FreeImage_GetBPP(dib) != 8) || (FreeImage_GetColorType(dib) != FIC_MINISBLACK)) {
+		FIBITMAP *working = ((FreeImage_GetBPP(dib) == 32) || FreeImage_IsTransparent(dib)) ? FreeImage_ConvertTo32Bits(dib) : FreeImage_ConvertTo24Bits(dib);
+		assert(working != NULL);
+		if(working != dib) {
+			FreeImage_Unload(dib);
+			dib = working;
+		}
+	}
+
+	for(int i = 0; i < count; i++) {
+		const FIROWOPERATION& operation = operations[i];
+		FIBITMAP *next = NULL;
+
+		switch(operation.operation) {
+			case FIRO_CONVERT:
+				if(operation.param == 8) {
+					next = FreeImage_ConvertTo8Bits(dib);
+				} else if(operation.param == 24) {
+					next = FreeImage_ConvertTo24Bits(dib);
+				} else {
+					next = FreeImage_ConvertTo32Bits(dib);
+				}
+				break;
+			case FIRO_GREYSCALE:
+				next = FreeImage_ConvertToGreyscale(dib);
+				break;
+			case FIRO_LUT:
+			{
+				BOOL bResult = FreeImage_AdjustCurve(dib, operation.lut, (FREE_IMAGE_COLOR_CHANNEL)operation.param);
+				assert(bResult);
+				break;
+			}
+			case FIRO_SWAP_RED_BLUE:
+				if(FreeImage_GetBPP(dib) >= 24) {
+					const unsigned bytespp = FreeImage_GetBPP(dib) / 8;
+					for(unsigned y = 0; y < FreeImage_GetHeight(dib); y++) {
+						BYTE *bits = FreeImage_GetScanLine(dib, y);
+						for(unsigned x = 0; x < FreeImage_GetWidth(dib); x++, bits += bytespp) {
+							const BYTE tmp = bits[0];
+							bits[0] = bits[2];
+							bits[2] = tmp;
+						}
+					}
+				}
+				break;
+			case FIRO_PREMULTIPLY:
+				if(FreeImage_GetBPP(dib) == 32) {
+					BOOL bResult = FreeImage_PreMultiplyWithAlpha(dib);
+					assert(bResult);
+				}
+				break;
+		}
+
+		if(next) {
+			assert(next != dib);
+			FreeImage_Unload(dib);
+			dib = next;
+		}
+	}
+
+	return dib;
+}
+
+/**
+Returns TRUE if two images have the same size, bit depth and pixels
+*/
+static BOOL
+samePixels(FIBITMAP *dib1, FIBITMAP *dib2) {
+	if((FreeImage_GetWidth(dib1) != FreeImage_GetWidth(dib2)) || (FreeImage_GetHeight(dib1) != FreeImage_GetHeight(dib2))) {
+		return FALSE;
+	}
+	if(FreeImage_GetBPP(dib1) != FreeImage_GetBPP(dib2)) {
+		return FALSE;
+	}
+	for(unsigned y = 0; y < FreeImage_GetHeight(dib1); y++) {
+		if(memcmp(FreeImage_GetScanLine(dib1, y), FreeImage_GetScanLine(dib2, y), FreeImage_GetLine(dib1)) != 0) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+Run a pipeline on a source image, single and multi-threaded, into a new image and into 
+a wrapped destination buffer, and compare the results with the chain of image functions. 
+A pipeline without format change is also run in place.
+*/
+static void
+checkPipeline(FIBITMAP *src, const FIROWOPERATION *operations, int count) {
+	FIBITMAP *reference = applyOperations(src, operations, count);
+
+	for(int flags = 0; flags <= FIRO_MULTITHREAD; flags += FIRO_MULTITHREAD) {
+		FIBITMAP *dst = FreeImage_ApplyRowPipeline(src, operations, count, NULL, flags);
+		assert(dst != NULL);
+		assert(samePixels(dst, reference));
+
+		// wrapped destination
+		BYTE *buffer = NULL;
+		FIBITMAP *wrapper = wrapImage(dst, &buffer);
+		memset(buffer, 0, FreeImage_GetPitch(wrapper) * FreeImage_GetHeight(wrapper));
+		FIBITMAP *result = FreeImage_ApplyRowPipeline(src, operations, count, wrapper, flags);
+		assert(result == wrapper);
+		assert(samePixels(wrapper, reference));
+		FreeImage_Unload(wrapper);
+		free(buffer);
+
+		FreeImage_Unload(dst);
+	}
+
+	if(FreeImage_GetBPP(reference) == FreeImage_GetBPP(src)) {
+		// in place processing
+		FIBITMAP *clone = copyImage(src);
+		FIBITMAP *result = FreeImage_ApplyRowPipeline(clone, operations, count, clone, 0);
+		assert(result == clone);
+		assert(samePixels(clone, reference));
+		FreeImage_Unload(clone);
+	}
+
+	FreeImage_Unload(reference);
+}
+
+/**
+Compare multi-stage pipelines with the individual conversions in sequence, for every source
+format, odd widths and wrapped sources with a padded bottom-up pitch.
+The largest images hold several bands of rows.
+*/
+static void
+testPipelineConversions() {
+	static const int widths[] = { 1, 7, 33, 101 };
+	static const int heights[] = { 9, 9, 9, 400 };
+
+	BYTE lut[256], inverse[256];
+	for(int i = 0; i < 256; i++) {
+		lut[i] = (BYTE)((i * i) / 255);
+		inverse[i] = (BYTE)(255 - i);
+	}
+
+	const FIROWOPERATION premultiply[] = {
+		{ FIRO_CONVERT, 32, NULL }, { FIRO_LUT, FICC_RGB, lut }, { FIRO_PREMULTIPLY, 0, NULL }
+	};
+	const FIROWOPERATION swap[] = {
+		{ FIRO_LUT, FICC_RED, lut }, { FIRO_SWAP_RED_BLUE, 0, NULL }, { FIRO_CONVERT, 24, NULL }
+	};
+	const FIROWOPERATION grey[] = {
+		{ FIRO_GREYSCALE, 0, NULL }, { FIRO_LUT, FICC_RGB, inverse }, { FIRO_CONVERT, 32, NULL }, { FIRO_LUT, FICC_ALPHA, inverse }
+	};
+	const FIROWOPERATION round_trip[] = {
+		{ FIRO_SWAP_RED_BLUE, 0, NULL }, { FIRO_CONVERT, 8, NULL }, { FIRO_CONVERT, 24, NULL }, { FIRO_LUT, FICC_GREEN, lut }
+	};
+	const FIROWOPERATION in_place[] = {
+		{ FIRO_LUT, FICC_ALPHA, inverse }, { FIRO_PREMULTIPLY, 0, NULL }, { FIRO_LUT, FICC_BLUE, lut }
+	};
+
+	// bpp, palettized (or 555), transparent
+	static const int sources[][3] = {
+		{ 1, TRUE, FALSE }, { 4, TRUE, FALSE }, { 4, TRUE, TRUE }, { 8, FALSE, FALSE }, { 8, TRUE, FALSE }, { 8, TRUE, TRUE },
+		{ 16, FALSE, FALSE }, { 16, TRUE, FALSE }, { 24, FALSE, FALSE }, { 32, FALSE, FALSE }
+	};
+
+	unsigned seed = 1357;
+
+	for(int w = 0; w < (int)(sizeof(widths) / sizeof(widths[0])); w++) {
+		for(int s = 0; s < (int)(sizeof(sources) / sizeof(sources[0])); s++) {
+			FIBITMAP *src = createSource(sources[s][0], widths[w], heights[w], sources[s][1], sources[s][2], seed);
+
+			BYTE *buffer = NULL;
+			FIBITMAP *wrapped = wrapImage(src, &buffer);
+
+			for(int pass = 0; pass < 2; pass++) {
+				FIBITMAP *dib = (pass == 0) ? src : wrapped;
+
+				checkPipeline(dib, NULL, 0);
+				checkPipeline(dib, premultiply, 3);
+				checkPipeline(dib, swap, 3);
+				checkPipeline(dib, grey, 4);
+				checkPipeline(dib, round_trip, 4);
+				checkPipeline(dib, in_place, 3);
+			}
+
+			FreeImage_Unload(wrapped);
+			free(buffer);
+			FreeImage_Unload(src);
+		}
+	}
+}
+
+/**
+Invalid operations and destinations are rejected
+*/
+static void
+testPipelineErrors() {
+	FIBITMAP *src = FreeImage_Allocate(16, 4, 24);
+	FIBITMAP *dst32 = FreeImage_Allocate(16, 4, 32);
+	FIBITMAP *small = FreeImage_Allocate(15, 4, 24);
+	assert(src && dst32 && small);
+
+	const FIROWOPERATION bad_bpp[] = { { FIRO_CONVERT, 16, NULL } };
+	const FIROWOPERATION no_lut[] = { { FIRO_LUT, FICC_RGB, NULL } };
+	const FIROWOPERATION to_32[] = { { FIRO_CONVERT, 32, NULL } };
+
+	assert(FreeImage_ApplyRowPipeline(src, bad_bpp, 1) == NULL);
+	assert(FreeImage_ApplyRowPipeline(src, no_lut, 1) == NULL);
+	assert(FreeImage_ApplyRowPipeline(src, NULL, 1) == NULL);
+	assert(FreeImage_ApplyRowPipeline(src, to_32, -1) == NULL);
+	// destination with another bit depth or size
+	assert(FreeImage_ApplyRowPipeline(src, NULL, 0, dst32) == NULL);
+	assert(FreeImage_ApplyRowPipeline(src, to_32, 1, src) == NULL);
+	assert(FreeImage_ApplyRowPipeline(src, NULL, 0, small) == NULL);
+	assert(FreeImage_ApplyRowPipeline(src, to_32, 1, dst32) == dst32);
+
+	FreeImage_Unload(small);
+	FreeImage_Unload(dst32);
+	FreeImage_Unload(src);
+}
+
+// ----------------------------------------------------------
+
+void testRowPipeline() {
+	printf("testRowPipeline ...\n");
+
+	testPipelineConversions();
+	testPipelineErrors();
+}
@@ -0,0 +1,191 @@
+// ==========================================================
+// FreeImage 3 Test Script
+//
+// This file is part of FreeImage 3
+//
+// COVERED CODE IS PROVIDED UNDER THIS LICENSE ON AN "AS IS" BASIS, WITHOUT WARRANTY
+// OF ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING, WITHOUT LIMITATION, WARRANTIES
+// THAT THE COVERED CODE IS FREE OF DEFECTS, MERCHANTABLE, FIT FOR A PARTICULAR PURPOSE
+// OR NON-INFRINGING. THE ENTIRE RISK AS TO THE QUALITY AND PERFORMANCE OF THE COVERED
+// CODE IS WITH YOU. SHOULD ANY COVERED CODE PROVE DEFECTIVE IN ANY RESPECT, YOU (NOT
+// THE INITIAL DEVELOPER OR ANY OTHER CONTRIBUTOR) ASSUME THE COST OF ANY NECESSARY
+// SERVICING, REPAIR OR CORRECTION. THIS DISCLAIMER OF WARRANTY CONSTITUTES AN ESSENTIAL
+// PART OF THIS LICENSE. NO USE OF ANY COVERED CODE IS AUTHORIZED HEREUNDER EXCEPT UNDER
+// THIS DISCLAIMER.
+//
+// Use at your own risk!
+// ==========================================================
+
+
+#include "TestSuite.h"
+
+// Local test functions
+// ----------------------------------------------------------
+
+/**
+Create a test buffer of compressible data : repeated text with some noise
+*/
+static BYTE*
+createData(DWORD size) {
+	static const char text[] = "FreeImage is an Open Source library project for developers ";
+	BYTE *data = (BYTE*)malloc(size);
+	assert(data != NULL);
+	srand(1);
+	for(DWORD i = 0; i < size; i++) {
+		data[i] = ((i % 97) == 0) ? (BYTE)rand() : (BYTE)text[i % (sizeof(text) - 1)];
+	}
+	return data;
+}
+
+/**
+Feed a stream with chunks of at most in_chunk bytes, giving it at most out_chunk bytes
+of output space per call, until it returns something else than FIZ_STREAM_OK.
+A compressor gets finish = TRUE with its last chunk of input.
+@param target_size Receives the number of bytes written to target
+@return Returns the last status of FreeImage_ZLibProcessStream
+*/
+static int
+processChunks(FIZSTREAM *stream, BOOL compress, const BYTE *source, DWORD source_size, DWORD in_chunk, BYTE *target, DWORD target_capacity, DWORD out_chunk, DWORD *target_size) {
+	DWORD in_pos = 0;
+	DWORD out_pos = 0;
+	int status = FIZ_STREAM_OK;
+
+	while(status == FIZ_STREAM_OK) {
+		DWORD in_size = (source_size - in_pos < in_chunk) ? source_size - in_pos : in_chunk;
+		DWORD out_size = (target_capacity - out_pos < out_chunk) ? target_capacity - out_pos : out_chunk;
+		assert(out_size > 0);
+		const BOOL finish = compress && (in_pos + in_size == source_size);
+
+		status = FreeImage_ZLibProcessStream(stream, (BYTE*)source + in_pos, &in_size, target + out_pos, &out_size, finish);
+		in_pos += in_size;
+		out_pos += out_size;
+	}
+
+	*target_size = out_pos;
+	return status;
+}
+
+/**
+Compress a buffer in chunks and decompress it in chunks of other sizes
+*/
+static void
+testStreamRoundTrip(FREE_IMAGE_ZFORMAT format) {
+	const DWORD size = 100000;
+	BYTE *data = createData(size);
+
+	const DWORD capacity = size + size / 100 + 64;
+	BYTE *compressed = (BYTE*)malloc(capacity);
+	BYTE *decompressed = (BYTE*)malloc(size + 1);
+	assert(compressed && decompressed);
+
+	FIZSTREAM *compressor = FreeImage_ZLibOpenCompressor(format, 6, 0);
+	assert(compressor != NULL);
+	FIZSTREAM *decompressor = FreeImage_ZLibOpenDecompressor((format == FIZ_RAW) ? FIZ_RAW : FIZ_AUTO);
+	assert(decompressor != NULL);
+
+	// the streams are reused after a reset
+	for(int pass = 0; pass < 2; pass++) {
+		DWORD compressed_size = 0;
+		int status = processChunks(compressor, TRUE, data, size, 1000, compressed, capacity, 777, &compressed_size);
+		assert(status == FIZ_STREAM_END);
+		assert(compressed_size < size / 2);
+
+		if(format == FIZ_ZLIB) {
+			// compatible with the one shot function
+			DWORD one_shot = FreeImage_ZLibUncompress(decompressed, size, compressed, compressed_size);
+			assert(one_shot == size);
+			assert(memcmp(decompressed, data, size) == 0);
+			memset(decompressed, 0, size);
+		}
+
+		DWORD decompressed_size = 0;
+		status = processChunks(decompressor, FALSE, compressed, compressed_size, 313, decompressed, size + 1, 500, &decompressed_size);
+		assert(status == FIZ_STREAM_END);
+		assert(decompressed_size == size);
+		assert(memcmp(decompressed, data, size) == 0);
+
+		// a finished stream has nothing more to do
+		DWORD in_size = 0;
+		DWORD out_size = 1;
+		status = FreeImage_ZLibProcessStream(decompressor, NULL, &in_size, decompressed, &out_size, FALSE);
+		assert((status == FIZ_STREAM_END) && (out_size == 0));
+
+		BOOL bResult = FreeImage_ZLibResetStream(compressor);
+		assert(bResult);
+		bResult = FreeImage_ZLibResetStream(decompressor);
+		assert(bResult);
+	}
+
+	FreeImage_ZLibCloseStream(decompressor);
+	FreeImage_ZLibCloseStream(compressor);
+	free(decompressed);
+	free(compressed);
+	free(data);
+}
+
+/**
+Decompress truncated and corrupted ZLib streams
+*/
+static void
+testStreamErrors() {
+	const DWORD size = 100000;
+	BYTE *data = createData(size);
+
+	const DWORD capacity = size + size / 100 + 64;
+	BYTE *compressed = (BYTE*)malloc(capacity);
+	BYTE *decompressed = (BYTE*)malloc(size);
+	assert(compressed && decompressed);
+
+	const DWORD compressed_size = FreeImage_ZLibCompress(compressed, capacity, data, size);
+	assert(compressed_size > 0);
+
+	FIZSTREAM *decompressor = FreeImage_ZLibOpenDecompressor(FIZ_ZLIB);
+	assert(decompressor != NULL);
+
+	// truncated input : once the input is exhausted, no progress is possible without more input
+	DWORD decompressed_size = 0;
+	int status = processChunks(decompressor, FALSE, compressed, compressed_size / 2, 1000, decompressed, size, 4096, &decompressed_size);
+	assert(status == FIZ_STREAM_NEED_INPUT);
+	assert((decompressed_size > 0) && (decompressed_size < size));
+	assert(memcmp(decompressed, data, decompressed_size) == 0);
+
+	// the stream goes on with the rest of the input
+	DWORD rest_size = 0;
+	status = processChunks(decompressor, FALSE, compressed + compressed_size / 2, compressed_size - compressed_size / 2, 1000, decompressed + decompressed_size, size - decompressed_size, 4096, &rest_size);
+	assert(status == FIZ_STREAM_END);
+	assert(decompressed_size + rest_size == size);
+	assert(memcmp(decompressed, data, size) == 0);
+
+	// corrupted header
+	BOOL bResult = FreeImage_ZLibResetStream(decompressor);
+	assert(bResult);
+	const BYTE header = compressed[0];
+	compressed[0] = 0xFF;
+	status = processChunks(decompressor, FALSE, compressed, compressed_size, 1000, decompressed, size, 4096, &decompressed_size);
+	assert(status == FIZ_STREAM_ERROR);
+	compressed[0] = header;
+
+	// corrupted checksum (last byte of the Adler-32 trailer)
+	bResult = FreeImage_ZLibResetStream(decompressor);
+	assert(bResult);
+	compressed[compressed_size - 1] ^= 0x55;
+	status = processChunks(decompressor, FALSE, compressed, compressed_size, 1000, decompressed, size, 4096, &decompressed_size);
+	assert(status == FIZ_STREAM_ERROR);
+
+	FreeImage_ZLibCloseStream(decompressor);
+	free(decompressed);
+	free(compressed);
+	free(data);
+}
+
+// ----------------------------------------------------------
+
+void testZLib() {
+	printf("testZLib ...\n");
+
+	testStreamRoundTrip(FIZ_ZLIB);
+	testStreamRoundTrip(FIZ_GZIP);
+	testStreamRoundTrip(FIZ_RAW);
+
+	testStreamErrors();
+}